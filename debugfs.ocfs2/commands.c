@@ -383,11 +383,14 @@ static int process_open_args(char **args,
 	for (argc = 0; (args[argc]); ++argc);
 	dev = strdup(args[1]);
 	optind = 0;
-	while ((c = getopt(argc, args, "is:")) != EOF) {
+	while ((c = getopt(argc, args, "ims:")) != EOF) {
 		switch (c) {
 			case 'i':
 				gbls.imagefile = 1;
 				break;
+			case 'm':
+				gbls.mmap = 1;
+				break;
 			case 's':
 				s = strtoul(optarg, &ptr, 0);
 				break;
@@ -637,8 +640,9 @@ static void do_open (char **args)
 		do_close (NULL);
 
 	if (dev == NULL || process_open_args(args, &superblock, &block_size)) {
-		fprintf (stderr, "usage: %s <device> [-i] [-s num]\n", args[0]);
+		fprintf (stderr, "usage: %s <device> [-i] [-m] [-s num]\n", args[0]);
 		gbls.imagefile = 0;
+		gbls.mmap = 0;
 		return ;
 	}
 
@@ -646,11 +650,15 @@ static void do_open (char **args)
         flags |= OCFS2_FLAG_HEARTBEAT_DEV_OK;
 	if (gbls.imagefile)
 		flags |= OCFS2_FLAG_IMAGE_FILE;
+	/* Image files don't change under us, so map them when we can */
+	if ((gbls.mmap || gbls.imagefile) && !gbls.allow_write)
+		flags |= OCFS2_FLAG_MMAP;
 
 	ret = ocfs2_open(dev, flags, superblock, block_size, &gbls.fs);
 	if (ret) {
 		gbls.fs = NULL;
 		gbls.imagefile = 0;
+		gbls.mmap = 0;
 		com_err(args[0], ret, "while opening context for device %s",
 			dev);
 		return ;
@@ -722,6 +730,7 @@ static void do_close (char **args)
 		com_err(args[0], ret, "while closing context");
 	gbls.fs = NULL;
 	gbls.imagefile = 0;
+	gbls.mmap = 0;
 
 	if (gbls.blockbuf)
 		ocfs2_free(&gbls.blockbuf);
@@ -853,7 +862,7 @@ static void do_help (char **args)
 	printf ("logdump <slot#>\t\t\t\tPrints journal file for the node slot\n");
 	printf ("ls [-l] <filespec>\t\t\tList directory\n");
 	printf ("ncheck <block#> ...\t\t\tList all pathnames of the inode(s)/lockname(s)\n");
-	printf ("open <device> [-i] [-s backup#]\t\tOpen a device\n");
+	printf ("open <device> [-i] [-m] [-s backup#]\tOpen a device\n");
 	printf ("quit, q\t\t\t\t\tExit the program\n");
 	printf ("rdump [-v] <filespec> <outdir>\t\tRecursively dumps from src to a dir on a mounted filesystem\n");
 	printf ("slotmap\t\t\t\t\tShow slot map\n");
@@ -1105,7 +1114,8 @@ static void do_dump (char **args)
 	char *out_fn;
 	errcode_t ret;
 	int fd;
-	
+	struct dump_stats ds = { 0, 0, 0 };
+
 	if (check_device_open())
 		return;
 
@@ -1141,9 +1151,11 @@ static void do_dump (char **args)
 		return ;
 	}
 
-	ret = dump_file(gbls.fs, blkno, fd, out_fn, preserve);
+	ret = dump_file(gbls.fs, blkno, fd, out_fn, preserve, &ds);
 	if (ret)
 		com_err(args[0], ret, "while dumping file");
+	else
+		print_dump_stats(stdout, &ds);
 
 	return;
 }
@@ -1175,7 +1187,7 @@ static void do_cat (char **args)
 		return ;
 	}
 
-	ret = dump_file(gbls.fs, blkno, fileno(stdout),  NULL, 0);
+	ret = dump_file(gbls.fs, blkno, fileno(stdout),  NULL, 0, NULL);
 	if (ret)
 		com_err(args[0], ret, "while reading file for inode %"PRIu64"",
 			blkno);
@@ -1394,6 +1406,7 @@ static void do_rdump(char **args)
 	int ind = 1;
 	int verbose = 0;
 	char tmp_str[40];
+	struct dump_stats ds = { 0, 0, 0 };
 
 	if (check_device_open())
 		return ;
@@ -1463,10 +1476,12 @@ static void do_rdump(char **args)
 
 	fprintf(stdout, "Copying to %s/%s\n", args[ind+1], p);
 
-	ret = rdump_inode(gbls.fs, blkno, p, args[ind+1], verbose);
+	ret = rdump_inode(gbls.fs, blkno, p, args[ind+1], verbose, &ds);
 	if (ret)
 		com_err(args[0], ret, "while recursively dumping "
 			"inode %"PRIu64, blkno);
+	else
+		print_dump_stats(stdout, &ds);
 
 	return ;
 }
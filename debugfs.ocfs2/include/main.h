@@ -70,6 +70,7 @@ typedef struct _dbgfs_glbs {
 	char *progname;
 	int allow_write;
 	int imagefile;
+	int mmap;
 	int interactive;
 	char *device;
 	ocfs2_filesys *fs;
@@ -89,6 +90,7 @@ typedef struct _dbgfs_glbs {
 typedef struct _dbgfs_opts {
 	int allow_write;
 	int imagefile;
+	int mmap;
 	int no_prompt;
 	uint32_t sb_num;
 	char *cmd_file;
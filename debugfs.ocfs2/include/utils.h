@@ -25,11 +25,18 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+struct dump_stats {
+	uint64_t ds_bytes;	/* Written to the output */
+	uint64_t ds_sparse;	/* Left as holes in the output */
+	uint64_t ds_usecs;
+};
+
 typedef struct _rdump_opts {
 	ocfs2_filesys *fs;
 	char *fullname;
 	char *buf;
 	int verbose;
+	struct dump_stats *ds;
 } rdump_opts;
 
 struct strings {
@@ -51,13 +58,14 @@ int inodestr_to_inode(char *str, uint64_t *blkno);
 errcode_t string_to_inode(ocfs2_filesys *fs, uint64_t root_blkno,
 			  uint64_t cwd_blkno, char *str, uint64_t *blkno);
 errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
-		    int preserve);
+		    int preserve, struct dump_stats *ds);
+void print_dump_stats(FILE *out, struct dump_stats *ds);
 errcode_t read_whole_file(ocfs2_filesys *fs, uint64_t ino, char **buf,
 			  uint32_t *buflen);
 void inode_perms_to_str(uint16_t mode, char *str, int len);
 void inode_time_to_str(uint64_t mtime, char *str, int len);
 errcode_t rdump_inode(ocfs2_filesys *fs, uint64_t blkno, const char *name,
-		      const char *dumproot, int verbose);
+		      const char *dumproot, int verbose, struct dump_stats *ds);
 void crunch_strsplit(char **args);
 void find_max_contig_free_bits(struct ocfs2_group_desc *gd, int *max_contig_free_bits);
 
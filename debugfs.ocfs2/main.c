@@ -49,11 +49,12 @@ static void usage (char *progname)
 	g_print ("usage: %s -l [<logentry> ... [allow|off|deny]] ...\n", progname);
 	g_print ("usage: %s -d, --decode <lockres>\n", progname);
 	g_print ("usage: %s -e, --encode <lock type> <block num> <generation|parent>\n", progname);
-	g_print ("usage: %s [-f cmdfile] [-R request] [-i] [-s backup#] [-V] [-w] [-n] [-?] [device]\n", progname);
+	g_print ("usage: %s [-f cmdfile] [-R request] [-i] [-m] [-s backup#] [-V] [-w] [-n] [-?] [device]\n", progname);
 	g_print ("\t-f, --file <cmdfile>\t\tExecute commands in cmdfile\n");
 	g_print ("\t-R, --request <command>\t\tExecute a single command\n");
 	g_print ("\t-s, --superblock <backup#>\tOpen the device using a backup superblock\n");
 	g_print ("\t-i, --image\t\t\tOpen an o2image file\n");
+	g_print ("\t-m, --mmap\t\t\tRead the device through a memory mapping\n");
 	g_print ("\t-w, --write\t\t\tOpen in read-write mode instead of the default of read-only\n");
 	g_print ("\t-V, --version\t\t\tShow version\n");
 	g_print ("\t-n, --noprompt\t\t\tHide prompt\n");
@@ -200,6 +201,7 @@ static void get_options(int argc, char **argv, dbgfs_opts *opts)
 		{ "encode", 0, 0, 'e' },
 		{ "superblock", 0, 0, 's' },
 		{ "image", 0, 0, 'i' },
+		{ "mmap", 0, 0, 'm' },
 		{ 0, 0, 0, 0}
 	};
 
@@ -207,7 +209,7 @@ static void get_options(int argc, char **argv, dbgfs_opts *opts)
 		if (decodemode || encodemode || logmode)
 			break;
 
-		c = getopt_long(argc, argv, "lf:R:deV?wns:i",
+		c = getopt_long(argc, argv, "lf:R:deV?wns:im",
 				long_options, NULL);
 		if (c == -1)
 			break;
@@ -241,6 +243,10 @@ static void get_options(int argc, char **argv, dbgfs_opts *opts)
 			opts->imagefile = 1;
 			break;
 
+		case 'm':
+			opts->mmap = 1;
+			break;
+
 		case 'l':
 			logmode++;
 			break;
@@ -480,6 +486,7 @@ int main (int argc, char **argv)
 
 	gbls.allow_write = opts.allow_write;
 	gbls.imagefile = opts.imagefile;
+	gbls.mmap = opts.mmap;
 	if (!opts.cmd_file)
 		gbls.interactive++;
 
@@ -519,12 +526,17 @@ int main (int argc, char **argv)
 				free (line);
 		} else {
 			printf ("\n");
+			/* Closing reports OCFS2_IO_STATS if asked for */
+			if (gbls.device)
+				do_command ("close");
 			raise (SIGTERM);
 			exit (0);
 		}
 	}
 
 bail:
+	if (gbls.device)
+		do_command ("close");
 	if (cmd)
 		fclose(cmd);
 	if (opts.cmd_file)
@@ -27,6 +27,10 @@
 #include "main.h"
 #include "ocfs2/bitops.h"
 
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+
 extern dbgfs_gbls gbls;
 
 void get_incompat_flag(uint32_t flag, GString *str)
@@ -419,15 +423,332 @@ bail:
 	return ret;
 }
 
+/*
+ * dump_file_extents()
+ *
+ * Regular files are copied out an extent at a time.  Each extent is
+ * read in DUMP_BUFLEN pieces into one of two buffers while a writer
+ * thread drains the other, so the disk and the output file are kept
+ * busy at the same time.  When the volume is a plain file (an image)
+ * and we are writing to a file of our own, the kernel is asked to copy
+ * the extent with copy_file_range(2) instead.  Holes and unwritten
+ * extents are skipped in output files and written as zeros to
+ * pipes and terminals.
+ */
+#define DUMP_BUFLEN	(4 * 1024 * 1024)
+
+struct dump_writer {
+	pthread_t dw_thread;
+	pthread_mutex_t dw_lock;
+	pthread_cond_t dw_cond;
+	int dw_threaded;
+	int dw_fd;
+	int dw_sparse;		/* pwrite(2) at dw_off, else write(2) */
+	char *dw_buf;
+	size_t dw_len;
+	uint64_t dw_off;
+	int dw_busy;
+	int dw_exit;
+	errcode_t dw_ret;
+};
+
+static errcode_t dump_write_all(int fd, char *buf, size_t len,
+				uint64_t off, int sparse)
+{
+	ssize_t wrote;
+
+	while (len) {
+		if (sparse)
+			wrote = pwrite64(fd, buf, len, off);
+		else
+			wrote = write(fd, buf, len);
+		if (wrote < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		if (!wrote)
+			return OCFS2_ET_SHORT_WRITE;
+
+		buf += wrote;
+		off += wrote;
+		len -= wrote;
+	}
+
+	return 0;
+}
+
+static void *dump_writer_thread(void *arg)
+{
+	struct dump_writer *dw = arg;
+	errcode_t ret;
+
+	pthread_mutex_lock(&dw->dw_lock);
+	while (1) {
+		while (!dw->dw_busy && !dw->dw_exit)
+			pthread_cond_wait(&dw->dw_cond, &dw->dw_lock);
+		if (!dw->dw_busy)
+			break;
+
+		pthread_mutex_unlock(&dw->dw_lock);
+		ret = dump_write_all(dw->dw_fd, dw->dw_buf, dw->dw_len,
+				     dw->dw_off, dw->dw_sparse);
+		pthread_mutex_lock(&dw->dw_lock);
+
+		if (ret && !dw->dw_ret)
+			dw->dw_ret = ret;
+		dw->dw_busy = 0;
+		pthread_cond_broadcast(&dw->dw_cond);
+	}
+	pthread_mutex_unlock(&dw->dw_lock);
+
+	return NULL;
+}
+
+static void dump_writer_start(struct dump_writer *dw, int fd, int sparse)
+{
+	memset(dw, 0, sizeof(struct dump_writer));
+	dw->dw_fd = fd;
+	dw->dw_sparse = sparse;
+
+	pthread_mutex_init(&dw->dw_lock, NULL);
+	pthread_cond_init(&dw->dw_cond, NULL);
+
+	/* Without a thread we just write synchronously */
+	if (!pthread_create(&dw->dw_thread, NULL, dump_writer_thread, dw))
+		dw->dw_threaded = 1;
+}
+
+/*
+ * Hand buf to the writer.  Returns once the previously queued buffer
+ * has been written, so the caller may refill that one.
+ */
+static errcode_t dump_writer_queue(struct dump_writer *dw, char *buf,
+				   size_t len, uint64_t off)
+{
+	errcode_t ret;
+
+	if (!dw->dw_threaded)
+		return dump_write_all(dw->dw_fd, buf, len, off,
+				      dw->dw_sparse);
+
+	pthread_mutex_lock(&dw->dw_lock);
+	while (dw->dw_busy)
+		pthread_cond_wait(&dw->dw_cond, &dw->dw_lock);
+	ret = dw->dw_ret;
+	if (!ret) {
+		dw->dw_buf = buf;
+		dw->dw_len = len;
+		dw->dw_off = off;
+		dw->dw_busy = 1;
+		pthread_cond_broadcast(&dw->dw_cond);
+	}
+	pthread_mutex_unlock(&dw->dw_lock);
+
+	return ret;
+}
+
+/* Wait for the last buffer and tear the writer down */
+static errcode_t dump_writer_stop(struct dump_writer *dw)
+{
+	errcode_t ret = 0;
+
+	if (dw->dw_threaded) {
+		pthread_mutex_lock(&dw->dw_lock);
+		while (dw->dw_busy)
+			pthread_cond_wait(&dw->dw_cond, &dw->dw_lock);
+		dw->dw_exit = 1;
+		ret = dw->dw_ret;
+		pthread_cond_broadcast(&dw->dw_cond);
+		pthread_mutex_unlock(&dw->dw_lock);
+		pthread_join(dw->dw_thread, NULL);
+	}
+
+	pthread_cond_destroy(&dw->dw_cond);
+	pthread_mutex_destroy(&dw->dw_lock);
+
+	return ret;
+}
+
+/*
+ * Copy len bytes from in_fd to out_fd inside the kernel.  *copied says
+ * how far we got.  If the kernel can't do it for these files, we return
+ * 0 with *copied short and the caller reads the rest itself.
+ */
+static errcode_t dump_copy_range(int in_fd, uint64_t in_off, int out_fd,
+				 uint64_t out_off, uint64_t len,
+				 uint64_t *copied)
+{
+	*copied = 0;
+#ifdef SYS_copy_file_range
+	loff_t ioff = in_off, ooff = out_off;
+	ssize_t got;
+
+	while (*copied < len) {
+		got = syscall(SYS_copy_file_range, in_fd, &ioff, out_fd,
+			      &ooff, (size_t)ocfs2_min(len - *copied,
+						       (uint64_t)1 << 30), 0);
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == ENOSYS) || (errno == EXDEV) ||
+			    (errno == EINVAL) || (errno == EOPNOTSUPP) ||
+			    (errno == EBADF))
+				return 0;
+			return errno;
+		}
+		if (!got)
+			return 0;
+		*copied += got;
+	}
+#endif
+	return 0;
+}
+
+static errcode_t dump_file_extents(ocfs2_filesys *fs, ocfs2_cached_inode *ci,
+				   int fd, int sparse, struct dump_stats *ds)
+{
+	errcode_t ret, tmp;
+	char *bufs[2] = { NULL, NULL };
+	int cur = 0, in_fd = -1;
+	int bs_bits = OCFS2_RAW_SB(fs->fs_super)->s_blocksize_bits;
+	int cs_bits = OCFS2_RAW_SB(fs->fs_super)->s_clustersize_bits;
+	uint64_t size = ci->ci_inode->i_size;
+	uint64_t off = 0, len, chunk, p_off, copied;
+	uint32_t p_cluster, num_clusters;
+	uint16_t flags;
+	struct dump_writer dw;
+	struct stat st;
+
+	ret = ocfs2_malloc_blocks(fs->fs_io, DUMP_BUFLEN >> bs_bits, &bufs[0]);
+	if (!ret)
+		ret = ocfs2_malloc_blocks(fs->fs_io, DUMP_BUFLEN >> bs_bits,
+					  &bufs[1]);
+	if (ret) {
+		com_err(gbls.cmd, ret, "while allocating %u bytes",
+			DUMP_BUFLEN);
+		goto out_free;
+	}
+
+	/* Image files remap blocks, so only a plain volume file will do */
+	if (sparse && !(fs->fs_flags & OCFS2_FLAG_IMAGE_FILE)) {
+		in_fd = io_get_fd(fs->fs_io);
+		if (fstat(in_fd, &st) || !S_ISREG(st.st_mode))
+			in_fd = -1;
+		else if (io_flush(fs->fs_io))
+			in_fd = -1;
+	}
+
+	dump_writer_start(&dw, fd, sparse);
+
+	while (off < size) {
+		ret = ocfs2_get_clusters(ci, off >> cs_bits, &p_cluster,
+					 &num_clusters, &flags);
+		if (ret) {
+			com_err(gbls.cmd, ret, "while reading file %"PRIu64" "
+				"at offset %"PRIu64, ci->ci_blkno, off);
+			break;
+		}
+
+		len = ocfs2_min((uint64_t)num_clusters << cs_bits, size - off);
+
+		if (!p_cluster || (flags & OCFS2_EXT_UNWRITTEN)) {
+			if (sparse) {
+				ds->ds_sparse += len;
+				off += len;
+				continue;
+			}
+
+			while (len) {
+				chunk = ocfs2_min(len, (uint64_t)DUMP_BUFLEN);
+				memset(bufs[cur], 0, chunk);
+				ret = dump_writer_queue(&dw, bufs[cur], chunk,
+							off);
+				if (ret) {
+					com_err(gbls.cmd, ret,
+						"while writing file");
+					goto out_stop;
+				}
+				cur ^= 1;
+				off += chunk;
+				len -= chunk;
+				ds->ds_bytes += chunk;
+			}
+			continue;
+		}
+
+		p_off = (uint64_t)p_cluster << cs_bits;
+
+		if (in_fd != -1) {
+			ret = dump_copy_range(in_fd, p_off, fd, off, len,
+					      &copied);
+			if (ret) {
+				com_err(gbls.cmd, ret, "while writing file");
+				goto out_stop;
+			}
+			if (copied < len)
+				in_fd = -1;
+			off += copied;
+			p_off += copied;
+			len -= copied;
+			ds->ds_bytes += copied;
+		}
+
+		while (len) {
+			chunk = ocfs2_min(len, (uint64_t)DUMP_BUFLEN);
+			ret = ocfs2_read_blocks(fs, p_off >> bs_bits,
+						(chunk + fs->fs_blocksize - 1) >>
+						bs_bits, bufs[cur]);
+			if (ret) {
+				com_err(gbls.cmd, ret, "while reading file "
+					"%"PRIu64" at offset %"PRIu64,
+					ci->ci_blkno, off);
+				goto out_stop;
+			}
+
+			ret = dump_writer_queue(&dw, bufs[cur], chunk, off);
+			if (ret) {
+				com_err(gbls.cmd, ret, "while writing file");
+				goto out_stop;
+			}
+			cur ^= 1;
+			off += chunk;
+			p_off += chunk;
+			len -= chunk;
+			ds->ds_bytes += chunk;
+		}
+	}
+
+out_stop:
+	tmp = dump_writer_stop(&dw);
+	if (!ret) {
+		ret = tmp;
+		/* Holes past the last write still need to count */
+		if (!ret && sparse && ftruncate64(fd, size))
+			ret = errno;
+		if (ret)
+			com_err(gbls.cmd, ret, "while writing file");
+	}
+
+out_free:
+	if (bufs[0])
+		ocfs2_free(&bufs[0]);
+	if (bufs[1])
+		ocfs2_free(&bufs[1]);
+	return ret;
+}
+
 /*
  * dump_file()
  *
+ * ds, if not NULL, accumulates the bytes written, the bytes left as
+ * holes, and the time spent.
  */
 static errcode_t dump_symlink(ocfs2_filesys *fs, uint64_t blkno, char *name,
 			      struct ocfs2_dinode *inode);
 
 errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
-		    int preserve)
+		    int preserve, struct dump_stats *ds)
 {
 	errcode_t ret;
 	char *buf = NULL;
@@ -436,6 +757,13 @@ errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
 	uint32_t wrote;
 	ocfs2_cached_inode *ci = NULL;
 	uint64_t offset = 0;
+	struct dump_stats tmp_ds = { 0, 0, 0 };
+	struct timeval start, end;
+	struct stat st;
+	int sparse;
+
+	if (!ds)
+		ds = &tmp_ds;
 
 	ret = ocfs2_read_cached_inode(fs, ino, &ci);
 	if (ret) {
@@ -453,6 +781,17 @@ errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
 		goto bail;
 	}
 
+	gettimeofday(&start, NULL);
+
+	if (!(ci->ci_inode->i_dyn_features & OCFS2_INLINE_DATA_FL)) {
+		/* Only seek over holes in files we opened ourselves */
+		sparse = out_file && !fstat(fd, &st) && S_ISREG(st.st_mode);
+		ret = dump_file_extents(fs, ci, fd, sparse, ds);
+		if (ret)
+			goto bail;
+		goto done;
+	}
+
 	buflen = 1024 * 1024;
 
 	ret = ocfs2_malloc_blocks(fs->fs_io,
@@ -481,6 +820,7 @@ errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
 			ret = errno;
 			goto bail;
 		}
+		ds->ds_bytes += got;
 
 		if (got < buflen)
 			break;
@@ -488,6 +828,11 @@ errcode_t dump_file(ocfs2_filesys *fs, uint64_t ino, int fd, char *out_file,
 			offset += got;
 	}
 
+done:
+	gettimeofday(&end, NULL);
+	ds->ds_usecs += (end.tv_sec - start.tv_sec) * 1000000ULL +
+		end.tv_usec - start.tv_usec;
+
 	if (preserve)
 		ret = fix_perms(ci->ci_inode, &fd, out_file);
 
@@ -502,6 +847,21 @@ bail:
 }
 
 
+void print_dump_stats(FILE *out, struct dump_stats *ds)
+{
+	double secs = ds->ds_usecs / 1000000.0;
+
+	fprintf(out, "Dumped %"PRIu64" bytes", ds->ds_bytes);
+	if (ds->ds_sparse)
+		fprintf(out, " (skipped %"PRIu64" bytes of holes)",
+			ds->ds_sparse);
+	fprintf(out, " in %.2f secs", secs);
+	if (ds->ds_usecs)
+		fprintf(out, ", %.2f MB/s",
+			ds->ds_bytes / (1024.0 * 1024.0) / secs);
+	fprintf(out, "\n");
+}
+
 /*
  * read_whole_file()
  *
@@ -687,7 +1047,7 @@ static int rdump_dirent(struct ocfs2_dir_entry *rec, int offset, int blocksize,
 		goto bail;
 
 	ret = rdump_inode(rd->fs, rec->inode, rec->name, rd->fullname,
-			  rd->verbose);
+			  rd->verbose, rd->ds);
 
 bail:
 	rec->name[rec->name_len] = tmp;
@@ -704,7 +1064,7 @@ bail:
  * under the terms of the GNU Public License.
  */
 errcode_t rdump_inode(ocfs2_filesys *fs, uint64_t blkno, const char *name,
-		      const char *dumproot, int verbose)
+		      const char *dumproot, int verbose, struct dump_stats *ds)
 {
 	char *fullname = NULL;
 	int len;
@@ -713,7 +1073,7 @@ errcode_t rdump_inode(ocfs2_filesys *fs, uint64_t blkno, const char *name,
 	char *dirbuf = NULL;
 	struct ocfs2_dinode *di;
 	int fd;
-	rdump_opts rd_opts = { NULL, NULL, NULL, 0 };
+	rdump_opts rd_opts = { NULL, NULL, NULL, 0, NULL };
 
 	len = strlen(dumproot) + strlen(name) + 2;
 	ret = ocfs2_malloc(len, &fullname);
@@ -754,7 +1114,7 @@ errcode_t rdump_inode(ocfs2_filesys *fs, uint64_t blkno, const char *name,
 			goto bail;
 		}
 
-		ret = dump_file(fs, blkno, fd, fullname, 1);
+		ret = dump_file(fs, blkno, fd, fullname, 1, ds);
 		if (ret)
 			goto bail;
 	} else if (S_ISDIR(di->i_mode) && strcmp(name, ".") &&
@@ -782,6 +1142,7 @@ errcode_t rdump_inode(ocfs2_filesys *fs, uint64_t blkno, const char *name,
 		rd_opts.buf = dirbuf;
 		rd_opts.fullname = fullname;
 		rd_opts.verbose = verbose;
+		rd_opts.ds = ds;
 
 		ret = ocfs2_dir_iterate(fs, blkno, 0, NULL,
 					rdump_dirent, (void *)&rd_opts);
@@ -0,0 +1,255 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * delta.c
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * --
+ *
+ * Deltas are how worker threads hand their results to the main thread.
+ * See delta.h.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "ocfs2/ocfs2.h"
+
+#include "delta.h"
+#include "dirparents.h"
+#include "fsck.h"
+#include "icount.h"
+#include "util.h"
+
+/* The delta the current thread is filling, if any */
+static __thread struct o2fsck_delta *current_delta;
+
+/* What com_err() did before we hooked it */
+static errf saved_com_err;
+
+void o2fsck_delta_init(struct o2fsck_delta *delta)
+{
+	memset(delta, 0, sizeof(struct o2fsck_delta));
+}
+
+void o2fsck_delta_reset(struct o2fsck_delta *delta)
+{
+	delta->d_nr = 0;
+	delta->d_failed = 0;
+}
+
+void o2fsck_delta_free(struct o2fsck_delta *delta)
+{
+	if (delta->d_recs)
+		ocfs2_free(&delta->d_recs);
+	o2fsck_delta_init(delta);
+}
+
+void o2fsck_delta_fail(struct o2fsck_delta *delta)
+{
+	delta->d_failed = 1;
+}
+
+void o2fsck_delta_add(struct o2fsck_delta *delta,
+		      enum o2fsck_delta_type type,
+		      uint64_t a, uint64_t b, uint64_t c)
+{
+	struct o2fsck_delta_rec *dr;
+	int want;
+
+	if (delta->d_failed)
+		return;
+
+	if (delta->d_nr == delta->d_alloced) {
+		want = delta->d_alloced ? delta->d_alloced * 2 : 256;
+		if (ocfs2_realloc(sizeof(struct o2fsck_delta_rec) * want,
+				  &delta->d_recs)) {
+			/* The main thread will try again */
+			o2fsck_delta_fail(delta);
+			return;
+		}
+		delta->d_alloced = want;
+	}
+
+	dr = &delta->d_recs[delta->d_nr++];
+	dr->dr_type = type;
+	dr->dr_a = a;
+	dr->dr_b = b;
+	dr->dr_c = c;
+}
+
+/*
+ * Apply records [start, end) to the real state.  The only things that
+ * can fail are tracking a directory block and finding a dir parent,
+ * and the caller reports that the way the pass would have.
+ */
+errcode_t o2fsck_delta_replay(o2fsck_state *ost, struct o2fsck_delta *delta,
+			      int start, int end)
+{
+	errcode_t ret = 0;
+	struct o2fsck_delta_rec *dr;
+	o2fsck_dir_parent *dp;
+
+	for (; !ret && (start < end); start++) {
+		dr = &delta->d_recs[start];
+		switch (dr->dr_type) {
+			case O2FSCK_DELTA_CLUSTERS:
+				o2fsck_mark_clusters_allocated(ost, dr->dr_a,
+							       dr->dr_b);
+				break;
+			case O2FSCK_DELTA_DIR_INODE:
+				o2fsck_mark_dir_inode(ost, dr->dr_a,
+						      dr->dr_b);
+				break;
+			case O2FSCK_DELTA_REG_INODE:
+				o2fsck_mark_reg_inode(ost, dr->dr_a);
+				break;
+			case O2FSCK_DELTA_LINKS:
+				o2fsck_mark_inode_links(ost, dr->dr_a,
+							dr->dr_b);
+				break;
+			case O2FSCK_DELTA_DIR_BLOCK:
+				ret = o2fsck_mark_dir_block(ost, dr->dr_a,
+							    dr->dr_b,
+							    dr->dr_c);
+				break;
+			case O2FSCK_DELTA_REF:
+				o2fsck_icount_delta(ost->ost_icount_refs,
+						    dr->dr_a, 1);
+				break;
+			case O2FSCK_DELTA_DOT_DOT:
+			case O2FSCK_DELTA_DIRENT:
+				dp = o2fsck_dir_parent_lookup(
+						&ost->ost_dir_parents,
+						dr->dr_a);
+				if (!dp) {
+					ret = OCFS2_ET_INTERNAL_FAILURE;
+					break;
+				}
+				if (dr->dr_type == O2FSCK_DELTA_DOT_DOT)
+					dp->dp_dot_dot = dr->dr_b;
+				else
+					dp->dp_dirent = dr->dr_b;
+				break;
+			default:
+				assert(0);
+		}
+	}
+
+	return ret;
+}
+
+void o2fsck_delta_set_current(struct o2fsck_delta *delta)
+{
+	current_delta = delta;
+}
+
+/*
+ * A worker's error message would come out ahead of things the main
+ * thread has yet to say.  Failing the delta means the main thread will
+ * redo the work and say it in the right place.  Everyone else gets what
+ * com_err() would have printed anyway.
+ */
+static void delta_com_err(const char *whoami, errcode_t code,
+			  const char *fmt, va_list args)
+{
+	if (current_delta) {
+		o2fsck_delta_fail(current_delta);
+		return;
+	}
+
+	if (saved_com_err) {
+		saved_com_err(whoami, code, fmt, args);
+		return;
+	}
+
+	if (whoami) {
+		fputs(whoami, stderr);
+		fputs(": ", stderr);
+	}
+	if (code) {
+		fputs(error_message(code), stderr);
+		fputs(" ", stderr);
+	}
+	if (fmt)
+		vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	fflush(stderr);
+}
+
+void o2fsck_delta_hook_com_err(void)
+{
+	saved_com_err = set_com_err_hook(delta_com_err);
+}
+
+void o2fsck_delta_unhook_com_err(void)
+{
+	if (saved_com_err)
+		set_com_err_hook(saved_com_err);
+	else
+		reset_com_err_hook();
+	saved_com_err = NULL;
+}
+
+int o2fsck_delta_nr_threads(o2fsck_state *ost, int max)
+{
+	long cpus;
+
+	/* verbose output would come from every thread at once */
+	if (verbose || (ost->ost_fs->fs_flags & OCFS2_FLAG_IMAGE_FILE))
+		return 1;
+
+	if (ost->ost_threads)
+		return ocfs2_min(ost->ost_threads, max);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		return 1;
+	return ocfs2_min(cpus, (long)max);
+}
+
+errcode_t o2fsck_delta_open_fs(ocfs2_filesys *fs, ocfs2_filesys *wfs,
+			       int cache_blocks)
+{
+	errcode_t ret;
+
+	*wfs = *fs;
+	wfs->fs_io = NULL;
+	wfs->fs_flags &= ~OCFS2_FLAG_RW;
+
+	ret = io_open_helper(fs->fs_io,
+			     OCFS2_FLAG_RO |
+			     (fs->fs_flags & OCFS2_FLAG_BUFFERED),
+			     &wfs->fs_io);
+	if (ret)
+		goto out;
+
+	ret = io_set_blksize(wfs->fs_io, fs->fs_blocksize);
+	if (!ret)
+		ret = io_init_cache(wfs->fs_io, cache_blocks);
+
+out:
+	if (ret)
+		o2fsck_delta_close_fs(wfs);
+	return ret;
+}
+
+void o2fsck_delta_close_fs(ocfs2_filesys *wfs)
+{
+	if (wfs->fs_io)
+		io_close(wfs->fs_io);
+	wfs->fs_io = NULL;
+}
@@ -19,8 +19,14 @@
  *
  * --
  *
- * Just a simple rbtree wrapper to record directory blocks and the inodes
- * that own them.
+ * Records directory blocks and the inodes that own them.
+ *
+ * Entries go into chunks of DB_CHUNK_ENTRIES as they are found.  Nothing
+ * is kept in order until o2fsck_dir_block_sort(), which runs a stable
+ * LSD radix sort on e_blkno, spread over a few threads, before pass2.
+ * Every chunk has room for one entry more than it holds.  After the sort
+ * that spare slot links to the next chunk, so o2fsck_dir_block_next()
+ * needs nothing but the entry in hand.
  */
 #include <unistd.h>
 #include <stdlib.h>
@@ -28,122 +34,341 @@
 #include <stdarg.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 
 #include "fsck.h"
 #include "dirblocks.h"
+#include "delta.h"
 #include "util.h"
+#include "scratch.h"
+
+#define DB_CHUNK_ENTRIES	(64 * 1024 - 1)
+
+/* e_blkcount of the spare slot; its e_ino is the next chunk, or 0 */
+#define DB_LINK			UINT64_MAX
+
+#define DB_RADIX_BITS		11
+#define DB_RADIX_SIZE		(1 << DB_RADIX_BITS)
+#define DB_SORT_MAX_THREADS	8
+#define DB_SORT_MIN_PER_THREAD	(256 * 1024)
+
+static inline o2fsck_dirblock_entry *db_entry(o2fsck_dirblock_entry **chunks,
+					      uint64_t i)
+{
+	return &chunks[i / DB_CHUNK_ENTRIES][i % DB_CHUNK_ENTRIES];
+}
+
+static void db_free_chunks(o2fsck_dirblock_entry ***chunks, uint64_t nr)
+{
+	uint64_t i;
+
+	for (i = 0; i < nr; i++)
+		o2fsck_scratch_free((*chunks)[i],
+				    sizeof(o2fsck_dirblock_entry) *
+				    (DB_CHUNK_ENTRIES + 1));
+	ocfs2_free(chunks);
+}
+
+static errcode_t db_alloc_chunk(o2fsck_dirblock_entry **chunk)
+{
+	*chunk = o2fsck_scratch_alloc(sizeof(o2fsck_dirblock_entry) *
+				      (DB_CHUNK_ENTRIES + 1));
+	return *chunk ? 0 : OCFS2_ET_NO_MEMORY;
+}
 
 errcode_t o2fsck_add_dir_block(o2fsck_dirblocks *db, uint64_t ino,
 			       uint64_t blkno, uint64_t blkcount)
 {
-	struct rb_node ** p = &db->db_root.rb_node;
-	struct rb_node * parent = NULL;
-	o2fsck_dirblock_entry *dbe, *tmp_dbe;
-	errcode_t ret = 0;
+	uint64_t chunk = db->db_nr / DB_CHUNK_ENTRIES;
+	uint64_t nr_chunks;
+	o2fsck_dirblock_entry *dbe;
+	errcode_t ret;
 
-	dbe = calloc(1, sizeof(*dbe));
-	if (dbe == NULL) {
-		ret = OCFS2_ET_NO_MEMORY;
-		goto out;
+	if (!(db->db_nr % DB_CHUNK_ENTRIES)) {
+		if (chunk >= db->db_nr_chunks) {
+			nr_chunks = db->db_nr_chunks ?
+				db->db_nr_chunks * 2 : 16;
+			ret = ocfs2_realloc0(sizeof(o2fsck_dirblock_entry *) *
+					     nr_chunks, &db->db_chunks,
+					     sizeof(o2fsck_dirblock_entry *) *
+					     db->db_nr_chunks);
+			if (ret)
+				return ret;
+			db->db_nr_chunks = nr_chunks;
+		}
+
+		if (!db->db_chunks[chunk]) {
+			ret = db_alloc_chunk(&db->db_chunks[chunk]);
+			if (ret)
+				return ret;
+		}
 	}
 
+	dbe = db_entry(db->db_chunks, db->db_nr);
 	dbe->e_ino = ino;
 	dbe->e_blkno = blkno;
 	dbe->e_blkcount = blkcount;
 
-	while (*p)
-	{
-		parent = *p;
-		tmp_dbe = rb_entry(parent, o2fsck_dirblock_entry, e_node);
+	db->db_nr++;
+	db->db_sorted = 0;
+	if (blkno > db->db_max_blkno)
+		db->db_max_blkno = blkno;
+
+	return 0;
+}
+
+struct db_sort_thread {
+	pthread_t		st_thread;
+	o2fsck_dirblock_entry	**st_src;
+	o2fsck_dirblock_entry	**st_dst;
+	uint64_t		st_start;
+	uint64_t		st_end;
+	int			st_shift;
+	int			st_scatter;
+	/* the histogram of st_start..st_end, then where each bucket goes */
+	uint64_t		st_count[DB_RADIX_SIZE];
+};
+
+static void *db_sort_worker(void *arg)
+{
+	struct db_sort_thread *st = arg;
+	o2fsck_dirblock_entry *src;
+	uint64_t i, off, chunk, bucket;
 
-		if (dbe->e_blkno < tmp_dbe->e_blkno)
-			p = &(*p)->rb_left;
-		else if (dbe->e_blkno > tmp_dbe->e_blkno)
-			p = &(*p)->rb_right;
+	chunk = st->st_start / DB_CHUNK_ENTRIES;
+	off = st->st_start % DB_CHUNK_ENTRIES;
+
+	if (!st->st_scatter)
+		memset(st->st_count, 0, sizeof(st->st_count));
+
+	for (i = st->st_start; i < st->st_end; i++) {
+		src = &st->st_src[chunk][off];
+		bucket = (src->e_blkno >> st->st_shift) & (DB_RADIX_SIZE - 1);
+
+		if (st->st_scatter)
+			*db_entry(st->st_dst, st->st_count[bucket]++) = *src;
+		else
+			st->st_count[bucket]++;
+
+		if (++off == DB_CHUNK_ENTRIES) {
+			chunk++;
+			off = 0;
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs the workers, the caller's thread taking the first range */
+static void db_sort_run(struct db_sort_thread *sts, int nr_threads)
+{
+	int i;
+
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&sts[i].st_thread, NULL, db_sort_worker,
+				   &sts[i]))
+			sts[i].st_thread = 0;
+	}
+
+	db_sort_worker(&sts[0]);
+
+	/* The ranges don't overlap, so a failed thread can run here */
+	for (i = 1; i < nr_threads; i++) {
+		if (sts[i].st_thread)
+			pthread_join(sts[i].st_thread, NULL);
+		else
+			db_sort_worker(&sts[i]);
+	}
+}
+
+/*
+ * Returns 1 when every entry landed in one bucket, which means this
+ * digit is already in order.
+ */
+static int db_sort_offsets(struct db_sort_thread *sts, int nr_threads,
+			   uint64_t nr)
+{
+	uint64_t pos = 0, count, total;
+	int b, t;
+
+	for (b = 0; b < DB_RADIX_SIZE; b++) {
+		total = 0;
+		for (t = 0; t < nr_threads; t++) {
+			count = sts[t].st_count[b];
+			sts[t].st_count[b] = pos;
+			pos += count;
+			total += count;
+		}
+		if (total == nr)
+			return 1;
 	}
 
-	rb_link_node(&dbe->e_node, parent, p);
-	rb_insert_color(&dbe->e_node, &db->db_root);
+	return 0;
+}
+
+static void db_set_links(o2fsck_dirblocks *db)
+{
+	uint64_t chunk, nr_used;
+	o2fsck_dirblock_entry *link;
+
+	nr_used = (db->db_nr + DB_CHUNK_ENTRIES - 1) / DB_CHUNK_ENTRIES;
+	for (chunk = 0; chunk < nr_used; chunk++) {
+		if (chunk == (nr_used - 1))
+			link = db_entry(db->db_chunks, db->db_nr - 1) + 1;
+		else
+			link = &db->db_chunks[chunk][DB_CHUNK_ENTRIES];
+
+		link->e_blkno = 0;
+		link->e_blkcount = DB_LINK;
+		link->e_ino = (chunk == (nr_used - 1)) ? 0 :
+			(uint64_t)(unsigned long)db->db_chunks[chunk + 1];
+	}
+}
+
+errcode_t o2fsck_dir_block_sort(o2fsck_state *ost)
+{
+	o2fsck_dirblocks *db = &ost->ost_dirblocks;
+	o2fsck_dirblock_entry **tmp = NULL, **swap;
+	struct db_sort_thread *sts = NULL;
+	uint64_t nr_used, i, per_thread;
+	int nr_threads, shift, t;
+	errcode_t ret = 0;
+
+	if (db->db_sorted || !db->db_nr)
+		goto out;
+
+	nr_used = (db->db_nr + DB_CHUNK_ENTRIES - 1) / DB_CHUNK_ENTRIES;
+	ret = ocfs2_malloc0(sizeof(o2fsck_dirblock_entry *) * db->db_nr_chunks,
+			    &tmp);
+	if (ret)
+		goto out;
+	for (i = 0; i < nr_used; i++) {
+		ret = db_alloc_chunk(&tmp[i]);
+		if (ret)
+			goto out;
+	}
+
+	nr_threads = o2fsck_delta_nr_threads(ost, DB_SORT_MAX_THREADS);
+	per_thread = (db->db_nr + nr_threads - 1) / nr_threads;
+	if (per_thread < DB_SORT_MIN_PER_THREAD) {
+		per_thread = DB_SORT_MIN_PER_THREAD;
+		nr_threads = (db->db_nr + per_thread - 1) / per_thread;
+	}
+
+	ret = ocfs2_malloc0(sizeof(struct db_sort_thread) * nr_threads, &sts);
+	if (ret)
+		goto out;
+
+	for (shift = 0; shift < 64 && (db->db_max_blkno >> shift);
+	     shift += DB_RADIX_BITS) {
+		for (t = 0; t < nr_threads; t++) {
+			sts[t].st_src = db->db_chunks;
+			sts[t].st_dst = tmp;
+			sts[t].st_start = t * per_thread;
+			sts[t].st_end = ocfs2_min(db->db_nr,
+						  (t + 1) * per_thread);
+			sts[t].st_shift = shift;
+			sts[t].st_scatter = 0;
+		}
+		db_sort_run(sts, nr_threads);
+
+		if (db_sort_offsets(sts, nr_threads, db->db_nr))
+			continue;
+
+		for (t = 0; t < nr_threads; t++)
+			sts[t].st_scatter = 1;
+		db_sort_run(sts, nr_threads);
+
+		swap = db->db_chunks;
+		db->db_chunks = tmp;
+		tmp = swap;
+	}
+
+	db_set_links(db);
+	db->db_sorted = 1;
 
 out:
+	if (tmp)
+		db_free_chunks(&tmp, db->db_nr_chunks);
+	if (sts)
+		ocfs2_free(&sts);
 	return ret;
 }
 
 /*
- * Go through the dirblocks pre-filling them.  We try to coalesce adjacent
+ * Go through the dirblocks pre-filling them.  A buffer's worth at a time
+ * goes to ocfs2_read_blocks_v(), which coalesces adjacent and nearby
  * ones.  Don't care to return errors, because it's a cache pre-fill.
  */
-static int try_to_cache(ocfs2_filesys *fs, struct rb_node *node,
-			char *pre_cache_buf, int pre_cache_blocks)
+static int try_to_cache(ocfs2_filesys *fs, o2fsck_dirblock_entry *dbe,
+			char *pre_cache_buf, int pre_cache_blocks,
+			struct io_vec_unit *ivus)
 {
 	int cached_blocks = 0;
-	o2fsck_dirblock_entry *dbe;
-	uint64_t io_blkno = 0, next_blkno = 0;
-	int count = 0;
+	int count;
 	errcode_t err;
-	uint64_t blocks_seen = 0;
 
 	o2fsck_reset_blocks_cached();
-	for (; node; node = rb_next(node)) {
-		blocks_seen++;
-		dbe = rb_entry(node, o2fsck_dirblock_entry, e_node);
-		if (io_blkno) {
-			assert(count);
-			assert(next_blkno > io_blkno);
-
-			if ((next_blkno == dbe->e_blkno) &&
-			    (count < pre_cache_blocks)) {
-				count++;
-				next_blkno++;
-				continue;
-			}
-
-			if (!o2fsck_worth_caching(count)) {
-				io_blkno = 0;
-				break;
-			}
-
-			err = ocfs2_read_blocks(fs, io_blkno, count,
-						pre_cache_buf);
-			io_blkno = 0;
-			next_blkno = 0;
-
-			if (err)
-				break;
-
-			cached_blocks += count;
-			count = 0;
+	while (dbe) {
+		for (count = 0; dbe && (count < pre_cache_blocks);
+		     count++, dbe = o2fsck_dir_block_next(dbe)) {
+			ivus[count].ivu_blkno = dbe->e_blkno;
+			ivus[count].ivu_count = 1;
+			ivus[count].ivu_buf = pre_cache_buf +
+				(count * fs->fs_blocksize);
 		}
 
-		assert(!io_blkno);
-		io_blkno = dbe->e_blkno;
-		next_blkno = io_blkno + 1;
-		count = 1;
-	}
+		if (!o2fsck_worth_caching(count))
+			break;
 
-	/* Catch the last pre-fill buffer */
-	if (io_blkno && o2fsck_worth_caching(count)) {
-		assert(count);
-		err = ocfs2_read_blocks(fs, io_blkno, count, pre_cache_buf);
-		if (!err)
-			cached_blocks += count;
+		err = ocfs2_read_blocks_v(fs, ivus, count);
+		if (err)
+			break;
+
+		cached_blocks += count;
 	}
 
 	return cached_blocks;
 }
 
+o2fsck_dirblock_entry *o2fsck_dir_block_first(o2fsck_dirblocks *db)
+{
+	if (!db->db_nr)
+		return NULL;
+
+	assert(db->db_sorted);
+	return db->db_chunks[0];
+}
+
+o2fsck_dirblock_entry *o2fsck_dir_block_next(o2fsck_dirblock_entry *dbe)
+{
+	dbe++;
+	if (dbe->e_blkcount == DB_LINK)
+		dbe = (o2fsck_dirblock_entry *)(unsigned long)dbe->e_ino;
+
+	return dbe;
+}
+
 void o2fsck_dir_block_iterate(o2fsck_state *ost, dirblock_iterator func,
 			      void *priv_data)
 {
-	o2fsck_dirblocks *db = &ost->ost_dirblocks;
+	o2fsck_dir_block_iterate_from(ost,
+				      o2fsck_dir_block_first(&ost->ost_dirblocks),
+				      func, priv_data);
+}
+
+/* Iterates from dbe to the end, in block order */
+void o2fsck_dir_block_iterate_from(o2fsck_state *ost,
+				   o2fsck_dirblock_entry *dbe,
+				   dirblock_iterator func, void *priv_data)
+{
 	ocfs2_filesys *fs = ost->ost_fs;
-	o2fsck_dirblock_entry *dbe;
-	struct rb_node *node;
 	unsigned ret;
 	errcode_t err;
 	char *pre_cache_buf = NULL;
+	struct io_vec_unit *ivus = NULL;
 	int pre_cache_blocks = ocfs2_blocks_in_bytes(fs, 1024 * 1024);
 	int cached_blocks = 0;
 
@@ -151,18 +376,23 @@ void o2fsck_dir_block_iterate(o2fsck_state *ost, dirblock_iterator func,
 	if (o2fsck_worth_caching(1)) {
 		err = ocfs2_malloc_blocks(fs->fs_io, pre_cache_blocks,
 					  &pre_cache_buf);
-		if (err)
+		if (!err)
+			err = ocfs2_malloc(sizeof(struct io_vec_unit) *
+					   pre_cache_blocks, &ivus);
+		if (err) {
 			verbosef("Unable to allocate dirblock pre-cache "
 				 "buffer, %s\n",
 				 "ignoring");
+			if (pre_cache_buf)
+				ocfs2_free(&pre_cache_buf);
+		}
 	}
 
-	for (node = rb_first(&db->db_root); node; node = rb_next(node)) {
+	for (; dbe; dbe = o2fsck_dir_block_next(dbe)) {
 		if (!cached_blocks && pre_cache_buf)
-			cached_blocks = try_to_cache(fs, node, pre_cache_buf,
-						     pre_cache_blocks);
+			cached_blocks = try_to_cache(fs, dbe, pre_cache_buf,
+						     pre_cache_blocks, ivus);
 
-		dbe = rb_entry(node, o2fsck_dirblock_entry, e_node);
 		ret = func(dbe, priv_data);
 		if (ret & OCFS2_DIRENT_ABORT)
 			break;
@@ -173,4 +403,6 @@ void o2fsck_dir_block_iterate(o2fsck_state *ost, dirblock_iterator func,
 
 	if (pre_cache_buf)
 		ocfs2_free(&pre_cache_buf);
+	if (ivus)
+		ocfs2_free(&ivus);
 }
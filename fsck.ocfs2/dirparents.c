@@ -35,6 +35,7 @@
 #include "fsck.h"
 #include "dirparents.h"
 #include "util.h"
+#include "scratch.h"
 
 /* XXX callers are supposed to make sure they don't call with dup inodes.
  * we'll see. */
@@ -49,7 +50,7 @@ errcode_t o2fsck_add_dir_parent(struct rb_root *root,
 	o2fsck_dir_parent *dp, *tmp_dp;
 	errcode_t ret = 0;
 
-	dp = calloc(1, sizeof(*dp));
+	dp = o2fsck_scratch_alloc0(sizeof(*dp));
 	if (dp == NULL) {
 		ret = OCFS2_ET_NO_MEMORY;
 		goto out;
@@ -144,7 +145,7 @@ void ocfsck_remove_dir_parent(struct rb_root *root, uint64_t ino)
 		goto out;
 
 	rb_erase(&dp->dp_node, root);
-	free(dp);
+	o2fsck_scratch_free(dp, sizeof(*dp));
 out:
 	return;
 }
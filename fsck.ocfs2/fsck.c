@@ -66,6 +66,7 @@
 #include "pass3.h"
 #include "pass4.h"
 #include "problem.h"
+#include "scratch.h"
 #include "util.h"
 #include "slot_recovery.h"
 
@@ -115,8 +116,9 @@ static void block_signals(int how)
 static void print_usage(void)
 {
 	fprintf(stderr,
-		"Usage: fsck.ocfs2 [ -fGnuvVy ] [ -b superblock block ]\n"
-		"		    [ -B block size ] [-r num] device\n"
+		"Usage: fsck.ocfs2 [ -fGHInuvVy ] [ -b superblock block ]\n"
+		"		    [ -B block size ] [-r num] [ -j threads ]\n"
+		"		    [ -S scratch dir ] device\n"
 		"\n"
 		"Critical flags for emergency repair:\n" 
 		" -n		Check but don't change the file system\n"
@@ -129,6 +131,10 @@ static void print_usage(void)
 		" -b superblock	Treat given block as the super block\n"
 		" -B blocksize	Force the given block size\n"
 		" -G		Ask to fix mismatched inode generations\n"
+		" -H		Back the I/O cache with huge pages\n"
+		" -I		Interleave the I/O cache over NUMA nodes\n"
+		" -j threads	Check with this many threads\n"
+		" -S dir		Keep bitmaps and counts in files in dir\n"
 		" -u		Access the device with buffering\n"
 		" -V		Output fsck.ocfs2's version\n"
 		" -v		Provide verbose debugging output\n"
@@ -166,22 +172,24 @@ static errcode_t o2fsck_state_init(ocfs2_filesys *fs, o2fsck_state *ost)
 		return ret;
 	}
 
-	ret = ocfs2_block_bitmap_new(fs, "directory inodes", 
-				     &ost->ost_dir_inodes);
+	ret = o2fsck_scratch_bitmap_new(fs, fs->fs_blocks, "directory inodes",
+					&ost->ost_dir_inodes);
 	if (ret) {
 		com_err(whoami, ret, "while allocating dir inodes bitmap");
 		return ret;
 	}
 
-	ret = ocfs2_block_bitmap_new(fs, "regular file inodes", 
-				     &ost->ost_reg_inodes);
+	ret = o2fsck_scratch_bitmap_new(fs, fs->fs_blocks,
+					"regular file inodes",
+					&ost->ost_reg_inodes);
 	if (ret) {
 		com_err(whoami, ret, "while allocating reg inodes bitmap");
 		return ret;
 	}
 
-	ret = ocfs2_cluster_bitmap_new(fs, "allocated clusters",
-				       &ost->ost_allocated_clusters);
+	ret = o2fsck_scratch_bitmap_new(fs, fs->fs_clusters,
+					"allocated clusters",
+					&ost->ost_allocated_clusters);
 	if (ret) {
 		com_err(whoami, ret, "while allocating a bitmap to track "
 			"allocated clusters");
@@ -624,7 +632,7 @@ bail:
 
 int main(int argc, char **argv)
 {
-	char *filename;
+	char *filename, *scratch_dir = NULL;
 	int64_t blkno, blksize;
 	o2fsck_state *ost = &_ost;
 	int c, open_flags = OCFS2_FLAG_RW | OCFS2_FLAG_STRICT_COMPAT_CHECK;
@@ -637,7 +645,6 @@ int main(int argc, char **argv)
 
 	memset(ost, 0, sizeof(o2fsck_state));
 	ost->ost_ask = 1;
-	ost->ost_dirblocks.db_root = RB_ROOT;
 	ost->ost_dir_parents = RB_ROOT;
 
 	/* These mean "autodetect" */
@@ -650,7 +657,7 @@ int main(int argc, char **argv)
 	setlinebuf(stderr);
 	setlinebuf(stdout);
 
-	while((c = getopt(argc, argv, "b:B:fFGnuvVyr:")) != EOF) {
+	while((c = getopt(argc, argv, "b:B:fFGHIj:nS:uvVyr:")) != EOF) {
 		switch (c) {
 			case 'b':
 				blkno = read_number(optarg);
@@ -688,6 +695,26 @@ int main(int argc, char **argv)
 				ost->ost_fix_fs_gen = 1;
 				break;
 
+			case 'H':
+				ost->ost_cache_flags |= IO_CACHE_HUGEPAGES;
+				break;
+
+			case 'I':
+				ost->ost_cache_flags |= IO_CACHE_INTERLEAVE;
+				break;
+
+			case 'j':
+				ost->ost_threads = read_number(optarg);
+				if (ost->ost_threads < 1) {
+					fprintf(stderr,
+						"Invalid thread count: %s\n",
+						optarg);
+					fsck_mask |= FSCK_USAGE;
+					print_usage();
+					goto out;
+				}
+				break;
+
 			case 'n':
 				ost->ost_ask = 0;
 				ost->ost_answer = 0;
@@ -695,6 +722,10 @@ int main(int argc, char **argv)
 				open_flags |= OCFS2_FLAG_RO;
 				break;
 
+			case 'S':
+				scratch_dir = optarg;
+				break;
+
 			case 'y':
 				ost->ost_ask = 0;
 				ost->ost_answer = 1;
@@ -743,6 +774,16 @@ int main(int argc, char **argv)
 
 	print_version();
 
+	if (scratch_dir) {
+		ret = o2fsck_scratch_init(scratch_dir);
+		if (ret) {
+			com_err(whoami, ret, "while creating scratch files in "
+				"%s", scratch_dir);
+			fsck_mask |= FSCK_ERROR;
+			goto out;
+		}
+	}
+
 	ret = ocfs2_check_if_mounted(filename, &mount_flags);
 	if (ret) {
 		com_err(whoami, ret, "while determining whether %s is mounted.",
@@ -20,8 +20,13 @@
  *
  * --
  *
- * A trivial rbtree that stores a u16 icount indexed by an inode's block
- * number.
+ * Stores a u16 icount indexed by an inode's block number.  Inodes with a
+ * single link live in a bitmap.  Counts above one are kept in a two-level
+ * radix: the block number picks a leaf covering IC_LEAF_BLOCKS blocks, and
+ * each leaf holds a bitmap of the blocks it has counts for and a packed
+ * array of those counts in block order.  A count costs two bytes and a
+ * lookup is a handful of popcounts, rather than a malloc'd rbtree node and
+ * a walk down the tree.
  */
 #include <unistd.h>
 #include <stdlib.h>
@@ -34,64 +39,190 @@
 #include "fsck.h"
 #include "icount.h"
 #include "util.h"
+#include "scratch.h"
 
-typedef struct _icount_node {
-	struct rb_node	in_node;
-	uint64_t	in_blkno;
-	uint16_t	in_icount;
-} icount_node;
+#define IC_LEAF_BITS		10
+#define IC_LEAF_BLOCKS		(1 << IC_LEAF_BITS)
+#define IC_LEAF_WORDS		(IC_LEAF_BLOCKS / 64)
+#define IC_LEAF_MIN_COUNTS	8
 
-/* XXX this is currently fragile in that it requires that the caller make
- * sure that the node doesn't already exist in the tree.
- */
-static void icount_insert(o2fsck_icount *icount, icount_node *in)
+struct icount_leaf {
+	uint64_t	il_map[IC_LEAF_WORDS];	/* blocks with a count > 1 */
+	uint16_t	il_nr;			/* counts in use */
+	uint16_t	il_alloced;		/* size of il_counts */
+	uint16_t	*il_counts;		/* in block order */
+};
+
+static inline uint64_t icount_leaf_index(uint64_t blkno)
+{
+	return blkno >> IC_LEAF_BITS;
+}
+
+static inline unsigned int icount_leaf_off(uint64_t blkno)
+{
+	return blkno & (IC_LEAF_BLOCKS - 1);
+}
+
+static struct icount_leaf *icount_lookup_leaf(o2fsck_icount *icount,
+					      uint64_t blkno)
+{
+	uint64_t idx = icount_leaf_index(blkno);
+
+	if (idx >= icount->ic_nr_leaves)
+		return NULL;
+	return icount->ic_leaves[idx];
+}
+
+static inline int icount_leaf_test(struct icount_leaf *il, unsigned int off)
 {
-	struct rb_node ** p = &icount->ic_multiple_tree.rb_node;
-	struct rb_node * parent = NULL;
-	icount_node *tmp_in;
+	return !!(il->il_map[off / 64] & (1ULL << (off % 64)));
+}
+
+/* the position of off's count in il_counts: the number of set bits below
+ * it in the leaf's map */
+static unsigned int icount_leaf_rank(struct icount_leaf *il, unsigned int off)
+{
+	unsigned int i, rank = 0;
+
+	for (i = 0; i < off / 64; i++)
+		rank += __builtin_popcountll(il->il_map[i]);
+	if (off % 64)
+		rank += __builtin_popcountll(il->il_map[i] &
+					     ((1ULL << (off % 64)) - 1));
+	return rank;
+}
+
+static uint16_t *icount_search(o2fsck_icount *icount, uint64_t blkno)
+{
+	struct icount_leaf *il = icount_lookup_leaf(icount, blkno);
+	unsigned int off = icount_leaf_off(blkno);
 
-	while (*p)
-	{
-		parent = *p;
-		tmp_in = rb_entry(parent, icount_node, in_node);
+	if (il == NULL || !icount_leaf_test(il, off))
+		return NULL;
+	return &il->il_counts[icount_leaf_rank(il, off)];
+}
+
+static errcode_t icount_get_leaf(o2fsck_icount *icount, uint64_t blkno,
+				 struct icount_leaf **ret)
+{
+	uint64_t i, idx = icount_leaf_index(blkno), nr;
+	struct icount_leaf **leaves;
+
+	if (idx >= icount->ic_nr_leaves) {
+		nr = icount->ic_nr_leaves ? icount->ic_nr_leaves : 64;
+		while (nr <= idx)
+			nr <<= 1;
+		leaves = o2fsck_scratch_realloc(icount->ic_leaves,
+						icount->ic_nr_leaves *
+						sizeof(*leaves),
+						nr * sizeof(*leaves));
+		if (leaves == NULL)
+			return OCFS2_ET_NO_MEMORY;
+		for (i = icount->ic_nr_leaves; i < nr; i++)
+			leaves[i] = NULL;
+		icount->ic_leaves = leaves;
+		icount->ic_nr_leaves = nr;
+	}
 
-		if (in->in_blkno < tmp_in->in_blkno)
-			p = &(*p)->rb_left;
-		else if (in->in_blkno > tmp_in->in_blkno)
-			p = &(*p)->rb_right;
+	if (icount->ic_leaves[idx] == NULL) {
+		icount->ic_leaves[idx] =
+			o2fsck_scratch_alloc0(sizeof(struct icount_leaf));
+		if (icount->ic_leaves[idx] == NULL)
+			return OCFS2_ET_NO_MEMORY;
 	}
 
-	rb_link_node(&in->in_node, parent, p);
-	rb_insert_color(&in->in_node, &icount->ic_multiple_tree);
+	*ret = icount->ic_leaves[idx];
+	return 0;
 }
 
-static icount_node *icount_search(o2fsck_icount *icount, uint64_t blkno,
-				  icount_node **next)
+static errcode_t icount_insert(o2fsck_icount *icount, uint64_t blkno,
+			       uint16_t count)
 {
-	struct rb_node *node = icount->ic_multiple_tree.rb_node;
-	icount_node *in, *last_left = NULL;
+	struct icount_leaf *il;
+	unsigned int off = icount_leaf_off(blkno), rank, alloced;
+	uint16_t *counts;
+	errcode_t ret;
 
-	while (node) {
-		in = rb_entry(node, icount_node, in_node);
+	ret = icount_get_leaf(icount, blkno, &il);
+	if (ret)
+		return ret;
+
+	if (il->il_nr == il->il_alloced) {
+		alloced = il->il_alloced ? il->il_alloced * 2 :
+					   IC_LEAF_MIN_COUNTS;
+		if (alloced > IC_LEAF_BLOCKS)
+			alloced = IC_LEAF_BLOCKS;
+		counts = o2fsck_scratch_realloc(il->il_counts,
+						il->il_alloced *
+						sizeof(*counts),
+						alloced * sizeof(*counts));
+		if (counts == NULL)
+			return OCFS2_ET_NO_MEMORY;
+		il->il_counts = counts;
+		il->il_alloced = alloced;
+	}
 
-		if (blkno < in->in_blkno) {
-			last_left = in;
-			node = node->rb_left;
-		} else if (blkno > in->in_blkno)
-			node = node->rb_right;
-		else
-			return in;
+	rank = icount_leaf_rank(il, off);
+	memmove(&il->il_counts[rank + 1], &il->il_counts[rank],
+		(il->il_nr - rank) * sizeof(*il->il_counts));
+	il->il_counts[rank] = count;
+	il->il_map[off / 64] |= 1ULL << (off % 64);
+	il->il_nr++;
+	return 0;
+}
+
+static void icount_remove(o2fsck_icount *icount, uint64_t blkno)
+{
+	uint64_t idx = icount_leaf_index(blkno);
+	struct icount_leaf *il = icount->ic_leaves[idx];
+	unsigned int off = icount_leaf_off(blkno);
+	unsigned int rank = icount_leaf_rank(il, off);
+
+	il->il_nr--;
+	memmove(&il->il_counts[rank], &il->il_counts[rank + 1],
+		(il->il_nr - rank) * sizeof(*il->il_counts));
+	il->il_map[off / 64] &= ~(1ULL << (off % 64));
+
+	if (il->il_nr == 0) {
+		o2fsck_scratch_free(il->il_counts,
+				    il->il_alloced * sizeof(*il->il_counts));
+		o2fsck_scratch_free(il, sizeof(*il));
+		icount->ic_leaves[idx] = NULL;
 	}
-	if (next && last_left)
-		*next = last_left;
-	return NULL;
+}
+
+/* finds the first block at or after start that has a count > 1 */
+static int icount_next_multiple(o2fsck_icount *icount, uint64_t start,
+				uint64_t *found)
+{
+	uint64_t idx, word;
+	struct icount_leaf *il;
+	unsigned int i = icount_leaf_off(start) / 64;
+	unsigned int bit = icount_leaf_off(start) % 64;
+
+	for (idx = icount_leaf_index(start); idx < icount->ic_nr_leaves;
+	     idx++, i = 0, bit = 0) {
+		il = icount->ic_leaves[idx];
+		if (il == NULL)
+			continue;
+
+		for (; i < IC_LEAF_WORDS; i++, bit = 0) {
+			word = il->il_map[i] & (~0ULL << bit);
+			if (word) {
+				*found = (idx << IC_LEAF_BITS) + i * 64 +
+					 __builtin_ctzll(word);
+				return 1;
+			}
+		}
+	}
+	return 0;
 }
 
 /* keep it simple for now by always updating both data structures */
 errcode_t o2fsck_icount_set(o2fsck_icount *icount, uint64_t blkno, 
 			    uint16_t count)
 {
-	icount_node *in;
+	uint16_t *in;
 	errcode_t ret = 0;
 
 	if (count == 1)
@@ -99,33 +230,21 @@ errcode_t o2fsck_icount_set(o2fsck_icount *icount, uint64_t blkno,
 	else
 		o2fsck_bitmap_clear(icount->ic_single_bm, blkno, NULL);
 
-	in = icount_search(icount, blkno, NULL);
+	in = icount_search(icount, blkno);
 	if (in) {
-		if (count < 2) {
-			rb_erase(&in->in_node, &icount->ic_multiple_tree);
-			free(in);
-		} else {
-			in->in_icount = count;
-		}
-	} else if (count > 1) {
-		in = calloc(1, sizeof(*in));
-		if (in == NULL) {
-			ret = OCFS2_ET_NO_MEMORY;
-			goto out;
-		}
-
-		in->in_blkno = blkno;
-		in->in_icount = count;
-		icount_insert(icount, in);
-	}
+		if (count < 2)
+			icount_remove(icount, blkno);
+		else
+			*in = count;
+	} else if (count > 1)
+		ret = icount_insert(icount, blkno, count);
 
-out:
 	return ret;
 }
 
 uint16_t o2fsck_icount_get(o2fsck_icount *icount, uint64_t blkno)
 {
-	icount_node *in;
+	uint16_t *in;
 	int was_set;
 	uint16_t ret = 0;
 
@@ -135,23 +254,23 @@ uint16_t o2fsck_icount_get(o2fsck_icount *icount, uint64_t blkno)
 		goto out;
 	}
 
-	in = icount_search(icount, blkno, NULL);
+	in = icount_search(icount, blkno);
 	if (in)
-		ret = in->in_icount;
+		ret = *in;
 
 out:
 	return ret;
 }
 
-/* again, simple before efficient.  We just find the old value and
- * use _set to make sure that the new value updates both the bitmap
- * and the tree */
+/* We find the old value and, unless the count stays above one and can be
+ * updated in place, use _set to make sure that the new value updates both
+ * the bitmap and the radix */
 void o2fsck_icount_delta(o2fsck_icount *icount, uint64_t blkno, 
 			 int delta)
 {
 	int was_set;
 	uint16_t prev_count;
-	icount_node *in;
+	uint16_t *in = NULL;
 
 	if (delta == 0)
 		return;
@@ -160,11 +279,11 @@ void o2fsck_icount_delta(o2fsck_icount *icount, uint64_t blkno,
 	if (was_set) {
 		prev_count = 1;
 	} else {
-		in = icount_search(icount, blkno, NULL);
+		in = icount_search(icount, blkno);
 		if (in == NULL)
 			prev_count = 0;
 		else
-			prev_count = in->in_icount;
+			prev_count = *in;
 	}
 
 	if (prev_count + delta < 0) 
@@ -172,6 +291,11 @@ void o2fsck_icount_delta(o2fsck_icount *icount, uint64_t blkno,
 		        "while droping icount from %"PRIu16" bt %d for "
 			"inode %"PRIu64, prev_count, delta, blkno);
 
+	if (in && (prev_count + delta) > 1) {
+		*in = prev_count + delta;
+		return;
+	}
+
 	o2fsck_icount_set(icount, blkno, prev_count + delta);
 }
 
@@ -184,16 +308,15 @@ errcode_t o2fsck_icount_new(ocfs2_filesys *fs, o2fsck_icount **ret)
 	if (icount == NULL)
 		return OCFS2_ET_NO_MEMORY;
 
-	err = ocfs2_block_bitmap_new(fs, "inodes with single link_count",
-				     &icount->ic_single_bm);
+	err = o2fsck_scratch_bitmap_new(fs, fs->fs_blocks,
+					"inodes with single link_count",
+					&icount->ic_single_bm);
 	if (err) {
 		free(icount);
 		com_err("icount", err, "while allocating single link_count bm");
 		return err;
 	}
 
-	icount->ic_multiple_tree = RB_ROOT;
-
 	*ret = icount;
 	return 0;
 }
@@ -201,23 +324,18 @@ errcode_t o2fsck_icount_new(ocfs2_filesys *fs, o2fsck_icount **ret)
 errcode_t o2fsck_icount_next_blkno(o2fsck_icount *icount, uint64_t start,
 				   uint64_t *found)
 {
-	uint64_t next_bit;
+	uint64_t next_bit, next_multiple;
 	errcode_t ret;
-	icount_node *in, *next = NULL;
 
 	ret = ocfs2_bitmap_find_next_set(icount->ic_single_bm, start,
 						  &next_bit);
 
-	in = icount_search(icount, start, &next);
-	if (in == NULL)
-		in = next;
-
-	if (in) {
+	if (icount_next_multiple(icount, start, &next_multiple)) {
 		if (ret == OCFS2_ET_BIT_NOT_FOUND)
-			*found = in->in_blkno;
+			*found = next_multiple;
 		else
-			*found = next_bit < in->in_blkno ? next_bit :
-							   in->in_blkno;
+			*found = next_bit < next_multiple ? next_bit :
+							    next_multiple;
 		ret = 0;
 	}
 	else {
@@ -229,14 +347,19 @@ errcode_t o2fsck_icount_next_blkno(o2fsck_icount *icount, uint64_t start,
 
 void o2fsck_icount_free(o2fsck_icount *icount)
 {
-	struct rb_node *node;
-	icount_node *in; 
+	uint64_t i;
+	struct icount_leaf *il;
 
 	ocfs2_bitmap_free(icount->ic_single_bm);
-	while((node = rb_first(&icount->ic_multiple_tree)) != NULL) {
-		in = rb_entry(node, icount_node, in_node);
-		rb_erase(node, &icount->ic_multiple_tree);
-		free(in);
+	for (i = 0; i < icount->ic_nr_leaves; i++) {
+		il = icount->ic_leaves[i];
+		if (il == NULL)
+			continue;
+		o2fsck_scratch_free(il->il_counts,
+				    il->il_alloced * sizeof(*il->il_counts));
+		o2fsck_scratch_free(il, sizeof(*il));
 	}
+	o2fsck_scratch_free(icount->ic_leaves,
+			    icount->ic_nr_leaves * sizeof(*icount->ic_leaves));
 	free(icount);
 }
@@ -0,0 +1,87 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * delta.h
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+#ifndef __O2FSCK_DELTA_H__
+#define __O2FSCK_DELTA_H__
+
+#include "fsck.h"
+
+enum o2fsck_delta_type {
+	O2FSCK_DELTA_CLUSTERS = 1,	/* dr_b clusters at dr_a are used */
+	O2FSCK_DELTA_DIR_INODE,		/* dr_a is a dir, orphaned if dr_b */
+	O2FSCK_DELTA_REG_INODE,		/* dr_a is a regular file */
+	O2FSCK_DELTA_LINKS,		/* dr_a has an i_links_count of dr_b */
+	O2FSCK_DELTA_DIR_BLOCK,		/* dir dr_a has block dr_b at dr_c */
+	O2FSCK_DELTA_REF,		/* a dirent refers to dr_a */
+	O2FSCK_DELTA_DOT_DOT,		/* dir dr_a's '..' is dr_b */
+	O2FSCK_DELTA_DIRENT,		/* dir dr_b has a dirent for dir dr_a */
+};
+
+struct o2fsck_delta_rec {
+	enum o2fsck_delta_type	dr_type;
+	uint64_t		dr_a;
+	uint64_t		dr_b;
+	uint64_t		dr_c;
+};
+
+/*
+ * A worker thread can't touch the o2fsck_state; the main thread owns
+ * it.  So a worker gets a copy of the state with ost_delta set, and
+ * the o2fsck_mark_*() helpers write down what they would have done
+ * instead of doing it.  The main thread plays the records back in
+ * order.
+ *
+ * Anything that can't be written down fails the delta: a question for
+ * the user, a write, an error message.  The main thread then does that
+ * piece of work over again itself.
+ */
+struct o2fsck_delta {
+	struct o2fsck_delta_rec	*d_recs;
+	int			d_nr;
+	int			d_alloced;
+	int			d_failed;
+};
+
+void o2fsck_delta_init(struct o2fsck_delta *delta);
+void o2fsck_delta_reset(struct o2fsck_delta *delta);
+void o2fsck_delta_free(struct o2fsck_delta *delta);
+void o2fsck_delta_add(struct o2fsck_delta *delta,
+		      enum o2fsck_delta_type type,
+		      uint64_t a, uint64_t b, uint64_t c);
+void o2fsck_delta_fail(struct o2fsck_delta *delta);
+errcode_t o2fsck_delta_replay(o2fsck_state *ost, struct o2fsck_delta *delta,
+			      int start, int end);
+
+/*
+ * While a delta is in use by this thread, com_err() fails it instead
+ * of printing.  The hook is installed around the threaded part of a
+ * pass.
+ */
+void o2fsck_delta_set_current(struct o2fsck_delta *delta);
+void o2fsck_delta_hook_com_err(void);
+void o2fsck_delta_unhook_com_err(void);
+
+/*
+ * How many threads a pass should check with, at most max.  A worker
+ * reads through its own copy of the filesystem with a read-only
+ * channel and a cache of its own.
+ */
+int o2fsck_delta_nr_threads(o2fsck_state *ost, int max);
+errcode_t o2fsck_delta_open_fs(ocfs2_filesys *fs, ocfs2_filesys *wfs,
+			       int cache_blocks);
+void o2fsck_delta_close_fs(ocfs2_filesys *wfs);
+
+#endif /* __O2FSCK_DELTA_H__ */
@@ -25,19 +25,25 @@
 #define __O2FSCK_DIRBLOCKS_H__
 
 #include "ocfs2/ocfs2.h"
-#include "ocfs2/kernel-rbtree.h"
-
-typedef struct _o2fsck_dirblocks {
-	struct rb_root	db_root;
-} o2fsck_dirblocks;
 
+/*
+ * Directory blocks are appended to fixed-size chunks as pass1 finds
+ * them and sorted by block number, once, before pass2 walks them.
+ */
 typedef struct _o2fsck_dirblock_entry {
-	struct rb_node	e_node;
-	uint64_t	e_ino;
 	uint64_t	e_blkno;
+	uint64_t	e_ino;
 	uint64_t	e_blkcount;
 } o2fsck_dirblock_entry;
 
+typedef struct _o2fsck_dirblocks {
+	o2fsck_dirblock_entry	**db_chunks;
+	uint64_t		db_nr_chunks;	/* room in db_chunks */
+	uint64_t		db_nr;
+	uint64_t		db_max_blkno;
+	int			db_sorted;
+} o2fsck_dirblocks;
+
 typedef unsigned (*dirblock_iterator)(o2fsck_dirblock_entry *,
 					void *priv_data);
 
@@ -45,9 +51,16 @@ errcode_t o2fsck_add_dir_block(o2fsck_dirblocks *db, uint64_t ino,
 			       uint64_t blkno, uint64_t blkcount);
 
 struct _o2fsck_state;
+errcode_t o2fsck_dir_block_sort(struct _o2fsck_state *ost);
 void o2fsck_dir_block_iterate(struct _o2fsck_state *ost, dirblock_iterator func,
                               void *priv_data);
-		     
+void o2fsck_dir_block_iterate_from(struct _o2fsck_state *ost,
+				   o2fsck_dirblock_entry *dbe,
+				   dirblock_iterator func, void *priv_data);
+
+/* These walk the sorted entries; o2fsck_dir_block_sort() must come first */
+o2fsck_dirblock_entry *o2fsck_dir_block_first(o2fsck_dirblocks *db);
+o2fsck_dirblock_entry *o2fsck_dir_block_next(o2fsck_dirblock_entry *dbe);
 
 #endif /* __O2FSCK_DIRBLOCKS_H__ */
 
@@ -26,9 +26,13 @@
 #ifndef __O2FSCK_FSCK_H__
 #define __O2FSCK_FSCK_H__
 
+#include "ocfs2/kernel-rbtree.h"
+
 #include "icount.h"
 #include "dirblocks.h"
 
+struct o2fsck_delta;
+
 typedef struct _o2fsck_state {
 	ocfs2_filesys 	*ost_fs;
 
@@ -58,6 +62,13 @@ typedef struct _o2fsck_state {
 
 	struct rb_root	ost_dir_parents;
 
+	int		ost_cache_flags; /* IO_CACHE_* flags from -H/-I */
+	int		ost_threads;	/* -j: threads for the passes */
+	uint64_t	ost_fixes;	/* repairs the user said yes to */
+
+	/* Set in a worker thread's copy of the state; see delta.h */
+	struct o2fsck_delta	*ost_delta;
+
 	unsigned	ost_ask:1,	/* confirm with the user */
 			ost_answer:1,	/* answer if we don't ask the user */
 			ost_force:1,	/* -f supplied; force check */
@@ -25,11 +25,13 @@
 #define __O2FSCK_ICOUNT_H__
 
 #include "ocfs2/ocfs2.h"
-#include "ocfs2/kernel-rbtree.h"
+
+struct icount_leaf;
 
 typedef struct _o2fsck_icount {
-	ocfs2_bitmap	*ic_single_bm;
-	struct rb_root	ic_multiple_tree;
+	ocfs2_bitmap		*ic_single_bm;
+	struct icount_leaf	**ic_leaves;	/* counts > 1, by blkno */
+	uint64_t		ic_nr_leaves;
 } o2fsck_icount;
 
 errcode_t o2fsck_icount_set(o2fsck_icount *icount, uint64_t blkno, 
@@ -0,0 +1,44 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * scratch.h
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+#ifndef __O2FSCK_SCRATCH_H__
+#define __O2FSCK_SCRATCH_H__
+
+#include "ocfs2/ocfs2.h"
+
+/*
+ * With -S, the big run-time state lives in files in a scratch
+ * directory instead of anonymous memory: the block and cluster bitmaps,
+ * the icount radix, the dir parents and the dirblock chunks.  Without
+ * -S, these all fall back to malloc() and the sparse bitmap.
+ *
+ * The allocator is only for the main thread, which owns the
+ * o2fsck_state.  Like free(), o2fsck_scratch_free() takes NULL, but it
+ * needs the size that was asked for.
+ */
+errcode_t o2fsck_scratch_init(const char *dir);
+int o2fsck_scratch_enabled(void);
+
+void *o2fsck_scratch_alloc(size_t size);
+void *o2fsck_scratch_alloc0(size_t size);
+void *o2fsck_scratch_realloc(void *ptr, size_t old_size, size_t new_size);
+void o2fsck_scratch_free(void *ptr, size_t size);
+
+errcode_t o2fsck_scratch_bitmap_new(ocfs2_filesys *fs, uint64_t total_bits,
+				    const char *description,
+				    ocfs2_bitmap **ret_bitmap);
+
+#endif /* __O2FSCK_SCRATCH_H__ */
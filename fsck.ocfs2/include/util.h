@@ -55,6 +55,12 @@ void o2fsck_mark_cluster_allocated(o2fsck_state *ost, uint32_t cluster);
 void o2fsck_mark_clusters_allocated(o2fsck_state *ost, uint32_t cluster,
 				    uint32_t num);
 void o2fsck_mark_cluster_unallocated(o2fsck_state *ost, uint32_t cluster);
+void o2fsck_mark_dir_inode(o2fsck_state *ost, uint64_t blkno, int orphaned);
+void o2fsck_mark_reg_inode(o2fsck_state *ost, uint64_t blkno);
+void o2fsck_mark_inode_links(o2fsck_state *ost, uint64_t blkno,
+			     uint16_t links);
+errcode_t o2fsck_mark_dir_block(o2fsck_state *ost, uint64_t ino,
+				uint64_t blkno, uint64_t blkcount);
 errcode_t o2fsck_type_from_dinode(o2fsck_state *ost, uint64_t ino,
 				  uint8_t *type);
 errcode_t o2fsck_read_publish(o2fsck_state *ost);
@@ -57,10 +57,13 @@
 #include <string.h>
 #include <inttypes.h>
 #include <time.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 #include "ocfs2/bitops.h"
 
+#include "delta.h"
 #include "dirblocks.h"
 #include "dirparents.h"
 #include "extent.h"
@@ -514,11 +517,10 @@ static void o2fsck_verify_inode_fields(ocfs2_filesys *fs,
 	}
 
 	if (S_ISDIR(di->i_mode)) {
-		o2fsck_bitmap_set(ost->ost_dir_inodes, blkno, NULL);
-		o2fsck_add_dir_parent(&ost->ost_dir_parents, blkno, 0, 0,
+		o2fsck_mark_dir_inode(ost, blkno,
 				      di->i_flags & OCFS2_ORPHANED_FL);
 	} else if (S_ISREG(di->i_mode)) {
-		o2fsck_bitmap_set(ost->ost_reg_inodes, blkno, NULL);
+		o2fsck_mark_reg_inode(ost, blkno);
 	} else if (S_ISLNK(di->i_mode)) {
 		/* we only make sure a link's i_size matches
 		 * the link names length in the file data later when
@@ -536,14 +538,13 @@ static void o2fsck_verify_inode_fields(ocfs2_filesys *fs,
 	/* put this after all opportunities to clear so we don't have to
 	 * unwind it */
 	if (di->i_links_count)
-		o2fsck_icount_set(ost->ost_icount_in_inodes, di->i_blkno,
-					di->i_links_count);
+		o2fsck_mark_inode_links(ost, di->i_blkno, di->i_links_count);
 
 	/* orphan inodes are a special case. if -n is given pass4 will try
 	 * and assert that their links_count should include the dirent
 	 * reference from the orphan dir. */
 	if (di->i_flags & OCFS2_ORPHANED_FL && di->i_links_count == 0)
-		o2fsck_icount_set(ost->ost_icount_in_inodes, di->i_blkno, 1);
+		o2fsck_mark_inode_links(ost, di->i_blkno, 1);
 
 	if (di->i_flags & OCFS2_LOCAL_ALLOC_FL)
 		verify_local_alloc(ost, di);
@@ -563,7 +564,7 @@ out:
 		 * should back-out the inode count we found in the inode
 		 * so that we're not surprised when there aren't any
 		 * references to it in pass 4 */
-		o2fsck_icount_set(ost->ost_icount_in_inodes, di->i_blkno, 0);
+		o2fsck_mark_inode_links(ost, di->i_blkno, 0);
 	}
 }
 
@@ -719,9 +720,8 @@ static int verify_block(ocfs2_filesys *fs,
 
 	if (S_ISDIR(di->i_mode)) {
 		verbosef("adding dir block %"PRIu64"\n", blkno);
-		ret = o2fsck_add_dir_block(&ost->ost_dirblocks,
-					   (uint64_t)di->i_blkno,
-					   blkno, bcount);
+		ret = o2fsck_mark_dir_block(ost, (uint64_t)di->i_blkno,
+					    blkno, bcount);
 		if (ret) {
 			com_err(whoami, ret, "while trying to track block in "
 				"directory inode %"PRIu64,
@@ -791,9 +791,8 @@ static errcode_t o2fsck_check_blocks(ocfs2_filesys *fs, o2fsck_state *ost,
 		 * directory check.
 		 */
 		if (S_ISDIR(di->i_mode)) {
-			ret = o2fsck_add_dir_block(&ost->ost_dirblocks,
-						   di->i_blkno,
-						   di->i_blkno, 0);
+			ret = o2fsck_mark_dir_block(ost, di->i_blkno,
+						    di->i_blkno, 0);
 			if (ret)
 				return ret;
 		}
@@ -833,8 +832,7 @@ static errcode_t o2fsck_check_blocks(ocfs2_filesys *fs, o2fsck_state *ost,
 	 */
 	if (vb.vb_clear) {
 		di->i_links_count = 0;
-		o2fsck_icount_set(ost->ost_icount_in_inodes, di->i_blkno,
-				  di->i_links_count);
+		o2fsck_mark_inode_links(ost, di->i_blkno, di->i_links_count);
 		di->i_dtime = time(NULL);
 		/* clear valid flag and stuff. */
 		ret = ocfs2_block_iterate_inode(fs, di,
@@ -1344,32 +1342,56 @@ static void write_inode_alloc(o2fsck_state *ost)
 	o2fsck_free_inode_allocs(ost);
 }
 
-errcode_t o2fsck_pass1(o2fsck_state *ost)
+/*
+ * Checks one inode that the scan returned.  The worker threads run this
+ * too, with a copy of the state whose ost_delta is set.  So it may only
+ * change the state through the o2fsck_mark_*() helpers, prompt(), and
+ * o2fsck_write_inode().
+ */
+static errcode_t pass1_check_inode(o2fsck_state *ost, uint64_t blkno,
+				   struct ocfs2_dinode *di, int *valid)
 {
-	errcode_t ret;
-	uint64_t blkno;
-	char *buf;
-	struct ocfs2_dinode *di;
-	ocfs2_inode_scan *scan;
 	ocfs2_filesys *fs = ost->ost_fs;
-	int valid;
+	errcode_t ret;
 
-	printf("Pass 1: Checking inodes and blocks.\n");
+	*valid = 0;
 
-	ret = ocfs2_malloc_block(fs->fs_io, &buf);
-	if (ret) {
-		com_err(whoami, ret, "while allocating inode buffer");
-		goto out;
-	}
+	/* we never consider inodes who don't have a signature */
+	if (memcmp(di->i_signature, OCFS2_INODE_SIGNATURE,
+		   strlen(OCFS2_INODE_SIGNATURE)))
+		return 0;
 
-	di = (struct ocfs2_dinode *)buf;
+	ocfs2_swap_inode_to_cpu(fs, di);
 
-	ret = ocfs2_open_inode_scan(fs, &scan);
-	if (ret) {
-		com_err(whoami, ret, "while opening inode scan");
-		goto out_free;
+	/* We only consider inodes whose generations don't
+	 * match if the user has asked us to */
+	if (!ost->ost_fix_fs_gen &&
+	    (di->i_fs_generation != ost->ost_fs_generation))
+		return 0;
+
+	if (di->i_flags & OCFS2_VALID_FL)
+		o2fsck_verify_inode_fields(fs, ost, blkno, di);
+	if (di->i_flags & OCFS2_VALID_FL) {
+		ret = o2fsck_check_blocks(fs, ost, blkno, di);
+		if (ret)
+			return ret;
+		ret = o2fsck_check_xattr(ost, di);
+		if (ret)
+			return ret;
 	}
 
+	*valid = di->i_flags & OCFS2_VALID_FL;
+	return 0;
+}
+
+static errcode_t pass1_scan(o2fsck_state *ost, ocfs2_inode_scan *scan,
+			    char *buf)
+{
+	errcode_t ret;
+	uint64_t blkno;
+	struct ocfs2_dinode *di = (struct ocfs2_dinode *)buf;
+	int valid;
+
 	for(;;) {
 		ret = ocfs2_get_next_inode(scan, &blkno, buf);
 		if (ret) {
@@ -1379,44 +1401,425 @@ errcode_t o2fsck_pass1(o2fsck_state *ost)
 			 * allocation if scanning returns an error. */
 			com_err(whoami, ret,
 				"while getting next inode");
-			goto out_close_scan;
+			break;
 		}
 		if (blkno == 0)
 			break;
 
-		valid = 0;
-
-		/* we never consider inodes who don't have a signature */
-		if (!memcmp(di->i_signature, OCFS2_INODE_SIGNATURE,
-			    strlen(OCFS2_INODE_SIGNATURE))) {
-
-			ocfs2_swap_inode_to_cpu(fs, di);
-
-			 /* We only consider inodes whose generations don't
-			  * match if the user has asked us to */
-			if ((ost->ost_fix_fs_gen ||
-			    (di->i_fs_generation == ost->ost_fs_generation))) {
-
-				if (di->i_flags & OCFS2_VALID_FL)
-					o2fsck_verify_inode_fields(fs, ost,
-								   blkno, di);
-				if (di->i_flags & OCFS2_VALID_FL) {
-					ret = o2fsck_check_blocks(fs, ost,
-								  blkno, di);
-					if (ret)
-						goto out;
-					ret = o2fsck_check_xattr(ost, di);
-					if (ret)
-						goto out;
-				}
-
-				valid = di->i_flags & OCFS2_VALID_FL;
+		ret = pass1_check_inode(ost, blkno, di, &valid);
+		if (ret)
+			break;
+
+		update_inode_alloc(ost, di, blkno, valid);
+	}
+
+	return ret;
+}
+
+/*
+ * Checking an inode mostly means reading the blocks hanging off of it,
+ * one inode after another.  Worker threads do that for inodes ahead of
+ * the main thread.
+ *
+ * The main thread keeps the inode scan.  It hands out the inodes in
+ * units of PASS1_UNIT_INODES and takes the units back in scan order.
+ * A worker checks a copy of each inode in the unit with its own
+ * read-only io_channel and a copy of the state, so what it would have
+ * done goes into the unit's delta (see delta.h).  The main thread plays
+ * each inode's records back and updates the inode allocators just as
+ * it would have in one thread.
+ *
+ * An inode the worker couldn't finish is checked again from the copy
+ * as read, by the main thread, in its place.  That is where any
+ * questions get asked, so the output comes out in the same order with
+ * any number of threads.  Once the user has said yes to a repair, what
+ * the workers read may be stale.  The rest of the pass is done by the
+ * main thread alone.
+ */
+#define PASS1_UNIT_INODES	64
+#define PASS1_UNITS_PER_THREAD	4
+#define PASS1_MAX_THREADS	8
+#define PASS1_WORKER_CACHE	1024	/* blocks */
+
+struct pass1_unit {
+	int			pu_nr;
+	int			pu_done;
+	uint64_t		pu_blknos[PASS1_UNIT_INODES];
+	int			pu_ok[PASS1_UNIT_INODES];
+	int			pu_valid[PASS1_UNIT_INODES];
+	int			pu_first_rec[PASS1_UNIT_INODES + 1];
+	char			*pu_raw;	/* the inodes as scanned */
+	char			*pu_out;	/* the inodes as checked */
+	struct o2fsck_delta	pu_delta;
+};
+
+struct pass1_worker {
+	struct pass1_ctxt	*pw_ctxt;
+	pthread_t		pw_thread;
+	int			pw_started;
+	ocfs2_filesys		pw_fs;
+	o2fsck_state		pw_ost;
+};
+
+struct pass1_ctxt {
+	o2fsck_state		*pc_ost;
+	pthread_mutex_t		pc_lock;
+	pthread_cond_t		pc_work;	/* a unit was queued */
+	pthread_cond_t		pc_done;	/* a unit was checked */
+	int			pc_stop;
+
+	struct pass1_unit	*pc_units;
+	int			pc_nr_units;
+	unsigned long		pc_queued;	/* units handed out */
+	unsigned long		pc_taken;	/* units a worker started */
+	unsigned long		pc_applied;	/* units taken back */
+
+	struct pass1_worker	*pc_workers;
+	int			pc_nr_workers;
+};
+
+static void pass1_check_unit(struct pass1_worker *pw, struct pass1_unit *pu)
+{
+	ocfs2_filesys *fs = &pw->pw_fs;
+	struct o2fsck_delta *delta = &pu->pu_delta;
+	struct ocfs2_dinode *di;
+	errcode_t ret;
+	int i;
+
+	o2fsck_delta_reset(delta);
+	pw->pw_ost.ost_delta = delta;
+	o2fsck_delta_set_current(delta);
+
+	for (i = 0; i < pu->pu_nr; i++) {
+		di = (struct ocfs2_dinode *)(pu->pu_out +
+					     i * fs->fs_blocksize);
+		memcpy(di, pu->pu_raw + i * fs->fs_blocksize,
+		       fs->fs_blocksize);
+
+		pu->pu_first_rec[i] = delta->d_nr;
+		delta->d_failed = 0;
+		ret = pass1_check_inode(&pw->pw_ost, pu->pu_blknos[i], di,
+					&pu->pu_valid[i]);
+		pu->pu_ok[i] = !ret && !delta->d_failed;
+		if (!pu->pu_ok[i])
+			delta->d_nr = pu->pu_first_rec[i];
+	}
+	pu->pu_first_rec[i] = delta->d_nr;
+
+	o2fsck_delta_set_current(NULL);
+	pw->pw_ost.ost_delta = NULL;
+}
+
+static void *pass1_worker_thread(void *arg)
+{
+	struct pass1_worker *pw = arg;
+	struct pass1_ctxt *pc = pw->pw_ctxt;
+	struct pass1_unit *pu;
+	sigset_t set;
+
+	/* Signals are the main thread's business */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&pc->pc_lock);
+	for (;;) {
+		while (!pc->pc_stop && (pc->pc_taken == pc->pc_queued))
+			pthread_cond_wait(&pc->pc_work, &pc->pc_lock);
+		if (pc->pc_stop)
+			break;
+
+		pu = &pc->pc_units[pc->pc_taken++ % pc->pc_nr_units];
+		pthread_mutex_unlock(&pc->pc_lock);
+
+		pass1_check_unit(pw, pu);
+
+		pthread_mutex_lock(&pc->pc_lock);
+		pu->pu_done = 1;
+		pthread_cond_broadcast(&pc->pc_done);
+	}
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	return NULL;
+}
+
+static void pass1_stop_workers(struct pass1_ctxt *pc)
+{
+	int i;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	pc->pc_stop = 1;
+	pthread_cond_broadcast(&pc->pc_work);
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		if (pc->pc_workers[i].pw_started)
+			pthread_join(pc->pc_workers[i].pw_thread, NULL);
+		pc->pc_workers[i].pw_started = 0;
+	}
+}
+
+static void pass1_free_ctxt(struct pass1_ctxt *pc)
+{
+	struct pass1_unit *pu;
+	int i;
+
+	pass1_stop_workers(pc);
+
+	for (i = 0; i < pc->pc_nr_workers; i++)
+		o2fsck_delta_close_fs(&pc->pc_workers[i].pw_fs);
+	if (pc->pc_workers)
+		ocfs2_free(&pc->pc_workers);
+
+	for (i = 0; i < pc->pc_nr_units; i++) {
+		pu = &pc->pc_units[i];
+		if (pu->pu_raw)
+			ocfs2_free(&pu->pu_raw);
+		if (pu->pu_out)
+			ocfs2_free(&pu->pu_out);
+		o2fsck_delta_free(&pu->pu_delta);
+	}
+	if (pc->pc_units)
+		ocfs2_free(&pc->pc_units);
+
+	pthread_cond_destroy(&pc->pc_done);
+	pthread_cond_destroy(&pc->pc_work);
+	pthread_mutex_destroy(&pc->pc_lock);
+}
+
+static errcode_t pass1_init_worker(struct pass1_ctxt *pc,
+				   struct pass1_worker *pw)
+{
+	errcode_t ret;
+
+	ret = o2fsck_delta_open_fs(pc->pc_ost->ost_fs, &pw->pw_fs,
+				   PASS1_WORKER_CACHE);
+	if (ret)
+		return ret;
+
+	pw->pw_ctxt = pc;
+	pw->pw_ost = *pc->pc_ost;
+	pw->pw_ost.ost_fs = &pw->pw_fs;
+	pw->pw_ost.ost_delta = NULL;
+
+	return 0;
+}
+
+static errcode_t pass1_init_ctxt(struct pass1_ctxt *pc, o2fsck_state *ost,
+				 int nr_threads)
+{
+	errcode_t ret;
+	ocfs2_filesys *fs = ost->ost_fs;
+	struct pass1_unit *pu;
+	int i;
+
+	memset(pc, 0, sizeof(struct pass1_ctxt));
+	pc->pc_ost = ost;
+	pthread_mutex_init(&pc->pc_lock, NULL);
+	pthread_cond_init(&pc->pc_work, NULL);
+	pthread_cond_init(&pc->pc_done, NULL);
+
+	ret = ocfs2_malloc0(sizeof(struct pass1_unit) * nr_threads *
+			    PASS1_UNITS_PER_THREAD, &pc->pc_units);
+	if (ret)
+		goto out;
+	pc->pc_nr_units = nr_threads * PASS1_UNITS_PER_THREAD;
+
+	for (i = 0; i < pc->pc_nr_units; i++) {
+		pu = &pc->pc_units[i];
+		o2fsck_delta_init(&pu->pu_delta);
+		ret = ocfs2_malloc_blocks(fs->fs_io, PASS1_UNIT_INODES,
+					  &pu->pu_raw);
+		if (ret)
+			goto out;
+		ret = ocfs2_malloc_blocks(fs->fs_io, PASS1_UNIT_INODES,
+					  &pu->pu_out);
+		if (ret)
+			goto out;
+	}
+
+	ret = ocfs2_malloc0(sizeof(struct pass1_worker) * nr_threads,
+			    &pc->pc_workers);
+	if (ret)
+		goto out;
+	pc->pc_nr_workers = nr_threads;
+
+	/* The workers read around the main thread's cache */
+	ret = io_flush(fs->fs_io);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		ret = pass1_init_worker(pc, &pc->pc_workers[i]);
+		if (ret)
+			goto out;
+	}
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		if (pthread_create(&pc->pc_workers[i].pw_thread, NULL,
+				   pass1_worker_thread, &pc->pc_workers[i])) {
+			ret = OCFS2_ET_INTERNAL_FAILURE;
+			goto out;
+		}
+		pc->pc_workers[i].pw_started = 1;
+	}
+
+out:
+	if (ret)
+		pass1_free_ctxt(pc);
+	return ret;
+}
+
+/* Fills the next unit from the scan.  *scan_ret gets any scan error. */
+static void pass1_queue_unit(struct pass1_ctxt *pc, ocfs2_inode_scan *scan,
+			     int *scan_done, errcode_t *scan_ret)
+{
+	struct pass1_unit *pu = &pc->pc_units[pc->pc_queued %
+					      pc->pc_nr_units];
+	unsigned int blocksize = pc->pc_ost->ost_fs->fs_blocksize;
+	uint64_t blkno;
+	errcode_t ret;
+
+	pu->pu_nr = 0;
+	while (pu->pu_nr < PASS1_UNIT_INODES) {
+		ret = ocfs2_get_next_inode(scan, &blkno,
+					   pu->pu_raw + pu->pu_nr * blocksize);
+		if (ret || !blkno) {
+			*scan_ret = ret;
+			*scan_done = 1;
+			break;
+		}
+		pu->pu_blknos[pu->pu_nr++] = blkno;
+	}
+
+	if (!pu->pu_nr)
+		return;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	pu->pu_done = 0;
+	pc->pc_queued++;
+	pthread_cond_signal(&pc->pc_work);
+	pthread_mutex_unlock(&pc->pc_lock);
+}
+
+/* Takes back the oldest unit, in the order the scan returned it */
+static errcode_t pass1_apply_unit(struct pass1_ctxt *pc, uint64_t fixes)
+{
+	o2fsck_state *ost = pc->pc_ost;
+	struct pass1_unit *pu = &pc->pc_units[pc->pc_applied %
+					      pc->pc_nr_units];
+	unsigned int blocksize = ost->ost_fs->fs_blocksize;
+	struct ocfs2_dinode *di;
+	errcode_t ret = 0;
+	int i, valid;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	while (!pu->pu_done)
+		pthread_cond_wait(&pc->pc_done, &pc->pc_lock);
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	for (i = 0; i < pu->pu_nr; i++) {
+		if (pu->pu_ok[i] && (ost->ost_fixes == fixes)) {
+			ret = o2fsck_delta_replay(ost, &pu->pu_delta,
+						  pu->pu_first_rec[i],
+						  pu->pu_first_rec[i + 1]);
+			if (ret) {
+				com_err(whoami, ret, "while trying to track "
+					"block in directory inode %"PRIu64,
+					pu->pu_blknos[i]);
+				break;
 			}
+			di = (struct ocfs2_dinode *)(pu->pu_out +
+						     i * blocksize);
+			valid = pu->pu_valid[i];
+		} else {
+			di = (struct ocfs2_dinode *)(pu->pu_raw +
+						     i * blocksize);
+			ret = pass1_check_inode(ost, pu->pu_blknos[i], di,
+						&valid);
+			if (ret)
+				break;
 		}
 
-		update_inode_alloc(ost, di, blkno, valid);
+		update_inode_alloc(ost, di, pu->pu_blknos[i], valid);
+	}
+
+	pc->pc_applied++;
+	return ret;
+}
+
+/*
+ * Scans with nr_threads workers.  *scan_done is cleared if the caller
+ * is to finish the scan alone.
+ */
+static errcode_t pass1_scan_threaded(o2fsck_state *ost,
+				     ocfs2_inode_scan *scan, int nr_threads,
+				     int *scan_done)
+{
+	struct pass1_ctxt pc;
+	uint64_t fixes = ost->ost_fixes;
+	errcode_t ret, scan_ret = 0;
+
+	*scan_done = 0;
+
+	/* Without the threads we can still go it alone */
+	if (pass1_init_ctxt(&pc, ost, nr_threads))
+		return 0;
+
+	o2fsck_delta_hook_com_err();
+
+	for (;;) {
+		while (!*scan_done && (ost->ost_fixes == fixes) &&
+		       (pc.pc_queued - pc.pc_applied < pc.pc_nr_units))
+			pass1_queue_unit(&pc, scan, scan_done, &scan_ret);
+
+		if (pc.pc_applied == pc.pc_queued)
+			break;
+
+		ret = pass1_apply_unit(&pc, fixes);
+		if (ret)
+			goto out;
+	}
+
+	ret = scan_ret;
+	if (ret)
+		com_err(whoami, ret, "while getting next inode");
+
+out:
+	o2fsck_delta_unhook_com_err();
+	pass1_free_ctxt(&pc);
+	return ret;
+}
+
+errcode_t o2fsck_pass1(o2fsck_state *ost)
+{
+	errcode_t ret;
+	char *buf;
+	ocfs2_inode_scan *scan;
+	ocfs2_filesys *fs = ost->ost_fs;
+	int nr_threads, scan_done = 0;
+
+	printf("Pass 1: Checking inodes and blocks.\n");
+
+	ret = ocfs2_malloc_block(fs->fs_io, &buf);
+	if (ret) {
+		com_err(whoami, ret, "while allocating inode buffer");
+		goto out;
+	}
+
+	ret = ocfs2_open_inode_scan(fs, &scan);
+	if (ret) {
+		com_err(whoami, ret, "while opening inode scan");
+		goto out_free;
 	}
 
+	nr_threads = o2fsck_delta_nr_threads(ost, PASS1_MAX_THREADS);
+	if (nr_threads > 1)
+		ret = pass1_scan_threaded(ost, scan, nr_threads, &scan_done);
+	if (!ret && !scan_done)
+		ret = pass1_scan(ost, scan, buf);
+	if (ret)
+		goto out_close_scan;
+
 	mark_local_allocs(ost);
 	mark_truncate_logs(ost);
 	write_cluster_alloc(ost);
@@ -34,9 +34,13 @@
 #include <string.h>
 #include <inttypes.h>
 #include <time.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 
+#include "delta.h"
+#include "dirblocks.h"
 #include "dirparents.h"
 #include "icount.h"
 #include "fsck.h"
@@ -152,7 +156,10 @@ static errcode_t fix_dirent_dots(o2fsck_state *ost, o2fsck_dirblock_entry *dbe,
 			ret = OCFS2_ET_INTERNAL_FAILURE;
 			com_err(whoami, ret, "no dir parents for '..' entry "
 				"for inode %"PRIu64, dbe->e_ino);
-		} else 
+		} else if (ost->ost_delta)
+			o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_DOT_DOT,
+					 dbe->e_ino, dirent->inode, 0);
+		else
 			dp->dp_dot_dot = dirent->inode;
 
 		goto out;
@@ -520,6 +527,14 @@ static errcode_t fix_dirent_linkage(o2fsck_state *ost,
 		goto out;
 	}
 
+	/* a worker can't know who got there first; the main thread
+	 * checks when it plays this back */
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_DIRENT,
+				 dirent->inode, dbe->e_ino, 0);
+		goto out;
+	}
+
 	/* if no dirents have pointed to this inode yet we record ours
 	 * as the first and move on */
 	if (dp->dp_dirent == 0) {
@@ -610,6 +625,10 @@ static errcode_t fix_dirent_dups(o2fsck_state *ost,
 	}
 
 	if (was_set) {
+		if (ost->ost_delta) {
+			o2fsck_delta_fail(ost->ost_delta);
+			goto out;
+		}
 		printf("Directory inode %"PRIu64" contains a duplicate "
 		       "occurance " "of the file name '%.*s' but fsck was "
 		       "unable to come up with a unique name so this duplicate "
@@ -672,6 +691,10 @@ static unsigned pass2_dir_block_iterate(o2fsck_dirblock_entry *dbe,
 	errcode_t ret = 0;
 
 	if (!o2fsck_test_inode_allocated(dd->ost, dbe->e_ino)) {
+		if (dd->ost->ost_delta) {
+			o2fsck_delta_fail(dd->ost->ost_delta);
+			goto out;
+		}
 		printf("Directory block %"PRIu64" belongs to directory inode "
 		       "%"PRIu64" which isn't allocated.  Ignoring this "
 		       "block.", dbe->e_blkno, dbe->e_ino);
@@ -802,7 +825,12 @@ static unsigned pass2_dir_block_iterate(o2fsck_dirblock_entry *dbe,
 
 		verbosef("dirent %.*s refs ino %"PRIu64"\n", dirent->name_len,
 				dirent->name, (uint64_t)dirent->inode);
-		o2fsck_icount_delta(dd->ost->ost_icount_refs, dirent->inode, 1);
+		if (dd->ost->ost_delta)
+			o2fsck_delta_add(dd->ost->ost_delta, O2FSCK_DELTA_REF,
+					 dirent->inode, 0, 0);
+		else
+			o2fsck_icount_delta(dd->ost->ost_icount_refs,
+					    dirent->inode, 1);
 next:
 		offset += dirent->rec_len;
 		prev = dirent;
@@ -836,10 +864,560 @@ out:
 	return ret_flags;
 }
 
+/*
+ * Checking a dir block depends on little but the block itself, so
+ * worker threads check blocks ahead of the main thread the way pass 1
+ * checks inodes (see the comment there).  The main thread walks the
+ * dirblocks and hands them out in units.  A worker checks each block
+ * through its own channel and copy of the state, recording its icount
+ * references and dir parent updates in the unit's delta.  The main
+ * thread plays the units back in block order.
+ *
+ * Duplicate names are looked for across the blocks of a dir that are
+ * checked one after another.  Those blocks make up a run, and a run is
+ * never split between units, so a worker sees the same names the
+ * single thread would have.  If any block in a run needs the main
+ * thread -- a question, a message, an error -- the main thread checks
+ * the whole run itself.
+ *
+ * The first dirent found for a subdir is taken as its parent's; later
+ * ones get a question.  That depends on the blocks before it, so a
+ * worker just records what it found.  The main thread claims the
+ * subdirs of a run as it plays it back and checks the run itself if
+ * any was already claimed.
+ */
+#define PASS2_UNIT_BLOCKS	256
+#define PASS2_UNITS_PER_THREAD	4
+#define PASS2_MAX_THREADS	8
+#define PASS2_WORKER_CACHE	1024	/* blocks */
+
+struct pass2_run {
+	int			pr_start;	/* first entry in the unit */
+	int			pr_end;		/* one past the last */
+	int			pr_ok;		/* the worker finished it */
+};
+
+struct pass2_unit {
+	int			pu_nr;
+	int			pu_alloced;
+	int			pu_done;
+	int			pu_last_partial; /* last run continues */
+	o2fsck_dirblock_entry	**pu_dbes;
+	char			*pu_skip;	/* dir inode isn't allocated */
+	int			*pu_first_rec;
+	struct pass2_run	*pu_runs;
+	int			pu_nr_runs;
+	struct o2fsck_delta	pu_delta;
+};
+
+struct pass2_worker {
+	struct pass2_ctxt	*pw_ctxt;
+	pthread_t		pw_thread;
+	int			pw_started;
+	ocfs2_filesys		pw_fs;
+	o2fsck_state		pw_ost;
+	struct dirblock_data	pw_dd;
+	char			*pw_prefetch_buf;
+	struct io_vec_unit	*pw_ivus;
+};
+
+struct pass2_ctxt {
+	o2fsck_state		*pc_ost;
+	pthread_mutex_t		pc_lock;
+	pthread_cond_t		pc_work;	/* a unit was queued */
+	pthread_cond_t		pc_done;	/* a unit was checked */
+	int			pc_stop;
+
+	struct pass2_unit	*pc_units;
+	int			pc_nr_units;
+	unsigned long		pc_queued;
+	unsigned long		pc_taken;
+	unsigned long		pc_applied;
+
+	/* where the walk is up to */
+	o2fsck_dirblock_entry	*pc_next;
+	uint64_t		pc_run_ino;
+	int			pc_serial;	/* the rest is single-threaded */
+
+	struct pass2_worker	*pc_workers;
+	int			pc_nr_workers;
+};
+
+/* Reads a unit's blocks into the worker's cache in as few I/Os as it can */
+static void pass2_prefetch_unit(struct pass2_worker *pw, struct pass2_unit *pu)
+{
+	ocfs2_filesys *fs = &pw->pw_fs;
+	int i, count = 0;
+
+	for (i = 0; (i < pu->pu_nr) && (count < PASS2_UNIT_BLOCKS); i++) {
+		if (pu->pu_skip[i])
+			continue;
+		pw->pw_ivus[count].ivu_blkno = pu->pu_dbes[i]->e_blkno;
+		pw->pw_ivus[count].ivu_count = 1;
+		pw->pw_ivus[count].ivu_buf = pw->pw_prefetch_buf +
+			count * fs->fs_blocksize;
+		count++;
+	}
+
+	/* Just a cache fill; the checks read them again */
+	if (count)
+		ocfs2_read_blocks_v(fs, pw->pw_ivus, count);
+}
+
+static void pass2_check_unit(struct pass2_worker *pw, struct pass2_unit *pu)
+{
+	struct dirblock_data *dd = &pw->pw_dd;
+	struct o2fsck_delta *delta = &pu->pu_delta;
+	struct pass2_run *pr;
+	unsigned flags;
+	int i, r;
+
+	pass2_prefetch_unit(pw, pu);
+
+	o2fsck_delta_reset(delta);
+	pw->pw_ost.ost_delta = delta;
+	o2fsck_delta_set_current(delta);
+
+	for (r = 0; r < pu->pu_nr_runs; r++) {
+		pr = &pu->pu_runs[r];
+		pr->pr_ok = 1;
+
+		/* as if the dir had just changed */
+		o2fsck_strings_free(&dd->strings);
+		dd->last_ino = 0;
+
+		for (i = pr->pr_start; i < pr->pr_end; i++) {
+			pu->pu_first_rec[i] = delta->d_nr;
+			if (pu->pu_skip[i] || !pr->pr_ok)
+				continue;
+
+			dd->ret = 0;
+			delta->d_failed = 0;
+			flags = pass2_dir_block_iterate(pu->pu_dbes[i], dd);
+			if (delta->d_failed || dd->ret ||
+			    (flags & (OCFS2_DIRENT_ABORT |
+				      OCFS2_DIRENT_CHANGED)))
+				pr->pr_ok = 0;
+		}
+
+		if (!pr->pr_ok)
+			delta->d_nr = pu->pu_first_rec[pr->pr_start];
+	}
+	pu->pu_first_rec[pu->pu_nr] = delta->d_nr;
+
+	o2fsck_delta_set_current(NULL);
+	pw->pw_ost.ost_delta = NULL;
+}
+
+static void *pass2_worker_thread(void *arg)
+{
+	struct pass2_worker *pw = arg;
+	struct pass2_ctxt *pc = pw->pw_ctxt;
+	struct pass2_unit *pu;
+	sigset_t set;
+
+	/* Signals are the main thread's business */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&pc->pc_lock);
+	for (;;) {
+		while (!pc->pc_stop && (pc->pc_taken == pc->pc_queued))
+			pthread_cond_wait(&pc->pc_work, &pc->pc_lock);
+		if (pc->pc_stop)
+			break;
+
+		pu = &pc->pc_units[pc->pc_taken++ % pc->pc_nr_units];
+		pthread_mutex_unlock(&pc->pc_lock);
+
+		pass2_check_unit(pw, pu);
+
+		pthread_mutex_lock(&pc->pc_lock);
+		pu->pu_done = 1;
+		pthread_cond_broadcast(&pc->pc_done);
+	}
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	return NULL;
+}
+
+static void pass2_free_ctxt(struct pass2_ctxt *pc)
+{
+	struct pass2_worker *pw;
+	struct pass2_unit *pu;
+	int i;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	pc->pc_stop = 1;
+	pthread_cond_broadcast(&pc->pc_work);
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		pw = &pc->pc_workers[i];
+		if (pw->pw_started)
+			pthread_join(pw->pw_thread, NULL);
+		o2fsck_strings_free(&pw->pw_dd.strings);
+		if (pw->pw_dd.dirblock_buf)
+			ocfs2_free(&pw->pw_dd.dirblock_buf);
+		if (pw->pw_dd.inoblock_buf)
+			ocfs2_free(&pw->pw_dd.inoblock_buf);
+		if (pw->pw_prefetch_buf)
+			ocfs2_free(&pw->pw_prefetch_buf);
+		if (pw->pw_ivus)
+			ocfs2_free(&pw->pw_ivus);
+		o2fsck_delta_close_fs(&pw->pw_fs);
+	}
+	if (pc->pc_workers)
+		ocfs2_free(&pc->pc_workers);
+
+	for (i = 0; i < pc->pc_nr_units; i++) {
+		pu = &pc->pc_units[i];
+		if (pu->pu_dbes)
+			ocfs2_free(&pu->pu_dbes);
+		if (pu->pu_skip)
+			ocfs2_free(&pu->pu_skip);
+		if (pu->pu_first_rec)
+			ocfs2_free(&pu->pu_first_rec);
+		if (pu->pu_runs)
+			ocfs2_free(&pu->pu_runs);
+		o2fsck_delta_free(&pu->pu_delta);
+	}
+	if (pc->pc_units)
+		ocfs2_free(&pc->pc_units);
+
+	pthread_cond_destroy(&pc->pc_done);
+	pthread_cond_destroy(&pc->pc_work);
+	pthread_mutex_destroy(&pc->pc_lock);
+}
+
+/* Makes room for nr entries (and as many runs) in the unit */
+static errcode_t pass2_grow_unit(struct pass2_unit *pu, int nr)
+{
+	errcode_t ret;
+
+	if (nr <= pu->pu_alloced)
+		return 0;
+
+	ret = ocfs2_realloc(sizeof(o2fsck_dirblock_entry *) * nr,
+			    &pu->pu_dbes);
+	if (!ret)
+		ret = ocfs2_realloc(sizeof(char) * nr, &pu->pu_skip);
+	if (!ret)
+		ret = ocfs2_realloc(sizeof(int) * (nr + 1),
+				    &pu->pu_first_rec);
+	if (!ret)
+		ret = ocfs2_realloc(sizeof(struct pass2_run) * nr,
+				    &pu->pu_runs);
+	if (!ret)
+		pu->pu_alloced = nr;
+
+	return ret;
+}
+
+static errcode_t pass2_init_worker(struct pass2_ctxt *pc,
+				   struct pass2_worker *pw)
+{
+	errcode_t ret;
+	ocfs2_filesys *fs;
+
+	ret = o2fsck_delta_open_fs(pc->pc_ost->ost_fs, &pw->pw_fs,
+				   PASS2_WORKER_CACHE);
+	if (ret)
+		return ret;
+	fs = &pw->pw_fs;
+
+	pw->pw_ctxt = pc;
+	pw->pw_ost = *pc->pc_ost;
+	pw->pw_ost.ost_fs = fs;
+	pw->pw_ost.ost_delta = NULL;
+
+	pw->pw_dd.ost = &pw->pw_ost;
+	pw->pw_dd.fs = fs;
+	o2fsck_strings_init(&pw->pw_dd.strings);
+
+	ret = ocfs2_malloc_block(fs->fs_io, &pw->pw_dd.dirblock_buf);
+	if (!ret)
+		ret = ocfs2_malloc_block(fs->fs_io, &pw->pw_dd.inoblock_buf);
+	if (!ret)
+		ret = ocfs2_malloc_blocks(fs->fs_io, PASS2_UNIT_BLOCKS,
+					  &pw->pw_prefetch_buf);
+	if (!ret)
+		ret = ocfs2_malloc(sizeof(struct io_vec_unit) *
+				   PASS2_UNIT_BLOCKS, &pw->pw_ivus);
+
+	return ret;
+}
+
+static errcode_t pass2_init_ctxt(struct pass2_ctxt *pc, o2fsck_state *ost,
+				 int nr_threads)
+{
+	errcode_t ret;
+	ocfs2_filesys *fs = ost->ost_fs;
+	int i, was_set;
+
+	memset(pc, 0, sizeof(struct pass2_ctxt));
+	pc->pc_ost = ost;
+	pc->pc_next = o2fsck_dir_block_first(&ost->ost_dirblocks);
+	pthread_mutex_init(&pc->pc_lock, NULL);
+	pthread_cond_init(&pc->pc_work, NULL);
+	pthread_cond_init(&pc->pc_done, NULL);
+
+	ret = ocfs2_malloc0(sizeof(struct pass2_unit) * nr_threads *
+			    PASS2_UNITS_PER_THREAD, &pc->pc_units);
+	if (ret)
+		goto out;
+	pc->pc_nr_units = nr_threads * PASS2_UNITS_PER_THREAD;
+
+	for (i = 0; i < pc->pc_nr_units; i++) {
+		o2fsck_delta_init(&pc->pc_units[i].pu_delta);
+		ret = pass2_grow_unit(&pc->pc_units[i], PASS2_UNIT_BLOCKS);
+		if (ret)
+			goto out;
+	}
+
+	/*
+	 * Testing for a block that no allocator covers loads them all.
+	 * The workers' copies of fs can then share them without ever
+	 * loading one themselves.
+	 */
+	ocfs2_test_inode_allocated(fs, fs->fs_blocks, &was_set);
+
+	ret = io_flush(fs->fs_io);
+	if (ret)
+		goto out;
+
+	ret = ocfs2_malloc0(sizeof(struct pass2_worker) * nr_threads,
+			    &pc->pc_workers);
+	if (ret)
+		goto out;
+	pc->pc_nr_workers = nr_threads;
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		ret = pass2_init_worker(pc, &pc->pc_workers[i]);
+		if (ret)
+			goto out;
+	}
+
+	for (i = 0; i < pc->pc_nr_workers; i++) {
+		if (pthread_create(&pc->pc_workers[i].pw_thread, NULL,
+				   pass2_worker_thread, &pc->pc_workers[i])) {
+			ret = OCFS2_ET_INTERNAL_FAILURE;
+			goto out;
+		}
+		pc->pc_workers[i].pw_started = 1;
+	}
+
+out:
+	if (ret)
+		pass2_free_ctxt(pc);
+	return ret;
+}
+
+/*
+ * Fills the next unit with whole runs.  The test for an allocated dir
+ * inode is quiet here; a worker that gets an error from it has the
+ * main thread report it.
+ */
+static void pass2_queue_unit(struct pass2_ctxt *pc)
+{
+	struct pass2_unit *pu = &pc->pc_units[pc->pc_queued %
+					      pc->pc_nr_units];
+	ocfs2_filesys *fs = pc->pc_ost->ost_fs;
+	o2fsck_dirblock_entry *dbe;
+	int skip, new_run, was_set;
+
+	pu->pu_nr = 0;
+	pu->pu_nr_runs = 0;
+	pu->pu_last_partial = 0;
+
+	for (; pc->pc_next; pc->pc_next = o2fsck_dir_block_next(dbe)) {
+		dbe = pc->pc_next;
+
+		skip = 0;
+		if (!ocfs2_test_inode_allocated(fs, dbe->e_ino, &was_set) &&
+		    !was_set)
+			skip = 1;
+
+		new_run = !skip && (dbe->e_ino != pc->pc_run_ino);
+		if (new_run && (pu->pu_nr >= PASS2_UNIT_BLOCKS))
+			break;
+
+		if (pass2_grow_unit(pu, pu->pu_nr ? pu->pu_nr * 2 : 1)) {
+			/* The main thread will finish the run, and the rest */
+			pu->pu_last_partial = 1;
+			pc->pc_serial = 1;
+			break;
+		}
+
+		if (new_run || !pu->pu_nr_runs) {
+			pu->pu_runs[pu->pu_nr_runs].pr_start = pu->pu_nr;
+			pu->pu_nr_runs++;
+		}
+		if (new_run)
+			pc->pc_run_ino = dbe->e_ino;
+
+		pu->pu_dbes[pu->pu_nr] = dbe;
+		pu->pu_skip[pu->pu_nr] = skip;
+		pu->pu_nr++;
+		pu->pu_runs[pu->pu_nr_runs - 1].pr_end = pu->pu_nr;
+	}
+
+	if (!pu->pu_nr)
+		return;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	pu->pu_done = 0;
+	pc->pc_queued++;
+	pthread_cond_signal(&pc->pc_work);
+	pthread_mutex_unlock(&pc->pc_lock);
+}
+
+/*
+ * Claims the subdirs a run found dirents for.  If one was claimed
+ * already, lets go of the run's claims and returns 0.
+ */
+static int pass2_claim_subdirs(o2fsck_state *ost, struct o2fsck_delta *delta,
+			       int start, int end)
+{
+	struct o2fsck_delta_rec *dr;
+	o2fsck_dir_parent *dp;
+	int i;
+
+	for (i = start; i < end; i++) {
+		dr = &delta->d_recs[i];
+		if (dr->dr_type != O2FSCK_DELTA_DIRENT)
+			continue;
+
+		dp = o2fsck_dir_parent_lookup(&ost->ost_dir_parents,
+					      dr->dr_a);
+		if (!dp || dp->dp_dirent)
+			break;
+		dp->dp_dirent = dr->dr_b;
+	}
+
+	if (i == end)
+		return 1;
+
+	while (i-- > start) {
+		dr = &delta->d_recs[i];
+		if (dr->dr_type != O2FSCK_DELTA_DIRENT)
+			continue;
+		dp = o2fsck_dir_parent_lookup(&ost->ost_dir_parents,
+					      dr->dr_a);
+		dp->dp_dirent = 0;
+	}
+
+	return 0;
+}
+
+/* Takes back the oldest unit, in block order */
+static unsigned pass2_apply_unit(struct pass2_ctxt *pc,
+				 struct dirblock_data *dd, uint64_t fixes)
+{
+	o2fsck_state *ost = pc->pc_ost;
+	struct pass2_unit *pu = &pc->pc_units[pc->pc_applied %
+					      pc->pc_nr_units];
+	struct o2fsck_delta *delta = &pu->pu_delta;
+	struct pass2_run *pr;
+	unsigned ret_flags = 0;
+	errcode_t ret;
+	int i, r, ok;
+
+	pthread_mutex_lock(&pc->pc_lock);
+	while (!pu->pu_done)
+		pthread_cond_wait(&pc->pc_done, &pc->pc_lock);
+	pthread_mutex_unlock(&pc->pc_lock);
+
+	for (r = 0; r < pu->pu_nr_runs; r++) {
+		pr = &pu->pu_runs[r];
+
+		ok = pr->pr_ok && (ost->ost_fixes == fixes) &&
+			!(pu->pu_last_partial && (r == pu->pu_nr_runs - 1)) &&
+			pass2_claim_subdirs(ost, delta,
+					    pu->pu_first_rec[pr->pr_start],
+					    pu->pu_first_rec[pr->pr_end]);
+
+		for (i = pr->pr_start; i < pr->pr_end; i++) {
+			if (!ok || pu->pu_skip[i]) {
+				ret_flags |= pass2_dir_block_iterate(
+							pu->pu_dbes[i], dd);
+				if (ret_flags & OCFS2_DIRENT_ABORT)
+					goto out;
+				continue;
+			}
+
+			ret = o2fsck_delta_replay(ost, delta,
+						  pu->pu_first_rec[i],
+						  pu->pu_first_rec[i + 1]);
+			if (ret) {
+				com_err(whoami, ret, "while recording the "
+					"entries of directory inode %"PRIu64,
+					pu->pu_dbes[i]->e_ino);
+				ret_flags |= OCFS2_DIRENT_ABORT;
+				goto out;
+			}
+		}
+
+		/* the next run is a different dir, so start it afresh */
+		if (ok) {
+			o2fsck_strings_free(&dd->strings);
+			dd->last_ino = 0;
+		}
+	}
+
+out:
+	pc->pc_applied++;
+	return ret_flags;
+}
+
+/*
+ * Walks the dirblocks with nr_threads workers.  Returns the entry the
+ * caller is to carry on from alone, or NULL when it's all done.
+ */
+static o2fsck_dirblock_entry *pass2_iterate_threaded(o2fsck_state *ost,
+						     struct dirblock_data *dd,
+						     int nr_threads)
+{
+	struct pass2_ctxt pc;
+	uint64_t fixes = ost->ost_fixes;
+	o2fsck_dirblock_entry *next;
+	unsigned ret_flags;
+
+	/* Without the threads we can still go it alone */
+	if (pass2_init_ctxt(&pc, ost, nr_threads))
+		return o2fsck_dir_block_first(&ost->ost_dirblocks);
+
+	o2fsck_delta_hook_com_err();
+
+	for (;;) {
+		while (pc.pc_next && !pc.pc_serial &&
+		       (ost->ost_fixes == fixes) &&
+		       (pc.pc_queued - pc.pc_applied < pc.pc_nr_units))
+			pass2_queue_unit(&pc);
+
+		if (pc.pc_applied == pc.pc_queued)
+			break;
+
+		ret_flags = pass2_apply_unit(&pc, dd, fixes);
+		if (ret_flags & OCFS2_DIRENT_ABORT) {
+			pc.pc_next = NULL;
+			break;
+		}
+	}
+
+	next = pc.pc_next;
+
+	o2fsck_delta_unhook_com_err();
+	pass2_free_ctxt(&pc);
+	return next;
+}
+
 errcode_t o2fsck_pass2(o2fsck_state *ost)
 {
 	o2fsck_dir_parent *dp;
+	o2fsck_dirblock_entry *dbe;
 	errcode_t ret;
+	int nr_threads;
 	struct dirblock_data dd = {
 		.ost = ost,
 		.fs = ost->ost_fs,
@@ -880,7 +1458,21 @@ errcode_t o2fsck_pass2(o2fsck_state *ost)
 	if (dp)
 		dp->dp_dirent = ost->ost_fs->fs_sysdir_blkno;
 
-	o2fsck_dir_block_iterate(ost, pass2_dir_block_iterate, &dd);
+	ret = o2fsck_dir_block_sort(ost);
+	if (ret) {
+		com_err(whoami, ret, "while sorting directory blocks");
+		goto out;
+	}
+
+	nr_threads = o2fsck_delta_nr_threads(ost, PASS2_MAX_THREADS);
+	if (nr_threads > 1) {
+		dbe = pass2_iterate_threaded(ost, &dd, nr_threads);
+		if (dbe)
+			o2fsck_dir_block_iterate_from(ost, dbe,
+						      pass2_dir_block_iterate,
+						      &dd);
+	} else
+		o2fsck_dir_block_iterate(ost, pass2_dir_block_iterate, &dd);
 	o2fsck_strings_free(&dd.strings);
 out:
 	if (dd.dirblock_buf)
@@ -38,6 +38,7 @@
 
 #include "ocfs2/ocfs2.h"
 
+#include "delta.h"
 #include "problem.h"
 #include "util.h"
 
@@ -98,6 +99,12 @@ int prompt_input(o2fsck_state *ost, unsigned flags, struct prompt_code code,
 	int c, ans = 0;
 	static char yes[] = " <y> ", no[] = " <n> ";
 
+	/* a worker thread can't ask; the main thread will ask in order */
+	if (ost->ost_delta) {
+		o2fsck_delta_fail(ost->ost_delta);
+		return 0;
+	}
+
 	/* paranoia for jokers that claim to default to both */
 	if((flags & PY) && (flags & PN))
 		flags &= ~PY;
@@ -161,5 +168,8 @@ int prompt_input(o2fsck_state *ost, unsigned flags, struct prompt_code code,
 	else
 		printf("%c\n", ans);
 
+	if (ans == 'y')
+		ost->ost_fixes++;
+
 	return ans == 'y';
 }
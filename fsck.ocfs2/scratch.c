@@ -0,0 +1,293 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * scratch.c
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * --
+ *
+ * The -S arena.  One unlinked file in the scratch directory grows a
+ * segment at a time, and each segment is mmap()ed shared.  Because the
+ * pages belong to a file rather than to us, the kernel can write them
+ * back and drop them when memory is short, and fault them in again
+ * when we come back.  The page cache is our pager; fsck sees plain
+ * pointers.
+ *
+ * Each segment's blocks are reserved when the file grows, so a full
+ * scratch file system fails the allocation rather than raising SIGBUS
+ * on a later store.  When carving moves on to a new segment, the old
+ * one is pushed to writeback and dropped from our mappings.  Its
+ * blocks are still in use, but they come back from the file as they
+ * are touched.  That keeps the dirty pages we hold to about a segment
+ * plus whatever is being worked on; past that, how much stays cached
+ * is up to the kernel.
+ *
+ * Allocations round up to a power of two.  Freed blocks go on a list
+ * for their size and are handed out again before we carve more off the
+ * current segment.  Anything bigger than a segment gets a segment to
+ * itself.  Nothing is ever given back to the file, which is fine for
+ * state that lives until fsck exits.
+ */
+#define _LARGEFILE64_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "ocfs2/ocfs2.h"
+
+#include "fsck.h"
+#include "scratch.h"
+
+#define SCRATCH_SEGMENT_SIZE	(64ULL * 1024 * 1024)
+#define SCRATCH_MIN_SHIFT	4
+#define SCRATCH_NR_CLASSES	64
+
+struct scratch_free {
+	struct scratch_free	*sf_next;
+};
+
+struct scratch_arena {
+	char			*sa_dir;
+	int			sa_fd;
+	uint64_t		sa_file_size;	/* bytes of the file mapped */
+	size_t			sa_page_size;
+	char			*sa_seg;	/* carving out of this segment */
+	char			*sa_cur;
+	size_t			sa_cur_left;
+	struct scratch_free	*sa_free[SCRATCH_NR_CLASSES];
+};
+
+static struct scratch_arena *arena;
+
+static unsigned int scratch_class(size_t size)
+{
+	unsigned int shift = SCRATCH_MIN_SHIFT;
+
+	while (((size_t)1 << shift) < size)
+		shift++;
+	return shift;
+}
+
+/*
+ * Grows the file by len bytes and maps the new piece.  The blocks are
+ * allocated up front; a page the file can't back would SIGBUS us.
+ */
+static void *scratch_map_segment(size_t len)
+{
+	void *seg;
+	int err;
+
+	err = posix_fallocate64(arena->sa_fd, arena->sa_file_size, len);
+	if (err) {
+		com_err("scratch", err, "while growing the scratch file in %s",
+			arena->sa_dir);
+		ftruncate64(arena->sa_fd, arena->sa_file_size);
+		return NULL;
+	}
+
+	seg = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   arena->sa_fd, arena->sa_file_size);
+	if (seg == MAP_FAILED) {
+		ftruncate64(arena->sa_fd, arena->sa_file_size);
+		return NULL;
+	}
+
+	arena->sa_file_size += len;
+	return seg;
+}
+
+/*
+ * Blocks are aligned to their size, up to a page, so a block never
+ * straddles more pages than it has to.
+ */
+static void *scratch_carve(size_t len)
+{
+	size_t align = len < arena->sa_page_size ? len : arena->sa_page_size;
+	size_t pad = (align - ((unsigned long)arena->sa_cur % align)) % align;
+	void *ptr;
+
+	if (arena->sa_cur && (pad + len) <= arena->sa_cur_left) {
+		ptr = arena->sa_cur + pad;
+		arena->sa_cur += pad + len;
+		arena->sa_cur_left -= pad + len;
+		return ptr;
+	}
+
+	ptr = scratch_map_segment(SCRATCH_SEGMENT_SIZE);
+	if (ptr == NULL)
+		return NULL;
+
+	/* Done carving the last one; let the kernel have its pages */
+	if (arena->sa_seg) {
+		msync(arena->sa_seg, SCRATCH_SEGMENT_SIZE, MS_ASYNC);
+		madvise(arena->sa_seg, SCRATCH_SEGMENT_SIZE, MADV_DONTNEED);
+	}
+
+	arena->sa_seg = ptr;
+	arena->sa_cur = (char *)ptr + len;
+	arena->sa_cur_left = SCRATCH_SEGMENT_SIZE - len;
+	return ptr;
+}
+
+void *o2fsck_scratch_alloc(size_t size)
+{
+	unsigned int class;
+	size_t len;
+	struct scratch_free *sf;
+
+	if (!arena)
+		return malloc(size);
+
+	class = scratch_class(size);
+	len = (size_t)1 << class;
+
+	if (len > SCRATCH_SEGMENT_SIZE) {
+		len = (size + arena->sa_page_size - 1) &
+			~(arena->sa_page_size - 1);
+		return scratch_map_segment(len);
+	}
+
+	sf = arena->sa_free[class];
+	if (sf) {
+		arena->sa_free[class] = sf->sf_next;
+		return sf;
+	}
+
+	return scratch_carve(len);
+}
+
+void *o2fsck_scratch_alloc0(size_t size)
+{
+	void *ptr;
+
+	if (!arena)
+		return calloc(1, size);
+
+	ptr = o2fsck_scratch_alloc(size);
+	if (ptr)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+void o2fsck_scratch_free(void *ptr, size_t size)
+{
+	unsigned int class;
+	struct scratch_free *sf = ptr;
+
+	if (!arena) {
+		free(ptr);
+		return;
+	}
+
+	if (ptr == NULL)
+		return;
+
+	class = scratch_class(size);
+	if (((size_t)1 << class) > SCRATCH_SEGMENT_SIZE) {
+		munmap(ptr, (size + arena->sa_page_size - 1) &
+			    ~(arena->sa_page_size - 1));
+		return;
+	}
+
+	sf->sf_next = arena->sa_free[class];
+	arena->sa_free[class] = sf;
+}
+
+void *o2fsck_scratch_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+	void *new_ptr;
+
+	if (!arena)
+		return realloc(ptr, new_size);
+
+	if (ptr && scratch_class(old_size) == scratch_class(new_size) &&
+	    ((size_t)1 << scratch_class(new_size)) <= SCRATCH_SEGMENT_SIZE)
+		return ptr;
+
+	new_ptr = o2fsck_scratch_alloc(new_size);
+	if (new_ptr == NULL)
+		return NULL;
+
+	if (ptr) {
+		memcpy(new_ptr, ptr,
+		       old_size < new_size ? old_size : new_size);
+		o2fsck_scratch_free(ptr, old_size);
+	}
+	return new_ptr;
+}
+
+int o2fsck_scratch_enabled(void)
+{
+	return arena != NULL;
+}
+
+errcode_t o2fsck_scratch_bitmap_new(ocfs2_filesys *fs, uint64_t total_bits,
+				    const char *description,
+				    ocfs2_bitmap **ret_bitmap)
+{
+	if (!arena)
+		return ocfs2_sparse_bitmap_new(fs, total_bits, description,
+					       ret_bitmap);
+
+	return ocfs2_scratch_bitmap_new(fs, total_bits, description,
+					arena->sa_dir, ret_bitmap);
+}
+
+errcode_t o2fsck_scratch_init(const char *dir)
+{
+	errcode_t ret;
+	char *template = NULL;
+	struct scratch_arena *sa = NULL;
+
+	ret = ocfs2_malloc0(sizeof(struct scratch_arena), &sa);
+	if (ret)
+		goto out;
+
+	ret = ocfs2_malloc(strlen(dir) + 1, &sa->sa_dir);
+	if (ret)
+		goto out;
+	strcpy(sa->sa_dir, dir);
+
+	ret = ocfs2_malloc(strlen(dir) + sizeof("/fsck.ocfs2-XXXXXX"),
+			   &template);
+	if (ret)
+		goto out;
+	sprintf(template, "%s/fsck.ocfs2-XXXXXX", dir);
+
+	sa->sa_fd = mkstemp(template);
+	if (sa->sa_fd < 0) {
+		ret = errno;
+		goto out;
+	}
+	unlink(template);
+
+	sa->sa_page_size = sysconf(_SC_PAGESIZE);
+	arena = sa;
+	sa = NULL;
+
+out:
+	if (sa) {
+		if (sa->sa_dir)
+			ocfs2_free(&sa->sa_dir);
+		ocfs2_free(&sa);
+	}
+	if (template)
+		ocfs2_free(&template);
+	return ret;
+}
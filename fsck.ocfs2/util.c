@@ -33,6 +33,11 @@
 #include <unistd.h>
 #include "ocfs2/ocfs2.h"
 
+#include "delta.h"
+#include "dirblocks.h"
+#include "dirparents.h"
+#include "icount.h"
+#include "scratch.h"
 #include "util.h"
 
 void o2fsck_write_inode(o2fsck_state *ost, uint64_t blkno,
@@ -41,6 +46,12 @@ void o2fsck_write_inode(o2fsck_state *ost, uint64_t blkno,
 	errcode_t ret;
 	const char *whoami = __FUNCTION__;
 
+	/* Workers don't write */
+	if (ost->ost_delta) {
+		o2fsck_delta_fail(ost->ost_delta);
+		return;
+	}
+
 	if (blkno != di->i_blkno) {
 		com_err(whoami, OCFS2_ET_INTERNAL_FAILURE, "when asked to "
 			"write an inode with an i_blkno of %"PRIu64" to block "
@@ -62,6 +73,12 @@ void o2fsck_mark_cluster_allocated(o2fsck_state *ost, uint32_t cluster)
 	errcode_t ret;
 	const char *whoami = __FUNCTION__;
 
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_CLUSTERS,
+				 cluster, 1, 0);
+		return;
+	}
+
 	o2fsck_bitmap_set(ost->ost_allocated_clusters, cluster, &was_set);
 
 	if (!was_set)
@@ -71,9 +88,10 @@ void o2fsck_mark_cluster_allocated(o2fsck_state *ost, uint32_t cluster)
 		fprintf(stderr,
 			"Duplicate clusters detected.  Pass 1b will be run\n");
 
-		ret = ocfs2_cluster_bitmap_new(ost->ost_fs,
-					       "duplicate clusters",
-					       &ost->ost_duplicate_clusters);
+		ret = o2fsck_scratch_bitmap_new(ost->ost_fs,
+						ost->ost_fs->fs_clusters,
+						"duplicate clusters",
+						&ost->ost_duplicate_clusters);
 		if (ret) {
 			com_err(whoami, ret,
 				"while allocating duplicate cluster bitmap");
@@ -89,6 +107,12 @@ void o2fsck_mark_cluster_allocated(o2fsck_state *ost, uint32_t cluster)
 void o2fsck_mark_clusters_allocated(o2fsck_state *ost, uint32_t cluster,
 				    uint32_t num)
 {
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_CLUSTERS,
+				 cluster, num, 0);
+		return;
+	}
+
 	while(num--)
 		o2fsck_mark_cluster_allocated(ost, cluster++);
 }
@@ -97,9 +121,68 @@ void o2fsck_mark_cluster_unallocated(o2fsck_state *ost, uint32_t cluster)
 {
 	int was_set;
 
+	/* Only ever done to repair; workers leave that to the main thread */
+	if (ost->ost_delta) {
+		o2fsck_delta_fail(ost->ost_delta);
+		return;
+	}
+
 	o2fsck_bitmap_clear(ost->ost_allocated_clusters, cluster, &was_set);
 }
 
+/*
+ * What pass 1 learns about each inode goes through these, so that a
+ * worker thread can record it in its delta instead.
+ */
+void o2fsck_mark_dir_inode(o2fsck_state *ost, uint64_t blkno, int orphaned)
+{
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_DIR_INODE,
+				 blkno, !!orphaned, 0);
+		return;
+	}
+
+	o2fsck_bitmap_set(ost->ost_dir_inodes, blkno, NULL);
+	o2fsck_add_dir_parent(&ost->ost_dir_parents, blkno, 0, 0,
+			      !!orphaned);
+}
+
+void o2fsck_mark_reg_inode(o2fsck_state *ost, uint64_t blkno)
+{
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_REG_INODE,
+				 blkno, 0, 0);
+		return;
+	}
+
+	o2fsck_bitmap_set(ost->ost_reg_inodes, blkno, NULL);
+}
+
+void o2fsck_mark_inode_links(o2fsck_state *ost, uint64_t blkno,
+			     uint16_t links)
+{
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_LINKS,
+				 blkno, links, 0);
+		return;
+	}
+
+	o2fsck_icount_set(ost->ost_icount_in_inodes, blkno, links);
+}
+
+errcode_t o2fsck_mark_dir_block(o2fsck_state *ost, uint64_t ino,
+				uint64_t blkno, uint64_t blkcount)
+{
+	if (ost->ost_delta) {
+		o2fsck_delta_add(ost->ost_delta, O2FSCK_DELTA_DIR_BLOCK,
+				 ino, blkno, blkcount);
+		return 0;
+	}
+
+	return o2fsck_add_dir_block(&ost->ost_dirblocks, ino, blkno,
+				    blkcount);
+}
+
 errcode_t o2fsck_type_from_dinode(o2fsck_state *ost, uint64_t ino,
 				  uint8_t *type)
 {
@@ -202,6 +285,32 @@ static int cache_blocks;
  */
 static int blocks_cached;
 
+/*
+ * Tell the user how the cache memory turned out if they asked for
+ * something special.  Faulting in a big cache can take a while, so
+ * that's worth knowing too.
+ */
+static void report_cache(o2fsck_state *ost)
+{
+	struct io_cache_stats stats;
+
+	if (io_get_cache_stats(ost->ost_fs->fs_io, &stats))
+		return;
+
+	verbosef("I/O cache flags 0x%x, faulted in after %"PRIu64" usecs\n",
+		 stats.ics_flags, stats.ics_fault_usecs);
+
+	if (!ost->ost_cache_flags)
+		return;
+
+	printf("I/O cache of %"PRIu64" blocks%s%s, faulted in after "
+	       "%"PRIu64".%03"PRIu64" seconds\n", (uint64_t)cache_blocks,
+	       (stats.ics_flags & IO_CACHE_HUGEPAGES) ? ", huge pages" : "",
+	       (stats.ics_flags & IO_CACHE_INTERLEAVE) ? ", interleaved" : "",
+	       stats.ics_fault_usecs / 1000000,
+	       (stats.ics_fault_usecs % 1000000) / 1000);
+}
+
 void o2fsck_init_cache(o2fsck_state *ost, enum o2fsck_cache_hint hint)
 {
 	errcode_t ret;
@@ -249,7 +358,8 @@ void o2fsck_init_cache(o2fsck_state *ost, enum o2fsck_cache_hint hint)
 		io_destroy_cache(fs->fs_io);
 		verbosef("Asking for %"PRIu64" blocks of I/O cache\n",
 			 blocks_wanted);
-		ret = io_init_cache(fs->fs_io, blocks_wanted);
+		ret = io_init_cache_flags(fs->fs_io, blocks_wanted,
+					  ost->ost_cache_flags);
 		if (!ret) {
 			/*
 			 * We want to pin our cache; there's no point in
@@ -272,6 +382,7 @@ void o2fsck_init_cache(o2fsck_state *ost, enum o2fsck_cache_hint hint)
 			 */
 			if (!leave_room) {
 				cache_blocks = blocks_wanted;
+				report_cache(ost);
 				break;
 			}
 
@@ -105,4 +105,5 @@ errcode_t ocfs2_image_alloc_bitmap(ocfs2_filesys *ofs);
 void ocfs2_image_mark_bitmap(ocfs2_filesys *ofs, uint64_t blkno);
 int ocfs2_image_test_bit(ocfs2_filesys *ofs, uint64_t blkno);
 uint64_t ocfs2_image_get_blockno(ocfs2_filesys *ofs, uint64_t blkno);
+uint64_t ocfs2_image_count_bits(ocfs2_filesys *ofs);
 void ocfs2_image_swap_header(struct ocfs2_image_hdr *hdr);
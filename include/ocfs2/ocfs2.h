@@ -87,6 +87,10 @@
 #define OCFS2_FLAG_HEARTBEAT_DEV_OK	0x40
 #define OCFS2_FLAG_STRICT_COMPAT_CHECK	0x80
 #define OCFS2_FLAG_IMAGE_FILE	      0x0100
+#define OCFS2_FLAG_ASYNC_IO		0x0200	/* Use kernel AIO for the
+						   io_*_async() calls */
+#define OCFS2_FLAG_MMAP		0x0400	/* Read a RO channel through
+						   a shared mapping */
 
 /* Return flags for the directory iterator functions */
 #define OCFS2_DIRENT_CHANGED	0x01
@@ -171,6 +175,7 @@ struct _ocfs2_cached_inode {
 	uint64_t ci_blkno;
 	struct ocfs2_dinode *ci_inode;
 	ocfs2_bitmap *ci_chains;
+	struct _ocfs2_extent_map *ci_map;
 };
 
 struct ocfs2_slot_data {
@@ -218,6 +223,8 @@ errcode_t ocfs2_malloc_blocks(io_channel *channel, int num_blocks,
 errcode_t ocfs2_malloc_block(io_channel *channel, void *ptr);
 
 errcode_t io_open(const char *name, int flags, io_channel **channel);
+errcode_t io_open_helper(io_channel *parent, int flags,
+			 io_channel **channel);
 errcode_t io_close(io_channel *channel);
 int io_get_error(io_channel *channel);
 errcode_t io_set_blksize(io_channel *channel, int blksize);
@@ -246,11 +253,155 @@ errcode_t io_write_block(io_channel *channel, int64_t blkno, int count,
 			 const char *data);
 errcode_t io_write_block_nocache(io_channel *channel, int64_t blkno, int count,
 			 const char *data);
+/*
+ * io_read_blocks_v() reads many discontiguous ranges in one call.  Each
+ * io_vec_unit reads ivu_count blocks at ivu_blkno into ivu_buf, which
+ * must come from ocfs2_malloc_blocks().  The ranges may come in any
+ * order; the channel sorts them and merges neighbours into large I/Os.
+ */
+struct io_vec_unit {
+	int64_t ivu_blkno;
+	int ivu_count;
+	char *ivu_buf;
+};
+errcode_t io_read_blocks_v(io_channel *channel, struct io_vec_unit *ivus,
+			   int nr);
+/*
+ * io_get_block() returns a read-only pointer to a block, pinned in the
+ * cache when possible, so the caller doesn't need to copy it.  Every
+ * successful io_get_block() must be matched by an io_put_block().
+ */
+errcode_t io_get_block(io_channel *channel, int64_t blkno,
+		       const char **buf);
+void io_put_block(io_channel *channel, const char *buf);
 errcode_t io_init_cache(io_channel *channel, size_t nr_blocks);
+/*
+ * Flags for io_init_cache_flags().  They are hints about how to back
+ * the cache memory; the cache works the same without them.
+ */
+#define IO_CACHE_HUGEPAGES	0x01	/* Use huge pages if we can */
+#define IO_CACHE_INTERLEAVE	0x02	/* Spread over all NUMA nodes */
+errcode_t io_init_cache_flags(io_channel *channel, size_t nr_blocks,
+			      int flags);
 void io_set_nocache(io_channel *channel, bool nocache);
 errcode_t io_init_cache_size(io_channel *channel, size_t bytes);
 errcode_t io_mlock_cache(io_channel *channel);
 void io_destroy_cache(io_channel *channel);
+/*
+ * In write-back mode, writes stay in the cache until io_flush(),
+ * io_close(), or until the cache needs the buffers.  They are written
+ * out sorted and coalesced.
+ */
+errcode_t io_set_writeback(io_channel *channel, bool writeback);
+errcode_t io_flush(io_channel *channel);
+/*
+ * Cached channels watch for sequential and strided reads and prefetch
+ * up to max_blocks ahead.  A new cache starts with a 1MB window.  Zero
+ * turns readahead off.
+ */
+errcode_t io_set_readahead(io_channel *channel, int max_blocks);
+
+/*
+ * Counted in blocks.  A hit is a block that didn't need a disk read.
+ * Readahead blocks were read speculatively and are not misses.
+ */
+struct io_cache_stats {
+	uint64_t ics_hits;
+	uint64_t ics_misses;
+	uint64_t ics_evictions;
+	uint64_t ics_readahead;
+	int ics_flags;			/* IO_CACHE_* flags in effect */
+	uint64_t ics_fault_usecs;	/* Time io_mlock_cache() took */
+};
+errcode_t io_get_cache_stats(io_channel *channel,
+			     struct io_cache_stats *stats);
+
+/*
+ * Asynchronous I/O.  Fill in ar_blkno, ar_count, and ar_buf, then queue
+ * the request.  io_async_wait() returns completed requests with ar_ret
+ * set.  ar_private is for the caller.  The channel uses kernel AIO if it
+ * was opened with OCFS2_FLAG_ASYNC_IO; otherwise requests complete
+ * synchronously when queued.  Either way, completed reads and writes
+ * update the I/O cache just like io_read_block() and io_write_block().
+ * io_close() finishes anything still queued, so buffers must stay
+ * valid until the request is reaped or the channel is closed.
+ */
+#define IO_ASYNC_READ	1
+#define IO_ASYNC_WRITE	2
+
+struct io_async_req {
+	struct list_head ar_list;	/* Private to the io_channel */
+	int ar_op;
+	int64_t ar_blkno;
+	int ar_count;
+	char *ar_buf;
+	errcode_t ar_ret;
+	void *ar_private;
+};
+
+errcode_t io_read_blocks_async(io_channel *channel, struct io_async_req *req);
+errcode_t io_write_blocks_async(io_channel *channel,
+				struct io_async_req *req);
+errcode_t io_async_submit(io_channel *channel);
+errcode_t io_async_wait(io_channel *channel, int min_nr, int max_nr,
+			struct io_async_req **reqs, int *nr);
+int io_async_outstanding(io_channel *channel);
+
+/*
+ * I/O statistics.  Once enabled, every disk request the channel makes
+ * is counted by op and bytes, and its latency goes into a histogram
+ * indexed by log2(blocks in the request) and log2(nanoseconds).
+ *
+ * If trace_entries is non-zero, the last trace_entries requests are
+ * also kept in a ring.  io_get_trace() copies them out oldest first.
+ *
+ * Setting OCFS2_IO_STATS in the environment enables statistics in
+ * io_open() and prints them to stderr at io_close().  Channels from
+ * io_open_helper() don't read the environment; they add their counts
+ * into the parent's.  Setting
+ * OCFS2_IO_TRACE to a file name also keeps a trace, which io_close()
+ * appends to that file as a struct io_trace_hdr followed by
+ * ith_nr_recs struct io_trace_recs.
+ */
+#define IO_STATS_READ		0
+#define IO_STATS_WRITE		1
+#define IO_STATS_NR_OPS		2
+#define IO_STATS_SIZE_BUCKETS	17
+#define IO_STATS_LAT_BUCKETS	40
+
+struct io_op_stats {
+	uint64_t ios_requests;
+	uint64_t ios_bytes;
+	uint64_t ios_ns;
+	uint64_t ios_errors;
+	uint64_t ios_hist[IO_STATS_SIZE_BUCKETS][IO_STATS_LAT_BUCKETS];
+};
+
+struct io_stats {
+	struct io_op_stats is_ops[IO_STATS_NR_OPS];
+};
+
+#define IO_TRACE_MAGIC		"O2IOTRC1"
+
+struct io_trace_hdr {
+	char ith_magic[8];
+	uint32_t ith_blksize;
+	uint32_t ith_nr_recs;
+};
+
+struct io_trace_rec {
+	uint64_t itr_blkno;
+	uint32_t itr_count;	/* In blocks */
+	uint32_t itr_op;	/* IO_STATS_READ or IO_STATS_WRITE */
+	uint64_t itr_start;	/* ns since stats were enabled */
+	uint64_t itr_ns;	/* How long it took */
+};
+
+errcode_t io_enable_stats(io_channel *channel, int trace_entries);
+void io_disable_stats(io_channel *channel);
+errcode_t io_get_stats(io_channel *channel, struct io_stats *stats);
+int io_get_trace(io_channel *channel, struct io_trace_rec *recs, int nr);
+errcode_t io_print_stats(io_channel *channel, FILE *out);
 
 errcode_t ocfs2_read_super(ocfs2_filesys *fs, uint64_t superblock, char *sb);
 /* Writes the main superblock at OCFS2_SUPER_BLOCK_BLKNO */
@@ -267,6 +418,19 @@ errcode_t ocfs2_read_blocks(ocfs2_filesys *fs, int64_t blkno, int count,
 			    char *data);
 errcode_t ocfs2_read_blocks_nocache(ocfs2_filesys *fs, int64_t blkno, int count,
 				    char *data);
+/* The image-aware wrapper around io_read_blocks_v() */
+errcode_t ocfs2_read_blocks_v(ocfs2_filesys *fs, struct io_vec_unit *ivus,
+			      int nr);
+/*
+ * ocfs2_get_block() is the image-aware wrapper around io_get_block().
+ * ocfs2_get_meta_block() also validates the check information at
+ * bc_offset in the block.  Release both with ocfs2_put_block().
+ */
+errcode_t ocfs2_get_block(ocfs2_filesys *fs, int64_t blkno,
+			  const char **buf);
+errcode_t ocfs2_get_meta_block(ocfs2_filesys *fs, int64_t blkno,
+			       size_t bc_offset, const char **buf);
+void ocfs2_put_block(ocfs2_filesys *fs, const char *buf);
 int ocfs2_mount_local(ocfs2_filesys *fs);
 errcode_t ocfs2_open(const char *name, int flags,
 		     unsigned int superblock, unsigned int blksize,
@@ -311,6 +475,12 @@ errcode_t ocfs2_get_clusters(ocfs2_cached_inode *cinode,
 			     uint32_t *p_cluster,
 			     uint32_t *num_clusters,
 			     uint16_t *extent_flags);
+/*
+ * ocfs2_get_clusters() remembers the leaves it reads in cinode.  Anyone
+ * changing the extent tree behind the cached inode's back (through a
+ * separate dinode buffer, say) must drop those before the next lookup.
+ */
+void ocfs2_extent_map_drop(ocfs2_cached_inode *cinode);
 int ocfs2_find_leaf(ocfs2_filesys *fs, struct ocfs2_dinode *di,
 		    uint32_t cpos, char **leaf_buf);
 int ocfs2_search_extent_list(struct ocfs2_extent_list *el, uint32_t v_cluster);
@@ -399,6 +569,40 @@ errcode_t ocfs2_open_inode_scan(ocfs2_filesys *fs,
 void ocfs2_close_inode_scan(ocfs2_inode_scan *scan);
 errcode_t ocfs2_get_next_inode(ocfs2_inode_scan *scan,
 			       uint64_t *blkno, char *inode);
+/*
+ * An inode scan reads ahead on a helper thread, keeping up to depth
+ * buffers of inode blocks ready.  The helper reads the device on its own
+ * channel, so a scan may miss what the caller writes to inodes it has
+ * not got to yet.  Set the depth before the first
+ * ocfs2_get_next_inode(); zero turns prefetch off.
+ */
+#define OCFS2_INODE_SCAN_PREFETCH_DEPTH	4
+errcode_t ocfs2_inode_scan_set_prefetch(ocfs2_inode_scan *scan, int depth);
+
+/*
+ * For splitting a scan across threads.  ocfs2_get_inode_groups() lists
+ * every inode group in the order a full scan reads them; free the list
+ * with ocfs2_free().  ig_bits counts the group descriptor.
+ * ocfs2_partition_inode_groups() cuts the list into parts runs of about
+ * the same number of blocks: part i is groups[bounds[i]] up to
+ * groups[bounds[i + 1]], so bounds needs parts + 1 entries.
+ * ocfs2_open_inode_scan_range() scans just the groups it is given.
+ * Scans run in different threads each need their own ocfs2_filesys.
+ */
+struct ocfs2_inode_group {
+	uint64_t ig_alloc_blkno;	/* The inode alloc file */
+	uint64_t ig_blkno;		/* The group descriptor */
+	uint32_t ig_bits;
+};
+errcode_t ocfs2_get_inode_groups(ocfs2_filesys *fs,
+				 struct ocfs2_inode_group **ret_groups,
+				 int *ret_nr);
+void ocfs2_partition_inode_groups(struct ocfs2_inode_group *groups,
+				  int nr_groups, int parts, int *bounds);
+errcode_t ocfs2_open_inode_scan_range(ocfs2_filesys *fs,
+				      struct ocfs2_inode_group *groups,
+				      int nr_groups,
+				      ocfs2_inode_scan **ret_scan);
 
 errcode_t ocfs2_open_dir_scan(ocfs2_filesys *fs, uint64_t dir, int flags,
 			      ocfs2_dir_scan **ret_scan);
@@ -412,6 +616,16 @@ errcode_t ocfs2_cluster_bitmap_new(ocfs2_filesys *fs,
 errcode_t ocfs2_block_bitmap_new(ocfs2_filesys *fs,
 				 const char *description,
 				 ocfs2_bitmap **ret_bitmap);
+errcode_t ocfs2_sparse_bitmap_new(ocfs2_filesys *fs,
+				  uint64_t total_bits,
+				  const char *description,
+				  ocfs2_bitmap **ret_bitmap);
+/* Like a sparse bitmap, but the bits live in an unlinked file in dir */
+errcode_t ocfs2_scratch_bitmap_new(ocfs2_filesys *fs,
+				   uint64_t total_bits,
+				   const char *description,
+				   const char *dir,
+				   ocfs2_bitmap **ret_bitmap);
 void ocfs2_bitmap_free(ocfs2_bitmap *bitmap);
 errcode_t ocfs2_bitmap_set(ocfs2_bitmap *bitmap, uint64_t bitno,
 			   int *oldval);
@@ -646,11 +860,32 @@ void ocfs2_compute_meta_ecc(ocfs2_filesys *fs, void *data,
 			    struct ocfs2_block_check *bc);
 errcode_t ocfs2_validate_meta_ecc(ocfs2_filesys *fs, void *data,
 				  struct ocfs2_block_check *bc);
+/* The same over nr blocks at once; bc[i] is the check for data[i] */
+void ocfs2_compute_meta_ecc_many(ocfs2_filesys *fs, void **data,
+				 struct ocfs2_block_check **bc, int nr);
+errcode_t ocfs2_validate_meta_ecc_many(ocfs2_filesys *fs, void **data,
+				       struct ocfs2_block_check **bc, int nr,
+				       errcode_t *errs);
 /* Low level checksum compute functions.  Use the high-level ones. */
 extern void ocfs2_block_check_compute(void *data, size_t blocksize,
 				      struct ocfs2_block_check *bc);
 extern errcode_t ocfs2_block_check_validate(void *data, size_t blocksize,
 					    struct ocfs2_block_check *bc);
+extern errcode_t ocfs2_block_check_verify(const void *data, size_t blocksize,
+					  const struct ocfs2_block_check *bc);
+extern void ocfs2_block_check_compute_many(void **data, size_t blocksize,
+					   struct ocfs2_block_check **bc,
+					   int nr);
+extern errcode_t ocfs2_block_check_validate_many(void **data,
+						 size_t blocksize,
+						 struct ocfs2_block_check **bc,
+						 int nr, errcode_t *errs);
+/*
+ * The _many() calls share big batches with a pool of threads, but only
+ * between these two calls.  Stop the pool before the program exits.
+ */
+extern void ocfs2_block_check_start_threads(void);
+extern void ocfs2_block_check_stop_threads(void);
 
 /* High level */
 errcode_t ocfs2_format_slot_map(ocfs2_filesys *fs);
@@ -410,7 +410,6 @@ done:
  * to the next node in the tree greater than the bitmap range
  * that was searched.
  */
-static
 struct ocfs2_bitmap_region *ocfs2_bitmap_lookup(ocfs2_bitmap *bitmap, 
 						uint64_t bitno, 
 						uint64_t total_bits, 
@@ -953,6 +952,7 @@ errcode_t ocfs2_block_bitmap_new(ocfs2_filesys *fs,
 #include <stdlib.h>
 #include <getopt.h>
 #include <limits.h>
+#include <sys/time.h>
 
 static uint64_t read_number(const char *num)
 {
@@ -969,7 +969,7 @@ static uint64_t read_number(const char *num)
 static void print_usage(void)
 {
 	fprintf(stderr,
-		"debug_bitmap [-a] <filename>\n");
+		"debug_bitmap [-a | -s] [-b] <filename>\n");
 }
 
 extern int opterr, optind;
@@ -1180,23 +1180,118 @@ static void run_test(ocfs2_bitmap *bitmap)
 	}
 }
 
+static uint64_t walltime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/*
+ * Walk every set bit and every clear bit with the searches, and every
+ * bit with ocfs2_bitmap_test(), which also checks what the searches
+ * found.
+ */
+static void bench_walk(ocfs2_bitmap *bitmap, const char *pattern)
+{
+	uint64_t bitno, found, nr_set = 0, nr_clear = 0, nr_tested = 0;
+	uint64_t start, set_usecs, clear_usecs, test_usecs;
+	int val;
+
+	start = walltime();
+	for (bitno = 0;
+	     !ocfs2_bitmap_find_next_set(bitmap, bitno, &found) &&
+	     (found + 1 < bitmap->b_total_bits);
+	     bitno = found + 1)
+		nr_set++;
+	if (!ocfs2_bitmap_test(bitmap, bitmap->b_total_bits - 1, &val) &&
+	    val)
+		nr_set++;
+	set_usecs = walltime() - start;
+
+	start = walltime();
+	for (bitno = 0;
+	     !ocfs2_bitmap_find_next_clear(bitmap, bitno, &found) &&
+	     (found + 1 < bitmap->b_total_bits);
+	     bitno = found + 1)
+		nr_clear++;
+	if (!ocfs2_bitmap_test(bitmap, bitmap->b_total_bits - 1, &val) &&
+	    !val)
+		nr_clear++;
+	clear_usecs = walltime() - start;
+
+	start = walltime();
+	for (bitno = 0; bitno < bitmap->b_total_bits; bitno++) {
+		if (!ocfs2_bitmap_test(bitmap, bitno, &val) && val)
+			nr_tested++;
+	}
+	test_usecs = walltime() - start;
+
+	fprintf(stdout,
+		"%-12s %12"PRIu64" set  find_next_set %8"PRIu64"us  "
+		"find_next_clear %8"PRIu64"us  test %8"PRIu64"us\n",
+		pattern, nr_tested, set_usecs, clear_usecs, test_usecs);
+	if ((nr_set != nr_tested) ||
+	    (nr_clear != bitmap->b_total_bits - nr_tested))
+		fprintf(stdout, "Searches found %"PRIu64" set and %"PRIu64
+			" clear bits, _incorrect_\n", nr_set, nr_clear);
+}
+
+static void bench_fill(ocfs2_bitmap *bitmap, uint64_t stride, int set)
+{
+	uint64_t bitno;
+
+	for (bitno = 0; bitno < bitmap->b_total_bits; bitno++) {
+		if (((bitno % stride) == 0) == set)
+			ocfs2_bitmap_set(bitmap, bitno, NULL);
+		else
+			ocfs2_bitmap_clear(bitmap, bitno, NULL);
+	}
+}
+
+static void run_bench(ocfs2_bitmap *bitmap)
+{
+	fprintf(stdout, "Bitmap \"%s\": total = %"PRIu64"\n",
+		bitmap->b_description, bitmap->b_total_bits);
+
+	bench_fill(bitmap, 1, 0);
+	bench_walk(bitmap, "empty");
+	bench_fill(bitmap, 4096, 1);
+	bench_walk(bitmap, "1/4096 set");
+	bench_fill(bitmap, 64, 1);
+	bench_walk(bitmap, "1/64 set");
+	bench_fill(bitmap, 4096, 0);
+	bench_walk(bitmap, "1/4096 clear");
+	bench_fill(bitmap, 1, 1);
+	bench_walk(bitmap, "full");
+}
+
 int main(int argc, char *argv[])
 {
 	errcode_t ret;
 	int c;
-	int alloc = 0;
+	int alloc = 0, sparse = 0, bench = 0;
 	char *filename;
 	ocfs2_filesys *fs;
 	ocfs2_bitmap *bitmap;
 
 	initialize_ocfs_error_table();
 
-	while ((c = getopt(argc, argv, "a")) != EOF) {
+	while ((c = getopt(argc, argv, "abs")) != EOF) {
 		switch (c) {
 			case 'a':
 				alloc = 1;
 				break;
 
+			case 'b':
+				bench = 1;
+				break;
+
+			case 's':
+				sparse = 1;
+				break;
+
 			default:
 				print_usage();
 				return 1;
@@ -1218,7 +1313,10 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (alloc)
+	if (sparse)
+		ret = ocfs2_sparse_bitmap_new(fs, fs->fs_clusters, "Testing",
+					      &bitmap);
+	else if (alloc)
 		ret = ocfs2_block_bitmap_new(fs, "Testing", &bitmap);
 	else
 		ret = ocfs2_cluster_bitmap_new(fs, "Testing", &bitmap);
@@ -1228,7 +1326,10 @@ int main(int argc, char *argv[])
 		goto out_close;
 	}
 
-	run_test(bitmap);
+	if (bench)
+		run_bench(bitmap);
+	else
+		run_test(bitmap);
 
 	ocfs2_bitmap_free(bitmap);
 
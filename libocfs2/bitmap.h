@@ -99,6 +99,12 @@ errcode_t ocfs2_bitmap_realloc_region(ocfs2_bitmap *bitmap,
 				      int total_bits);
 errcode_t ocfs2_bitmap_insert_region(ocfs2_bitmap *bitmap,
 				     struct ocfs2_bitmap_region *br);
+struct ocfs2_bitmap_region *ocfs2_bitmap_lookup(ocfs2_bitmap *bitmap,
+						uint64_t bitno,
+						uint64_t total_bits,
+						struct rb_node ***ret_p,
+						struct rb_node **ret_parent,
+						struct rb_node **ret_next);
 typedef errcode_t (*ocfs2_bitmap_foreach_func)(struct ocfs2_bitmap_region *br,
 					       void *private_data);
 errcode_t ocfs2_bitmap_foreach_region(ocfs2_bitmap *bitmap,
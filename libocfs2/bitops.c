@@ -27,9 +27,11 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/types.h>
 
+#include "ocfs2/byteorder.h"
 #include "ocfs2/bitops.h"
 
 /*
@@ -86,79 +88,157 @@ int ocfs2_find_first_bit_clear(void *addr, int size)
 	return ocfs2_find_next_bit_clear(addr, size, 0);
 }
 
-int ocfs2_find_next_bit_set(void *addr, int size, int offset)
+/*
+ * The bitmaps are little-endian bytes, so a little-endian 64-bit load
+ * puts bit nr of the bitmap at bit nr % 64 of its word.  The searches
+ * below look at a word at a time, flipping the words when looking for
+ * a clear bit, and skip long runs of all-clear or all-set words as fast
+ * as the CPU allows.
+ */
+static inline uint64_t bitops_load(const unsigned char *p)
 {
-	unsigned char * p;
-	int set = 0, d0;
-	unsigned int	bit = offset & 7, res = 0;
-	unsigned char	tilde = ~0;
-	unsigned int	mask = 0U | tilde;
-
-	/* XXX care to check for null ADDR and <= 0 for int args? */
-	if (size == 0)
-		return 0;
-	
-	res = offset >> 3;
-	p = ((unsigned char *) addr) + res;
-	res <<= 3;
-	
-	if (bit) {
-		set = ffs(*p & ~((1 << bit) - 1));
-		if (set)
-			return (offset & ~7) + set - 1;
-		p++;
-		res += 8;
+	uint64_t word;
+
+	memcpy(&word, p, sizeof(word));
+	return le64_to_cpu(word);
+}
+
+/* The last, partial word.  Only the bytes within the bitmap are read. */
+static inline uint64_t bitops_load_tail(const unsigned char *p, int bits)
+{
+	uint64_t word = 0;
+	int i;
+
+	for (i = 0; i < (bits + 7) / 8; i++)
+		word |= (uint64_t)p[i] << (i * 8);
+	return word;
+}
+
+/* How many of the nr words at p are all fill */
+static size_t bitops_skip_generic(const unsigned char *p, size_t nr,
+				  uint64_t fill)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++) {
+		if (bitops_load(p + i * 8) != fill)
+			break;
 	}
-	while ((size > res) && (*p == 0)) {
-		p++;
-		res += 8;
+	return i;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 5)
+# define BITOPS_AVX2
+# include <immintrin.h>
+
+/* 64 bytes at a time, then the generic loop for what's left */
+static size_t __attribute__((target("avx2")))
+bitops_skip_avx2(const unsigned char *p, size_t nr, uint64_t fill)
+{
+	__m256i f = _mm256_set1_epi64x(fill);
+	__m256i a, b;
+	size_t i;
+
+	for (i = 0; i + 8 <= nr; i += 8) {
+		a = _mm256_loadu_si256((const __m256i *)(p + i * 8));
+		b = _mm256_loadu_si256((const __m256i *)(p + i * 8 + 32));
+		a = _mm256_or_si256(_mm256_xor_si256(a, f),
+				    _mm256_xor_si256(b, f));
+		if (!_mm256_testz_si256(a, a))
+			break;
 	}
-	if (res >= size)
-		return size;
-	if ((res + 8) > size)
-		mask >>= 8 - (size - res);
-	d0 = ffs(*p & mask);
-	if (d0 == 0)
-		return size;
 
-	return (res + d0 - 1);
+	return i + bitops_skip_generic(p + i * 8, nr - i, fill);
 }
+#endif
 
-int ocfs2_find_next_bit_clear(void *addr, int size, int offset)
+static size_t bitops_skip_resolve(const unsigned char *p, size_t nr,
+				  uint64_t fill);
+
+/*
+ * Starts out pointing at the resolver, which replaces itself with the
+ * best implementation.  Racing callers all store the same pointer.
+ */
+static size_t (*bitops_skip)(const unsigned char *p, size_t nr,
+			     uint64_t fill) = bitops_skip_resolve;
+
+static size_t bitops_skip_resolve(const unsigned char *p, size_t nr,
+				  uint64_t fill)
 {
-	unsigned char * p;
-	int set = 0, d0;
-	unsigned int	bit = offset & 7, res = 0;
-	unsigned char tilde = ~0;
-	unsigned int	mask = 0U | tilde;
-
-	if (size == 0)
-		return 0;
-	
-	res = offset >> 3;
-	p = ((unsigned char *) addr) + res;
-	res <<= 3;
-	
-	if (bit) {
-		set = ffs(~*p & ~((1 << bit) - 1) & mask);
-		if (set)
-			return (offset & ~7) + set - 1;
-		p++;
-		res += 8;
-	}
-	while ((size > res) && (*p == tilde)) {
-		p++;
-		res += 8;
+	size_t (*impl)(const unsigned char *, size_t, uint64_t) =
+		bitops_skip_generic;
+
+#ifdef BITOPS_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		impl = bitops_skip_avx2;
+#endif
+
+	bitops_skip = impl;
+	return impl(p, nr, fill);
+}
+
+/* Past the word holding offset, or offset is in the last, partial word */
+static int __attribute__((noinline))
+bitops_find_next_slow(const unsigned char *p, int size,
+				 int offset, uint64_t flip)
+{
+	int w = offset / 64, nr_words = size / 64, bits;
+	uint64_t word;
+
+	if (w < nr_words) {
+		w++;
+		w += bitops_skip(p + w * 8, nr_words - w, flip);
+		if (w < nr_words) {
+			word = bitops_load(p + w * 8) ^ flip;
+			return w * 64 + __builtin_ctzll(word);
+		}
 	}
-	if (res >= size)
+
+	bits = size - w * 64;
+	if (!bits)
 		return size;
-	if ((res + 8) > size)
-		mask >>= 8 - (size - res);
-	d0 = ffs(~(*p & mask));
-	if (d0 == 0)
+
+	word = (bitops_load_tail(p + w * 8, bits) ^ flip) &
+		((1ULL << bits) - 1);
+	if (w == offset / 64)
+		word &= ~0ULL << (offset % 64);
+	if (word)
+		return w * 64 + __builtin_ctzll(word);
+
+	return size;
+}
+
+/*
+ * flip is 0 to find a set bit, ~0 to find a clear one.  Most searches
+ * end in the word they start in, so that is kept short.
+ */
+static inline int bitops_find_next(const unsigned char *p, int size,
+				   int offset, uint64_t flip)
+{
+	uint64_t word;
+
+	if (offset >= size)
 		return size;
 
-	return (res + d0 - 1);
+	if ((offset | 63) < size) {
+		word = (bitops_load(p + (offset / 64) * 8) ^ flip) &
+			(~0ULL << (offset % 64));
+		if (word)
+			return (offset & ~63) + __builtin_ctzll(word);
+	}
+
+	return bitops_find_next_slow(p, size, offset, flip);
+}
+
+int ocfs2_find_next_bit_set(void *addr, int size, int offset)
+{
+	return bitops_find_next(addr, size, offset, 0);
+}
+
+int ocfs2_find_next_bit_clear(void *addr, int size, int offset)
+{
+	return bitops_find_next(addr, size, offset, ~0ULL);
 }
 
 #ifdef DEBUG_EXE
@@ -173,6 +253,70 @@ int ocfs2_find_next_bit_clear(void *addr, int size, int offset)
 			_ret == expect ? "correct" : "_incorrect_");	\
 } while (0)
 
+/* What the searches should find, a bit at a time */
+static int slow_find_next(void *addr, int size, int offset, int set)
+{
+	for (; offset < size; offset++) {
+		if (ocfs2_test_bit(offset, addr) == set)
+			return offset;
+	}
+	return size;
+}
+
+/*
+ * Every size and offset over a few patterns: random bits, and runs of
+ * set and clear bits long enough for the word skipping to matter.  The
+ * searches start at an odd byte too, as the bitmap regions can.
+ */
+static int check_all(void)
+{
+	unsigned char buf[1024 + 1];
+	unsigned char *bitmap;
+	int pattern, size, offset, i, got, want, bad = 0;
+
+	for (pattern = 0; pattern < 4; pattern++) {
+		bitmap = buf + (pattern & 1);
+		for (i = 0; i < 1024; i++) {
+			if (pattern < 2)
+				bitmap[i] = random();
+			else
+				bitmap[i] = ((i / 300) & 1) ? 0xFF : 0;
+		}
+		if (pattern >= 2) {
+			ocfs2_set_bit(1000, bitmap);
+			ocfs2_clear_bit(2500 * (pattern - 1), bitmap);
+		}
+
+		for (size = 0; size <= 8192; size += (size < 200) ? 1 : 67) {
+			for (offset = 0; offset <= size; offset++) {
+				got = ocfs2_find_next_bit_set(bitmap, size,
+							      offset);
+				want = slow_find_next(bitmap, size, offset, 1);
+				if (got != want) {
+					fprintf(stdout, "next_bit_set(%d, %d) "
+						"= %d, expected %d\n",
+						size, offset, got, want);
+					bad++;
+				}
+
+				got = ocfs2_find_next_bit_clear(bitmap, size,
+								offset);
+				want = slow_find_next(bitmap, size, offset, 0);
+				if (got != want) {
+					fprintf(stdout, "next_bit_clear(%d, %d) "
+						"= %d, expected %d\n",
+						size, offset, got, want);
+					bad++;
+				}
+			}
+		}
+	}
+
+	fprintf(stdout, "Exhaustive search checks: %s\n",
+		bad ? "_incorrect_" : "correct");
+	return bad;
+}
+
 int main(int argc, char *argv[])
 {
 	char bitmap[8 * sizeof(unsigned long)];
@@ -195,8 +339,7 @@ int main(int argc, char *argv[])
 	bit_expect(size - 1, next_bit_clear, size, size - 1);
 	bit_expect(size, next_bit_set, size, size - 1);
 
-	/* XXX add more tests */
-	return 0;
+	return check_all() ? 1 : 0;
 }
 #endif
 
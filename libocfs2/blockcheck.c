@@ -29,6 +29,10 @@
 #endif
 
 #include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 #include "ocfs2/bitops.h"
@@ -36,6 +40,7 @@
 
 #include "blockcheck.h"
 #include "crc32table.h"
+#include "hammingtable.h"
 
 
 static inline unsigned int hc_hweight32(unsigned int w)
@@ -97,6 +102,18 @@ static unsigned int calc_code_bit(unsigned int i, unsigned int *p_cache)
 	return b;
 }
 
+/*
+ * Data bit g ends up at code bit g + 1 + P, where P is the number of
+ * parity bits before it.  P only changes when the next code bit would
+ * be a power of two.  The data bit that would have landed on code bit
+ * 2^m is the first one with P = m + 1, and that's data bit
+ * 2^m - 1 - m.
+ */
+static inline uint64_t hamming_seg_start(unsigned int m)
+{
+	return ((uint64_t)1 << m) - 1 - m;
+}
+
 /*
  * This is the low level encoder function.  It can be called across
  * multiple hunks just like the crc32 code.  'd' is the number of bits
@@ -107,49 +124,64 @@ static unsigned int calc_code_bit(unsigned int i, unsigned int *p_cache)
  * parity = ocfs2_hamming_encode(parity, buf2, 512 * 8, 512 * 8);
  *
  * If you just have one buffer, use ocfs2_hamming_encode_block().
+ *
+ * The parity is the xor of the code bit numbers of all the set data
+ * bits.  Within a run of data bits that have the same P, a whole byte
+ * can be handled with one lookup in hamming_byte_table (see
+ * hammingtable.h).  Zero words are skipped outright.  The few bits
+ * that aren't in a whole byte of one run are done one at a time.
  */
 uint32_t ocfs2_hamming_encode(uint32_t parity, void *data, unsigned int d,
 			      unsigned int nr)
 {
-	unsigned int i, b, p = 0;
+	unsigned char *p = data;
+	const uint8_t *tab;
+	unsigned int i = 0, m = 1, end, k, c, e;
+	uint64_t word, next;
 
 	if (!d)
 		abort();
 
-	/*
-	 * b is the hamming code bit number.  Hamming code specifies a
-	 * 1-based array, but C uses 0-based.  So 'i' is for C, and 'b' is
-	 * for the algorithm.
-	 *
-	 * The i++ in the for loop is so that the start offset passed
-	 * to ocfs2_find_next_bit_set() is one greater than the previously
-	 * found bit.
-	 */
-	for (i = 0; (i = ocfs2_find_next_bit_set(data, d, i)) < d; i++)
-	{
-		/*
-		 * i is the offset in this hunk, nr + i is the total bit
-		 * offset.
-		 */
-		b = calc_code_bit(nr + i, &p);
+	while (i < d) {
+		/* Find the run that nr + i is in */
+		while (hamming_seg_start(m + 1) <= (nr + i))
+			m++;
+		/* The code bit for data bit g in this run is g + m + 2 */
+		k = m + 2;
+		next = hamming_seg_start(m + 1) - nr;
+		end = (next < d) ? next : d;
+
+		/* Bits before the first whole byte */
+		for (; (i < end) && (i & 7); i++) {
+			if (ocfs2_test_bit(i, data))
+				parity ^= nr + i + k;
+		}
 
-		/*
-		 * Data bits in the resultant code are checked by
-		 * parity bits that are part of the bit number
-		 * representation.  Huh?
-		 *
-		 * <wikipedia href="http://en.wikipedia.org/wiki/Hamming_code">
-		 * In other words, the parity bit at position 2^k
-		 * checks bits in positions having bit k set in
-		 * their binary representation.  Conversely, for
-		 * instance, bit 13, i.e. 1101(2), is checked by
-		 * bits 1000(2) = 8, 0100(2)=4 and 0001(2) = 1.
-		 * </wikipedia>
-		 *
-		 * Note that 'k' is the _code_ bit number.  'b' in
-		 * our loop.
-		 */
-		parity ^= b;
+		c = nr + i + k;
+		tab = hamming_byte_table[c & 7];
+		c &= ~7;
+		while ((i + 8) <= end) {
+			if (!(i & 63) && ((i + 64) <= end)) {
+				memcpy(&word, p + (i >> 3), sizeof(word));
+				if (!word) {
+					i += 64;
+					c += 64;
+					continue;
+				}
+			}
+
+			e = tab[p[i >> 3]];
+			parity ^= (e & 7) ^ (c & -((e >> 3) & 1)) ^
+				((c + 8) & -((e >> 4) & 1));
+			i += 8;
+			c += 8;
+		}
+
+		/* And any left over */
+		for (; i < end; i++) {
+			if (ocfs2_test_bit(i, data))
+				parity ^= nr + i + k;
+		}
 	}
 
 	/* While the data buffer was treated as little endian, the
@@ -172,7 +204,7 @@ uint32_t ocfs2_hamming_encode_block(void *data, unsigned int blocksize)
 void ocfs2_hamming_fix(void *data, unsigned int d, unsigned int nr,
 		       unsigned int fix)
 {
-	unsigned int i, b;
+	unsigned int i, b, l;
 
 	if (!d)
 		abort();
@@ -201,29 +233,19 @@ void ocfs2_hamming_fix(void *data, unsigned int d, unsigned int nr,
 	if (fix < b)
 		return;
 
-	for (i = 0; i < d; i++, b++)
-	{
-		/* Skip past parity bits */
-		while (hc_hweight32(b) == 1)
-			b++;
-
-		/*
-		 * i is the offset in this data hunk.
-		 * nr + i is the offset in the total data buffer.
-		 * b is the offset in the total code buffer.
-		 *
-		 * Thus, when b == fix, bit i in the current hunk needs
-		 * fixing.
-		 */
-		if (b == fix)
-		{
-			if (ocfs2_test_bit(i, data))
-				ocfs2_clear_bit(i, data);
-			else
-				ocfs2_set_bit(i, data);
-			break;
-		}
-	}
+	/*
+	 * fix isn't a power of two, so the parity bits before it are
+	 * 2^0 through 2^l, where 2^l is fix's highest bit.  Take those
+	 * and the 1-based offset away and we have the data bit.
+	 */
+	for (l = 0; fix >> (l + 1); l++)
+		;
+	i = fix - 2 - l - nr;
+
+	if (ocfs2_test_bit(i, data))
+		ocfs2_clear_bit(i, data);
+	else
+		ocfs2_set_bit(i, data);
 }
 
 void ocfs2_hamming_fix_block(void *data, unsigned int blocksize,
@@ -239,62 +261,361 @@ void ocfs2_hamming_fix_block(void *data, unsigned int blocksize,
  * RFC 3385 shows that the 802.3 crc32 (this one) has the same properties
  * and probabilities as crc32c (which iSCSI uses) for data blocks < 2^16
  * bits.  We fit.
- */
-
-/**
- * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
- * @crc - seed value for computation.  ~0 for Ethernet, sometimes 0 for
- *        other uses, or the previous crc32 value if computing incrementally.
- * @p   - pointer to buffer over which CRC is run
- * @len - length of buffer @p
  *
+ * Every metadata block on a metaecc volume goes through here, so we
+ * pick the fastest implementation the CPU has the first time we're
+ * called.  The portable one is the kernel's slice-by-8; x86_64 can fold
+ * with PCLMULQDQ, and arm64 has crc32 instructions.  They all produce
+ * the same answer.
  */
-uint32_t crc32_le(uint32_t crc, unsigned char const *p, size_t len)
-{
-	const uint32_t      *b =(uint32_t *)p;
-	const uint32_t      *tab = crc32table_le;
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
-# define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
+# define DO_CRC(x) crc = t0[(crc ^ (x)) & 255] ^ (crc >> 8)
+# define DO_CRC4 (t3[(q) & 255] ^ t2[(q >> 8) & 255] ^ \
+		  t1[(q >> 16) & 255] ^ t0[(q >> 24) & 255])
+# define DO_CRC8 (t7[(q) & 255] ^ t6[(q >> 8) & 255] ^ \
+		  t5[(q >> 16) & 255] ^ t4[(q >> 24) & 255])
 #else
-# define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
+# define DO_CRC(x) crc = t0[((crc >> 24) ^ (x)) & 255] ^ (crc << 8)
+# define DO_CRC4 (t0[(q) & 255] ^ t1[(q >> 8) & 255] ^ \
+		  t2[(q >> 16) & 255] ^ t3[(q >> 24) & 255])
+# define DO_CRC8 (t4[(q) & 255] ^ t5[(q >> 8) & 255] ^ \
+		  t6[(q >> 16) & 255] ^ t7[(q >> 24) & 255])
 #endif
 
+/* Slice-by-8: eight bytes per step, one table lookup per byte */
+static uint32_t crc32_le_sb8(uint32_t crc, unsigned char const *p,
+			     size_t len)
+{
+	const uint32_t *t0 = crc32table_le[0], *t1 = crc32table_le[1];
+	const uint32_t *t2 = crc32table_le[2], *t3 = crc32table_le[3];
+	const uint32_t *t4 = crc32table_le[4], *t5 = crc32table_le[5];
+	const uint32_t *t6 = crc32table_le[6], *t7 = crc32table_le[7];
+	const uint32_t *b;
+	size_t rem_len;
+	uint32_t q;
+
 	crc = cpu_to_le32(crc);
 	/* Align it */
-	if(((long)b)&3 && len){
+	if (((long)p & 3) && len) {
 		do {
-			uint8_t *p = (uint8_t *)b;
 			DO_CRC(*p++);
-			b = (void *)p;
-		} while ((--len) && ((long)b)&3 );
+		} while ((--len) && ((long)p & 3));
 	}
-	if(len >= 4){
-		/* load data 32 bits wide, xor data 32 bits wide. */
-		size_t save_len = len & 3;
-	        len = len >> 2;
-		--b; /* use pre increment below(*++b) for speed */
-		do {
-			crc ^= *++b;
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-			DO_CRC(0);
-		} while (--len);
-		b++; /* point to next byte(s) */
-		len = save_len;
+
+	rem_len = len & 7;
+	len = len >> 3;
+	b = (const uint32_t *)p;
+	for (--b; len; --len) {
+		q = crc ^ *++b; /* use pre increment for speed */
+		crc = DO_CRC8;
+		q = *++b;
+		crc ^= DO_CRC4;
 	}
+
 	/* And the last few bytes */
-	if(len){
+	len = rem_len;
+	if (len) {
+		p = (const unsigned char *)(b + 1);
 		do {
-			uint8_t *p = (uint8_t *)b;
 			DO_CRC(*p++);
-			b = (void *)p;
 		} while (--len);
 	}
 
 	return le32_to_cpu(crc);
+}
+
+/*
+ * Slice-by-8 over four buffers of the same length at once.  Each
+ * buffer's crc is one long chain of dependent table lookups; running
+ * four chains side by side keeps more loads in flight.  The buffers
+ * must be 4-byte aligned.  crcs[] holds the seeds and gets the results.
+ */
+static void crc32_le_sb8_x4(uint32_t *crcs, unsigned char const **bufs,
+			    size_t len)
+{
+	const uint32_t *t0 = crc32table_le[0], *t1 = crc32table_le[1];
+	const uint32_t *t2 = crc32table_le[2], *t3 = crc32table_le[3];
+	const uint32_t *t4 = crc32table_le[4], *t5 = crc32table_le[5];
+	const uint32_t *t6 = crc32table_le[6], *t7 = crc32table_le[7];
+	const uint32_t *b[4];
+	uint32_t c[4], crc, q;
+	size_t words = len >> 3;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		c[i] = cpu_to_le32(crcs[i]);
+		b[i] = (const uint32_t *)bufs[i];
+	}
+
+	for (; words; words--) {
+		for (i = 0; i < 4; i++) {
+			crc = c[i];
+			q = crc ^ b[i][0];
+			crc = DO_CRC8;
+			q = b[i][1];
+			c[i] = crc ^ DO_CRC4;
+			b[i] += 2;
+		}
+	}
+
+	for (i = 0; i < 4; i++)
+		crcs[i] = crc32_le_sb8(le32_to_cpu(c[i]),
+				       (const unsigned char *)b[i], len & 7);
+}
+
 #undef DO_CRC
+#undef DO_CRC4
+#undef DO_CRC8
+
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 5)
+# define CRC32_PCLMUL
+# include <immintrin.h>
+
+/*
+ * Fold 64 bytes at a time with carry-less multiplies, then Barrett
+ * reduce to 32 bits.  The constants are the bit-reflected ones from
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" paper.  len must be at least 64 and a multiple of 16.
+ */
+static uint32_t __attribute__((target("pclmul,sse4.1")))
+crc32_le_pclmul_body(uint32_t crc, unsigned char const *p, size_t len)
+{
+	static const uint64_t __attribute__((aligned(16))) k1k2[] =
+		{ 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64_t __attribute__((aligned(16))) k3k4[] =
+		{ 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64_t __attribute__((aligned(16))) k5k0[] =
+		{ 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64_t __attribute__((aligned(16))) poly[] =
+		{ 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+	p += 64;
+	len -= 64;
+
+	/* Four folds in parallel while there's 64 bytes to fold in */
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			_mm_loadu_si128((const __m128i *)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+			_mm_loadu_si128((const __m128i *)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+			_mm_loadu_si128((const __m128i *)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+			_mm_loadu_si128((const __m128i *)(p + 0x30)));
+		p += 64;
+		len -= 64;
+	}
+
+	/* Fold the four down to one */
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Then any 16 byte pieces left */
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)p);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+		p += 16;
+		len -= 16;
+	}
+
+	/* 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 */
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_le_pclmul(uint32_t crc, unsigned char const *p,
+				size_t len)
+{
+	size_t chunk;
+
+	if (len < 64)
+		return crc32_le_sb8(crc, p, len);
+
+	chunk = len & ~(size_t)15;
+	crc = crc32_le_pclmul_body(crc, p, chunk);
+	return crc32_le_sb8(crc, p + chunk, len - chunk);
+}
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__) && (__GNUC__ >= 6)
+# define CRC32_ARM64
+# include <arm_acle.h>
+# include <sys/auxv.h>
+# ifndef HWCAP_CRC32
+#  define HWCAP_CRC32 (1 << 7)
+# endif
+
+/* The ARMv8 crc32 instructions use our polynomial, bit-reflected */
+static uint32_t __attribute__((target("+crc")))
+crc32_le_arm64(uint32_t crc, unsigned char const *p, size_t len)
+{
+	uint64_t q;
+
+	while (len && ((long)p & 7)) {
+		crc = __crc32b(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		memcpy(&q, p, sizeof(q));
+		crc = __crc32d(crc, q);
+		p += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = __crc32b(crc, *p++);
+
+	return crc;
+}
+
+/*
+ * Each crc32 instruction waits on the one before it.  Four buffers
+ * give four independent chains to keep the unit busy.
+ */
+static void __attribute__((target("+crc")))
+crc32_le_arm64_x4(uint32_t *crcs, unsigned char const **bufs, size_t len)
+{
+	uint64_t q;
+	size_t off;
+	int i;
+
+	for (off = 0; (off + 8) <= len; off += 8) {
+		for (i = 0; i < 4; i++) {
+			memcpy(&q, bufs[i] + off, sizeof(q));
+			crcs[i] = __crc32d(crcs[i], q);
+		}
+	}
+	for (; off < len; off++) {
+		for (i = 0; i < 4; i++)
+			crcs[i] = __crc32b(crcs[i], bufs[i][off]);
+	}
+}
+#endif
+
+static uint32_t crc32_le_resolve(uint32_t crc, unsigned char const *p,
+				 size_t len);
+
+/*
+ * Starts out pointing at the resolver, which replaces itself with the
+ * best implementation.  Racing callers all store the same pointer.
+ */
+static uint32_t (*crc32_le_impl)(uint32_t crc, unsigned char const *p,
+				 size_t len) = crc32_le_resolve;
+
+static void crc32_le_pick(void)
+{
+	uint32_t (*impl)(uint32_t, unsigned char const *, size_t) =
+		crc32_le_sb8;
+
+#ifdef CRC32_PCLMUL
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("sse4.1"))
+		impl = crc32_le_pclmul;
+#endif
+#ifdef CRC32_ARM64
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+		impl = crc32_le_arm64;
+#endif
+
+	crc32_le_impl = impl;
+}
+
+static uint32_t crc32_le_resolve(uint32_t crc, unsigned char const *p,
+				 size_t len)
+{
+	crc32_le_pick();
+	return crc32_le_impl(crc, p, len);
+}
+
+/**
+ * crc32_le() - Calculate bitwise little-endian Ethernet AUTODIN II CRC32
+ * @crc - seed value for computation.  ~0 for Ethernet, sometimes 0 for
+ *        other uses, or the previous crc32 value if computing incrementally.
+ * @p   - pointer to buffer over which CRC is run
+ * @len - length of buffer @p
+ *
+ */
+uint32_t crc32_le(uint32_t crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_impl(crc, p, len);
+}
+
+/*
+ * Fresh crc32s of nr buffers that are all len bytes long, four at a
+ * time with whichever implementation crc32_le() picked.  Slice-by-8
+ * wants them aligned.  PCLMULQDQ is the exception: its fold loop
+ * already runs four independent chains over one buffer, which keeps
+ * the multiplier saturated, so a second buffer would have nothing to
+ * overlap with.  It goes one buffer at a time.
+ */
+static void crc32_le_many(uint32_t *crcs, unsigned char const **bufs,
+			  int nr, size_t len)
+{
+	void (*x4)(uint32_t *, unsigned char const **, size_t) = NULL;
+	int i = 0;
+
+	if (crc32_le_impl == crc32_le_sb8)
+		x4 = crc32_le_sb8_x4;
+#ifdef CRC32_ARM64
+	else if (crc32_le_impl == crc32_le_arm64)
+		x4 = crc32_le_arm64_x4;
+#endif
+
+	for (; x4 && ((i + 4) <= nr); i += 4) {
+		if ((x4 == crc32_le_sb8_x4) &&
+		    (((unsigned long)bufs[i] | (unsigned long)bufs[i + 1] |
+		      (unsigned long)bufs[i + 2] |
+		      (unsigned long)bufs[i + 3]) & 3))
+			break;
+		crcs[i] = crcs[i + 1] = crcs[i + 2] = crcs[i + 3] = ~0;
+		x4(crcs + i, bufs + i, len);
+	}
+
+	for (; i < nr; i++)
+		crcs[i] = crc32_le(~0, bufs[i], len);
 }
 
 /*
@@ -327,6 +648,27 @@ void ocfs2_block_check_compute(void *data, size_t blocksize,
 	bc->bc_ecc = cpu_to_le16(ecc);  /* We know it's max 16 bits */
 }
 
+/*
+ * The crc32 didn't match.  check holds the cpu-endian values that came
+ * off the disk, and the block's own copy has been zeroed.  Try the ECC
+ * fixup and see if the crc32 comes right.
+ */
+static errcode_t block_check_fix(void *data, size_t blocksize,
+				 struct ocfs2_block_check *check)
+{
+	uint32_t crc, ecc;
+
+	ecc = ocfs2_hamming_encode_block(data, blocksize);
+	ocfs2_hamming_fix_block(data, blocksize, ecc ^ check->bc_ecc);
+
+	/* And check the crc32 again */
+	crc = crc32_le(~0, data, blocksize);
+	if (crc == check->bc_crc32e)
+		return 0;
+
+	return OCFS2_ET_IO;
+}
+
 /*
  * This function validates existing check information.  Like _compute,
  * the function will take care of zeroing bc before calculating check codes.
@@ -338,36 +680,352 @@ void ocfs2_block_check_compute(void *data, size_t blocksize,
 errcode_t ocfs2_block_check_validate(void *data, size_t blocksize,
 				     struct ocfs2_block_check *bc)
 {
-	errcode_t err = 0;
-	struct ocfs2_block_check check;
-	uint32_t crc, ecc;
+	errcode_t err = 0;
+	struct ocfs2_block_check check;
+	uint32_t crc;
+
+	check.bc_crc32e = le32_to_cpu(bc->bc_crc32e);
+	check.bc_ecc = le16_to_cpu(bc->bc_ecc);
+
+	memset(bc, 0, sizeof(struct ocfs2_block_check));
+
+	/* Fast path - if the crc32 validates, we're good to go */
+	crc = crc32_le(~0, data, blocksize);
+	if (crc != check.bc_crc32e)
+		err = block_check_fix(data, blocksize, &check);
+
+	bc->bc_crc32e = cpu_to_le32(check.bc_crc32e);
+	bc->bc_ecc = cpu_to_le16(check.bc_ecc);
+
+	return err;
+}
+
+/*
+ * This only checks the crc32, and it never writes to data.  Use it on
+ * buffers you don't own, like ones from io_get_block().  bc must point
+ * inside data.  If it fails, the block may still be fixable by
+ * ocfs2_block_check_validate() on a private copy.
+ */
+errcode_t ocfs2_block_check_verify(const void *data, size_t blocksize,
+				   const struct ocfs2_block_check *bc)
+{
+	static const struct ocfs2_block_check zero;
+	const unsigned char *p = data;
+	size_t off = (const unsigned char *)bc - p;
+	uint32_t crc;
+
+	if (off + sizeof(struct ocfs2_block_check) > blocksize)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	/* The crc32 was computed with bc zeroed */
+	crc = crc32_le(~0, p, off);
+	crc = crc32_le(crc, (const unsigned char *)&zero, sizeof(zero));
+	off += sizeof(zero);
+	crc = crc32_le(crc, p + off, blocksize - off);
+
+	if (crc == le32_to_cpu(bc->bc_crc32e))
+		return 0;
+
+	return OCFS2_ET_IO;
+}
+
+/*
+ * Batches of blocks.  A batch is cut into chunks, and the caller and a
+ * small pool of worker threads take chunks until none are left.  The
+ * pool is the caller's choice: it runs from
+ * ocfs2_block_check_start_threads() to ocfs2_block_check_stop_threads().
+ * Without it, or while another batch is using it, a batch runs in the
+ * calling thread.
+ */
+#define BLOCK_CHECK_CHUNK	16	/* Blocks taken at a time */
+#define BLOCK_CHECK_MT_MIN	(4 * BLOCK_CHECK_CHUNK)
+#define BLOCK_CHECK_MAX_THREADS	7
+
+struct block_check_batch {
+	void **bb_data;
+	size_t bb_blocksize;
+	struct ocfs2_block_check **bb_bc;
+	int bb_nr;
+	int bb_validate;
+	errcode_t *bb_errs;	/* Optional, per block */
+	int bb_next;		/* First block nobody has taken */
+	int bb_active;		/* Workers inside this batch */
+	errcode_t bb_ret;
+};
+
+static pthread_mutex_t bcp_call_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t bcp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bcp_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bcp_done = PTHREAD_COND_INITIALIZER;
+static struct block_check_batch *bcp_batch;	/* Protected by bcp_lock */
+static unsigned long bcp_generation;		/* Ditto */
+static int bcp_stop;				/* Ditto */
+static pthread_t bcp_thread_ids[BLOCK_CHECK_MAX_THREADS];
+static int bcp_threads;				/* Under bcp_call_lock */
+
+static void block_check_compute_chunk(struct block_check_batch *bb,
+				      int start, int count)
+{
+	unsigned char const *bufs[BLOCK_CHECK_CHUNK];
+	uint32_t crcs[BLOCK_CHECK_CHUNK];
+	struct ocfs2_block_check *bc;
+	uint16_t ecc;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		memset(bb->bb_bc[start + i], 0,
+		       sizeof(struct ocfs2_block_check));
+		bufs[i] = bb->bb_data[start + i];
+	}
+
+	crc32_le_many(crcs, bufs, count, bb->bb_blocksize);
+
+	for (i = 0; i < count; i++) {
+		bc = bb->bb_bc[start + i];
+		ecc = (uint16_t)ocfs2_hamming_encode_block(bb->bb_data[start + i],
+							   bb->bb_blocksize);
+		bc->bc_crc32e = cpu_to_le32(crcs[i]);
+		bc->bc_ecc = cpu_to_le16(ecc);
+	}
+}
+
+static errcode_t block_check_validate_chunk(struct block_check_batch *bb,
+					    int start, int count)
+{
+	struct ocfs2_block_check check[BLOCK_CHECK_CHUNK];
+	unsigned char const *bufs[BLOCK_CHECK_CHUNK];
+	uint32_t crcs[BLOCK_CHECK_CHUNK];
+	struct ocfs2_block_check *bc;
+	errcode_t err, ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		bc = bb->bb_bc[start + i];
+		check[i].bc_crc32e = le32_to_cpu(bc->bc_crc32e);
+		check[i].bc_ecc = le16_to_cpu(bc->bc_ecc);
+		memset(bc, 0, sizeof(struct ocfs2_block_check));
+		bufs[i] = bb->bb_data[start + i];
+	}
+
+	crc32_le_many(crcs, bufs, count, bb->bb_blocksize);
+
+	for (i = 0; i < count; i++) {
+		err = 0;
+		if (crcs[i] != check[i].bc_crc32e)
+			err = block_check_fix(bb->bb_data[start + i],
+					      bb->bb_blocksize, &check[i]);
+
+		bc = bb->bb_bc[start + i];
+		bc->bc_crc32e = cpu_to_le32(check[i].bc_crc32e);
+		bc->bc_ecc = cpu_to_le16(check[i].bc_ecc);
+
+		if (bb->bb_errs)
+			bb->bb_errs[start + i] = err;
+		if (err)
+			ret = err;
+	}
+
+	return ret;
+}
+
+/* Take chunks until the batch is used up */
+static void block_check_run(struct block_check_batch *bb)
+{
+	int start, count;
+	errcode_t ret;
+
+	for (;;) {
+		pthread_mutex_lock(&bcp_lock);
+		start = bb->bb_next;
+		count = bb->bb_nr - start;
+		if (count > BLOCK_CHECK_CHUNK)
+			count = BLOCK_CHECK_CHUNK;
+		if (count > 0)
+			bb->bb_next += count;
+		pthread_mutex_unlock(&bcp_lock);
+
+		if (count <= 0)
+			break;
+
+		if (!bb->bb_validate) {
+			block_check_compute_chunk(bb, start, count);
+			continue;
+		}
+
+		ret = block_check_validate_chunk(bb, start, count);
+		if (ret) {
+			pthread_mutex_lock(&bcp_lock);
+			bb->bb_ret = ret;
+			pthread_mutex_unlock(&bcp_lock);
+		}
+	}
+}
+
+static void *block_check_worker(void *arg)
+{
+	struct block_check_batch *bb;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&bcp_lock);
+	for (;;) {
+		while (!bcp_stop && (!bcp_batch || (bcp_generation == seen)))
+			pthread_cond_wait(&bcp_work, &bcp_lock);
+		if (bcp_stop)
+			break;
+
+		seen = bcp_generation;
+		bb = bcp_batch;
+		bb->bb_active++;
+		pthread_mutex_unlock(&bcp_lock);
+
+		block_check_run(bb);
+
+		pthread_mutex_lock(&bcp_lock);
+		if (!--bb->bb_active)
+			pthread_cond_signal(&bcp_done);
+	}
+	pthread_mutex_unlock(&bcp_lock);
+
+	return NULL;
+}
+
+/*
+ * Start one worker per extra online CPU, up to BLOCK_CHECK_MAX_THREADS,
+ * for the _many() calls to share.  Does nothing if the pool is already
+ * running.  If no thread can be started, batches just run in the
+ * caller.
+ */
+void ocfs2_block_check_start_threads(void)
+{
+	sigset_t all, old;
+	long cpus;
+	int want;
+
+	pthread_mutex_lock(&bcp_call_lock);
+	if (bcp_threads)
+		goto out;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	want = (cpus > 1) ? cpus - 1 : 0;
+	if (want > BLOCK_CHECK_MAX_THREADS)
+		want = BLOCK_CHECK_MAX_THREADS;
+
+	/* Signals belong to the program, not to us */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	while (bcp_threads < want) {
+		if (pthread_create(&bcp_thread_ids[bcp_threads], NULL,
+				   block_check_worker, NULL))
+			break;
+		bcp_threads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+out:
+	pthread_mutex_unlock(&bcp_call_lock);
+}
+
+/* Waits for any batch using the pool, then ends the workers */
+void ocfs2_block_check_stop_threads(void)
+{
+	int i;
+
+	pthread_mutex_lock(&bcp_call_lock);
+
+	pthread_mutex_lock(&bcp_lock);
+	bcp_stop = 1;
+	pthread_cond_broadcast(&bcp_work);
+	pthread_mutex_unlock(&bcp_lock);
+
+	for (i = 0; i < bcp_threads; i++)
+		pthread_join(bcp_thread_ids[i], NULL);
+	bcp_threads = 0;
+
+	pthread_mutex_lock(&bcp_lock);
+	bcp_stop = 0;
+	pthread_mutex_unlock(&bcp_lock);
+
+	pthread_mutex_unlock(&bcp_call_lock);
+}
+
+static errcode_t block_check_batch_run(struct block_check_batch *bb)
+{
+	/* Workers must not race to resolve crc32_le() */
+	if (crc32_le_impl == crc32_le_resolve)
+		crc32_le_pick();
+
+	if ((bb->bb_nr < BLOCK_CHECK_MT_MIN) ||
+	    pthread_mutex_trylock(&bcp_call_lock)) {
+		block_check_run(bb);
+		return bb->bb_ret;
+	}
 
-	check.bc_crc32e = le32_to_cpu(bc->bc_crc32e);
-	check.bc_ecc = le16_to_cpu(bc->bc_ecc);
+	if (!bcp_threads) {
+		pthread_mutex_unlock(&bcp_call_lock);
+		block_check_run(bb);
+		return bb->bb_ret;
+	}
 
-	memset(bc, 0, sizeof(struct ocfs2_block_check));
+	pthread_mutex_lock(&bcp_lock);
+	bcp_batch = bb;
+	bcp_generation++;
+	pthread_cond_broadcast(&bcp_work);
+	pthread_mutex_unlock(&bcp_lock);
 
-	/* Fast path - if the crc32 validates, we're good to go */
-	crc = crc32_le(~0, data, blocksize);
-	if (crc == check.bc_crc32e)
-		goto out;
+	block_check_run(bb);
 
-	/* Ok, try ECC fixups */
-	ecc = ocfs2_hamming_encode_block(data, blocksize);
-	ocfs2_hamming_fix_block(data, blocksize, ecc ^ check.bc_ecc);
+	/*
+	 * Everything is taken.  Close the batch to latecomers and wait
+	 * for the workers still finishing their chunks.
+	 */
+	pthread_mutex_lock(&bcp_lock);
+	bcp_batch = NULL;
+	while (bb->bb_active)
+		pthread_cond_wait(&bcp_done, &bcp_lock);
+	pthread_mutex_unlock(&bcp_lock);
 
-	/* And check the crc32 again */
-	crc = crc32_le(~0, data, blocksize);
-	if (crc == check.bc_crc32e)
-		goto out;
+	pthread_mutex_unlock(&bcp_call_lock);
 
-	err = OCFS2_ET_IO;
+	return bb->bb_ret;
+}
 
-out:
-	bc->bc_crc32e = cpu_to_le32(check.bc_crc32e);
-	bc->bc_ecc = cpu_to_le16(check.bc_ecc);
+/*
+ * ocfs2_block_check_compute() for nr blocks of blocksize bytes.
+ * bc[i] describes data[i], with the same rules as the single-block
+ * version.  Big batches are spread over the CPUs.
+ */
+void ocfs2_block_check_compute_many(void **data, size_t blocksize,
+				    struct ocfs2_block_check **bc, int nr)
+{
+	struct block_check_batch bb = {
+		.bb_data = data,
+		.bb_blocksize = blocksize,
+		.bb_bc = bc,
+		.bb_nr = nr,
+	};
 
-	return err;
+	block_check_batch_run(&bb);
+}
+
+/*
+ * ocfs2_block_check_validate() for nr blocks.  Every block is checked
+ * and fixed where possible.  If errs is not NULL, errs[i] gets the
+ * result for data[i].  Returns OCFS2_ET_IO if any block was bad.
+ */
+errcode_t ocfs2_block_check_validate_many(void **data, size_t blocksize,
+					  struct ocfs2_block_check **bc,
+					  int nr, errcode_t *errs)
+{
+	struct block_check_batch bb = {
+		.bb_data = data,
+		.bb_blocksize = blocksize,
+		.bb_bc = bc,
+		.bb_nr = nr,
+		.bb_validate = 1,
+		.bb_errs = errs,
+	};
+
+	return block_check_batch_run(&bb);
 }
 
 /*
@@ -394,6 +1052,27 @@ errcode_t ocfs2_validate_meta_ecc(ocfs2_filesys *fs, void *data,
 	return err;
 }
 
+void ocfs2_compute_meta_ecc_many(ocfs2_filesys *fs, void **data,
+				 struct ocfs2_block_check **bc, int nr)
+{
+	if (ocfs2_meta_ecc(OCFS2_RAW_SB(fs->fs_super)))
+		ocfs2_block_check_compute_many(data, fs->fs_blocksize, bc,
+					       nr);
+}
+
+errcode_t ocfs2_validate_meta_ecc_many(ocfs2_filesys *fs, void **data,
+				       struct ocfs2_block_check **bc, int nr,
+				       errcode_t *errs)
+{
+	if (ocfs2_meta_ecc(OCFS2_RAW_SB(fs->fs_super)))
+		return ocfs2_block_check_validate_many(data, fs->fs_blocksize,
+						       bc, nr, errs);
+
+	if (errs)
+		memset(errs, 0, sizeof(errcode_t) * nr);
+	return 0;
+}
+
 #ifdef DEBUG_EXE
 #include <stdio.h>
 #include <string.h>
@@ -748,6 +1427,112 @@ static uint32_t ocfs2_hamming_encode_cheat_code_bit(uint32_t parity, void *data,
 }
 
 
+/*
+ * The crc32_le() we used to have, a byte at a time through one table.
+ * It's here so run_crc32() has something to measure against.
+ */
+static uint32_t crc32_le_orig(uint32_t crc, unsigned char const *p,
+			      size_t len)
+{
+	const uint32_t      *b =(uint32_t *)p;
+	const uint32_t      *tab = crc32table_le[0];
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+# define DO_CRC(x) crc = tab[ (crc ^ (x)) & 255 ] ^ (crc>>8)
+#else
+# define DO_CRC(x) crc = tab[ ((crc >> 24) ^ (x)) & 255] ^ (crc<<8)
+#endif
+
+	crc = cpu_to_le32(crc);
+	/* Align it */
+	if(((long)b)&3 && len){
+		do {
+			uint8_t *p = (uint8_t *)b;
+			DO_CRC(*p++);
+			b = (void *)p;
+		} while ((--len) && ((long)b)&3 );
+	}
+	if(len >= 4){
+		/* load data 32 bits wide, xor data 32 bits wide. */
+		size_t save_len = len & 3;
+	        len = len >> 2;
+		--b; /* use pre increment below(*++b) for speed */
+		do {
+			crc ^= *++b;
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+			DO_CRC(0);
+		} while (--len);
+		b++; /* point to next byte(s) */
+		len = save_len;
+	}
+	/* And the last few bytes */
+	if(len){
+		do {
+			uint8_t *p = (uint8_t *)b;
+			DO_CRC(*p++);
+			b = (void *)p;
+		} while (--len);
+	}
+
+	return le32_to_cpu(crc);
+#undef DO_CRC
+}
+
+/*
+ * The ocfs2_hamming_encode() we had before hamming_byte_table, walking
+ * the set bits one at a time.
+ */
+static uint32_t ocfs2_hamming_encode_bits(uint32_t parity, void *data,
+					  unsigned int d, unsigned int nr)
+{
+	unsigned int i, b, p = 0;
+
+	if (!d)
+		abort();
+
+	/*
+	 * b is the hamming code bit number.  Hamming code specifies a
+	 * 1-based array, but C uses 0-based.  So 'i' is for C, and 'b' is
+	 * for the algorithm.
+	 *
+	 * The i++ in the for loop is so that the start offset passed
+	 * to ocfs2_find_next_bit_set() is one greater than the previously
+	 * found bit.
+	 */
+	for (i = 0; (i = ocfs2_find_next_bit_set(data, d, i)) < d; i++)
+	{
+		/*
+		 * i is the offset in this hunk, nr + i is the total bit
+		 * offset.
+		 */
+		b = calc_code_bit(nr + i, &p);
+
+		/*
+		 * Data bits in the resultant code are checked by
+		 * parity bits that are part of the bit number
+		 * representation.  Huh?
+		 *
+		 * <wikipedia href="http://en.wikipedia.org/wiki/Hamming_code">
+		 * In other words, the parity bit at position 2^k
+		 * checks bits in positions having bit k set in
+		 * their binary representation.  Conversely, for
+		 * instance, bit 13, i.e. 1101(2), is checked by
+		 * bits 1000(2) = 8, 0100(2)=4 and 0001(2) = 1.
+		 * </wikipedia>
+		 *
+		 * Note that 'k' is the _code_ bit number.  'b' in
+		 * our loop.
+		 */
+		parity ^= b;
+	}
+
+	/* While the data buffer was treated as little endian, the
+	 * return value is in host endian. */
+	return parity;
+}
+
 struct run_context {
 	char *rc_name;
 	void *rc_data;
@@ -756,7 +1541,8 @@ struct run_context {
 	void (*rc_func)(struct run_context *ct, int nr);
 };
 
-static void timeme(struct run_context *ct)
+/* Returns the user+system time in microseconds */
+static uint64_t timeme(struct run_context *ct)
 {
 	int i;
 	struct rusage start;
@@ -775,26 +1561,112 @@ static void timeme(struct run_context *ct)
 	fprintf(stderr, "Time for %s: %ld.%06ld user, %ld.%06ld system\n",
 		ct->rc_name, usr_diff.tv_sec, usr_diff.tv_usec,
 		sys_diff.tv_sec, sys_diff.tv_usec);
+
+	return (usr_diff.tv_sec + sys_diff.tv_sec) * 1000000ULL +
+		usr_diff.tv_usec + sys_diff.tv_usec;
 }
 
+struct crc32_context {
+	struct run_context cc_rc;
+	uint32_t cc_crc;
+	int cc_crc_valid;
+	uint32_t (*cc_func)(uint32_t crc, unsigned char const *p,
+			    size_t len);
+};
+
+#define rc_to_cc(_rc) ((struct crc32_context *)(_rc))
+
 static void crc32_func(struct run_context *ct, int nr)
 {
 	uint32_t crc = ~0;
+	struct crc32_context *cc = rc_to_cc(ct);
+
+	crc = cc->cc_func(crc, ct->rc_data, ct->rc_size);
+
+	if (cc->cc_crc_valid) {
+		if (cc->cc_crc != crc) {
+			fprintf(stderr,
+				"Calculated crc32 %"PRIu32" != saved crc32 %"PRIu32"\n",
+				crc, cc->cc_crc);
+			exit(1);
+		}
+	} else {
+		assert(!nr);
+		cc->cc_crc = crc;
+		cc->cc_crc_valid = 1;
+	}
+}
+
+/*
+ * Every implementation has to agree with the original at each alignment
+ * and for all the short lengths, not just on the whole buffer.
+ */
+static void check_crc32(char *buf, int size,
+			uint32_t (*func)(uint32_t crc,
+					 unsigned char const *p, size_t len),
+			char *name)
+{
+	int off, len;
+	unsigned char *p = (unsigned char *)buf;
+
+	for (off = 0; (off < 16) && (off < size); off++) {
+		for (len = 0; (off + len) <= size;
+		     len += (len < 512) ? 1 : (len < 8192) ? 61 : size) {
+			if (func(~0, p + off, len) ==
+			    crc32_le_orig(~0, p + off, len))
+				continue;
+			fprintf(stderr,
+				"%s crc32 differs at offset %d, length %d\n",
+				name, off, len);
+			exit(1);
+		}
+	}
+}
 
-	crc = crc32_le(crc, ct->rc_data, ct->rc_size);
+static void run_crc32_one(struct crc32_context *cc, char *name,
+			  uint32_t (*func)(uint32_t crc,
+					   unsigned char const *p, size_t len),
+			  uint64_t orig_usecs)
+{
+	uint64_t usecs;
+
+	check_crc32(cc->cc_rc.rc_data, cc->cc_rc.rc_size, func, name);
+
+	cc->cc_rc.rc_name = name;
+	cc->cc_func = func;
+	usecs = timeme(&cc->cc_rc);
+	if (orig_usecs && usecs)
+		fprintf(stderr, "    %.2fx the original\n",
+			(double)orig_usecs / usecs);
 }
 
 static void run_crc32(char *buf, int size, int count)
 {
-	struct run_context ct = {
-		.rc_name = "CRC32",
-		.rc_data = buf,
-		.rc_size = size,
-		.rc_count = count,
-		.rc_func = crc32_func,
+	uint64_t orig;
+	struct crc32_context cc = {
+		.cc_rc = {
+			.rc_name = "Original CRC32",
+			.rc_data = buf,
+			.rc_size = size,
+			.rc_count = count,
+			.rc_func = crc32_func,
+		},
+		.cc_func = crc32_le_orig,
 	};
 
-	timeme(&ct);
+	orig = timeme(&cc.cc_rc);
+
+	run_crc32_one(&cc, "Slice-by-8 CRC32", crc32_le_sb8, orig);
+#ifdef CRC32_PCLMUL
+	if (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("sse4.1"))
+		run_crc32_one(&cc, "PCLMULQDQ CRC32", crc32_le_pclmul, orig);
+#endif
+#ifdef CRC32_ARM64
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+		run_crc32_one(&cc, "ARMv8 CRC32", crc32_le_arm64, orig);
+#endif
+	run_crc32_one(&cc, "Current CRC32", crc32_le, orig);
 }
 
 struct hamming_context {
@@ -847,6 +1719,10 @@ static void run_hamming(char *buf, int size, int count)
 	hc.hc_encode = ocfs2_hamming_encode;
 	timeme(&hc.hc_rc);
 
+	hc.hc_rc.rc_name = "Bit at a time hamming code";
+	hc.hc_encode = ocfs2_hamming_encode_bits;
+	timeme(&hc.hc_rc);
+
 	hc.hc_rc.rc_name = "Parity xor with orig calc bits";
 	hc.hc_encode = ocfs2_hamming_encode_orig_bits;
 	timeme(&hc.hc_rc);
@@ -864,6 +1740,264 @@ static void run_hamming(char *buf, int size, int count)
 	timeme(&hc.hc_rc);
 }
 
+/* Make sure hammingtable.h is what we think it is */
+/* What hammingtable.h says hamming_byte_table[r][v] should be */
+static unsigned int hamming_byte(unsigned int r, unsigned int v)
+{
+	unsigned int j, x, e = 0;
+
+	for (j = 0; j < 8; j++) {
+		if (!(v & (1 << j)))
+			continue;
+		x = r + j;
+		if (x < 8)
+			e ^= x | (1 << 3);
+		else
+			e ^= (x - 8) | (1 << 4);
+	}
+
+	return e;
+}
+
+static void hamming_table(void)
+{
+	unsigned int r, v, e;
+
+	for (r = 0; r < 8; r++) {
+		for (v = 0; v < 256; v++) {
+			e = hamming_byte(r, v);
+			if (hamming_byte_table[r][v] != e) {
+				fprintf(stderr,
+					"hamming_byte_table[%u][%u] is 0x%02x, "
+					"should be 0x%02x\n", r, v,
+					hamming_byte_table[r][v], e);
+				exit(1);
+			}
+		}
+	}
+}
+
+/* blockcheck -t > hammingtable.h */
+static void print_hamming_table(void)
+{
+	unsigned int r, v;
+
+	fprintf(stdout,
+		"/* this file is generated - do not edit */\n"
+		"\n"
+		"/*\n"
+		" * Generated by \"blockcheck -t\", the debug program in "
+		"blockcheck.c.\n"
+		" *\n"
+		" * ocfs2_hamming_encode() handles data a byte at a time.  "
+		"If the byte's\n"
+		" * first bit lands on code bit C, its bits are code bits C "
+		"through\n"
+		" * C + 7.  With A = C & ~7 and r = C & 7, the bits below "
+		"8 - r are at\n"
+		" * A + r + j, and the rest are at A + 8 + (r + j - 8).\n"
+		" * hamming_byte_table[r][byte] holds, for the set bits:\n"
+		" *\n"
+		" *   bits 0-2\tThe xor of the low three bits of their code "
+		"bit numbers\n"
+		" *   bit 3\tParity of the number of them at A + 0 .. A + 7\n"
+		" *   bit 4\tParity of the number of them at A + 8 .. "
+		"A + 15\n"
+		" */\n"
+		"#include <inttypes.h>\n"
+		"\n"
+		"static const uint8_t hamming_byte_table[8][256] = {{\n");
+
+	for (r = 0; r < 8; r++) {
+		for (v = 0; v < 256; v++)
+			fprintf(stdout, "0x%02x%s", hamming_byte(r, v),
+				(v == 255) ? "\n" :
+				((v % 8) == 7) ? ",\n" : ", ");
+		fprintf(stdout, "%s", (r == 7) ? "}};\n" : "},{\n");
+	}
+}
+
+/*
+ * Encode the buffer in odd sized hunks, then flip bits and make sure
+ * ocfs2_hamming_fix() puts them back.
+ */
+static void check_hamming(char *buf, int size)
+{
+	unsigned int d = size * 8, nr, hunk, bit, ecc, fix;
+	uint32_t full;
+	char *copy;
+
+	full = ocfs2_hamming_encode_bits(0, buf, d, 0);
+	if (ocfs2_hamming_encode_block(buf, size) != full) {
+		fprintf(stderr, "Hamming code differs on the whole buffer\n");
+		exit(1);
+	}
+
+	for (hunk = 1; hunk < 200; hunk += 13) {
+		ecc = 0;
+		for (nr = 0; nr < d; nr += 8 * hunk)
+			ecc = ocfs2_hamming_encode(ecc, buf + nr / 8,
+						   ocfs2_min(8 * hunk, d - nr),
+						   nr);
+		if (ecc != full) {
+			fprintf(stderr,
+				"Hamming code differs with %u byte hunks\n",
+				hunk);
+			exit(1);
+		}
+	}
+
+	copy = malloc(size);
+	if (!copy) {
+		fprintf(stderr, "Unable to allocate buffer: %s\n",
+			strerror(errno));
+		exit(1);
+	}
+	memcpy(copy, buf, size);
+
+	for (bit = 0; bit < d; bit += (bit < 4096) ? 1 : 997) {
+		if (ocfs2_test_bit(bit, buf))
+			ocfs2_clear_bit(bit, buf);
+		else
+			ocfs2_set_bit(bit, buf);
+		fix = ocfs2_hamming_encode_block(buf, size) ^ full;
+		ocfs2_hamming_fix_block(buf, size, fix);
+		if (memcmp(buf, copy, size)) {
+			fprintf(stderr, "Unable to fix data bit %u\n", bit);
+			exit(1);
+		}
+	}
+
+	free(copy);
+}
+
+/* Wall clock, because the batch functions use more than one thread */
+static uint64_t walltime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+#define BATCH_BLOCKSIZE	4096
+#define BATCH_CHECK_OFF	64	/* Where each block keeps its check */
+
+static void *batch_alloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p) {
+		fprintf(stderr, "Unable to allocate buffer: %s\n",
+			strerror(errno));
+		exit(1);
+	}
+	return p;
+}
+
+static void flip_bit(char *block, unsigned int seed)
+{
+	unsigned int first = (BATCH_CHECK_OFF + 8) * 8;
+	unsigned int bit = first + seed % (BATCH_BLOCKSIZE * 8 - first);
+
+	if (ocfs2_test_bit(bit, block))
+		ocfs2_clear_bit(bit, block);
+	else
+		ocfs2_set_bit(bit, block);
+}
+
+static void run_batch(char *buf, int size, int count)
+{
+	int i, n, nr = size / BATCH_BLOCKSIZE;
+	size_t len = (size_t)nr * BATCH_BLOCKSIZE;
+	struct ocfs2_block_check **bc, *want;
+	uint64_t start, serial, batch;
+	char *copy, *orig;
+	errcode_t *errs;
+	errcode_t ret;
+	void **data;
+
+	if (!nr) {
+		fprintf(stderr, "Buffer too small for batch checks\n");
+		return;
+	}
+
+	copy = batch_alloc(len);
+	orig = batch_alloc(len);
+	data = batch_alloc(sizeof(void *) * nr);
+	bc = batch_alloc(sizeof(struct ocfs2_block_check *) * nr);
+	want = batch_alloc(sizeof(struct ocfs2_block_check) * nr);
+	errs = batch_alloc(sizeof(errcode_t) * nr);
+
+	memcpy(copy, buf, len);
+	for (i = 0; i < nr; i++) {
+		data[i] = copy + (size_t)i * BATCH_BLOCKSIZE;
+		bc[i] = (struct ocfs2_block_check *)((char *)data[i] +
+						     BATCH_CHECK_OFF);
+	}
+
+	start = walltime();
+	for (n = 0; n < count; n++)
+		for (i = 0; i < nr; i++)
+			ocfs2_block_check_compute(data[i], BATCH_BLOCKSIZE,
+						  bc[i]);
+	serial = walltime() - start;
+	for (i = 0; i < nr; i++)
+		want[i] = *bc[i];
+
+	start = walltime();
+	for (n = 0; n < count; n++)
+		ocfs2_block_check_compute_many(data, BATCH_BLOCKSIZE, bc, nr);
+	batch = walltime() - start;
+	for (i = 0; i < nr; i++) {
+		if (memcmp(bc[i], &want[i], sizeof(want[i]))) {
+			fprintf(stderr, "Batched check differs on block %d\n",
+				i);
+			exit(1);
+		}
+	}
+
+	fprintf(stderr,
+		"Wall time for %d blocks: %"PRIu64" usecs one at a time, "
+		"%"PRIu64" usecs batched (%.2fx)\n",
+		nr, serial, batch, batch ? (double)serial / batch : 0.0);
+
+	/* One bad bit per block is fixable */
+	memcpy(orig, copy, len);
+	for (i = 0; i < nr; i++)
+		flip_bit(data[i], i * 7919);
+	ret = ocfs2_block_check_validate_many(data, BATCH_BLOCKSIZE, bc, nr,
+					      errs);
+	if (ret || memcmp(copy, orig, len)) {
+		fprintf(stderr, "Batched validate did not fix all blocks\n");
+		exit(1);
+	}
+
+	/* Two are not */
+	flip_bit(data[nr / 2], 1);
+	flip_bit(data[nr / 2], 2);
+	ret = ocfs2_block_check_validate_many(data, BATCH_BLOCKSIZE, bc, nr,
+					      errs);
+	for (i = 0; i < nr; i++) {
+		if (errs[i] != ((i == nr / 2) ? OCFS2_ET_IO : 0)) {
+			fprintf(stderr,
+				"Batched validate got block %d wrong\n", i);
+			exit(1);
+		}
+	}
+	if (ret != OCFS2_ET_IO) {
+		fprintf(stderr, "Batched validate missed a bad block\n");
+		exit(1);
+	}
+
+	free(errs);
+	free(want);
+	free(bc);
+	free(data);
+	free(orig);
+	free(copy);
+}
+
 static uint64_t read_number(const char *num)
 {
 	uint64_t val;
@@ -931,7 +2065,8 @@ static void get_file(char *filename, char **buf, int *size)
 static void print_usage(void)
 {
 	fprintf(stderr,
-		"Usage: blockcheck <filename> [<count>]\n");
+		"Usage: blockcheck <filename> [<count>]\n"
+		"       blockcheck -t\n");
 }
 
 int main(int argc, char *argv[])
@@ -948,6 +2083,11 @@ int main(int argc, char *argv[])
 	}
 	filename = argv[1];
 
+	if (!strcmp(filename, "-t")) {
+		print_hamming_table();
+		return 0;
+	}
+
 	if (argc > 2) {
 		count = read_number(argv[2]);
 		if (count < 1) {
@@ -958,9 +2098,13 @@ int main(int argc, char *argv[])
 	}
 
 	get_file(filename, &buf, &size);
+	hamming_table();
+	check_hamming(buf, size);
 	run_crc32(buf, size, count);
 	run_hamming(buf, size, count);
-
+	ocfs2_block_check_start_threads();
+	run_batch(buf, size, count);
+	ocfs2_block_check_stop_threads();
 
 #if 0
 	ocfs2_block_check_compute(buf, size, &check);
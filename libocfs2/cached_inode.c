@@ -76,6 +76,8 @@ errcode_t ocfs2_free_cached_inode(ocfs2_filesys *fs,
 	if (cinode->ci_chains)
 		ocfs2_bitmap_free(cinode->ci_chains);
 
+	ocfs2_extent_map_drop(cinode);
+
 	if (cinode->ci_inode)
 		ocfs2_free(&cinode->ci_inode);
 
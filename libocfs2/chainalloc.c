@@ -41,10 +41,22 @@ struct chainalloc_bitmap_private {
 	int			cb_dirty;
 };
 
+/*
+ * Each group keeps a summary of its free bits so that searches can skip
+ * groups without looking at their bitmaps.  The free count is the
+ * region's br_total_bits - br_set_bits.  cr_largest_free is never less
+ * than the longest run of free bits, and cr_first_free is never past
+ * the first free bit.  Setting a bit keeps both true; clearing one
+ * loosens cr_largest_free to the free count.  Whenever a search has
+ * looked at every free run, or found the first free bit, it makes them
+ * exact again.
+ */
 struct chainalloc_region_private {
 	struct chainalloc_bitmap_private	*cr_cb;
 	struct ocfs2_group_desc			*cr_ag;
 	int					cr_dirty;
+	int					cr_largest_free;
+	int					cr_first_free;
 };
 
 
@@ -127,6 +139,8 @@ static int chainalloc_process_group(ocfs2_filesys *fs,
 	br->br_private = cr;
 	memcpy(br->br_bitmap, cr->cr_ag->bg_bitmap, br->br_bytes);
 	br->br_set_bits = cr->cr_ag->bg_bits - cr->cr_ag->bg_free_bits_count;
+	cr->cr_largest_free = cr->cr_ag->bg_free_bits_count;
+	cr->cr_first_free = 0;
 
 	cb->cb_errcode = ocfs2_bitmap_insert_region(bitmap, br);
 	if (cb->cb_errcode)
@@ -230,33 +244,152 @@ static void chainalloc_bit_change_notify(ocfs2_bitmap *bitmap,
 	struct ocfs2_group_desc *ag = cr->cr_ag;
 	struct ocfs2_chain_rec *rec =
 		&di->id2.i_chain.cl_recs[ag->bg_chain];
+	int free_bits = br->br_total_bits - br->br_set_bits;
 
 	if (new_val) {
 		ag->bg_free_bits_count--;
 		rec->c_free--;
 		di->id1.bitmap1.i_used++;
+		if (cr->cr_largest_free > free_bits)
+			cr->cr_largest_free = free_bits;
 	} else {
 		ag->bg_free_bits_count++;
 		rec->c_free++;
 		di->id1.bitmap1.i_used--;
+		cr->cr_largest_free = free_bits;
+		if (bitno - br->br_start_bit < cr->cr_first_free)
+			cr->cr_first_free = bitno - br->br_start_bit;
 	}
 
 	cr->cr_dirty = 1;
 	cb->cb_dirty = 1;
 }
 
+static errcode_t chainalloc_find_next_clear(ocfs2_bitmap *bitmap,
+					    uint64_t start,
+					    uint64_t *found)
+{
+	struct ocfs2_bitmap_region *br;
+	struct chainalloc_region_private *cr;
+	struct rb_node *node = NULL;
+	int offset, from, ret;
+
+	/* start from either the group that contains the bit or the next
+	 * one after it */
+	br = ocfs2_bitmap_lookup(bitmap, start, 1, NULL, NULL, &node);
+	if (br)
+		node = &br->br_node;
+
+	for (; node != NULL; node = rb_next(node)) {
+		br = rb_entry(node, struct ocfs2_bitmap_region, br_node);
+		cr = br->br_private;
+
+		if (start > br->br_start_bit)
+			offset = start - br->br_start_bit;
+		else
+			offset = 0;
+
+		from = offset;
+		if (from < cr->cr_first_free)
+			from = cr->cr_first_free;
+
+		ret = ocfs2_find_next_bit_clear(br->br_bitmap,
+						br->br_total_bits, from);
+		if (offset <= cr->cr_first_free)
+			cr->cr_first_free = ret;
+		if (ret != br->br_total_bits) {
+			*found = br->br_start_bit + ret;
+			return 0;
+		}
+	}
+
+	return OCFS2_ET_BIT_NOT_FOUND;
+}
+
+/*
+ * The same choice as ocfs2_bitmap_alloc_range_generic(): the first
+ * group with a free run of at least min_len gives the first run of len,
+ * or failing that its longest run.  Groups whose summary says they have
+ * no run of min_len are skipped.
+ */
+static errcode_t chainalloc_alloc_range(ocfs2_bitmap *bitmap,
+					uint64_t min_len,
+					uint64_t len,
+					uint64_t *first_bit,
+					uint64_t *bits_found)
+{
+	struct ocfs2_bitmap_region *br;
+	struct chainalloc_region_private *cr;
+	struct rb_node *node;
+	int start, end, best_start, best_len;
+
+	for (node = rb_first(&bitmap->b_regions); node; node = rb_next(node)) {
+		br = rb_entry(node, struct ocfs2_bitmap_region, br_node);
+		cr = br->br_private;
+
+		if (cr->cr_largest_free < min_len)
+			continue;
+
+		best_start = best_len = 0;
+		start = ocfs2_find_next_bit_clear(br->br_bitmap,
+						  br->br_total_bits,
+						  cr->cr_first_free);
+		cr->cr_first_free = start;
+		while (start < br->br_total_bits) {
+			end = ocfs2_find_next_bit_set(br->br_bitmap,
+						      br->br_total_bits,
+						      start);
+
+			/* We've found a region large enough to hold our max. */
+			if ((end - start) >= len) {
+				end = start + len;
+				goto found;
+			}
+
+			if ((end - start) > best_len) {
+				best_len = end - start;
+				best_start = start;
+			}
+
+			start = ocfs2_find_next_bit_clear(br->br_bitmap,
+							  br->br_total_bits,
+							  end);
+		}
+
+		/* That was every free run in the group */
+		cr->cr_largest_free = best_len;
+		if (best_len < min_len)
+			continue;
+
+		/* Best fit works */
+		start = best_start;
+		end = best_start + best_len;
+found:
+		*first_bit = br->br_start_bit + start;
+		*bits_found = end - start;
+
+		for (; start < end; start++)
+			ocfs2_bitmap_set_generic(bitmap,
+						 br->br_start_bit + start,
+						 NULL);
+		return 0;
+	}
+
+	return OCFS2_ET_BIT_NOT_FOUND;
+}
+
 static struct ocfs2_bitmap_operations chainalloc_bitmap_ops = {
 	.set_bit		= ocfs2_bitmap_set_generic,
 	.clear_bit		= ocfs2_bitmap_clear_generic,
 	.test_bit		= ocfs2_bitmap_test_generic,
 	.find_next_set		= ocfs2_bitmap_find_next_set_generic,
-	.find_next_clear	= ocfs2_bitmap_find_next_clear_generic,
+	.find_next_clear	= chainalloc_find_next_clear,
 	.merge_region		= chainalloc_merge_region,
 	.read_bitmap		= chainalloc_read_bitmap,
 	.write_bitmap		= chainalloc_write_bitmap,
 	.destroy_notify		= chainalloc_destroy_notify,
 	.bit_change_notify	= chainalloc_bit_change_notify,
-	.alloc_range		= ocfs2_bitmap_alloc_range_generic,
+	.alloc_range		= chainalloc_alloc_range,
 	.clear_range		= ocfs2_bitmap_clear_range_generic,
 };
 
@@ -633,6 +766,7 @@ extern char *optarg;
 static void dump_regions(ocfs2_bitmap *bitmap)
 {
 	struct ocfs2_bitmap_region *br;
+	struct chainalloc_region_private *cr;
 	struct rb_node *node;
 
 	fprintf(stdout, "Bitmap \"%s\": total = %"PRIu64", set = %"PRIu64"\n",
@@ -641,11 +775,14 @@ static void dump_regions(ocfs2_bitmap *bitmap)
 
 	for (node = rb_first(&bitmap->b_regions);node; node = rb_next(node)) {
 		br = rb_entry(node, struct ocfs2_bitmap_region, br_node);
+		cr = br->br_private;
 
 		fprintf(stdout,
-			"(start: %"PRIu64", n: %d, set: %d)\n",
+			"(start: %"PRIu64", n: %d, set: %d, "
+			"largest free <= %d, first free >= %d)\n",
 			br->br_start_bit, br->br_total_bits,
-			br->br_set_bits);
+			br->br_set_bits, cr->cr_largest_free,
+			cr->cr_first_free);
 	}
 }
 
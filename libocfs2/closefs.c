@@ -33,14 +33,18 @@
 
 errcode_t ocfs2_flush(ocfs2_filesys *fs)
 {
-	return 0;
+	/* tunefs hands its shared channel around and clears fs_io */
+	if (!fs->fs_io)
+		return 0;
+
+	return io_flush(fs->fs_io);
 }
 
 errcode_t ocfs2_close(ocfs2_filesys *fs)
 {
 	errcode_t ret;
 
-	if (fs->fs_flags & OCFS2_FLAG_DIRTY) {
+	if (fs->fs_flags & (OCFS2_FLAG_DIRTY | OCFS2_FLAG_RW)) {
 		ret = ocfs2_flush(fs);
 		if (ret)
 			return ret;
@@ -3381,6 +3381,8 @@ errcode_t ocfs2_cached_inode_insert_extent(ocfs2_cached_inode *ci,
 	int free_records = 0;
 	ocfs2_filesys *fs = ci->ci_fs;
 
+	ocfs2_extent_map_drop(ci);
+
 	ctxt.fs = fs;
 	ctxt.di = ci->ci_inode;
 	di_buf = (char *)ctxt.di;
@@ -33,6 +33,176 @@
 
 #include "extent_map.h"
 
+/*
+ * How many leaf records we are willing to remember per cached inode.
+ * When a new leaf does not fit, the old ones are forgotten wholesale;
+ * sequential readers only ever need the leaf they are walking.
+ */
+#define OCFS2_EXTENT_MAP_MAX_ENTRIES	2048
+
+void ocfs2_extent_map_drop(ocfs2_cached_inode *cinode)
+{
+	ocfs2_extent_map *em = cinode->ci_map;
+	ocfs2_extent_map_entry *ent;
+	struct rb_node *node;
+
+	if (!em)
+		return;
+
+	while ((node = rb_first(&em->em_extents)) != NULL) {
+		ent = rb_entry(node, ocfs2_extent_map_entry, e_node);
+		rb_erase(node, &em->em_extents);
+		ocfs2_free(&ent);
+	}
+
+	if (em->em_root)
+		ocfs2_free(&em->em_root);
+	ocfs2_free(&cinode->ci_map);
+}
+
+/*
+ * The map is only good for the tree it was read from.  Anything that
+ * reshapes the tree through ci_inode changes i_clusters, the root
+ * records or i_last_eb_blk, so compare those before trusting it.
+ */
+static int ocfs2_extent_map_valid(ocfs2_extent_map *em,
+				  struct ocfs2_dinode *di)
+{
+	struct ocfs2_extent_list *el = &di->id2.i_list;
+
+	if ((em->em_clusters != di->i_clusters) ||
+	    (em->em_last_eb_blk != di->i_last_eb_blk) ||
+	    (em->em_tree_depth != el->l_tree_depth) ||
+	    (em->em_next_free_rec != el->l_next_free_rec))
+		return 0;
+
+	return !memcmp(em->em_root, el->l_recs,
+		       sizeof(struct ocfs2_extent_rec) * el->l_next_free_rec);
+}
+
+static errcode_t ocfs2_extent_map_new(ocfs2_cached_inode *cinode)
+{
+	errcode_t ret;
+	ocfs2_extent_map *em;
+	struct ocfs2_dinode *di = cinode->ci_inode;
+	struct ocfs2_extent_list *el = &di->id2.i_list;
+
+	ret = ocfs2_malloc0(sizeof(ocfs2_extent_map), &em);
+	if (ret)
+		return ret;
+
+	ret = ocfs2_malloc(sizeof(struct ocfs2_extent_rec) *
+			   (el->l_next_free_rec ? el->l_next_free_rec : 1),
+			   &em->em_root);
+	if (ret) {
+		ocfs2_free(&em);
+		return ret;
+	}
+
+	memcpy(em->em_root, el->l_recs,
+	       sizeof(struct ocfs2_extent_rec) * el->l_next_free_rec);
+	em->em_extents = RB_ROOT;
+	em->em_clusters = di->i_clusters;
+	em->em_last_eb_blk = di->i_last_eb_blk;
+	em->em_tree_depth = el->l_tree_depth;
+	em->em_next_free_rec = el->l_next_free_rec;
+
+	cinode->ci_map = em;
+	return 0;
+}
+
+static ocfs2_extent_map_entry *ocfs2_extent_map_lookup(ocfs2_extent_map *em,
+						       uint32_t v_cluster)
+{
+	struct rb_node *node = em->em_extents.rb_node;
+	ocfs2_extent_map_entry *ent;
+
+	while (node) {
+		ent = rb_entry(node, ocfs2_extent_map_entry, e_node);
+
+		if (v_cluster < ent->e_rec.e_cpos)
+			node = node->rb_left;
+		else if (v_cluster >= (ent->e_rec.e_cpos +
+				       ent->e_rec.e_leaf_clusters))
+			node = node->rb_right;
+		else
+			return ent;
+	}
+
+	return NULL;
+}
+
+static errcode_t ocfs2_extent_map_insert(ocfs2_extent_map *em,
+					 struct ocfs2_extent_rec *rec)
+{
+	errcode_t ret;
+	struct rb_node **p = &em->em_extents.rb_node;
+	struct rb_node *parent = NULL;
+	ocfs2_extent_map_entry *ent;
+	uint32_t end = rec->e_cpos + rec->e_leaf_clusters;
+
+	while (*p) {
+		parent = *p;
+		ent = rb_entry(parent, ocfs2_extent_map_entry, e_node);
+
+		if (end <= ent->e_rec.e_cpos)
+			p = &(*p)->rb_left;
+		else if (rec->e_cpos >= (ent->e_rec.e_cpos +
+					 ent->e_rec.e_leaf_clusters))
+			p = &(*p)->rb_right;
+		else if (!memcmp(&ent->e_rec, rec, sizeof(*rec)))
+			return 0;
+		else
+			return OCFS2_ET_CORRUPT_EXTENT_BLOCK;
+	}
+
+	ret = ocfs2_malloc(sizeof(ocfs2_extent_map_entry), &ent);
+	if (ret)
+		return ret;
+
+	ent->e_rec = *rec;
+	rb_link_node(&ent->e_node, parent, p);
+	rb_insert_color(&ent->e_node, &em->em_extents);
+	em->em_nr_entries++;
+
+	return 0;
+}
+
+/*
+ * Remember every record of a leaf we just paid to read.  This is only
+ * a cache, so on any trouble we simply stop caching for this inode and
+ * let the lookup go to disk next time.
+ */
+static void ocfs2_extent_map_add_leaf(ocfs2_cached_inode *cinode,
+				      struct ocfs2_extent_list *el)
+{
+	int i;
+	struct ocfs2_extent_rec *rec;
+
+	if (!cinode->ci_map && ocfs2_extent_map_new(cinode))
+		return;
+
+	if ((cinode->ci_map->em_nr_entries + el->l_next_free_rec) >
+	    OCFS2_EXTENT_MAP_MAX_ENTRIES) {
+		ocfs2_extent_map_drop(cinode);
+		if (ocfs2_extent_map_new(cinode))
+			return;
+	}
+
+	for (i = 0; i < el->l_next_free_rec; i++) {
+		rec = &el->l_recs[i];
+
+		/* ocfs2_get_clusters() wants to complain about these */
+		if (!rec->e_leaf_clusters || !rec->e_blkno)
+			continue;
+
+		if (ocfs2_extent_map_insert(cinode->ci_map, rec)) {
+			ocfs2_extent_map_drop(cinode);
+			return;
+		}
+	}
+}
+
 /*
  * Return the 1st index within el which contains an extent start
  * larger than v_cluster.
@@ -140,6 +310,7 @@ errcode_t ocfs2_get_clusters(ocfs2_cached_inode *cinode,
 	struct ocfs2_extent_block *eb;
 	struct ocfs2_extent_list *el;
 	struct ocfs2_extent_rec *rec;
+	ocfs2_extent_map_entry *ent;
 	char *eb_buf = NULL;
 	uint32_t coff;
 
@@ -147,6 +318,28 @@ errcode_t ocfs2_get_clusters(ocfs2_cached_inode *cinode,
 	el = &di->id2.i_list;
 
 	if (el->l_tree_depth) {
+		if (cinode->ci_map &&
+		    !ocfs2_extent_map_valid(cinode->ci_map, di))
+			ocfs2_extent_map_drop(cinode);
+
+		if (cinode->ci_map) {
+			ent = ocfs2_extent_map_lookup(cinode->ci_map,
+						      v_cluster);
+			if (ent) {
+				rec = &ent->e_rec;
+				coff = v_cluster - rec->e_cpos;
+				*p_cluster = ocfs2_blocks_to_clusters(fs,
+								rec->e_blkno);
+				*p_cluster = *p_cluster + coff;
+				if (num_clusters)
+					*num_clusters =
+						rec->e_leaf_clusters - coff;
+				if (extent_flags)
+					*extent_flags = rec->e_flags;
+				return 0;
+			}
+		}
+
 		ret = ocfs2_find_leaf(fs, di, v_cluster, &eb_buf);
 		if (ret)
 			goto out;
@@ -158,6 +351,8 @@ errcode_t ocfs2_get_clusters(ocfs2_cached_inode *cinode,
 			ret = OCFS2_ET_CORRUPT_EXTENT_BLOCK;
 			goto out;
 		}
+
+		ocfs2_extent_map_add_leaf(cinode, el);
 	}
 
 	i = ocfs2_search_extent_list(el, v_cluster);
@@ -29,16 +29,28 @@
 
 #include "ocfs2/kernel-rbtree.h"
 
+typedef struct _ocfs2_extent_map ocfs2_extent_map;
 typedef struct _ocfs2_extent_map_entry ocfs2_extent_map_entry;
 
+/*
+ * Leaf records that ocfs2_get_clusters() has already resolved for a
+ * cached inode, keyed by e_cpos.  The map only describes the tree
+ * hanging off the dinode it was filled from; the em_* fields below are
+ * a copy of that dinode's root and the map is thrown away as soon as
+ * ci_inode no longer matches them.
+ */
 struct _ocfs2_extent_map {
 	struct rb_root em_extents;
+	int em_nr_entries;
 	uint32_t em_clusters;
+	uint64_t em_last_eb_blk;
+	uint16_t em_tree_depth;
+	uint16_t em_next_free_rec;
+	struct ocfs2_extent_rec *em_root;
 };
 
 struct _ocfs2_extent_map_entry {
 	struct rb_node e_node;
-	int e_tree_depth;
 	struct ocfs2_extent_rec e_rec;
 };
 
@@ -117,27 +117,21 @@ errcode_t ocfs2_read_extent_block_nocheck(ocfs2_filesys *fs,
 					  char *eb_buf)
 {
 	errcode_t ret;
-	char *blk;
-	struct ocfs2_extent_block *eb;
+	const char *blk;
+	const struct ocfs2_extent_block *eb;
 
 	if ((blkno < OCFS2_SUPER_BLOCK_BLKNO) ||
 	    (blkno > fs->fs_blocks))
 		return OCFS2_ET_BAD_BLKNO;
 
-	ret = ocfs2_malloc_block(fs->fs_io, &blk);
+	ret = ocfs2_get_meta_block(fs, blkno,
+				   offsetof(struct ocfs2_extent_block,
+					    h_check),
+				   &blk);
 	if (ret)
 		return ret;
 
-	ret = ocfs2_read_blocks(fs, blkno, 1, blk);
-	if (ret)
-		goto out;
-
-	eb = (struct ocfs2_extent_block *)blk;
-
-	ret = ocfs2_validate_meta_ecc(fs, blk, &eb->h_check);
-	if (ret)
-		goto out;
-
+	eb = (const struct ocfs2_extent_block *)blk;
 	if (memcmp(eb->h_signature, OCFS2_EXTENT_BLOCK_SIGNATURE,
 		   strlen(OCFS2_EXTENT_BLOCK_SIGNATURE))) {
 		ret = OCFS2_ET_BAD_EXTENT_BLOCK_MAGIC;
@@ -145,12 +139,11 @@ errcode_t ocfs2_read_extent_block_nocheck(ocfs2_filesys *fs,
 	}
 
 	memcpy(eb_buf, blk, fs->fs_blocksize);
-
-	eb = (struct ocfs2_extent_block *) eb_buf;
-	ocfs2_swap_extent_block_to_cpu(fs, eb);
+	ocfs2_swap_extent_block_to_cpu(fs,
+				       (struct ocfs2_extent_block *)eb_buf);
 
 out:
-	ocfs2_free(&blk);
+	ocfs2_put_block(fs, blk);
 
 	return ret;
 }
@@ -0,0 +1,282 @@
+/* this file is generated - do not edit */
+
+/*
+ * Generated by "blockcheck -t", the debug program in blockcheck.c.
+ *
+ * ocfs2_hamming_encode() handles data a byte at a time.  If the byte's
+ * first bit lands on code bit C, its bits are code bits C through
+ * C + 7.  With A = C & ~7 and r = C & 7, the bits below 8 - r are at
+ * A + r + j, and the rest are at A + 8 + (r + j - 8).
+ * hamming_byte_table[r][byte] holds, for the set bits:
+ *
+ *   bits 0-2	The xor of the low three bits of their code bit numbers
+ *   bit 3	Parity of the number of them at A + 0 .. A + 7
+ *   bit 4	Parity of the number of them at A + 8 .. A + 15
+ */
+#include <inttypes.h>
+
+static const uint8_t hamming_byte_table[8][256] = {{
+0x00, 0x08, 0x09, 0x01, 0x0a, 0x02, 0x03, 0x0b,
+0x0b, 0x03, 0x02, 0x0a, 0x01, 0x09, 0x08, 0x00,
+0x0c, 0x04, 0x05, 0x0d, 0x06, 0x0e, 0x0f, 0x07,
+0x07, 0x0f, 0x0e, 0x06, 0x0d, 0x05, 0x04, 0x0c,
+0x0d, 0x05, 0x04, 0x0c, 0x07, 0x0f, 0x0e, 0x06,
+0x06, 0x0e, 0x0f, 0x07, 0x0c, 0x04, 0x05, 0x0d,
+0x01, 0x09, 0x08, 0x00, 0x0b, 0x03, 0x02, 0x0a,
+0x0a, 0x02, 0x03, 0x0b, 0x00, 0x08, 0x09, 0x01,
+0x0e, 0x06, 0x07, 0x0f, 0x04, 0x0c, 0x0d, 0x05,
+0x05, 0x0d, 0x0c, 0x04, 0x0f, 0x07, 0x06, 0x0e,
+0x02, 0x0a, 0x0b, 0x03, 0x08, 0x00, 0x01, 0x09,
+0x09, 0x01, 0x00, 0x08, 0x03, 0x0b, 0x0a, 0x02,
+0x03, 0x0b, 0x0a, 0x02, 0x09, 0x01, 0x00, 0x08,
+0x08, 0x00, 0x01, 0x09, 0x02, 0x0a, 0x0b, 0x03,
+0x0f, 0x07, 0x06, 0x0e, 0x05, 0x0d, 0x0c, 0x04,
+0x04, 0x0c, 0x0d, 0x05, 0x0e, 0x06, 0x07, 0x0f,
+0x0f, 0x07, 0x06, 0x0e, 0x05, 0x0d, 0x0c, 0x04,
+0x04, 0x0c, 0x0d, 0x05, 0x0e, 0x06, 0x07, 0x0f,
+0x03, 0x0b, 0x0a, 0x02, 0x09, 0x01, 0x00, 0x08,
+0x08, 0x00, 0x01, 0x09, 0x02, 0x0a, 0x0b, 0x03,
+0x02, 0x0a, 0x0b, 0x03, 0x08, 0x00, 0x01, 0x09,
+0x09, 0x01, 0x00, 0x08, 0x03, 0x0b, 0x0a, 0x02,
+0x0e, 0x06, 0x07, 0x0f, 0x04, 0x0c, 0x0d, 0x05,
+0x05, 0x0d, 0x0c, 0x04, 0x0f, 0x07, 0x06, 0x0e,
+0x01, 0x09, 0x08, 0x00, 0x0b, 0x03, 0x02, 0x0a,
+0x0a, 0x02, 0x03, 0x0b, 0x00, 0x08, 0x09, 0x01,
+0x0d, 0x05, 0x04, 0x0c, 0x07, 0x0f, 0x0e, 0x06,
+0x06, 0x0e, 0x0f, 0x07, 0x0c, 0x04, 0x05, 0x0d,
+0x0c, 0x04, 0x05, 0x0d, 0x06, 0x0e, 0x0f, 0x07,
+0x07, 0x0f, 0x0e, 0x06, 0x0d, 0x05, 0x04, 0x0c,
+0x00, 0x08, 0x09, 0x01, 0x0a, 0x02, 0x03, 0x0b,
+0x0b, 0x03, 0x02, 0x0a, 0x01, 0x09, 0x08, 0x00
+},{
+0x00, 0x09, 0x0a, 0x03, 0x0b, 0x02, 0x01, 0x08,
+0x0c, 0x05, 0x06, 0x0f, 0x07, 0x0e, 0x0d, 0x04,
+0x0d, 0x04, 0x07, 0x0e, 0x06, 0x0f, 0x0c, 0x05,
+0x01, 0x08, 0x0b, 0x02, 0x0a, 0x03, 0x00, 0x09,
+0x0e, 0x07, 0x04, 0x0d, 0x05, 0x0c, 0x0f, 0x06,
+0x02, 0x0b, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0a,
+0x03, 0x0a, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0b,
+0x0f, 0x06, 0x05, 0x0c, 0x04, 0x0d, 0x0e, 0x07,
+0x0f, 0x06, 0x05, 0x0c, 0x04, 0x0d, 0x0e, 0x07,
+0x03, 0x0a, 0x09, 0x00, 0x08, 0x01, 0x02, 0x0b,
+0x02, 0x0b, 0x08, 0x01, 0x09, 0x00, 0x03, 0x0a,
+0x0e, 0x07, 0x04, 0x0d, 0x05, 0x0c, 0x0f, 0x06,
+0x01, 0x08, 0x0b, 0x02, 0x0a, 0x03, 0x00, 0x09,
+0x0d, 0x04, 0x07, 0x0e, 0x06, 0x0f, 0x0c, 0x05,
+0x0c, 0x05, 0x06, 0x0f, 0x07, 0x0e, 0x0d, 0x04,
+0x00, 0x09, 0x0a, 0x03, 0x0b, 0x02, 0x01, 0x08,
+0x10, 0x19, 0x1a, 0x13, 0x1b, 0x12, 0x11, 0x18,
+0x1c, 0x15, 0x16, 0x1f, 0x17, 0x1e, 0x1d, 0x14,
+0x1d, 0x14, 0x17, 0x1e, 0x16, 0x1f, 0x1c, 0x15,
+0x11, 0x18, 0x1b, 0x12, 0x1a, 0x13, 0x10, 0x19,
+0x1e, 0x17, 0x14, 0x1d, 0x15, 0x1c, 0x1f, 0x16,
+0x12, 0x1b, 0x18, 0x11, 0x19, 0x10, 0x13, 0x1a,
+0x13, 0x1a, 0x19, 0x10, 0x18, 0x11, 0x12, 0x1b,
+0x1f, 0x16, 0x15, 0x1c, 0x14, 0x1d, 0x1e, 0x17,
+0x1f, 0x16, 0x15, 0x1c, 0x14, 0x1d, 0x1e, 0x17,
+0x13, 0x1a, 0x19, 0x10, 0x18, 0x11, 0x12, 0x1b,
+0x12, 0x1b, 0x18, 0x11, 0x19, 0x10, 0x13, 0x1a,
+0x1e, 0x17, 0x14, 0x1d, 0x15, 0x1c, 0x1f, 0x16,
+0x11, 0x18, 0x1b, 0x12, 0x1a, 0x13, 0x10, 0x19,
+0x1d, 0x14, 0x17, 0x1e, 0x16, 0x1f, 0x1c, 0x15,
+0x1c, 0x15, 0x16, 0x1f, 0x17, 0x1e, 0x1d, 0x14,
+0x10, 0x19, 0x1a, 0x13, 0x1b, 0x12, 0x11, 0x18
+},{
+0x00, 0x0a, 0x0b, 0x01, 0x0c, 0x06, 0x07, 0x0d,
+0x0d, 0x07, 0x06, 0x0c, 0x01, 0x0b, 0x0a, 0x00,
+0x0e, 0x04, 0x05, 0x0f, 0x02, 0x08, 0x09, 0x03,
+0x03, 0x09, 0x08, 0x02, 0x0f, 0x05, 0x04, 0x0e,
+0x0f, 0x05, 0x04, 0x0e, 0x03, 0x09, 0x08, 0x02,
+0x02, 0x08, 0x09, 0x03, 0x0e, 0x04, 0x05, 0x0f,
+0x01, 0x0b, 0x0a, 0x00, 0x0d, 0x07, 0x06, 0x0c,
+0x0c, 0x06, 0x07, 0x0d, 0x00, 0x0a, 0x0b, 0x01,
+0x10, 0x1a, 0x1b, 0x11, 0x1c, 0x16, 0x17, 0x1d,
+0x1d, 0x17, 0x16, 0x1c, 0x11, 0x1b, 0x1a, 0x10,
+0x1e, 0x14, 0x15, 0x1f, 0x12, 0x18, 0x19, 0x13,
+0x13, 0x19, 0x18, 0x12, 0x1f, 0x15, 0x14, 0x1e,
+0x1f, 0x15, 0x14, 0x1e, 0x13, 0x19, 0x18, 0x12,
+0x12, 0x18, 0x19, 0x13, 0x1e, 0x14, 0x15, 0x1f,
+0x11, 0x1b, 0x1a, 0x10, 0x1d, 0x17, 0x16, 0x1c,
+0x1c, 0x16, 0x17, 0x1d, 0x10, 0x1a, 0x1b, 0x11,
+0x11, 0x1b, 0x1a, 0x10, 0x1d, 0x17, 0x16, 0x1c,
+0x1c, 0x16, 0x17, 0x1d, 0x10, 0x1a, 0x1b, 0x11,
+0x1f, 0x15, 0x14, 0x1e, 0x13, 0x19, 0x18, 0x12,
+0x12, 0x18, 0x19, 0x13, 0x1e, 0x14, 0x15, 0x1f,
+0x1e, 0x14, 0x15, 0x1f, 0x12, 0x18, 0x19, 0x13,
+0x13, 0x19, 0x18, 0x12, 0x1f, 0x15, 0x14, 0x1e,
+0x10, 0x1a, 0x1b, 0x11, 0x1c, 0x16, 0x17, 0x1d,
+0x1d, 0x17, 0x16, 0x1c, 0x11, 0x1b, 0x1a, 0x10,
+0x01, 0x0b, 0x0a, 0x00, 0x0d, 0x07, 0x06, 0x0c,
+0x0c, 0x06, 0x07, 0x0d, 0x00, 0x0a, 0x0b, 0x01,
+0x0f, 0x05, 0x04, 0x0e, 0x03, 0x09, 0x08, 0x02,
+0x02, 0x08, 0x09, 0x03, 0x0e, 0x04, 0x05, 0x0f,
+0x0e, 0x04, 0x05, 0x0f, 0x02, 0x08, 0x09, 0x03,
+0x03, 0x09, 0x08, 0x02, 0x0f, 0x05, 0x04, 0x0e,
+0x00, 0x0a, 0x0b, 0x01, 0x0c, 0x06, 0x07, 0x0d,
+0x0d, 0x07, 0x06, 0x0c, 0x01, 0x0b, 0x0a, 0x00
+},{
+0x00, 0x0b, 0x0c, 0x07, 0x0d, 0x06, 0x01, 0x0a,
+0x0e, 0x05, 0x02, 0x09, 0x03, 0x08, 0x0f, 0x04,
+0x0f, 0x04, 0x03, 0x08, 0x02, 0x09, 0x0e, 0x05,
+0x01, 0x0a, 0x0d, 0x06, 0x0c, 0x07, 0x00, 0x0b,
+0x10, 0x1b, 0x1c, 0x17, 0x1d, 0x16, 0x11, 0x1a,
+0x1e, 0x15, 0x12, 0x19, 0x13, 0x18, 0x1f, 0x14,
+0x1f, 0x14, 0x13, 0x18, 0x12, 0x19, 0x1e, 0x15,
+0x11, 0x1a, 0x1d, 0x16, 0x1c, 0x17, 0x10, 0x1b,
+0x11, 0x1a, 0x1d, 0x16, 0x1c, 0x17, 0x10, 0x1b,
+0x1f, 0x14, 0x13, 0x18, 0x12, 0x19, 0x1e, 0x15,
+0x1e, 0x15, 0x12, 0x19, 0x13, 0x18, 0x1f, 0x14,
+0x10, 0x1b, 0x1c, 0x17, 0x1d, 0x16, 0x11, 0x1a,
+0x01, 0x0a, 0x0d, 0x06, 0x0c, 0x07, 0x00, 0x0b,
+0x0f, 0x04, 0x03, 0x08, 0x02, 0x09, 0x0e, 0x05,
+0x0e, 0x05, 0x02, 0x09, 0x03, 0x08, 0x0f, 0x04,
+0x00, 0x0b, 0x0c, 0x07, 0x0d, 0x06, 0x01, 0x0a,
+0x12, 0x19, 0x1e, 0x15, 0x1f, 0x14, 0x13, 0x18,
+0x1c, 0x17, 0x10, 0x1b, 0x11, 0x1a, 0x1d, 0x16,
+0x1d, 0x16, 0x11, 0x1a, 0x10, 0x1b, 0x1c, 0x17,
+0x13, 0x18, 0x1f, 0x14, 0x1e, 0x15, 0x12, 0x19,
+0x02, 0x09, 0x0e, 0x05, 0x0f, 0x04, 0x03, 0x08,
+0x0c, 0x07, 0x00, 0x0b, 0x01, 0x0a, 0x0d, 0x06,
+0x0d, 0x06, 0x01, 0x0a, 0x00, 0x0b, 0x0c, 0x07,
+0x03, 0x08, 0x0f, 0x04, 0x0e, 0x05, 0x02, 0x09,
+0x03, 0x08, 0x0f, 0x04, 0x0e, 0x05, 0x02, 0x09,
+0x0d, 0x06, 0x01, 0x0a, 0x00, 0x0b, 0x0c, 0x07,
+0x0c, 0x07, 0x00, 0x0b, 0x01, 0x0a, 0x0d, 0x06,
+0x02, 0x09, 0x0e, 0x05, 0x0f, 0x04, 0x03, 0x08,
+0x13, 0x18, 0x1f, 0x14, 0x1e, 0x15, 0x12, 0x19,
+0x1d, 0x16, 0x11, 0x1a, 0x10, 0x1b, 0x1c, 0x17,
+0x1c, 0x17, 0x10, 0x1b, 0x11, 0x1a, 0x1d, 0x16,
+0x12, 0x19, 0x1e, 0x15, 0x1f, 0x14, 0x13, 0x18
+},{
+0x00, 0x0c, 0x0d, 0x01, 0x0e, 0x02, 0x03, 0x0f,
+0x0f, 0x03, 0x02, 0x0e, 0x01, 0x0d, 0x0c, 0x00,
+0x10, 0x1c, 0x1d, 0x11, 0x1e, 0x12, 0x13, 0x1f,
+0x1f, 0x13, 0x12, 0x1e, 0x11, 0x1d, 0x1c, 0x10,
+0x11, 0x1d, 0x1c, 0x10, 0x1f, 0x13, 0x12, 0x1e,
+0x1e, 0x12, 0x13, 0x1f, 0x10, 0x1c, 0x1d, 0x11,
+0x01, 0x0d, 0x0c, 0x00, 0x0f, 0x03, 0x02, 0x0e,
+0x0e, 0x02, 0x03, 0x0f, 0x00, 0x0c, 0x0d, 0x01,
+0x12, 0x1e, 0x1f, 0x13, 0x1c, 0x10, 0x11, 0x1d,
+0x1d, 0x11, 0x10, 0x1c, 0x13, 0x1f, 0x1e, 0x12,
+0x02, 0x0e, 0x0f, 0x03, 0x0c, 0x00, 0x01, 0x0d,
+0x0d, 0x01, 0x00, 0x0c, 0x03, 0x0f, 0x0e, 0x02,
+0x03, 0x0f, 0x0e, 0x02, 0x0d, 0x01, 0x00, 0x0c,
+0x0c, 0x00, 0x01, 0x0d, 0x02, 0x0e, 0x0f, 0x03,
+0x13, 0x1f, 0x1e, 0x12, 0x1d, 0x11, 0x10, 0x1c,
+0x1c, 0x10, 0x11, 0x1d, 0x12, 0x1e, 0x1f, 0x13,
+0x13, 0x1f, 0x1e, 0x12, 0x1d, 0x11, 0x10, 0x1c,
+0x1c, 0x10, 0x11, 0x1d, 0x12, 0x1e, 0x1f, 0x13,
+0x03, 0x0f, 0x0e, 0x02, 0x0d, 0x01, 0x00, 0x0c,
+0x0c, 0x00, 0x01, 0x0d, 0x02, 0x0e, 0x0f, 0x03,
+0x02, 0x0e, 0x0f, 0x03, 0x0c, 0x00, 0x01, 0x0d,
+0x0d, 0x01, 0x00, 0x0c, 0x03, 0x0f, 0x0e, 0x02,
+0x12, 0x1e, 0x1f, 0x13, 0x1c, 0x10, 0x11, 0x1d,
+0x1d, 0x11, 0x10, 0x1c, 0x13, 0x1f, 0x1e, 0x12,
+0x01, 0x0d, 0x0c, 0x00, 0x0f, 0x03, 0x02, 0x0e,
+0x0e, 0x02, 0x03, 0x0f, 0x00, 0x0c, 0x0d, 0x01,
+0x11, 0x1d, 0x1c, 0x10, 0x1f, 0x13, 0x12, 0x1e,
+0x1e, 0x12, 0x13, 0x1f, 0x10, 0x1c, 0x1d, 0x11,
+0x10, 0x1c, 0x1d, 0x11, 0x1e, 0x12, 0x13, 0x1f,
+0x1f, 0x13, 0x12, 0x1e, 0x11, 0x1d, 0x1c, 0x10,
+0x00, 0x0c, 0x0d, 0x01, 0x0e, 0x02, 0x03, 0x0f,
+0x0f, 0x03, 0x02, 0x0e, 0x01, 0x0d, 0x0c, 0x00
+},{
+0x00, 0x0d, 0x0e, 0x03, 0x0f, 0x02, 0x01, 0x0c,
+0x10, 0x1d, 0x1e, 0x13, 0x1f, 0x12, 0x11, 0x1c,
+0x11, 0x1c, 0x1f, 0x12, 0x1e, 0x13, 0x10, 0x1d,
+0x01, 0x0c, 0x0f, 0x02, 0x0e, 0x03, 0x00, 0x0d,
+0x12, 0x1f, 0x1c, 0x11, 0x1d, 0x10, 0x13, 0x1e,
+0x02, 0x0f, 0x0c, 0x01, 0x0d, 0x00, 0x03, 0x0e,
+0x03, 0x0e, 0x0d, 0x00, 0x0c, 0x01, 0x02, 0x0f,
+0x13, 0x1e, 0x1d, 0x10, 0x1c, 0x11, 0x12, 0x1f,
+0x13, 0x1e, 0x1d, 0x10, 0x1c, 0x11, 0x12, 0x1f,
+0x03, 0x0e, 0x0d, 0x00, 0x0c, 0x01, 0x02, 0x0f,
+0x02, 0x0f, 0x0c, 0x01, 0x0d, 0x00, 0x03, 0x0e,
+0x12, 0x1f, 0x1c, 0x11, 0x1d, 0x10, 0x13, 0x1e,
+0x01, 0x0c, 0x0f, 0x02, 0x0e, 0x03, 0x00, 0x0d,
+0x11, 0x1c, 0x1f, 0x12, 0x1e, 0x13, 0x10, 0x1d,
+0x10, 0x1d, 0x1e, 0x13, 0x1f, 0x12, 0x11, 0x1c,
+0x00, 0x0d, 0x0e, 0x03, 0x0f, 0x02, 0x01, 0x0c,
+0x14, 0x19, 0x1a, 0x17, 0x1b, 0x16, 0x15, 0x18,
+0x04, 0x09, 0x0a, 0x07, 0x0b, 0x06, 0x05, 0x08,
+0x05, 0x08, 0x0b, 0x06, 0x0a, 0x07, 0x04, 0x09,
+0x15, 0x18, 0x1b, 0x16, 0x1a, 0x17, 0x14, 0x19,
+0x06, 0x0b, 0x08, 0x05, 0x09, 0x04, 0x07, 0x0a,
+0x16, 0x1b, 0x18, 0x15, 0x19, 0x14, 0x17, 0x1a,
+0x17, 0x1a, 0x19, 0x14, 0x18, 0x15, 0x16, 0x1b,
+0x07, 0x0a, 0x09, 0x04, 0x08, 0x05, 0x06, 0x0b,
+0x07, 0x0a, 0x09, 0x04, 0x08, 0x05, 0x06, 0x0b,
+0x17, 0x1a, 0x19, 0x14, 0x18, 0x15, 0x16, 0x1b,
+0x16, 0x1b, 0x18, 0x15, 0x19, 0x14, 0x17, 0x1a,
+0x06, 0x0b, 0x08, 0x05, 0x09, 0x04, 0x07, 0x0a,
+0x15, 0x18, 0x1b, 0x16, 0x1a, 0x17, 0x14, 0x19,
+0x05, 0x08, 0x0b, 0x06, 0x0a, 0x07, 0x04, 0x09,
+0x04, 0x09, 0x0a, 0x07, 0x0b, 0x06, 0x05, 0x08,
+0x14, 0x19, 0x1a, 0x17, 0x1b, 0x16, 0x15, 0x18
+},{
+0x00, 0x0e, 0x0f, 0x01, 0x10, 0x1e, 0x1f, 0x11,
+0x11, 0x1f, 0x1e, 0x10, 0x01, 0x0f, 0x0e, 0x00,
+0x12, 0x1c, 0x1d, 0x13, 0x02, 0x0c, 0x0d, 0x03,
+0x03, 0x0d, 0x0c, 0x02, 0x13, 0x1d, 0x1c, 0x12,
+0x13, 0x1d, 0x1c, 0x12, 0x03, 0x0d, 0x0c, 0x02,
+0x02, 0x0c, 0x0d, 0x03, 0x12, 0x1c, 0x1d, 0x13,
+0x01, 0x0f, 0x0e, 0x00, 0x11, 0x1f, 0x1e, 0x10,
+0x10, 0x1e, 0x1f, 0x11, 0x00, 0x0e, 0x0f, 0x01,
+0x14, 0x1a, 0x1b, 0x15, 0x04, 0x0a, 0x0b, 0x05,
+0x05, 0x0b, 0x0a, 0x04, 0x15, 0x1b, 0x1a, 0x14,
+0x06, 0x08, 0x09, 0x07, 0x16, 0x18, 0x19, 0x17,
+0x17, 0x19, 0x18, 0x16, 0x07, 0x09, 0x08, 0x06,
+0x07, 0x09, 0x08, 0x06, 0x17, 0x19, 0x18, 0x16,
+0x16, 0x18, 0x19, 0x17, 0x06, 0x08, 0x09, 0x07,
+0x15, 0x1b, 0x1a, 0x14, 0x05, 0x0b, 0x0a, 0x04,
+0x04, 0x0a, 0x0b, 0x05, 0x14, 0x1a, 0x1b, 0x15,
+0x15, 0x1b, 0x1a, 0x14, 0x05, 0x0b, 0x0a, 0x04,
+0x04, 0x0a, 0x0b, 0x05, 0x14, 0x1a, 0x1b, 0x15,
+0x07, 0x09, 0x08, 0x06, 0x17, 0x19, 0x18, 0x16,
+0x16, 0x18, 0x19, 0x17, 0x06, 0x08, 0x09, 0x07,
+0x06, 0x08, 0x09, 0x07, 0x16, 0x18, 0x19, 0x17,
+0x17, 0x19, 0x18, 0x16, 0x07, 0x09, 0x08, 0x06,
+0x14, 0x1a, 0x1b, 0x15, 0x04, 0x0a, 0x0b, 0x05,
+0x05, 0x0b, 0x0a, 0x04, 0x15, 0x1b, 0x1a, 0x14,
+0x01, 0x0f, 0x0e, 0x00, 0x11, 0x1f, 0x1e, 0x10,
+0x10, 0x1e, 0x1f, 0x11, 0x00, 0x0e, 0x0f, 0x01,
+0x13, 0x1d, 0x1c, 0x12, 0x03, 0x0d, 0x0c, 0x02,
+0x02, 0x0c, 0x0d, 0x03, 0x12, 0x1c, 0x1d, 0x13,
+0x12, 0x1c, 0x1d, 0x13, 0x02, 0x0c, 0x0d, 0x03,
+0x03, 0x0d, 0x0c, 0x02, 0x13, 0x1d, 0x1c, 0x12,
+0x00, 0x0e, 0x0f, 0x01, 0x10, 0x1e, 0x1f, 0x11,
+0x11, 0x1f, 0x1e, 0x10, 0x01, 0x0f, 0x0e, 0x00
+},{
+0x00, 0x0f, 0x10, 0x1f, 0x11, 0x1e, 0x01, 0x0e,
+0x12, 0x1d, 0x02, 0x0d, 0x03, 0x0c, 0x13, 0x1c,
+0x13, 0x1c, 0x03, 0x0c, 0x02, 0x0d, 0x12, 0x1d,
+0x01, 0x0e, 0x11, 0x1e, 0x10, 0x1f, 0x00, 0x0f,
+0x14, 0x1b, 0x04, 0x0b, 0x05, 0x0a, 0x15, 0x1a,
+0x06, 0x09, 0x16, 0x19, 0x17, 0x18, 0x07, 0x08,
+0x07, 0x08, 0x17, 0x18, 0x16, 0x19, 0x06, 0x09,
+0x15, 0x1a, 0x05, 0x0a, 0x04, 0x0b, 0x14, 0x1b,
+0x15, 0x1a, 0x05, 0x0a, 0x04, 0x0b, 0x14, 0x1b,
+0x07, 0x08, 0x17, 0x18, 0x16, 0x19, 0x06, 0x09,
+0x06, 0x09, 0x16, 0x19, 0x17, 0x18, 0x07, 0x08,
+0x14, 0x1b, 0x04, 0x0b, 0x05, 0x0a, 0x15, 0x1a,
+0x01, 0x0e, 0x11, 0x1e, 0x10, 0x1f, 0x00, 0x0f,
+0x13, 0x1c, 0x03, 0x0c, 0x02, 0x0d, 0x12, 0x1d,
+0x12, 0x1d, 0x02, 0x0d, 0x03, 0x0c, 0x13, 0x1c,
+0x00, 0x0f, 0x10, 0x1f, 0x11, 0x1e, 0x01, 0x0e,
+0x16, 0x19, 0x06, 0x09, 0x07, 0x08, 0x17, 0x18,
+0x04, 0x0b, 0x14, 0x1b, 0x15, 0x1a, 0x05, 0x0a,
+0x05, 0x0a, 0x15, 0x1a, 0x14, 0x1b, 0x04, 0x0b,
+0x17, 0x18, 0x07, 0x08, 0x06, 0x09, 0x16, 0x19,
+0x02, 0x0d, 0x12, 0x1d, 0x13, 0x1c, 0x03, 0x0c,
+0x10, 0x1f, 0x00, 0x0f, 0x01, 0x0e, 0x11, 0x1e,
+0x11, 0x1e, 0x01, 0x0e, 0x00, 0x0f, 0x10, 0x1f,
+0x03, 0x0c, 0x13, 0x1c, 0x12, 0x1d, 0x02, 0x0d,
+0x03, 0x0c, 0x13, 0x1c, 0x12, 0x1d, 0x02, 0x0d,
+0x11, 0x1e, 0x01, 0x0e, 0x00, 0x0f, 0x10, 0x1f,
+0x10, 0x1f, 0x00, 0x0f, 0x01, 0x0e, 0x11, 0x1e,
+0x02, 0x0d, 0x12, 0x1d, 0x13, 0x1c, 0x03, 0x0c,
+0x17, 0x18, 0x07, 0x08, 0x06, 0x09, 0x16, 0x19,
+0x05, 0x0a, 0x15, 0x1a, 0x14, 0x1b, 0x04, 0x0b,
+0x04, 0x0b, 0x14, 0x1b, 0x15, 0x1a, 0x05, 0x0a,
+0x16, 0x19, 0x06, 0x09, 0x07, 0x08, 0x17, 0x18
+}};
@@ -41,6 +41,27 @@
 #include "ocfs2/byteorder.h"
 #include "ocfs2/image.h"
 
+/*
+ * Bits set in the first nr bits of a bitmap block.  Whole words are
+ * counted at once; popcount doesn't care about byte order.  The tail
+ * goes a byte at a time to stay in ocfs2_test_bit()'s bit order.
+ */
+static uint64_t image_bits_before(const char *map, int nr)
+{
+	const uint64_t *words = (const uint64_t *)map;
+	uint64_t cnt = 0;
+	int i;
+
+	for (i = 0; i < nr / 64; i++)
+		cnt += __builtin_popcountll(words[i]);
+	for (i = (nr / 64) * 8; i < nr / 8; i++)
+		cnt += __builtin_popcount((unsigned char)map[i]);
+	if (nr % 8)
+		cnt += __builtin_popcount((unsigned char)map[nr / 8] &
+					  ((1 << (nr % 8)) - 1));
+	return cnt;
+}
+
 void ocfs2_image_swap_header(struct ocfs2_image_hdr *hdr)
 {
 	int i;
@@ -125,6 +146,8 @@ errcode_t ocfs2_image_alloc_bitmap(ocfs2_filesys *ofs)
 			continue;
 		}
 
+		/* o2image marks into these, so they must start out clear */
+		memset(buf, 0, allocsize);
 		n = allocsize / OCFS2_IMAGE_BITMAP_BLOCKSIZE;
 		for (i = 0; i < n; i++) {
 			ost->ost_bmparr[indx].arr_set_bit_cnt = 0;
@@ -161,7 +184,7 @@ errcode_t ocfs2_image_load_bitmap(ocfs2_filesys *ofs)
 	struct ocfs2_image_state *ost;
 	struct ocfs2_image_hdr *hdr;
 	uint64_t blk_off, bits_set;
-	int count, i, j, fd;
+	int count, i, fd;
 	errcode_t ret;
 	char *blk;
 
@@ -220,9 +243,8 @@ errcode_t ocfs2_image_load_bitmap(ocfs2_filesys *ofs)
 			goto out;
 
 		/* add bits set in this bitmap */
-		for (j = 0; j < (ost->ost_bmpblksz * 8); j++)
-			if (ocfs2_test_bit(j, ost->ost_bmparr[i].arr_map))
-				bits_set++;
+		bits_set += image_bits_before(ost->ost_bmparr[i].arr_map,
+					      ost->ost_bmpblksz * 8);
 
 		blk_off += ost->ost_bmpblksz;
 	}
@@ -233,16 +255,24 @@ out:
 	return ret;
 }
 
+/*
+ * o2image marks blocks from several threads at once, so this is
+ * ocfs2_set_bit() done atomically.
+ */
 void ocfs2_image_mark_bitmap(ocfs2_filesys *ofs, uint64_t blkno)
 {
 	struct ocfs2_image_state *ost = ofs->ost;
+	unsigned char *addr, mask;
 	int bitmap_blk;
 	int bit;
 
 	bit = blkno % OCFS2_IMAGE_BITS_IN_BLOCK;
 	bitmap_blk = blkno / OCFS2_IMAGE_BITS_IN_BLOCK;
 
-	ocfs2_set_bit(bit, ost->ost_bmparr[bitmap_blk].arr_map);
+	addr = (unsigned char *)ost->ost_bmparr[bitmap_blk].arr_map +
+		(bit >> 3);
+	mask = 1 << (bit & 0x07);
+	__sync_fetch_and_or(addr, mask);
 }
 
 int ocfs2_image_test_bit(ocfs2_filesys *ofs, uint64_t blkno)
@@ -265,7 +295,7 @@ uint64_t ocfs2_image_get_blockno(ocfs2_filesys *ofs, uint64_t blkno)
 	struct ocfs2_image_state *ost = ofs->ost;
 	uint64_t ret_blk;
 	int bitmap_blk;
-	int i, bit;
+	int bit;
 
 	bit = blkno % OCFS2_IMAGE_BITS_IN_BLOCK;
 	bitmap_blk = blkno / OCFS2_IMAGE_BITS_IN_BLOCK;
@@ -274,12 +304,30 @@ uint64_t ocfs2_image_get_blockno(ocfs2_filesys *ofs, uint64_t blkno)
 		ret_blk = ost->ost_bmparr[bitmap_blk].arr_set_bit_cnt + 1;
 
 		/* add bits set in this block before the block no */
-		for (i = 0; i < bit; i++)
-			if (ocfs2_test_bit(i,
-					   ost->ost_bmparr[bitmap_blk].arr_map))
-				ret_blk++;
+		ret_blk += image_bits_before(
+				ost->ost_bmparr[bitmap_blk].arr_map, bit);
 	} else
 		ret_blk = -1;
 
 	return ret_blk;
 }
+
+/*
+ * Fill in arr_set_bit_cnt for every bitmap block, as
+ * ocfs2_image_get_blockno() wants it, and return the number of blocks
+ * marked in all.
+ */
+uint64_t ocfs2_image_count_bits(ocfs2_filesys *ofs)
+{
+	struct ocfs2_image_state *ost = ofs->ost;
+	uint64_t bits_set = 0;
+	int i;
+
+	for (i = 0; i < ost->ost_bmpblks; i++) {
+		ost->ost_bmparr[i].arr_set_bit_cnt = bits_set;
+		bits_set += image_bits_before(ost->ost_bmparr[i].arr_map,
+					      ost->ost_bmpblksz * 8);
+	}
+
+	return bits_set;
+}
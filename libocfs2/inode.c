@@ -277,39 +277,31 @@ errcode_t ocfs2_read_inode(ocfs2_filesys *fs, uint64_t blkno,
 			   char *inode_buf)
 {
 	errcode_t ret;
-	char *blk;
-	struct ocfs2_dinode *di;
+	const char *blk;
+	const struct ocfs2_dinode *di;
 
 	if ((blkno < OCFS2_SUPER_BLOCK_BLKNO) ||
 	    (blkno > fs->fs_blocks))
 		return OCFS2_ET_BAD_BLKNO;
 
-	ret = ocfs2_malloc_block(fs->fs_io, &blk);
+	ret = ocfs2_get_meta_block(fs, blkno,
+				   offsetof(struct ocfs2_dinode, i_check),
+				   &blk);
 	if (ret)
 		return ret;
 
-	ret = ocfs2_read_blocks(fs, blkno, 1, blk);
-	if (ret)
-		goto out;
-
-	di = (struct ocfs2_dinode *)blk;
-	ret = ocfs2_validate_meta_ecc(fs, blk, &di->i_check);
-	if (ret)
-		goto out;
-
+	di = (const struct ocfs2_dinode *)blk;
 	ret = OCFS2_ET_BAD_INODE_MAGIC;
 	if (memcmp(di->i_signature, OCFS2_INODE_SIGNATURE,
 		   strlen(OCFS2_INODE_SIGNATURE)))
 		goto out;
 
 	memcpy(inode_buf, blk, fs->fs_blocksize);
-
-	di = (struct ocfs2_dinode *) inode_buf;
-	ocfs2_swap_inode_to_cpu(fs, di);
+	ocfs2_swap_inode_to_cpu(fs, (struct ocfs2_dinode *)inode_buf);
 
 	ret = 0;
 out:
-	ocfs2_free(&blk);
+	ocfs2_put_block(fs, blk);
 
 	return ret;
 }
@@ -32,11 +32,29 @@
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 
 #include "extent_map.h"
 
+/*
+ * A prefetching scan reads through buffers of at least this much, so
+ * each read is big enough to keep the disk busy.
+ */
+#define INODE_SCAN_PREFETCH_BYTES	(1024 * 1024)
+
+/*
+ * One read's worth of inode blocks.  isb_nr == 0 means the scan is
+ * over; isb_ret is the error the read hit, if any.
+ */
+struct inode_scan_buf {
+	uint64_t isb_blkno;
+	int isb_nr;
+	errcode_t isb_ret;
+	char *isb_data;
+};
+
 struct _ocfs2_inode_scan {
 	ocfs2_filesys *fs;
 	int num_inode_alloc;
@@ -49,20 +67,49 @@ struct _ocfs2_inode_scan {
 	unsigned int count;
 	uint64_t cur_blkno;
 	char *group_buffer;
-	char *cur_block;
 	int buffer_blocks;
-	int blocks_in_buffer;
 	unsigned int blocks_left;
 	uint64_t bpos;
+
+	/* What the caller is working through */
+	struct inode_scan_buf *cur_buf;
+	struct inode_scan_buf sync_buf;
+	char *cur_block;
+	int blocks_in_buffer;
+	uint64_t next_blkno;
+
+	/* A range scan walks these instead of the inode alloc files */
+	struct ocfs2_inode_group *groups;
+	int nr_groups;
+	int next_group;
+	unsigned int group_left;
+
+	/*
+	 * With prefetch, a helper thread walks the chains on its own
+	 * io_channel and fills pf_bufs ahead of the caller.  pf_tail is
+	 * the next one it fills, pf_head the next one the caller takes.
+	 */
+	int pf_depth;
+	int pf_started;
+	int pf_stop;
+	int pf_nr_full;
+	int pf_head;
+	int pf_tail;
+	int pf_blocks;
+	struct inode_scan_buf *pf_bufs;
+	ocfs2_filesys pf_fs;
+	pthread_t pf_thread;
+	pthread_mutex_t pf_lock;
+	pthread_cond_t pf_cond;
 };
 
 
 /*
  * This function is called by fill_group_buffer when an alloc group has
  * been completely read.  It must not be called from the last group.
- * ocfs2_get_next_inode() should have detected that condition.
+ * read_next_blocks() should have detected that condition.
  */
-static errcode_t get_next_group(ocfs2_inode_scan *scan)
+static errcode_t get_next_group(ocfs2_inode_scan *scan, ocfs2_filesys *fs)
 {
 	errcode_t ret;
 
@@ -70,7 +117,7 @@ static errcode_t get_next_group(ocfs2_inode_scan *scan)
 		if (scan->bpos)
 			abort();
 
-		ret = ocfs2_malloc_block(scan->fs->fs_io,
+		ret = ocfs2_malloc_block(fs->fs_io,
 					 &scan->cur_desc);
 		if (ret)
 			return ret;
@@ -82,11 +129,11 @@ static errcode_t get_next_group(ocfs2_inode_scan *scan)
 	/*
 	 * scan->cur_blkno better be nonzero, either set by
 	 * get_next_chain() or valid from bg_next_group
-	 */ 
+	 */
 	if (!scan->cur_blkno)
 		abort();
 
-	ret = ocfs2_read_group_desc(scan->fs, scan->cur_blkno,
+	ret = ocfs2_read_group_desc(fs, scan->cur_blkno,
 				    (char *)scan->cur_desc);
 	if (ret)
 		return (ret);
@@ -107,7 +154,7 @@ static errcode_t get_next_group(ocfs2_inode_scan *scan)
  * This function is called by fill_group_buffer when an alloc chain
  * has been completely read.  It must not be called  when the current
  * inode alloc file has been read in its entirety.  This condition
- * should have been detected by ocfs2_get_next_inode().
+ * should have been detected by read_next_blocks().
  */
 static errcode_t get_next_chain(ocfs2_inode_scan *scan)
 {
@@ -137,13 +184,13 @@ static errcode_t get_next_chain(ocfs2_inode_scan *scan)
 }
 
 /*
- * This function is called by ocfs2_get_next_inode when it needs
- * to read in more clusters from the current inode alloc file.  It
- * must not be called when the current inode alloc file has been read
- * in its entirety.  This condition is detected by
- * ocfs2_get_next_inode().
+ * This function is called by read_next_blocks when it needs to read in
+ * more blocks from the current inode alloc file.  It must not be
+ * called when the current inode alloc file has been read in its
+ * entirety.  This condition is detected by read_next_blocks().
  */
-static errcode_t fill_group_buffer(ocfs2_inode_scan *scan)
+static errcode_t fill_group_buffer(ocfs2_inode_scan *scan, ocfs2_filesys *fs,
+				   struct inode_scan_buf *isb, int max_blocks)
 {
 	errcode_t ret;
 	int num_blocks;
@@ -160,10 +207,10 @@ static errcode_t fill_group_buffer(ocfs2_inode_scan *scan)
 		if (ret)
 			return ret;
 	}
-	
+
 	if (!scan->bpos || (scan->bpos == (scan->cur_desc->bg_blkno +
 					   scan->cur_desc->bg_bits))) {
-		ret = get_next_group(scan);
+		ret = get_next_group(scan, fs);
 		if (ret)
 			return ret;
 	}
@@ -172,17 +219,28 @@ static errcode_t fill_group_buffer(ocfs2_inode_scan *scan)
 	num_blocks = (scan->cur_desc->bg_blkno +
 		      scan->cur_desc->bg_bits) - scan->bpos;
 
-	if (num_blocks > scan->buffer_blocks)
-		num_blocks = scan->buffer_blocks;
+	if (num_blocks > max_blocks)
+		num_blocks = max_blocks;
+	if (num_blocks > scan->blocks_left)
+		num_blocks = scan->blocks_left;
+
+	/* Just the descriptor; read_next_blocks() moves on */
+	isb->isb_nr = 0;
+	if (!num_blocks)
+		return 0;
 
-	ret = ocfs2_read_blocks(scan->fs, scan->cur_blkno, num_blocks,
-				scan->group_buffer);
+	ret = ocfs2_read_blocks(fs, scan->cur_blkno, num_blocks,
+				isb->isb_data);
 	if (ret)
 		return ret;
 
+	isb->isb_blkno = scan->cur_blkno;
+	isb->isb_nr = num_blocks;
+
 	scan->bpos += num_blocks;
-	scan->blocks_in_buffer = num_blocks;
-	scan->cur_block = scan->group_buffer;
+	scan->cur_blkno += num_blocks;
+	scan->count += num_blocks;
+	scan->blocks_left -= num_blocks;
 
 	return 0;
 }
@@ -216,62 +274,310 @@ static int get_next_inode_alloc(ocfs2_inode_scan *scan)
 	return 0;
 }
 
-errcode_t ocfs2_get_next_inode(ocfs2_inode_scan *scan,
-			       uint64_t *blkno, char *inode)
+/*
+ * A range scan already knows its groups and their sizes from
+ * ocfs2_get_inode_groups(), so it just reads past each descriptor.
+ */
+static errcode_t read_next_range(ocfs2_inode_scan *scan, ocfs2_filesys *fs,
+				 struct inode_scan_buf *isb, int max_blocks)
 {
+	struct ocfs2_inode_group *ig;
+	int num_blocks;
 	errcode_t ret;
 
-	if (!scan->blocks_left) {
-		if (scan->blocks_in_buffer)
-			abort();
+	while (!scan->group_left) {
+		if (scan->next_group == scan->nr_groups)
+			return 0;
 
-		if (get_next_inode_alloc(scan)) {
-			*blkno = 0;
+		ig = &scan->groups[scan->next_group++];
+		scan->cur_blkno = ig->ig_blkno + 1;
+		scan->group_left = ig->ig_bits ? ig->ig_bits - 1 : 0;
+	}
+
+	num_blocks = scan->group_left;
+	if (num_blocks > max_blocks)
+		num_blocks = max_blocks;
+
+	ret = ocfs2_read_blocks(fs, scan->cur_blkno, num_blocks,
+				isb->isb_data);
+	if (ret)
+		return ret;
+
+	isb->isb_blkno = scan->cur_blkno;
+	isb->isb_nr = num_blocks;
+
+	scan->cur_blkno += num_blocks;
+	scan->group_left -= num_blocks;
+
+	return 0;
+}
+
+/*
+ * Reads the next run of inode blocks into isb.  At the end of the
+ * last inode alloc file, isb->isb_nr is zero, and never before.  A
+ * group can give us no inode blocks -- a one-block group, or an
+ * i_total that runs out at a descriptor -- so keep going until one
+ * does.  Like ocfs2_get_inode_groups(), a short i_total just ends that
+ * file.
+ */
+static errcode_t read_next_blocks(ocfs2_inode_scan *scan, ocfs2_filesys *fs,
+				  struct inode_scan_buf *isb, int max_blocks)
+{
+	errcode_t ret;
+
+	isb->isb_nr = 0;
+
+	if (scan->groups)
+		return read_next_range(scan, fs, isb, max_blocks);
+
+	do {
+		if (!scan->blocks_left && get_next_inode_alloc(scan))
 			return 0;
+
+		ret = fill_group_buffer(scan, fs, isb, max_blocks);
+	} while (!ret && !isb->isb_nr);
+
+	return ret;
+}
+
+static void *prefetch_thread(void *arg)
+{
+	ocfs2_inode_scan *scan = arg;
+	struct inode_scan_buf *isb;
+	errcode_t ret;
+
+	pthread_mutex_lock(&scan->pf_lock);
+	while (!scan->pf_stop) {
+		if (scan->pf_nr_full == scan->pf_depth) {
+			pthread_cond_wait(&scan->pf_cond, &scan->pf_lock);
+			continue;
 		}
+		isb = &scan->pf_bufs[scan->pf_tail];
+		pthread_mutex_unlock(&scan->pf_lock);
+
+		ret = read_next_blocks(scan, &scan->pf_fs, isb,
+				       scan->pf_blocks);
+		isb->isb_ret = ret;
+
+		pthread_mutex_lock(&scan->pf_lock);
+		scan->pf_tail = (scan->pf_tail + 1) % scan->pf_depth;
+		scan->pf_nr_full++;
+		pthread_cond_broadcast(&scan->pf_cond);
+
+		/* Nothing more to read after the end or an error */
+		if (ret || !isb->isb_nr)
+			break;
+	}
+	pthread_mutex_unlock(&scan->pf_lock);
+
+	return NULL;
+}
+
+static void prefetch_free_bufs(ocfs2_inode_scan *scan)
+{
+	int i;
+
+	for (i = 0; i < scan->pf_depth; i++) {
+		if (scan->pf_bufs[i].isb_data)
+			ocfs2_free(&scan->pf_bufs[i].isb_data);
+	}
+	ocfs2_free(&scan->pf_bufs);
+}
+
+/*
+ * The helper reads on its own channel, so anything the caller has
+ * written must be on disk first.  If we can't get the helper going,
+ * the scan just reads as it goes.
+ */
+static void prefetch_start(ocfs2_inode_scan *scan)
+{
+	ocfs2_filesys *fs = scan->fs;
+	errcode_t ret;
+	int i;
+
+	scan->pf_blocks = ocfs2_blocks_in_bytes(fs,
+						INODE_SCAN_PREFETCH_BYTES);
+	if (scan->pf_blocks < scan->buffer_blocks)
+		scan->pf_blocks = scan->buffer_blocks;
+
+	ret = ocfs2_malloc0(sizeof(struct inode_scan_buf) * scan->pf_depth,
+			    &scan->pf_bufs);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < scan->pf_depth; i++) {
+		ret = ocfs2_malloc_blocks(fs->fs_io, scan->pf_blocks,
+					  &scan->pf_bufs[i].isb_data);
+		if (ret)
+			goto out;
+	}
+
+	ret = io_flush(fs->fs_io);
+	if (ret)
+		goto out;
+
+	scan->pf_fs = *fs;
+	scan->pf_fs.fs_io = NULL;
+	scan->pf_fs.fs_flags &= ~OCFS2_FLAG_RW;
+	ret = io_open_helper(fs->fs_io,
+			     OCFS2_FLAG_RO |
+			     (fs->fs_flags & OCFS2_FLAG_BUFFERED),
+			     &scan->pf_fs.fs_io);
+	if (ret)
+		goto out;
+
+	ret = io_set_blksize(scan->pf_fs.fs_io, fs->fs_blocksize);
+	if (ret)
+		goto out;
+
+	pthread_mutex_init(&scan->pf_lock, NULL);
+	pthread_cond_init(&scan->pf_cond, NULL);
+	if (pthread_create(&scan->pf_thread, NULL, prefetch_thread, scan)) {
+		pthread_cond_destroy(&scan->pf_cond);
+		pthread_mutex_destroy(&scan->pf_lock);
+		ret = OCFS2_ET_INTERNAL_FAILURE;
+		goto out;
 	}
+	scan->pf_started = 1;
+
+out:
+	if (ret) {
+		if (scan->pf_fs.fs_io)
+			io_close(scan->pf_fs.fs_io);
+		scan->pf_fs.fs_io = NULL;
+		if (scan->pf_bufs)
+			prefetch_free_bufs(scan);
+		scan->pf_depth = 0;
+	}
+}
+
+static void prefetch_stop(ocfs2_inode_scan *scan)
+{
+	pthread_mutex_lock(&scan->pf_lock);
+	scan->pf_stop = 1;
+	pthread_cond_broadcast(&scan->pf_cond);
+	pthread_mutex_unlock(&scan->pf_lock);
+	pthread_join(scan->pf_thread, NULL);
+
+	pthread_cond_destroy(&scan->pf_cond);
+	pthread_mutex_destroy(&scan->pf_lock);
+	io_close(scan->pf_fs.fs_io);
+	prefetch_free_bufs(scan);
+	scan->pf_started = 0;
+}
+
+/*
+ * Hands the caller the next buffer.  The one it just finished goes
+ * back to the helper.  An error or the end stays at the head, so
+ * asking again gets the same answer.
+ */
+static errcode_t next_buffer(ocfs2_inode_scan *scan)
+{
+	struct inode_scan_buf *isb;
+	errcode_t ret;
+
+	/* The end buffer stays put; there is nothing after it */
+	if (scan->cur_buf && !scan->cur_buf->isb_nr)
+		return 0;
+
+	if (!scan->pf_started) {
+		ret = read_next_blocks(scan, scan->fs, &scan->sync_buf,
+				       scan->buffer_blocks);
+		if (ret)
+			return ret;
+		scan->cur_buf = &scan->sync_buf;
+		return 0;
+	}
+
+	pthread_mutex_lock(&scan->pf_lock);
+	if (scan->cur_buf) {
+		scan->cur_buf = NULL;
+		scan->pf_head = (scan->pf_head + 1) % scan->pf_depth;
+		scan->pf_nr_full--;
+		pthread_cond_broadcast(&scan->pf_cond);
+	}
+	while (!scan->pf_nr_full)
+		pthread_cond_wait(&scan->pf_cond, &scan->pf_lock);
+	isb = &scan->pf_bufs[scan->pf_head];
+	pthread_mutex_unlock(&scan->pf_lock);
+
+	if (isb->isb_ret)
+		return isb->isb_ret;
+
+	scan->cur_buf = isb;
+	return 0;
+}
+
+errcode_t ocfs2_get_next_inode(ocfs2_inode_scan *scan,
+			       uint64_t *blkno, char *inode)
+{
+	errcode_t ret;
+
+	if (scan->pf_depth && !scan->pf_started && !scan->cur_buf)
+		prefetch_start(scan);
 
 	if (!scan->blocks_in_buffer) {
-		ret = fill_group_buffer(scan);
+		ret = next_buffer(scan);
 		if (ret)
 			return ret;
+
+		if (!scan->cur_buf->isb_nr) {
+			*blkno = 0;
+			return 0;
+		}
+
+		scan->cur_block = scan->cur_buf->isb_data;
+		scan->blocks_in_buffer = scan->cur_buf->isb_nr;
+		scan->next_blkno = scan->cur_buf->isb_blkno;
 	}
-	
+
 	/* the caller swap after verifying the inode's signature */
 	memcpy(inode, scan->cur_block, scan->fs->fs_blocksize);
 
 	scan->cur_block += scan->fs->fs_blocksize;
 	scan->blocks_in_buffer--;
-	scan->blocks_left--;
-	*blkno = scan->cur_blkno;
-	scan->cur_blkno++;
-	scan->count++;
+	*blkno = scan->next_blkno;
+	scan->next_blkno++;
 
 	return 0;
 }
 
-errcode_t ocfs2_open_inode_scan(ocfs2_filesys *fs,
+errcode_t ocfs2_inode_scan_set_prefetch(ocfs2_inode_scan *scan, int depth)
+{
+	if (scan->pf_started || scan->cur_buf)
+		return OCFS2_ET_INVALID_ARGUMENT;
+	if (depth < 0)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	scan->pf_depth = depth;
+	return 0;
+}
+
+/*
+ * The parts of a scan that don't depend on what it walks.  A range scan
+ * has no inode alloc files.
+ */
+static errcode_t inode_scan_new(ocfs2_filesys *fs, int num_inode_alloc,
 				ocfs2_inode_scan **ret_scan)
 {
 	ocfs2_inode_scan *scan;
-	uint64_t blkno;
 	errcode_t ret;
-	int i, slot_num;
 
 	ret = ocfs2_malloc0(sizeof(struct _ocfs2_inode_scan), &scan);
 	if (ret)
 		return ret;
 
 	scan->fs = fs;
+	scan->pf_depth = OCFS2_INODE_SCAN_PREFETCH_DEPTH;
 
-	/* One inode alloc per slot, one global inode alloc */
-	scan->num_inode_alloc =
-		OCFS2_RAW_SB(fs->fs_super)->s_max_slots + 1;
-	ret = ocfs2_malloc0(sizeof(ocfs2_cached_inode *) *
-			    scan->num_inode_alloc,
-			    &scan->inode_alloc);
-	if (ret)
-		goto out_scan;
+	scan->num_inode_alloc = num_inode_alloc;
+	if (num_inode_alloc) {
+		ret = ocfs2_malloc0(sizeof(ocfs2_cached_inode *) *
+				    scan->num_inode_alloc,
+				    &scan->inode_alloc);
+		if (ret)
+			goto out_scan;
+	}
 
 	/* Minimum 8 inodes in the buffer */
 	scan->buffer_blocks = fs->fs_clustersize / fs->fs_blocksize;
@@ -289,6 +595,33 @@ errcode_t ocfs2_open_inode_scan(ocfs2_filesys *fs,
 				  &scan->group_buffer);
 	if (ret)
 		goto out_inode_files;
+	scan->sync_buf.isb_data = scan->group_buffer;
+
+	*ret_scan = scan;
+	return 0;
+
+out_inode_files:
+	ocfs2_free(&scan->inode_alloc);
+
+out_scan:
+	ocfs2_free(&scan);
+
+	return ret;
+}
+
+errcode_t ocfs2_open_inode_scan(ocfs2_filesys *fs,
+				ocfs2_inode_scan **ret_scan)
+{
+	ocfs2_inode_scan *scan;
+	uint64_t blkno;
+	errcode_t ret;
+	int i, slot_num;
+
+	/* One inode alloc per slot, one global inode alloc */
+	ret = inode_scan_new(fs, OCFS2_RAW_SB(fs->fs_super)->s_max_slots + 1,
+			     &scan);
+	if (ret)
+		return ret;
 
 	ret = ocfs2_lookup_system_inode(fs,
 					GLOBAL_INODE_ALLOC_SYSTEM_INODE,
@@ -324,19 +657,175 @@ errcode_t ocfs2_open_inode_scan(ocfs2_filesys *fs,
 
 	return 0;
 
-out_inode_files:
-	ocfs2_free(&scan->inode_alloc);
+out_cleanup:
+	ocfs2_close_inode_scan(scan);
 
-out_scan:
-	ocfs2_free(&scan);
+	return ret;
+}
 
-out_cleanup:
-	if (scan)
-		ocfs2_close_inode_scan(scan);
+errcode_t ocfs2_open_inode_scan_range(ocfs2_filesys *fs,
+				      struct ocfs2_inode_group *groups,
+				      int nr_groups,
+				      ocfs2_inode_scan **ret_scan)
+{
+	ocfs2_inode_scan *scan;
+	errcode_t ret;
+
+	ret = inode_scan_new(fs, 0, &scan);
+	if (ret)
+		return ret;
+
+	if (nr_groups) {
+		ret = ocfs2_malloc(sizeof(struct ocfs2_inode_group) *
+				   nr_groups, &scan->groups);
+		if (ret) {
+			ocfs2_close_inode_scan(scan);
+			return ret;
+		}
+		memcpy(scan->groups, groups,
+		       sizeof(struct ocfs2_inode_group) * nr_groups);
+	}
+	scan->nr_groups = nr_groups;
+
+	*ret_scan = scan;
+	return 0;
+}
+
+/* Walks one inode alloc file's chains the way a full scan would */
+static errcode_t add_alloc_groups(ocfs2_filesys *fs, uint64_t alloc_blkno,
+				  char *buf, char *gd_buf,
+				  struct ocfs2_inode_group **groups,
+				  int *nr, int *alloced)
+{
+	struct ocfs2_dinode *di;
+	struct ocfs2_chain_list *cl;
+	struct ocfs2_group_desc *gd;
+	struct ocfs2_inode_group *ig;
+	uint64_t blkno;
+	uint32_t left, count, bits;
+	errcode_t ret;
+	int i;
+
+	ret = ocfs2_read_inode(fs, alloc_blkno, buf);
+	if (ret)
+		return ret;
+
+	di = (struct ocfs2_dinode *)buf;
+	cl = &di->id2.i_chain;
+	left = di->id1.bitmap1.i_total;
+	if (left && !cl->cl_next_free_rec)
+		return OCFS2_ET_CORRUPT_CHAIN;
+
+	for (i = 0; left && (i < cl->cl_next_free_rec); i++) {
+		blkno = cl->cl_recs[i].c_blkno;
+		count = 0;
+		while (left && (count < cl->cl_recs[i].c_total)) {
+			if (!blkno)
+				return OCFS2_ET_CORRUPT_CHAIN;
+
+			ret = ocfs2_read_group_desc(fs, blkno, gd_buf);
+			if (ret)
+				return ret;
+			gd = (struct ocfs2_group_desc *)gd_buf;
+			if (gd->bg_blkno != blkno)
+				return OCFS2_ET_CORRUPT_GROUP_DESC;
+
+			bits = gd->bg_bits;
+			if (bits > (cl->cl_recs[i].c_total - count))
+				bits = cl->cl_recs[i].c_total - count;
+			if (bits > left)
+				bits = left;
+
+			if (*nr == *alloced) {
+				*alloced = *alloced ? *alloced * 2 : 64;
+				ret = ocfs2_realloc(sizeof(**groups) * *alloced,
+						    groups);
+				if (ret)
+					return ret;
+			}
+			ig = &(*groups)[(*nr)++];
+			ig->ig_alloc_blkno = alloc_blkno;
+			ig->ig_blkno = blkno;
+			ig->ig_bits = bits;
+
+			count += bits;
+			left -= bits;
+			blkno = gd->bg_next_group;
+		}
+	}
+
+	if (left)
+		return OCFS2_ET_CORRUPT_CHAIN;
+
+	return 0;
+}
+
+errcode_t ocfs2_get_inode_groups(ocfs2_filesys *fs,
+				 struct ocfs2_inode_group **ret_groups,
+				 int *ret_nr)
+{
+	struct ocfs2_inode_group *groups = NULL;
+	uint64_t blkno;
+	char *buf = NULL, *gd_buf = NULL;
+	errcode_t ret;
+	int i, nr = 0, alloced = 0;
+
+	ret = ocfs2_malloc_block(fs->fs_io, &buf);
+	if (ret)
+		return ret;
+	ret = ocfs2_malloc_block(fs->fs_io, &gd_buf);
+	if (ret)
+		goto out;
+
+	/* Same order as ocfs2_open_inode_scan(): global, then each slot */
+	for (i = -1; i < OCFS2_RAW_SB(fs->fs_super)->s_max_slots; i++) {
+		if (i < 0)
+			ret = ocfs2_lookup_system_inode(fs,
+						GLOBAL_INODE_ALLOC_SYSTEM_INODE,
+						0, &blkno);
+		else
+			ret = ocfs2_lookup_system_inode(fs,
+						INODE_ALLOC_SYSTEM_INODE,
+						i, &blkno);
+		if (ret)
+			goto out;
+
+		ret = add_alloc_groups(fs, blkno, buf, gd_buf, &groups, &nr,
+				       &alloced);
+		if (ret)
+			goto out;
+	}
+
+	*ret_groups = groups;
+	*ret_nr = nr;
+	groups = NULL;
 
+out:
+	ocfs2_free(&groups);
+	ocfs2_free(&gd_buf);
+	ocfs2_free(&buf);
 	return ret;
 }
 
+void ocfs2_partition_inode_groups(struct ocfs2_inode_group *groups,
+				  int nr_groups, int parts, int *bounds)
+{
+	uint64_t total = 0, sum = 0;
+	int i, p = 1;
+
+	for (i = 0; i < nr_groups; i++)
+		total += groups[i].ig_bits;
+
+	bounds[0] = 0;
+	for (i = 0; (i < nr_groups) && (p < parts); i++) {
+		sum += groups[i].ig_bits;
+		while ((p < parts) && (sum * parts >= total * p))
+			bounds[p++] = i + 1;
+	}
+	while (p <= parts)
+		bounds[p++] = nr_groups;
+}
+
 void ocfs2_close_inode_scan(ocfs2_inode_scan *scan)
 {
 	int i;
@@ -344,6 +833,9 @@ void ocfs2_close_inode_scan(ocfs2_inode_scan *scan)
 	if (!scan)
 		return;
 
+	if (scan->pf_started)
+		prefetch_stop(scan);
+
 	for (i = 0; i < scan->num_inode_alloc; i++) {
 		if (scan->inode_alloc[i]) {
 			ocfs2_free_cached_inode(scan->fs,
@@ -354,6 +846,7 @@ void ocfs2_close_inode_scan(ocfs2_inode_scan *scan)
 	ocfs2_free(&scan->group_buffer);
 	ocfs2_free(&scan->cur_desc);
 	ocfs2_free(&scan->inode_alloc);
+	ocfs2_free(&scan->groups);
 	ocfs2_free(&scan);
 
 	return;
@@ -364,34 +857,241 @@ void ocfs2_close_inode_scan(ocfs2_inode_scan *scan)
 #ifdef DEBUG_EXE
 #include <string.h>
 #include <stdlib.h>
+#include <getopt.h>
 
 static void print_usage(void)
 {
 	fprintf(stderr,
-		"Usage: debug_inode_scan <filename>\n");
+		"Usage: debug_inode_scan [-p parts] <filename>\n"
+		"       debug_inode_scan -c [-p parts] <filename>\n");
 }
 
 extern int opterr, optind;
 extern char *optarg;
 
-int main(int argc, char *argv[])
+static errcode_t print_scan(ocfs2_inode_scan *scan, char *buf)
+{
+	errcode_t ret;
+	uint64_t blkno;
+	struct ocfs2_dinode *di = (struct ocfs2_dinode *)buf;
+
+	for (;;) {
+		ret = ocfs2_get_next_inode(scan, &blkno, buf);
+		if (ret || !blkno)
+			return ret;
+
+		if (memcmp(di->i_signature,
+			   OCFS2_INODE_SIGNATURE,
+			   strlen(OCFS2_INODE_SIGNATURE)))
+			continue;
+
+		if (!(di->i_flags & OCFS2_VALID_FL))
+			continue;
+
+		fprintf(stdout,
+			"%snode %"PRIu64" with size %"PRIu64"\n",
+			(di->i_flags & OCFS2_SYSTEM_FL) ?
+			"System i" : "I",
+			blkno, (uint64_t)di->i_size);
+	}
+}
+
+/* Scans the groups in parts, one after another, as threads would */
+static errcode_t print_parts(ocfs2_filesys *fs, int parts, char *buf)
+{
+	errcode_t ret;
+	struct ocfs2_inode_group *groups;
+	ocfs2_inode_scan *scan;
+	int i, nr, *bounds;
+
+	ret = ocfs2_get_inode_groups(fs, &groups, &nr);
+	if (ret)
+		return ret;
+
+	ret = ocfs2_malloc(sizeof(int) * (parts + 1), &bounds);
+	if (ret)
+		goto out;
+
+	ocfs2_partition_inode_groups(groups, nr, parts, bounds);
+	for (i = 0; i < parts; i++) {
+		fprintf(stdout, "Part %d: groups %d-%d of %d\n", i,
+			bounds[i], bounds[i + 1], nr);
+
+		ret = ocfs2_open_inode_scan_range(fs, groups + bounds[i],
+						  bounds[i + 1] - bounds[i],
+						  &scan);
+		if (ret)
+			break;
+
+		ret = print_scan(scan, buf);
+		ocfs2_close_inode_scan(scan);
+		if (ret)
+			break;
+	}
+
+	ocfs2_free(&bounds);
+out:
+	ocfs2_free(&groups);
+	return ret;
+}
+
+struct scan_list {
+	uint64_t	*sl_blknos;
+	int		sl_nr;
+	int		sl_alloced;
+};
+
+/* Every block a scan returns, inode or not */
+static errcode_t list_scan(ocfs2_inode_scan *scan, char *buf,
+			   struct scan_list *sl)
 {
 	errcode_t ret;
-	int done;
 	uint64_t blkno;
+
+	for (;;) {
+		ret = ocfs2_get_next_inode(scan, &blkno, buf);
+		if (ret || !blkno)
+			return ret;
+
+		if (sl->sl_nr == sl->sl_alloced) {
+			sl->sl_alloced = sl->sl_alloced ?
+				sl->sl_alloced * 2 : 1024;
+			ret = ocfs2_realloc(sizeof(uint64_t) * sl->sl_alloced,
+					    &sl->sl_blknos);
+			if (ret)
+				return ret;
+		}
+		sl->sl_blknos[sl->sl_nr++] = blkno;
+	}
+}
+
+static int compare_blknos(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * The full scan and a scan of the groups in parts must return the same
+ * blocks, even when an alloc file's i_total stops short of its chains.
+ * Returns 1 if they differ.
+ */
+static int compare_scans(ocfs2_filesys *fs, int parts, char *buf)
+{
+	errcode_t ret;
+	struct scan_list full = { NULL, }, split = { NULL, };
+	struct ocfs2_inode_group *groups = NULL;
+	ocfs2_inode_scan *scan;
+	int i, nr, *bounds = NULL, differ = 1;
+
+	ret = ocfs2_open_inode_scan(fs, &scan);
+	if (!ret) {
+		ret = list_scan(scan, buf, &full);
+		ocfs2_close_inode_scan(scan);
+	}
+	if (ret) {
+		com_err("compare_scans", ret, "during the full scan");
+		goto out;
+	}
+
+	ret = ocfs2_get_inode_groups(fs, &groups, &nr);
+	if (!ret)
+		ret = ocfs2_malloc(sizeof(int) * (parts + 1), &bounds);
+	if (ret)
+		goto out_split;
+
+	ocfs2_partition_inode_groups(groups, nr, parts, bounds);
+	for (i = 0; i < parts; i++) {
+		ret = ocfs2_open_inode_scan_range(fs, groups + bounds[i],
+						  bounds[i + 1] - bounds[i],
+						  &scan);
+		if (ret)
+			break;
+
+		ret = list_scan(scan, buf, &split);
+		ocfs2_close_inode_scan(scan);
+		if (ret)
+			break;
+	}
+
+out_split:
+	if (ret) {
+		com_err("compare_scans", ret, "during the scan in %d parts",
+			parts);
+		goto out;
+	}
+
+	if (full.sl_nr)
+		qsort(full.sl_blknos, full.sl_nr, sizeof(uint64_t),
+		      compare_blknos);
+	if (split.sl_nr)
+		qsort(split.sl_blknos, split.sl_nr, sizeof(uint64_t),
+		      compare_blknos);
+
+	for (i = 0; (i < full.sl_nr) && (i < split.sl_nr); i++) {
+		if (full.sl_blknos[i] != split.sl_blknos[i])
+			break;
+	}
+	if ((i < full.sl_nr) || (i < split.sl_nr)) {
+		fprintf(stdout, "Scans differ after %d blocks: the full scan "
+			"returned %d, the scan in %d parts %d\n", i,
+			full.sl_nr, parts, split.sl_nr);
+		goto out;
+	}
+
+	fprintf(stdout, "Full scan and scan in %d parts agree on %d "
+		"blocks\n", parts, full.sl_nr);
+	differ = 0;
+
+out:
+	if (bounds)
+		ocfs2_free(&bounds);
+	if (groups)
+		ocfs2_free(&groups);
+	if (split.sl_blknos)
+		ocfs2_free(&split.sl_blknos);
+	if (full.sl_blknos)
+		ocfs2_free(&full.sl_blknos);
+	return differ;
+}
+
+int main(int argc, char *argv[])
+{
+	errcode_t ret;
+	int c, parts = 0, compare = 0, differ = 0;
 	char *filename, *buf;
 	ocfs2_filesys *fs;
-	struct ocfs2_dinode *di;
 	ocfs2_inode_scan *scan;
 
 	initialize_ocfs_error_table();
 
-	if (argc < 2) {
+	while ((c = getopt(argc, argv, "cp:")) != EOF) {
+		switch (c) {
+			case 'c':
+				compare = 1;
+				break;
+
+			case 'p':
+				parts = atoi(optarg);
+				if (parts < 1) {
+					print_usage();
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	if (optind >= argc) {
 		fprintf(stderr, "Missing filename\n");
 		print_usage();
 		return 1;
 	}
-	filename = argv[1];
+	filename = argv[optind];
 
 	ret = ocfs2_open(filename, OCFS2_FLAG_RO|OCFS2_FLAG_BUFFERED, 0, 0, &fs);
 	if (ret) {
@@ -407,7 +1107,18 @@ int main(int argc, char *argv[])
 		goto out_close;
 	}
 
-	di = (struct ocfs2_dinode *)buf;
+	if (compare) {
+		differ = compare_scans(fs, parts ? parts : 1, buf);
+		goto out_free;
+	}
+
+	if (parts) {
+		ret = print_parts(fs, parts, buf);
+		if (ret)
+			com_err(argv[0], ret,
+				"while scanning inode groups");
+		goto out_free;
+	}
 
 	ret = ocfs2_open_inode_scan(fs, &scan);
 	if (ret) {
@@ -416,34 +1127,11 @@ int main(int argc, char *argv[])
 		goto out_free;
 	}
 
-	done = 0;
-	while (!done) {
-		ret = ocfs2_get_next_inode(scan, &blkno, buf);
-		if (ret) {
-			com_err(argv[0], ret,
-				"while getting next inode");
-			goto out_close_scan;
-		}
-		if (blkno) {
-			if (memcmp(di->i_signature,
-				   OCFS2_INODE_SIGNATURE,
-				   strlen(OCFS2_INODE_SIGNATURE)))
-				continue;
-
-			if (!(di->i_flags & OCFS2_VALID_FL))
-				continue;
-
-			fprintf(stdout, 
-				"%snode %"PRIu64" with size %"PRIu64"\n",
-				(di->i_flags & OCFS2_SYSTEM_FL) ?
-				"System i" : "I",
-				blkno, di->i_size);
-		}
-		else
-			done = 1;
-	}
+	ret = print_scan(scan, buf);
+	if (ret)
+		com_err(argv[0], ret,
+			"while getting next inode");
 
-out_close_scan:
 	ocfs2_close_inode_scan(scan);
 
 out_free:
@@ -457,6 +1145,6 @@ out_close:
 	}
 
 out:
-	return 0;
+	return differ;
 }
 #endif  /* DEBUG_EXE */
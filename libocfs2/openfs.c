@@ -89,6 +89,103 @@ errcode_t ocfs2_read_blocks(ocfs2_filesys *fs, int64_t blkno,
 	return __ocfs2_read_blocks(fs, blkno, count, data, false);
 }
 
+/*
+ * Image files need every range checked and translated, so we do that
+ * on a copy of the caller's array.
+ */
+errcode_t ocfs2_read_blocks_v(ocfs2_filesys *fs, struct io_vec_unit *ivus,
+			      int nr)
+{
+	int i, j;
+	errcode_t ret;
+	struct io_vec_unit *img;
+
+	if (!(fs->fs_flags & OCFS2_FLAG_IMAGE_FILE) || (nr <= 0))
+		return io_read_blocks_v(fs->fs_io, ivus, nr);
+
+	ret = ocfs2_malloc(sizeof(struct io_vec_unit) * nr, &img);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < ivus[i].ivu_count; j++) {
+			if (!ocfs2_image_test_bit(fs, ivus[i].ivu_blkno + j)) {
+				ret = OCFS2_ET_IO;
+				goto out;
+			}
+		}
+		img[i] = ivus[i];
+		img[i].ivu_blkno = ocfs2_image_get_blockno(fs,
+							   ivus[i].ivu_blkno);
+	}
+
+	ret = io_read_blocks_v(fs->fs_io, img, nr);
+
+out:
+	ocfs2_free(&img);
+	return ret;
+}
+
+errcode_t ocfs2_get_block(ocfs2_filesys *fs, int64_t blkno,
+			  const char **buf)
+{
+	if (fs->fs_flags & OCFS2_FLAG_IMAGE_FILE) {
+		if (!ocfs2_image_test_bit(fs, blkno))
+			return OCFS2_ET_IO;
+		blkno = ocfs2_image_get_blockno(fs, blkno);
+	}
+
+	return io_get_block(fs->fs_io, blkno, buf);
+}
+
+void ocfs2_put_block(ocfs2_filesys *fs, const char *buf)
+{
+	io_put_block(fs->fs_io, buf);
+}
+
+/*
+ * The block from ocfs2_get_block() may be shared with the cache, so we
+ * can only verify it in place.  If the crc32 is bad, we copy it and let
+ * ocfs2_validate_meta_ecc() try to fix the copy.
+ */
+errcode_t ocfs2_get_meta_block(ocfs2_filesys *fs, int64_t blkno,
+			       size_t bc_offset, const char **buf)
+{
+	errcode_t ret;
+	const char *blk;
+	char *copy = NULL;
+
+	ret = ocfs2_get_block(fs, blkno, &blk);
+	if (ret)
+		return ret;
+
+	if (!ocfs2_meta_ecc(OCFS2_RAW_SB(fs->fs_super)) ||
+	    !ocfs2_block_check_verify(blk, fs->fs_blocksize,
+				      (const struct ocfs2_block_check *)
+				      (blk + bc_offset))) {
+		*buf = blk;
+		return 0;
+	}
+
+	ret = ocfs2_malloc_block(fs->fs_io, &copy);
+	if (!ret) {
+		memcpy(copy, blk, fs->fs_blocksize);
+		ret = ocfs2_validate_meta_ecc(fs, copy,
+					      (struct ocfs2_block_check *)
+					      (copy + bc_offset));
+	}
+	ocfs2_put_block(fs, blk);
+	if (ret) {
+		if (copy)
+			ocfs2_free(&copy);
+		return ret;
+	}
+
+	/* ocfs2_put_block() frees memory that isn't in the cache */
+	*buf = copy;
+	return 0;
+}
+
 static errcode_t ocfs2_validate_ocfs1_header(ocfs2_filesys *fs)
 {
 	errcode_t ret;
@@ -201,10 +298,23 @@ errcode_t ocfs2_write_primary_super(ocfs2_filesys *fs)
 		   strlen(OCFS2_SUPER_BLOCK_SIGNATURE)))
 		goto out_blk;
 
+	/*
+	 * The superblock carries the in-progress flags, so it must not
+	 * pass the metadata it describes.  Everything written before
+	 * it goes out first, and it goes out now.
+	 */
+	ret = io_flush(fs->fs_io);
+	if (ret)
+		goto out_blk;
+
 	ret = ocfs2_write_inode(fs, OCFS2_SUPER_BLOCK_BLKNO, blk);
 	if (ret)
 		goto out_blk;
 
+	ret = io_flush(fs->fs_io);
+	if (ret)
+		goto out_blk;
+
 	return 0;
 
 out_blk:
@@ -282,7 +392,9 @@ errcode_t ocfs2_open(const char *name, int flags,
 	fs->fs_umask = 022;
 
 	ret = io_open(name, (flags & (OCFS2_FLAG_RO | OCFS2_FLAG_RW |
-				      OCFS2_FLAG_BUFFERED)),
+				      OCFS2_FLAG_BUFFERED |
+				      OCFS2_FLAG_ASYNC_IO |
+				      OCFS2_FLAG_MMAP)),
 		      &fs->fs_io);
 	if (ret)
 		goto out;
@@ -0,0 +1,291 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * scratch_bitmap.c
+ *
+ * A file-backed bitmap for the OCFS2 userspace library.
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License, version 2,  as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+/*
+ * Plain bits for every bit of the bitmap, but kept in an unlinked
+ * file that is mmap()ed shared rather than in anonymous memory.  The
+ * kernel writes out and drops pages we haven't touched lately, so a
+ * bitmap far bigger than RAM only costs the pages in use.  The whole
+ * file is allocated up front, so running out of scratch space fails
+ * ocfs2_scratch_bitmap_new() rather than a later store.
+ *
+ * Like the sparse bitmap, it has no regions, so it can't be read from
+ * or written to disk, and bit_change_notify is never called.
+ */
+
+#define _XOPEN_SOURCE 600 /* Triggers magic in features.h */
+#define _LARGEFILE64_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "ocfs2/ocfs2.h"
+#include "ocfs2/bitops.h"
+
+#include "bitmap.h"
+
+
+/* The bitops take an int, so we go at the bits a slice at a time */
+#define SCB_SLICE_BITS		((uint64_t)1 << 30)
+#define SCB_SLICE_BYTES		(SCB_SLICE_BITS / 8)
+
+struct scratch_bitmap {
+	int		sb_fd;
+	size_t		sb_len;
+	char		*sb_bits;
+};
+
+static inline char *scb_slice(struct scratch_bitmap *sb, uint64_t bitno)
+{
+	return sb->sb_bits + (bitno / SCB_SLICE_BITS) * SCB_SLICE_BYTES;
+}
+
+static errcode_t scratch_set_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				 int *oldval)
+{
+	*oldval = ocfs2_set_bit(bitno % SCB_SLICE_BITS,
+				scb_slice(bitmap->b_private, bitno));
+	return 0;
+}
+
+static errcode_t scratch_clear_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				   int *oldval)
+{
+	*oldval = ocfs2_clear_bit(bitno % SCB_SLICE_BITS,
+				  scb_slice(bitmap->b_private, bitno));
+	return 0;
+}
+
+static errcode_t scratch_test_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				  int *val)
+{
+	*val = ocfs2_test_bit(bitno % SCB_SLICE_BITS,
+			      scb_slice(bitmap->b_private, bitno));
+	return 0;
+}
+
+static errcode_t scratch_find_next(ocfs2_bitmap *bitmap, uint64_t start,
+				   uint64_t *found, int set)
+{
+	struct scratch_bitmap *sb = bitmap->b_private;
+	uint64_t base;
+	int size, off, next;
+
+	while (start < bitmap->b_total_bits) {
+		base = start - (start % SCB_SLICE_BITS);
+		size = ocfs2_min(bitmap->b_total_bits - base, SCB_SLICE_BITS);
+		off = start - base;
+
+		if (set)
+			next = ocfs2_find_next_bit_set(scb_slice(sb, base),
+						       size, off);
+		else
+			next = ocfs2_find_next_bit_clear(scb_slice(sb, base),
+							 size, off);
+		if (next < size) {
+			*found = base + next;
+			return 0;
+		}
+
+		start = base + size;
+	}
+
+	return OCFS2_ET_BIT_NOT_FOUND;
+}
+
+static errcode_t scratch_find_next_set(ocfs2_bitmap *bitmap, uint64_t start,
+				       uint64_t *found)
+{
+	return scratch_find_next(bitmap, start, found, 1);
+}
+
+static errcode_t scratch_find_next_clear(ocfs2_bitmap *bitmap,
+					 uint64_t start, uint64_t *found)
+{
+	return scratch_find_next(bitmap, start, found, 0);
+}
+
+/* Same best-fit as the generic bitmaps */
+static errcode_t scratch_alloc_range(ocfs2_bitmap *bitmap, uint64_t min_len,
+				     uint64_t len, uint64_t *first_bit,
+				     uint64_t *bits_found)
+{
+	errcode_t ret;
+	uint64_t start = 0, end, best_start = 0, best_len = 0;
+
+	while (start < bitmap->b_total_bits) {
+		ret = scratch_find_next_clear(bitmap, start, &start);
+		if (ret)
+			break;
+
+		ret = scratch_find_next_set(bitmap, start, &end);
+		if (ret)
+			end = bitmap->b_total_bits;
+
+		if ((end - start) >= len) {
+			best_start = start;
+			best_len = len;
+			break;
+		}
+		if ((end - start) > best_len) {
+			best_start = start;
+			best_len = end - start;
+		}
+		start = end;
+	}
+
+	if (best_len < min_len)
+		return OCFS2_ET_BIT_NOT_FOUND;
+
+	for (end = best_start; end < best_start + best_len; end++)
+		ocfs2_bitmap_set(bitmap, end, NULL);
+
+	*first_bit = best_start;
+	*bits_found = best_len;
+	return 0;
+}
+
+static errcode_t scratch_clear_range(ocfs2_bitmap *bitmap, uint64_t len,
+				     uint64_t first_bit)
+{
+	errcode_t ret;
+	uint64_t end;
+
+	for (end = first_bit + len; first_bit < end; first_bit++) {
+		ret = ocfs2_bitmap_clear(bitmap, first_bit, NULL);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void scratch_destroy_notify(ocfs2_bitmap *bitmap)
+{
+	struct scratch_bitmap *sb = bitmap->b_private;
+
+	munmap(sb->sb_bits, sb->sb_len);
+	close(sb->sb_fd);
+	ocfs2_free(&sb);
+	bitmap->b_private = NULL;
+}
+
+static struct ocfs2_bitmap_operations scratch_ops = {
+	.set_bit		= scratch_set_bit,
+	.clear_bit		= scratch_clear_bit,
+	.test_bit		= scratch_test_bit,
+	.find_next_set		= scratch_find_next_set,
+	.find_next_clear	= scratch_find_next_clear,
+	.alloc_range		= scratch_alloc_range,
+	.clear_range		= scratch_clear_range,
+	.destroy_notify		= scratch_destroy_notify,
+};
+
+/*
+ * The bitops work on unsigned longs, so round up to one.  The file
+ * starts out as zeros.  Its blocks are reserved now; a page the file
+ * couldn't back would SIGBUS on the first store to it.
+ */
+static errcode_t scratch_map(struct scratch_bitmap *sb, const char *dir,
+			     uint64_t total_bits)
+{
+	errcode_t ret;
+	char *template = NULL;
+	size_t len;
+
+	ret = ocfs2_malloc(strlen(dir) + sizeof("/ocfs2-bitmap-XXXXXX"),
+			   &template);
+	if (ret)
+		return ret;
+	sprintf(template, "%s/ocfs2-bitmap-XXXXXX", dir);
+
+	sb->sb_fd = mkstemp(template);
+	if (sb->sb_fd < 0) {
+		ret = errno;
+		goto out;
+	}
+	unlink(template);
+
+	len = (total_bits + 7) / 8;
+	len = (len + sizeof(unsigned long) - 1) & ~(sizeof(unsigned long) - 1);
+	if (!len)
+		len = sizeof(unsigned long);
+
+	ret = posix_fallocate64(sb->sb_fd, 0, len);
+	if (ret)
+		goto out_close;
+
+	sb->sb_bits = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   sb->sb_fd, 0);
+	if (sb->sb_bits == MAP_FAILED) {
+		ret = (errno == ENOMEM) ? OCFS2_ET_NO_MEMORY : errno;
+		goto out_close;
+	}
+	sb->sb_len = len;
+	goto out;
+
+out_close:
+	close(sb->sb_fd);
+out:
+	ocfs2_free(&template);
+	return ret;
+}
+
+errcode_t ocfs2_scratch_bitmap_new(ocfs2_filesys *fs,
+				   uint64_t total_bits,
+				   const char *description,
+				   const char *dir,
+				   ocfs2_bitmap **ret_bitmap)
+{
+	errcode_t ret;
+	struct scratch_bitmap *sb;
+
+	ret = ocfs2_malloc0(sizeof(struct scratch_bitmap), &sb);
+	if (ret)
+		return ret;
+
+	ret = scratch_map(sb, dir, total_bits);
+	if (ret) {
+		ocfs2_free(&sb);
+		return ret;
+	}
+
+	ret = ocfs2_bitmap_new(fs, total_bits,
+			       description ? description :
+			       "Scratch bitmap",
+			       &scratch_ops, sb, ret_bitmap);
+	if (ret) {
+		munmap(sb->sb_bits, sb->sb_len);
+		close(sb->sb_fd);
+		ocfs2_free(&sb);
+	}
+
+	return ret;
+}
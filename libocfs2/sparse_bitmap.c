@@ -0,0 +1,794 @@
+/* -*- mode: c; c-basic-offset: 8; -*-
+ * vim: noexpandtab sw=8 ts=8 sts=0:
+ *
+ * sparse_bitmap.c
+ *
+ * A compressed bitmap for the OCFS2 userspace library.
+ *
+ * Copyright (C) 2026 Oracle.  All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License, version 2,  as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 021110-1307, USA.
+ */
+
+/*
+ * The cluster and block bitmaps in bitmap.c keep plain bits for every
+ * region they cover.  A bitmap that has to cover a whole volume, but
+ * has long stretches that are all clear or all set, wastes most of that.
+ *
+ * This bitmap cuts the bits into chunks of SB_CHUNK_BITS.  Only chunks
+ * with bits set are kept, in a sorted array, and each is stored the
+ * way that suits it:
+ *
+ *  - a sorted array of the offsets that are set, while there are few;
+ *  - plain bits, once the array would be bigger than that;
+ *  - a list of runs of set bits, once every bit is set.
+ *
+ * It has no regions, so it can't be read from or written to disk, and
+ * bit_change_notify is never called.
+ */
+
+#define _XOPEN_SOURCE 600 /* Triggers magic in features.h */
+#define _LARGEFILE64_SOURCE
+
+#include <string.h>
+#include <inttypes.h>
+
+#include "ocfs2/ocfs2.h"
+
+#include "bitmap.h"
+
+
+#define SB_CHUNK_SHIFT		16
+#define SB_CHUNK_BITS		(1 << SB_CHUNK_SHIFT)
+#define SB_CHUNK_MASK		(SB_CHUNK_BITS - 1)
+#define SB_CHUNK_WORDS		(SB_CHUNK_BITS / 64)
+
+/* An array or run chunk never grows past the size of plain bits */
+#define SB_ARRAY_MAX		(SB_CHUNK_BITS / 16)
+#define SB_RUN_MAX		(SB_CHUNK_BITS / 32)
+#define SB_ALLOC_MIN		4
+
+enum sb_chunk_type {
+	SB_ARRAY,
+	SB_BITS,
+	SB_RUNS,
+};
+
+struct sb_run {
+	uint16_t	r_first;
+	uint16_t	r_last;		/* inclusive */
+};
+
+struct sb_chunk {
+	enum sb_chunk_type	c_type;
+	uint32_t		c_set;		/* bits set in the chunk */
+	uint32_t		c_nr;		/* offsets or runs in use */
+	uint32_t		c_alloced;	/* offsets or runs allocated */
+	union {
+		uint16_t	*u_array;
+		uint64_t	*u_bits;
+		struct sb_run	*u_runs;
+	} c_u;
+};
+
+struct sb_entry {
+	uint64_t		e_key;		/* bit >> SB_CHUNK_SHIFT */
+	struct sb_chunk		*e_chunk;
+};
+
+struct sparse_bitmap {
+	struct sb_entry		*sb_entries;	/* sorted by e_key */
+	uint64_t		sb_nr;
+	uint64_t		sb_alloced;
+	uint64_t		sb_hint;	/* last entry changed */
+};
+
+
+static void sb_chunk_free(struct sb_chunk *c)
+{
+	ocfs2_free(&c->c_u.u_array);
+	ocfs2_free(&c);
+}
+
+/* The first offset in the array >= off */
+static uint32_t sb_array_search(struct sb_chunk *c, unsigned int off)
+{
+	uint32_t lo = 0, hi = c->c_nr, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (c->c_u.u_array[mid] < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* The first run ending at or after off */
+static uint32_t sb_runs_search(struct sb_chunk *c, unsigned int off)
+{
+	uint32_t lo = 0, hi = c->c_nr, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (c->c_u.u_runs[mid].r_last < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static errcode_t sb_chunk_grow(struct sb_chunk *c, size_t entry_size,
+			       uint32_t max)
+{
+	errcode_t ret;
+	uint32_t alloced;
+
+	if (c->c_nr < c->c_alloced)
+		return 0;
+
+	alloced = c->c_alloced ? c->c_alloced * 2 : SB_ALLOC_MIN;
+	if (alloced > max)
+		alloced = max;
+
+	ret = ocfs2_realloc(alloced * entry_size, &c->c_u.u_array);
+	if (ret)
+		return ret;
+
+	c->c_alloced = alloced;
+	return 0;
+}
+
+static errcode_t sb_chunk_to_bits(struct sb_chunk *c)
+{
+	errcode_t ret;
+	uint64_t *bits;
+	uint32_t i, off;
+
+	ret = ocfs2_malloc0(SB_CHUNK_WORDS * sizeof(uint64_t), &bits);
+	if (ret)
+		return ret;
+
+	if (c->c_type == SB_ARRAY) {
+		for (i = 0; i < c->c_nr; i++) {
+			off = c->c_u.u_array[i];
+			bits[off / 64] |= 1ULL << (off % 64);
+		}
+	} else {
+		for (i = 0; i < c->c_nr; i++) {
+			for (off = c->c_u.u_runs[i].r_first;
+			     off <= c->c_u.u_runs[i].r_last; off++)
+				bits[off / 64] |= 1ULL << (off % 64);
+		}
+	}
+
+	ocfs2_free(&c->c_u.u_array);
+	c->c_u.u_bits = bits;
+	c->c_type = SB_BITS;
+	c->c_nr = c->c_alloced = 0;
+	return 0;
+}
+
+static errcode_t sb_chunk_to_array(struct sb_chunk *c)
+{
+	errcode_t ret;
+	uint16_t *array;
+	uint64_t word;
+	uint32_t i, nr = 0;
+
+	ret = ocfs2_malloc(SB_ARRAY_MAX * sizeof(uint16_t), &array);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < SB_CHUNK_WORDS; i++) {
+		for (word = c->c_u.u_bits[i]; word; word &= word - 1)
+			array[nr++] = i * 64 + __builtin_ctzll(word);
+	}
+
+	ocfs2_free(&c->c_u.u_bits);
+	c->c_u.u_array = array;
+	c->c_type = SB_ARRAY;
+	c->c_nr = nr;
+	c->c_alloced = SB_ARRAY_MAX;
+	return 0;
+}
+
+static errcode_t sb_chunk_to_full_run(struct sb_chunk *c)
+{
+	errcode_t ret;
+	struct sb_run *runs;
+
+	ret = ocfs2_malloc(SB_ALLOC_MIN * sizeof(struct sb_run), &runs);
+	if (ret)
+		return ret;
+
+	runs[0].r_first = 0;
+	runs[0].r_last = SB_CHUNK_MASK;
+
+	ocfs2_free(&c->c_u.u_bits);
+	c->c_u.u_runs = runs;
+	c->c_type = SB_RUNS;
+	c->c_nr = 1;
+	c->c_alloced = SB_ALLOC_MIN;
+	return 0;
+}
+
+static int sb_chunk_test(struct sb_chunk *c, unsigned int off)
+{
+	uint32_t i;
+
+	switch (c->c_type) {
+	case SB_ARRAY:
+		i = sb_array_search(c, off);
+		return (i < c->c_nr) && (c->c_u.u_array[i] == off);
+	case SB_BITS:
+		return !!(c->c_u.u_bits[off / 64] & (1ULL << (off % 64)));
+	case SB_RUNS:
+		i = sb_runs_search(c, off);
+		return (i < c->c_nr) && (c->c_u.u_runs[i].r_first <= off);
+	}
+	return 0;
+}
+
+static errcode_t sb_array_set(struct sb_chunk *c, unsigned int off)
+{
+	errcode_t ret;
+	uint32_t i = sb_array_search(c, off);
+
+	if (c->c_nr == SB_ARRAY_MAX) {
+		ret = sb_chunk_to_bits(c);
+		if (ret)
+			return ret;
+		c->c_u.u_bits[off / 64] |= 1ULL << (off % 64);
+		return 0;
+	}
+
+	ret = sb_chunk_grow(c, sizeof(uint16_t), SB_ARRAY_MAX);
+	if (ret)
+		return ret;
+
+	memmove(&c->c_u.u_array[i + 1], &c->c_u.u_array[i],
+		(c->c_nr - i) * sizeof(uint16_t));
+	c->c_u.u_array[i] = off;
+	c->c_nr++;
+	return 0;
+}
+
+static errcode_t sb_runs_set(struct sb_chunk *c, unsigned int off)
+{
+	errcode_t ret;
+	struct sb_run *runs;
+	uint32_t i = sb_runs_search(c, off);
+	int join_prev, join_next;
+
+	runs = c->c_u.u_runs;
+	join_prev = (i > 0) && (runs[i - 1].r_last + 1 == off);
+	join_next = (i < c->c_nr) && (runs[i].r_first == off + 1);
+
+	if (join_prev && join_next) {
+		runs[i - 1].r_last = runs[i].r_last;
+		memmove(&runs[i], &runs[i + 1],
+			(c->c_nr - i - 1) * sizeof(struct sb_run));
+		c->c_nr--;
+		return 0;
+	}
+	if (join_prev) {
+		runs[i - 1].r_last = off;
+		return 0;
+	}
+	if (join_next) {
+		runs[i].r_first = off;
+		return 0;
+	}
+
+	if (c->c_nr == SB_RUN_MAX) {
+		ret = sb_chunk_to_bits(c);
+		if (ret)
+			return ret;
+		c->c_u.u_bits[off / 64] |= 1ULL << (off % 64);
+		return 0;
+	}
+
+	ret = sb_chunk_grow(c, sizeof(struct sb_run), SB_RUN_MAX);
+	if (ret)
+		return ret;
+
+	runs = c->c_u.u_runs;
+	memmove(&runs[i + 1], &runs[i], (c->c_nr - i) * sizeof(struct sb_run));
+	runs[i].r_first = runs[i].r_last = off;
+	c->c_nr++;
+	return 0;
+}
+
+/* The caller has checked that off is clear */
+static errcode_t sb_chunk_set(struct sb_chunk *c, unsigned int off)
+{
+	errcode_t ret = 0;
+
+	switch (c->c_type) {
+	case SB_ARRAY:
+		ret = sb_array_set(c, off);
+		break;
+	case SB_BITS:
+		c->c_u.u_bits[off / 64] |= 1ULL << (off % 64);
+		break;
+	case SB_RUNS:
+		ret = sb_runs_set(c, off);
+		break;
+	}
+	if (ret)
+		return ret;
+
+	c->c_set++;
+
+	/* A full chunk is one run.  Staying as bits is fine if we can't */
+	if ((c->c_set == SB_CHUNK_BITS) && (c->c_type == SB_BITS))
+		sb_chunk_to_full_run(c);
+
+	return 0;
+}
+
+static errcode_t sb_runs_clear(struct sb_chunk *c, unsigned int off)
+{
+	errcode_t ret;
+	struct sb_run *runs;
+	uint32_t i = sb_runs_search(c, off);
+
+	runs = c->c_u.u_runs;
+	if (runs[i].r_first == runs[i].r_last) {
+		memmove(&runs[i], &runs[i + 1],
+			(c->c_nr - i - 1) * sizeof(struct sb_run));
+		c->c_nr--;
+		return 0;
+	}
+	if (runs[i].r_first == off) {
+		runs[i].r_first++;
+		return 0;
+	}
+	if (runs[i].r_last == off) {
+		runs[i].r_last--;
+		return 0;
+	}
+
+	/* Splitting the run */
+	if (c->c_nr == SB_RUN_MAX) {
+		ret = sb_chunk_to_bits(c);
+		if (ret)
+			return ret;
+		c->c_u.u_bits[off / 64] &= ~(1ULL << (off % 64));
+		return 0;
+	}
+
+	ret = sb_chunk_grow(c, sizeof(struct sb_run), SB_RUN_MAX);
+	if (ret)
+		return ret;
+
+	runs = c->c_u.u_runs;
+	memmove(&runs[i + 1], &runs[i], (c->c_nr - i) * sizeof(struct sb_run));
+	runs[i].r_last = off - 1;
+	runs[i + 1].r_first = off + 1;
+	c->c_nr++;
+	return 0;
+}
+
+/* The caller has checked that off is set */
+static errcode_t sb_chunk_clear(struct sb_chunk *c, unsigned int off)
+{
+	errcode_t ret = 0;
+	uint32_t i;
+
+	switch (c->c_type) {
+	case SB_ARRAY:
+		i = sb_array_search(c, off);
+		memmove(&c->c_u.u_array[i], &c->c_u.u_array[i + 1],
+			(c->c_nr - i - 1) * sizeof(uint16_t));
+		c->c_nr--;
+		break;
+	case SB_BITS:
+		c->c_u.u_bits[off / 64] &= ~(1ULL << (off % 64));
+		break;
+	case SB_RUNS:
+		ret = sb_runs_clear(c, off);
+		break;
+	}
+	if (ret)
+		return ret;
+
+	c->c_set--;
+
+	/*
+	 * Go back to an array well below SB_ARRAY_MAX, so that a chunk
+	 * near the limit doesn't flip back and forth.  Staying as bits
+	 * is fine if we can't.
+	 */
+	if ((c->c_type == SB_BITS) && (c->c_set < SB_ARRAY_MAX / 2))
+		sb_chunk_to_array(c);
+
+	return 0;
+}
+
+/* The first offset >= off that is set, or -1 */
+static int sb_chunk_next_set(struct sb_chunk *c, unsigned int off)
+{
+	uint32_t i;
+	uint64_t word;
+
+	switch (c->c_type) {
+	case SB_ARRAY:
+		i = sb_array_search(c, off);
+		if (i < c->c_nr)
+			return c->c_u.u_array[i];
+		break;
+	case SB_BITS:
+		i = off / 64;
+		word = c->c_u.u_bits[i] & (~0ULL << (off % 64));
+		while (1) {
+			if (word)
+				return i * 64 + __builtin_ctzll(word);
+			if (++i == SB_CHUNK_WORDS)
+				break;
+			word = c->c_u.u_bits[i];
+		}
+		break;
+	case SB_RUNS:
+		i = sb_runs_search(c, off);
+		if (i < c->c_nr)
+			return (c->c_u.u_runs[i].r_first > off) ?
+				c->c_u.u_runs[i].r_first : off;
+		break;
+	}
+	return -1;
+}
+
+/* The first offset >= off that is clear, or -1 */
+static int sb_chunk_next_clear(struct sb_chunk *c, unsigned int off)
+{
+	uint32_t i;
+	uint64_t word;
+
+	switch (c->c_type) {
+	case SB_ARRAY:
+		for (i = sb_array_search(c, off);
+		     (i < c->c_nr) && (c->c_u.u_array[i] == off); i++)
+			off++;
+		break;
+	case SB_BITS:
+		i = off / 64;
+		word = ~c->c_u.u_bits[i] & (~0ULL << (off % 64));
+		while (1) {
+			if (word)
+				return i * 64 + __builtin_ctzll(word);
+			if (++i == SB_CHUNK_WORDS)
+				return -1;
+			word = ~c->c_u.u_bits[i];
+		}
+		break;
+	case SB_RUNS:
+		/* Runs are never adjacent, so the bit after one is clear */
+		i = sb_runs_search(c, off);
+		if ((i < c->c_nr) && (c->c_u.u_runs[i].r_first <= off))
+			off = c->c_u.u_runs[i].r_last + 1;
+		break;
+	}
+	return (off < SB_CHUNK_BITS) ? (int)off : -1;
+}
+
+/*
+ * The first entry with e_key >= key.  Lookups only read the bitmap, so
+ * threads may test bits at the same time as long as nobody changes
+ * them.  Only set and clear move the hint.
+ */
+static uint64_t sb_search(struct sparse_bitmap *sb, uint64_t key)
+{
+	uint64_t lo = 0, hi = sb->sb_nr, mid;
+
+	/* Most callers walk the bits in order */
+	if (sb->sb_hint < sb->sb_nr) {
+		if (sb->sb_entries[sb->sb_hint].e_key == key)
+			return sb->sb_hint;
+		if (sb->sb_entries[sb->sb_hint].e_key < key)
+			lo = sb->sb_hint + 1;
+		else
+			hi = sb->sb_hint;
+	}
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (sb->sb_entries[mid].e_key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static struct sb_chunk *sb_lookup(struct sparse_bitmap *sb, uint64_t bitno,
+				  uint64_t *index)
+{
+	uint64_t key = bitno >> SB_CHUNK_SHIFT;
+	uint64_t i = sb_search(sb, key);
+
+	if (index)
+		*index = i;
+	if ((i < sb->sb_nr) && (sb->sb_entries[i].e_key == key))
+		return sb->sb_entries[i].e_chunk;
+	return NULL;
+}
+
+static errcode_t sb_insert_chunk(struct sparse_bitmap *sb, uint64_t bitno,
+				 struct sb_chunk **ret_c)
+{
+	errcode_t ret;
+	uint64_t key = bitno >> SB_CHUNK_SHIFT;
+	uint64_t i = sb_search(sb, key), alloced;
+	struct sb_chunk *c;
+
+	if (sb->sb_nr == sb->sb_alloced) {
+		alloced = sb->sb_alloced ? sb->sb_alloced * 2 : SB_ALLOC_MIN;
+		ret = ocfs2_realloc(alloced * sizeof(struct sb_entry),
+				    &sb->sb_entries);
+		if (ret)
+			return ret;
+		sb->sb_alloced = alloced;
+	}
+
+	ret = ocfs2_malloc0(sizeof(struct sb_chunk), &c);
+	if (ret)
+		return ret;
+	c->c_type = SB_ARRAY;
+
+	memmove(&sb->sb_entries[i + 1], &sb->sb_entries[i],
+		(sb->sb_nr - i) * sizeof(struct sb_entry));
+	sb->sb_entries[i].e_key = key;
+	sb->sb_entries[i].e_chunk = c;
+	sb->sb_nr++;
+
+	*ret_c = c;
+	return 0;
+}
+
+static void sb_remove_chunk(struct sparse_bitmap *sb, uint64_t bitno)
+{
+	uint64_t i = sb_search(sb, bitno >> SB_CHUNK_SHIFT);
+
+	sb_chunk_free(sb->sb_entries[i].e_chunk);
+	memmove(&sb->sb_entries[i], &sb->sb_entries[i + 1],
+		(sb->sb_nr - i - 1) * sizeof(struct sb_entry));
+	sb->sb_nr--;
+}
+
+static errcode_t sparse_set_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				int *oldval)
+{
+	errcode_t ret;
+	struct sparse_bitmap *sb = bitmap->b_private;
+	struct sb_chunk *c;
+	unsigned int off = bitno & SB_CHUNK_MASK;
+
+	c = sb_lookup(sb, bitno, &sb->sb_hint);
+	if (c && sb_chunk_test(c, off)) {
+		*oldval = 1;
+		return 0;
+	}
+
+	if (!c) {
+		ret = sb_insert_chunk(sb, bitno, &c);
+		if (ret)
+			return ret;
+	}
+
+	ret = sb_chunk_set(c, off);
+	if (ret) {
+		if (!c->c_set)
+			sb_remove_chunk(sb, bitno);
+		return ret;
+	}
+
+	*oldval = 0;
+	return 0;
+}
+
+static errcode_t sparse_clear_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				  int *oldval)
+{
+	errcode_t ret;
+	struct sparse_bitmap *sb = bitmap->b_private;
+	struct sb_chunk *c;
+	unsigned int off = bitno & SB_CHUNK_MASK;
+
+	c = sb_lookup(sb, bitno, &sb->sb_hint);
+	if (!c || !sb_chunk_test(c, off)) {
+		*oldval = 0;
+		return 0;
+	}
+
+	ret = sb_chunk_clear(c, off);
+	if (ret)
+		return ret;
+
+	if (!c->c_set)
+		sb_remove_chunk(sb, bitno);
+
+	*oldval = 1;
+	return 0;
+}
+
+static errcode_t sparse_test_bit(ocfs2_bitmap *bitmap, uint64_t bitno,
+				 int *val)
+{
+	struct sb_chunk *c = sb_lookup(bitmap->b_private, bitno, NULL);
+
+	*val = c ? sb_chunk_test(c, bitno & SB_CHUNK_MASK) : 0;
+	return 0;
+}
+
+static errcode_t sparse_find_next_set(ocfs2_bitmap *bitmap, uint64_t start,
+				      uint64_t *found)
+{
+	struct sparse_bitmap *sb = bitmap->b_private;
+	uint64_t key = start >> SB_CHUNK_SHIFT;
+	uint64_t i = sb_search(sb, key);
+	unsigned int off;
+	int next;
+
+	for (; i < sb->sb_nr; i++) {
+		off = (sb->sb_entries[i].e_key == key) ?
+			(start & SB_CHUNK_MASK) : 0;
+		next = sb_chunk_next_set(sb->sb_entries[i].e_chunk, off);
+		if (next >= 0) {
+			*found = (sb->sb_entries[i].e_key << SB_CHUNK_SHIFT) +
+				next;
+			return 0;
+		}
+	}
+
+	return OCFS2_ET_BIT_NOT_FOUND;
+}
+
+static errcode_t sparse_find_next_clear(ocfs2_bitmap *bitmap,
+					uint64_t start, uint64_t *found)
+{
+	struct sparse_bitmap *sb = bitmap->b_private;
+	uint64_t i = sb_search(sb, start >> SB_CHUNK_SHIFT);
+	int next;
+
+	/* Any chunk we don't have is all clear */
+	for (; i < sb->sb_nr; i++) {
+		if (sb->sb_entries[i].e_key != (start >> SB_CHUNK_SHIFT))
+			break;
+
+		next = sb_chunk_next_clear(sb->sb_entries[i].e_chunk,
+					   start & SB_CHUNK_MASK);
+		if (next >= 0) {
+			start = (start & ~(uint64_t)SB_CHUNK_MASK) + next;
+			break;
+		}
+		start = (sb->sb_entries[i].e_key + 1) << SB_CHUNK_SHIFT;
+	}
+
+	if (start >= bitmap->b_total_bits)
+		return OCFS2_ET_BIT_NOT_FOUND;
+
+	*found = start;
+	return 0;
+}
+
+/* Same best-fit as the generic bitmaps, but over free extents */
+static errcode_t sparse_alloc_range(ocfs2_bitmap *bitmap, uint64_t min_len,
+				    uint64_t len, uint64_t *first_bit,
+				    uint64_t *bits_found)
+{
+	errcode_t ret;
+	uint64_t start = 0, end, best_start = 0, best_len = 0;
+
+	while (start < bitmap->b_total_bits) {
+		ret = sparse_find_next_clear(bitmap, start, &start);
+		if (ret)
+			break;
+
+		ret = sparse_find_next_set(bitmap, start, &end);
+		if (ret || (end > bitmap->b_total_bits))
+			end = bitmap->b_total_bits;
+
+		if ((end - start) >= len) {
+			best_start = start;
+			best_len = len;
+			break;
+		}
+		if ((end - start) > best_len) {
+			best_start = start;
+			best_len = end - start;
+		}
+		start = end;
+	}
+
+	if (best_len < min_len)
+		return OCFS2_ET_BIT_NOT_FOUND;
+
+	for (end = best_start; end < best_start + best_len; end++) {
+		ret = ocfs2_bitmap_set(bitmap, end, NULL);
+		if (ret) {
+			while (end-- > best_start)
+				ocfs2_bitmap_clear(bitmap, end, NULL);
+			return ret;
+		}
+	}
+
+	*first_bit = best_start;
+	*bits_found = best_len;
+	return 0;
+}
+
+static errcode_t sparse_clear_range(ocfs2_bitmap *bitmap, uint64_t len,
+				    uint64_t first_bit)
+{
+	errcode_t ret;
+	uint64_t end;
+
+	for (end = first_bit + len; first_bit < end; first_bit++) {
+		ret = ocfs2_bitmap_clear(bitmap, first_bit, NULL);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void sparse_destroy_notify(ocfs2_bitmap *bitmap)
+{
+	struct sparse_bitmap *sb = bitmap->b_private;
+	uint64_t i;
+
+	for (i = 0; i < sb->sb_nr; i++)
+		sb_chunk_free(sb->sb_entries[i].e_chunk);
+	ocfs2_free(&sb->sb_entries);
+	ocfs2_free(&sb);
+	bitmap->b_private = NULL;
+}
+
+static struct ocfs2_bitmap_operations sparse_ops = {
+	.set_bit		= sparse_set_bit,
+	.clear_bit		= sparse_clear_bit,
+	.test_bit		= sparse_test_bit,
+	.find_next_set		= sparse_find_next_set,
+	.find_next_clear	= sparse_find_next_clear,
+	.alloc_range		= sparse_alloc_range,
+	.clear_range		= sparse_clear_range,
+	.destroy_notify		= sparse_destroy_notify,
+};
+
+errcode_t ocfs2_sparse_bitmap_new(ocfs2_filesys *fs,
+				  uint64_t total_bits,
+				  const char *description,
+				  ocfs2_bitmap **ret_bitmap)
+{
+	errcode_t ret;
+	struct sparse_bitmap *sb;
+
+	ret = ocfs2_malloc0(sizeof(struct sparse_bitmap), &sb);
+	if (ret)
+		return ret;
+
+	ret = ocfs2_bitmap_new(fs, total_bits,
+			       description ? description :
+			       "Sparse bitmap",
+			       &sparse_ops, sb, ret_bitmap);
+	if (ret)
+		ocfs2_free(&sb);
+
+	return ret;
+}
@@ -223,6 +223,7 @@ static errcode_t ocfs2_zero_tail_and_truncate_full(ocfs2_filesys *fs,
 					 OCFS2_EXTENT_FLAG_DEPTH_TRAVERSE,
 					 NULL, truncate_iterate,
 					 &ctxt);
+	ocfs2_extent_map_drop(ci);
 	if (ret)
 		goto out;
 
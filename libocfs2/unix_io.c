@@ -40,11 +40,15 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/utsname.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#include <linux/mempolicy.h>
 #endif
+#include <stdio.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <inttypes.h>
-
-#include "ocfs2/kernel-rbtree.h"
+#include <stdlib.h>
 
 #include "ocfs2/ocfs2.h"
 
@@ -58,34 +62,133 @@
 
 
 /*
+ * The cache is a 2Q cache.  Blocks read for the first time go on the
+ * ic_a1in FIFO.  If they fall off the end of that FIFO, we remember
+ * their block numbers on the ic_a1out ghost list.  Blocks that are
+ * read again while they are ghosts were not a one-time scan, so they
+ * go on the ic_am LRU.  Big sequential scans only churn ic_a1in and
+ * leave the hot metadata in ic_am alone.
+ *
  * The cache looks up blocks in two ways:
  *
- * 1) If it needs a new block, it gets one off of ic->ic_lru.  The blocks
- *    attach to that list via icb->icb_list.
+ * 1) If it needs a new block, it steals one via io_cache_steal().
+ *    Invalid and "unseen" blocks on ic_cold go first, then the head of
+ *    ic_a1in if it is over its target size, then the head of ic_am.
+ *    The blocks attach to these lists via icb->icb_list.
  *
- * 2) If it wants to look up an existing block, it gets it from
- *    ic->ic_lookup.  The blocks are attached vai icb->icb_node.
+ * 2) If it wants to look up an existing block, it hashes into
+ *    ic_hash.  The blocks are chained via icb->icb_hash_next.  Ghosts
+ *    live in their own ic_ghost_hash.
+ *
+ * Blocks pinned by io_get_block() are taken off their list so that
+ * they can't be stolen.  icb_queue still says where they belong, and
+ * io_put_block() puts them back.
+ *
+ * If the cache is in write-back mode (io_set_writeback()), writes only
+ * update the cache.  The block is marked dirty and put on ic_dirty via
+ * icb->icb_dirty_list.  io_flush() sorts the dirty blocks and writes
+ * them out in as few I/Os as it can.  Stealing a dirty block flushes
+ * everything first.
+ *
+ * Reads also feed a readahead detector, io_cache_readahead().  When
+ * reads walk forward, either back to back or at a fixed stride, we read
+ * a window of blocks past the request into the cache.  The window
+ * doubles each time it is used, up to ic_ra_max blocks.
  */
+#define IO_CACHE_COLD	0
+#define IO_CACHE_A1IN	1
+#define IO_CACHE_AM	2
+
 struct io_cache_block {
-	struct rb_node icb_node;
+	struct io_cache_block *icb_hash_next;
 	struct list_head icb_list;
 	uint64_t icb_blkno;
 	char *icb_buf;
+	int icb_queue;
+	int icb_refcount;
+	int icb_dirty;
+	struct list_head icb_dirty_list;
+};
+
+struct io_cache_ghost {
+	struct io_cache_ghost *icg_hash_next;
+	struct list_head icg_list;
+	uint64_t icg_blkno;
 };
 
 struct io_cache {
 	size_t ic_nr_blocks;
-	struct list_head ic_lru;
-	struct rb_root ic_lookup;
+	struct list_head ic_cold;
+	struct list_head ic_a1in;
+	struct list_head ic_am;
+	size_t ic_a1in_count;
+	size_t ic_a1in_target;
+
+	struct io_cache_block **ic_hash;
+	struct io_cache_ghost **ic_ghost_hash;
+	unsigned int ic_hash_bits;
+	struct list_head ic_a1out;
+
+	struct io_cache_stats ic_stats;
+
+	/* Write-back state */
+	int ic_writeback;
+	struct list_head ic_dirty;
+	size_t ic_nr_dirty;
+	struct io_cache_block **ic_flush_list;
+
+	/* Readahead state */
+	int ic_ra_max;
+	int ic_ra_window;
+	int ic_ra_hits;
+	int64_t ic_ra_prev;
+	int64_t ic_ra_next;
+	int64_t ic_ra_stride;
+	int64_t ic_ra_end;
+	char *ic_ra_buffer;
 
 	/* Housekeeping */
 	struct io_cache_block *ic_metadata_buffer;
 	unsigned long ic_metadata_buffer_len;
 	char *ic_data_buffer;
 	unsigned long ic_data_buffer_len;
+	unsigned long ic_data_map_len;	/* Non-zero if we mmap()ed it */
+	int ic_hugetlb;
+	int ic_flags;			/* IO_CACHE_* flags we got */
+	uint64_t ic_fault_usecs;
+	struct io_cache_ghost *ic_ghost_buffer;
 	int ic_locked;
 };
 
+/*
+ * Asynchronous I/O state.  Requests queued by io_read_blocks_async()
+ * and io_write_blocks_async() sit on iac_pending until there is a free
+ * iocb slot.  Once submitted to the kernel they are in flight.  When
+ * they complete they move to iac_done, where io_async_wait() hands
+ * them back to the caller.
+ *
+ * If the channel was opened without OCFS2_FLAG_ASYNC_IO, or the kernel
+ * doesn't support AIO, iac_ctx is zero and requests are completed
+ * synchronously at queue time.  Callers don't have to care.
+ */
+#define IO_ASYNC_MAX_DEPTH	128
+
+struct io_async_ctx {
+#ifdef __linux__
+	aio_context_t iac_ctx;
+	struct iocb iac_iocbs[IO_ASYNC_MAX_DEPTH];
+	struct io_event iac_events[IO_ASYNC_MAX_DEPTH];
+	uint64_t iac_submit_ns[IO_ASYNC_MAX_DEPTH];	/* For io_stats */
+#endif
+	int iac_free[IO_ASYNC_MAX_DEPTH];
+	int iac_nr_free;
+	int iac_inflight;
+	int iac_nr_pending;
+	int iac_nr_done;
+	struct list_head iac_pending;
+	struct list_head iac_done;
+};
+
 struct _io_channel {
 	char *io_name;
 	int io_blksize;
@@ -94,8 +197,79 @@ struct _io_channel {
 	int io_fd;
 	bool io_nocache;
 	struct io_cache *io_cache;
+	struct io_async_ctx *io_async;
+	struct io_stats_ctx *io_stats;
+	io_channel *io_parent;		/* io_open_helper() */
+	char *io_map;			/* OCFS2_FLAG_MMAP mapping */
+	uint64_t io_map_len;
+};
+
+/*
+ * I/O statistics state.  isc_trace is a ring of isc_trace_size
+ * records; isc_trace_total counts every record ever added, so the
+ * oldest one is at isc_trace_total % isc_trace_size once it wraps.
+ */
+struct io_stats_ctx {
+	struct io_stats isc_stats;
+	uint64_t isc_epoch;
+	struct io_trace_rec *isc_trace;
+	int isc_trace_size;
+	uint64_t isc_trace_total;
+	int isc_print;			/* OCFS2_IO_STATS was set */
+	char *isc_trace_file;		/* OCFS2_IO_TRACE was set */
 };
 
+static inline uint64_t io_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static inline int io_stats_bucket(uint64_t val, int nr_buckets)
+{
+	int bucket = 0;
+
+	while ((val > 1) && (bucket < (nr_buckets - 1))) {
+		val >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+/* Account one disk request that started at start and just finished */
+static void io_stats_record(io_channel *channel, int op, int64_t blkno,
+			    int64_t bytes, uint64_t start, errcode_t ret)
+{
+	struct io_stats_ctx *isc = channel->io_stats;
+	struct io_op_stats *ios = &isc->isc_stats.is_ops[op];
+	struct io_trace_rec *itr;
+	uint64_t ns = io_stats_now() - start;
+	uint64_t blocks = (bytes + channel->io_blksize - 1) /
+		channel->io_blksize;
+
+	ios->ios_requests++;
+	ios->ios_bytes += bytes;
+	ios->ios_ns += ns;
+	if (ret)
+		ios->ios_errors++;
+	ios->ios_hist[io_stats_bucket(blocks, IO_STATS_SIZE_BUCKETS)]
+		[io_stats_bucket(ns, IO_STATS_LAT_BUCKETS)]++;
+
+	if (!isc->isc_trace_size)
+		return;
+
+	itr = &isc->isc_trace[isc->isc_trace_total % isc->isc_trace_size];
+	itr->itr_blkno = blkno;
+	itr->itr_count = blocks;
+	itr->itr_op = op;
+	itr->itr_start = start - isc->isc_epoch;
+	itr->itr_ns = ns;
+	isc->isc_trace_total++;
+}
+
 /*
  * We open code this because we don't have the ocfs2_filesys to call
  * ocfs2_blocks_in_bytes().
@@ -111,13 +285,27 @@ static errcode_t unix_io_read_block(io_channel *channel, int64_t blkno,
 {
 	int ret;
 	ssize_t size, tot, rd;
-	uint64_t location;
+	uint64_t location, start = 0;
 
 	/* -ative means count is in bytes */
 	size = (count < 0) ? -count : count * channel->io_blksize;
 	location = blkno * channel->io_blksize;
 
+	if (channel->io_stats)
+		start = io_stats_now();
+
 	tot = 0;
+	if (channel->io_map) {
+		if (location < channel->io_map_len) {
+			tot = channel->io_map_len - location;
+			if (tot > size)
+				tot = size;
+			memcpy(data, channel->io_map + location, tot);
+		}
+		ret = 0;
+		goto out;
+	}
+
 	while (tot < size) {
 		rd = pread64(channel->io_fd, data + tot,
 			     size - tot, location + tot);
@@ -141,6 +329,10 @@ out:
 		memset(data + tot, 0, size - tot);
 	}
 
+	if (channel->io_stats)
+		io_stats_record(channel, IO_STATS_READ, blkno, size, start,
+				ret);
+
 	return ret;
 }
 
@@ -150,12 +342,15 @@ static errcode_t unix_io_write_block_full(io_channel *channel, int64_t blkno,
 {
 	int ret;
 	ssize_t size, tot, wr;
-	uint64_t location;
+	uint64_t location, start = 0;
 
 	/* -ative means count is in bytes */
 	size = (count < 0) ? -count : count * channel->io_blksize;
 	location = blkno * channel->io_blksize;
 
+	if (channel->io_stats)
+		start = io_stats_now();
+
 	tot = 0;
 	while (tot < size) {
 		wr = pwrite64(channel->io_fd, data + tot,
@@ -179,6 +374,10 @@ out:
 	if (!ret && (tot != size))
 		ret = OCFS2_ET_SHORT_WRITE;
 
+	if (channel->io_stats)
+		io_stats_record(channel, IO_STATS_WRITE, blkno, size, start,
+				ret);
+
 	return ret;
 }
 
@@ -189,188 +388,664 @@ static errcode_t unix_io_write_block(io_channel *channel, int64_t blkno,
 }
 
 /*
- * See if the rbtree has a block for the given block number.
- *
- * The rb_node garbage lets insertion share the search.  Trivial callers
- * pass NULL.
+ * Write iovcnt blocks starting at blkno.  Each iovec is one block.
+ * The iovecs are modified if the write is short.
+ */
+static errcode_t unix_io_writev(io_channel *channel, int64_t blkno,
+				struct iovec *iov, int iovcnt,
+				int *completed)
+{
+	errcode_t ret = 0;
+	ssize_t size, tot, wr;
+	uint64_t location, start = 0;
+	int idx = 0;
+
+	size = (ssize_t)iovcnt * channel->io_blksize;
+	location = blkno * channel->io_blksize;
+
+	if (channel->io_stats)
+		start = io_stats_now();
+
+	tot = 0;
+	while (tot < size) {
+		wr = pwritev64(channel->io_fd, iov + idx, iovcnt - idx,
+			       location + tot);
+		if (wr < 0) {
+			channel->io_error = errno;
+			ret = OCFS2_ET_IO;
+			break;
+		}
+
+		if (!wr) {
+			ret = OCFS2_ET_SHORT_WRITE;
+			break;
+		}
+
+		tot += wr;
+		while ((idx < iovcnt) && (wr >= iov[idx].iov_len)) {
+			wr -= iov[idx].iov_len;
+			idx++;
+		}
+		if (wr) {
+			iov[idx].iov_base = (char *)iov[idx].iov_base + wr;
+			iov[idx].iov_len -= wr;
+		}
+	}
+
+	*completed = tot / channel->io_blksize;
+
+	if (channel->io_stats)
+		io_stats_record(channel, IO_STATS_WRITE, blkno, size, start,
+				ret);
+
+	return ret;
+}
+
+/*
+ * Read into iovcnt buffers starting at blkno.  Like unix_io_read_block(),
+ * a short read zeroes what's left and returns OCFS2_ET_SHORT_READ.  The
+ * iovecs are modified as the read progresses.
+ */
+static errcode_t unix_io_readv(io_channel *channel, int64_t blkno,
+			       struct iovec *iov, int iovcnt)
+{
+	errcode_t ret = 0;
+	ssize_t size = 0, tot, rd;
+	uint64_t location, start = 0;
+	int idx;
+
+	for (idx = 0; idx < iovcnt; idx++)
+		size += iov[idx].iov_len;
+	location = blkno * channel->io_blksize;
+
+	if (channel->io_stats)
+		start = io_stats_now();
+
+	tot = 0;
+	idx = 0;
+	while (tot < size) {
+		rd = preadv64(channel->io_fd, iov + idx, iovcnt - idx,
+			      location + tot);
+		if (rd < 0) {
+			channel->io_error = errno;
+			ret = OCFS2_ET_IO;
+			break;
+		}
+
+		if (!rd) {
+			ret = OCFS2_ET_SHORT_READ;
+			break;
+		}
+
+		tot += rd;
+		while ((idx < iovcnt) && (rd >= iov[idx].iov_len)) {
+			rd -= iov[idx].iov_len;
+			idx++;
+		}
+		if (rd) {
+			iov[idx].iov_base = (char *)iov[idx].iov_base + rd;
+			iov[idx].iov_len -= rd;
+		}
+	}
+
+	if (ret == OCFS2_ET_SHORT_READ) {
+		for (; idx < iovcnt; idx++)
+			memset(iov[idx].iov_base, 0, iov[idx].iov_len);
+	}
+
+	if (channel->io_stats)
+		io_stats_record(channel, IO_STATS_READ, blkno, size, start,
+				ret);
+
+	return ret;
+}
+
+static inline unsigned int io_cache_hash(struct io_cache *ic,
+					 uint64_t blkno)
+{
+	return (unsigned int)((blkno * 0x9E3779B97F4A7C15ULL) >>
+			      (64 - ic->ic_hash_bits));
+}
+
+/*
+ * See if the hash has a block for the given block number.
  */
 static struct io_cache_block *io_cache_lookup(struct io_cache *ic,
 					      uint64_t blkno)
 {
-	struct rb_node *p = ic->ic_lookup.rb_node;
 	struct io_cache_block *icb;
 
-	while (p) {
-		icb = rb_entry(p, struct io_cache_block, icb_node);
-		if (blkno < icb->icb_blkno) {
-			p = p->rb_left;
-		} else if (blkno > icb->icb_blkno) {
-			p = p->rb_right;
-		} else
-			return icb;
-	}
+	icb = ic->ic_hash[io_cache_hash(ic, blkno)];
+	while (icb && (icb->icb_blkno != blkno))
+		icb = icb->icb_hash_next;
 
-	return NULL;
+	return icb;
 }
 
-static void io_cache_insert(struct io_cache *ic,
-			    struct io_cache_block *insert_icb)
+static void io_cache_unhash(struct io_cache *ic, struct io_cache_block *icb)
 {
-	struct rb_node **p = &ic->ic_lookup.rb_node;
-	struct rb_node *parent = NULL;
-	struct io_cache_block *icb = NULL;
+	struct io_cache_block **p = &ic->ic_hash[io_cache_hash(ic,
+							      icb->icb_blkno)];
 
-	while (*p) {
-		parent = *p;
-		icb = rb_entry(parent, struct io_cache_block, icb_node);
-		if (insert_icb->icb_blkno < icb->icb_blkno) {
-			p = &(*p)->rb_left;
-			icb = NULL;
-		} else if (insert_icb->icb_blkno > icb->icb_blkno) {
-			p = &(*p)->rb_right;
-			icb = NULL;
-		} else
-			assert(0);  /* We erased it, remember? */
-	}
+	while (*p != icb)
+		p = &(*p)->icb_hash_next;
+	*p = icb->icb_hash_next;
+	icb->icb_hash_next = NULL;
+}
+
+static struct io_cache_ghost *io_cache_ghost_lookup(struct io_cache *ic,
+						    uint64_t blkno)
+{
+	struct io_cache_ghost *icg;
+
+	icg = ic->ic_ghost_hash[io_cache_hash(ic, blkno)];
+	while (icg && (icg->icg_blkno != blkno))
+		icg = icg->icg_hash_next;
+
+	return icg;
+}
+
+static void io_cache_ghost_unhash(struct io_cache *ic,
+				  struct io_cache_ghost *icg)
+{
+	struct io_cache_ghost **p =
+		&ic->ic_ghost_hash[io_cache_hash(ic, icg->icg_blkno)];
+
+	while (*p != icg)
+		p = &(*p)->icg_hash_next;
+	*p = icg->icg_hash_next;
+	icg->icg_hash_next = NULL;
+	icg->icg_blkno = UINT64_MAX;
+}
+
+/*
+ * A block fell off the end of ic_a1in.  Remember that we saw it by
+ * recycling the oldest ghost.  Unused ghosts sit at the front of
+ * ic_a1out with a blkno of UINT64_MAX.
+ */
+static void io_cache_add_ghost(struct io_cache *ic, uint64_t blkno)
+{
+	unsigned int hash = io_cache_hash(ic, blkno);
+	struct io_cache_ghost *icg;
+
+	if (list_empty(&ic->ic_a1out))
+		return;
+
+	icg = list_entry(ic->ic_a1out.next, struct io_cache_ghost,
+			 icg_list);
+	if (icg->icg_blkno != UINT64_MAX)
+		io_cache_ghost_unhash(ic, icg);
+
+	icg->icg_blkno = blkno;
+	icg->icg_hash_next = ic->ic_ghost_hash[hash];
+	ic->ic_ghost_hash[hash] = icg;
+	list_del(&icg->icg_list);
+	list_add_tail(&icg->icg_list, &ic->ic_a1out);
+}
 
-	rb_link_node(&insert_icb->icb_node, parent, p);
-	rb_insert_color(&insert_icb->icb_node, &ic->ic_lookup);
+/*
+ * Hash a new block and put it on the right queue.  Blocks we remember
+ * from ic_a1out are hot and go on ic_am.  Everything else starts on
+ * ic_a1in.
+ */
+static void io_cache_insert(struct io_cache *ic,
+			    struct io_cache_block *icb, uint64_t blkno)
+{
+	unsigned int hash = io_cache_hash(ic, blkno);
+	struct io_cache_ghost *icg;
+
+	icb->icb_blkno = blkno;
+	icb->icb_hash_next = ic->ic_hash[hash];
+	ic->ic_hash[hash] = icb;
+
+	icg = io_cache_ghost_lookup(ic, blkno);
+	if (icg) {
+		io_cache_ghost_unhash(ic, icg);
+		list_del(&icg->icg_list);
+		list_add(&icg->icg_list, &ic->ic_a1out);
+
+		icb->icb_queue = IO_CACHE_AM;
+		list_add_tail(&icb->icb_list, &ic->ic_am);
+	} else {
+		icb->icb_queue = IO_CACHE_A1IN;
+		list_add_tail(&icb->icb_list, &ic->ic_a1in);
+		ic->ic_a1in_count++;
+	}
 }
 
 static void io_cache_seen(struct io_cache *ic, struct io_cache_block *icb)
 {
-	/* Move to the front of the LRU */
-	list_del(&icb->icb_list);
-	list_add_tail(&icb->icb_list, &ic->ic_lru);
+	if (icb->icb_refcount) {
+		if (icb->icb_queue == IO_CACHE_COLD)
+			icb->icb_queue = IO_CACHE_A1IN;
+		return;
+	}
+
+	switch (icb->icb_queue) {
+		case IO_CACHE_A1IN:
+			/*
+			 * 2Q ignores repeat hits on ic_a1in.  They're
+			 * usually correlated references to a block we
+			 * just read.
+			 */
+			break;
+
+		case IO_CACHE_AM:
+			/* Move to the front of the LRU */
+			list_del(&icb->icb_list);
+			list_add_tail(&icb->icb_list, &ic->ic_am);
+			break;
+
+		case IO_CACHE_COLD:
+			/* Someone wants it after all */
+			list_del(&icb->icb_list);
+			list_add_tail(&icb->icb_list, &ic->ic_a1in);
+			icb->icb_queue = IO_CACHE_A1IN;
+			ic->ic_a1in_count++;
+			break;
+	}
 }
 
 static void io_cache_unsee(struct io_cache *ic, struct io_cache_block *icb)
 {
 	/*
-	 * Move to the end of the LRU.  There's no point in removing an
+	 * Move to the front of ic_cold.  There's no point in removing an
 	 * "unseen" buffer from the cache.  It's valid, but we want the
 	 * next I/O to steal it.
 	 */
+	if (icb->icb_refcount) {
+		icb->icb_queue = IO_CACHE_COLD;
+		return;
+	}
+
+	if (icb->icb_queue == IO_CACHE_A1IN)
+		ic->ic_a1in_count--;
+	icb->icb_queue = IO_CACHE_COLD;
+	list_del(&icb->icb_list);
+	list_add(&icb->icb_list, &ic->ic_cold);
+}
+
+static void io_cache_pin(struct io_cache *ic, struct io_cache_block *icb)
+{
+	if (icb->icb_refcount++)
+		return;
+
 	list_del(&icb->icb_list);
-	list_add(&icb->icb_list, &ic->ic_lru);
+	if (icb->icb_queue == IO_CACHE_A1IN)
+		ic->ic_a1in_count--;
+}
+
+static void io_cache_unpin(struct io_cache *ic, struct io_cache_block *icb)
+{
+	assert(icb->icb_refcount > 0);
+	if (--icb->icb_refcount)
+		return;
+
+	switch (icb->icb_queue) {
+		case IO_CACHE_A1IN:
+			list_add_tail(&icb->icb_list, &ic->ic_a1in);
+			ic->ic_a1in_count++;
+			break;
+
+		case IO_CACHE_AM:
+			list_add_tail(&icb->icb_list, &ic->ic_am);
+			break;
+
+		case IO_CACHE_COLD:
+			list_add(&icb->icb_list, &ic->ic_cold);
+			break;
+	}
 }
 
-static void io_cache_disconnect(struct io_cache *ic,
+static void io_cache_mark_dirty(struct io_cache *ic,
 				struct io_cache_block *icb)
 {
-	/*
-	 * This icb should longer be looked up.
-	 * If icb->icb_blkno is UINT64_MAX, it's already disconnected.
-	 */
-	if (icb->icb_blkno != UINT64_MAX) {
-		rb_erase(&icb->icb_node, &ic->ic_lookup);
-		memset(&icb->icb_node, 0, sizeof(struct rb_node));
-		icb->icb_blkno = UINT64_MAX;
+	if (icb->icb_dirty)
+		return;
+
+	icb->icb_dirty = 1;
+	list_add_tail(&icb->icb_dirty_list, &ic->ic_dirty);
+	ic->ic_nr_dirty++;
+}
+
+static void io_cache_mark_clean(struct io_cache *ic,
+				struct io_cache_block *icb)
+{
+	if (!icb->icb_dirty)
+		return;
+
+	icb->icb_dirty = 0;
+	list_del(&icb->icb_dirty_list);
+	ic->ic_nr_dirty--;
+}
+
+static int io_cache_blkno_cmp(const void *a, const void *b)
+{
+	const struct io_cache_block *l = *(struct io_cache_block **)a;
+	const struct io_cache_block *r = *(struct io_cache_block **)b;
+
+	if (l->icb_blkno < r->icb_blkno)
+		return -1;
+	if (l->icb_blkno > r->icb_blkno)
+		return 1;
+	return 0;
+}
+
+/*
+ * The most blocks we hand to a single pwritev().  Linux won't take
+ * more than 1024 iovecs.
+ */
+#define IO_CACHE_FLUSH_IOVS	256
+
+/*
+ * Write every dirty block to disk.  The blocks are written in block
+ * order, and adjacent blocks go out in one I/O.  Blocks that were
+ * written are clean even if a later write fails; the rest stay dirty
+ * so that the next flush can try again.
+ */
+static errcode_t io_cache_flush(io_channel *channel)
+{
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block **dirty = ic->ic_flush_list;
+	struct io_cache_block *icb;
+	struct iovec iov[IO_CACHE_FLUSH_IOVS];
+	struct list_head *pos;
+	size_t i, nr = 0;
+	int j, iovcnt, completed;
+	errcode_t ret = 0;
+
+	if (!ic->ic_nr_dirty)
+		return 0;
+
+	list_for_each(pos, &ic->ic_dirty) {
+		icb = list_entry(pos, struct io_cache_block, icb_dirty_list);
+		dirty[nr++] = icb;
+	}
+	qsort(dirty, nr, sizeof(struct io_cache_block *),
+	      io_cache_blkno_cmp);
+
+	for (i = 0; i < nr; i += iovcnt) {
+		iovcnt = 0;
+		do {
+			iov[iovcnt].iov_base = dirty[i + iovcnt]->icb_buf;
+			iov[iovcnt].iov_len = channel->io_blksize;
+			iovcnt++;
+		} while ((iovcnt < IO_CACHE_FLUSH_IOVS) &&
+			 ((i + iovcnt) < nr) &&
+			 (dirty[i + iovcnt]->icb_blkno ==
+			  (dirty[i]->icb_blkno + iovcnt)));
+
+		ret = unix_io_writev(channel, dirty[i]->icb_blkno, iov,
+				     iovcnt, &completed);
+		for (j = 0; j < completed; j++)
+			io_cache_mark_clean(ic, dirty[i + j]);
+		if (ret)
+			break;
 	}
+
+	return ret;
 }
 
-static struct io_cache_block *io_cache_pop_lru(struct io_cache *ic)
+/*
+ * Take a buffer out of the cache so it can be reused.  The returned
+ * icb is on no list and in no hash.  If every buffer is pinned, there's
+ * nothing to steal and we return NULL.  If the victim is dirty, all
+ * dirty blocks are flushed first; if that fails we return NULL too.
+ */
+static struct io_cache_block *io_cache_steal(io_channel *channel)
 {
+	struct io_cache *ic = channel->io_cache;
 	struct io_cache_block *icb;
 
-	icb = list_entry(ic->ic_lru.next, struct io_cache_block, icb_list);
-	io_cache_disconnect(ic, icb);
+	if (!list_empty(&ic->ic_cold))
+		icb = list_entry(ic->ic_cold.next, struct io_cache_block,
+				 icb_list);
+	else if ((ic->ic_a1in_count > ic->ic_a1in_target) ||
+		 list_empty(&ic->ic_am)) {
+		if (list_empty(&ic->ic_a1in))
+			return NULL;
+		icb = list_entry(ic->ic_a1in.next, struct io_cache_block,
+				 icb_list);
+	} else
+		icb = list_entry(ic->ic_am.next, struct io_cache_block,
+				 icb_list);
+
+	if (icb->icb_dirty && io_cache_flush(channel))
+		return NULL;
+
+	list_del(&icb->icb_list);
+	if (icb->icb_queue == IO_CACHE_A1IN) {
+		ic->ic_a1in_count--;
+		io_cache_add_ghost(ic, icb->icb_blkno);
+	}
+
+	/* If icb->icb_blkno is UINT64_MAX, it was never hashed. */
+	if (icb->icb_blkno != UINT64_MAX) {
+		io_cache_unhash(ic, icb);
+		icb->icb_blkno = UINT64_MAX;
+		ic->ic_stats.ics_evictions++;
+	}
 
 	return icb;
 }
 
 /*
- * This relies on the fact that our cache is always up to date.  If a
- * block is in the cache, the same thing is on disk.  Even if we re-read
- * the disk block, we don't need to update the cache.  This allows us
- * to look for optimal I/O sizes; it's better to call one read 1MB of
- * half-cached blocks than to read every other block.
- *
- * If the caller specifies "nocache", we still want to give them anything
- * we found in the cache, but we want cached blocks moved to the front
- * of the LRU.  That way they get stolen first.
+ * Copy any dirty cached blocks in the range over data just read from
+ * disk.  They are newer than what the disk has.
  */
-static errcode_t io_cache_read_blocks(io_channel *channel, int64_t blkno,
-				      int count, char *data, bool nocache)
+static void io_cache_overlay_dirty(io_channel *channel, int64_t blkno,
+				   int count, char *data)
 {
-	int i, good_blocks;
-	errcode_t ret = 0;
+	int i;
 	struct io_cache *ic = channel->io_cache;
 	struct io_cache_block *icb;
 
-	/*
-	 * Here we check two things:
-	 *
-	 * 1) Are all the blocks cached?  If so, we can skip I/O.
-	 * 2) If they are not all cached, we want to start our read at the
-	 *    first uncached blkno.
-	 */
-	for (good_blocks = 0; good_blocks < count; good_blocks++) {
-		icb = io_cache_lookup(ic, blkno + good_blocks);
-		if (!icb)
-			break;
-	}
+	if (!ic->ic_nr_dirty)
+		return;
 
-	/* Read any blocks not in the cache */
-	if (good_blocks < count) {
-		ret = unix_io_read_block(channel, blkno + good_blocks,
-					 count - good_blocks,
-					 data + (channel->io_blksize *
-						 good_blocks));
-		if (ret)
-			goto out;
+	for (i = 0; i < count; i++) {
+		icb = io_cache_lookup(ic, blkno + i);
+		if (icb && icb->icb_dirty)
+			memcpy(data + (i * channel->io_blksize),
+			       icb->icb_buf, channel->io_blksize);
 	}
+}
+
+/*
+ * Sync up the cache with count blocks just read from disk into data.
+ * Dirty blocks are copied over the data first.  That has to happen
+ * before we steal anything, because stealing can write out and evict a
+ * dirty block.  After that, a block in the cache matches the data
+ * buffer.
+ */
+static void io_cache_fill_blocks(io_channel *channel, int64_t blkno,
+				 int count, char *data, bool nocache)
+{
+	int i;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb;
+
+	io_cache_overlay_dirty(channel, blkno, count, data);
 
-	/* Now we sync up the cache with the data buffer */
 	for (i = 0; i < count; i++, data += channel->io_blksize) {
 		icb = io_cache_lookup(ic, blkno + i);
-		if (i < good_blocks) {
-			/*
-			 * We skipped reading this because it was in the
-			 * cache.  Copy it to the data buffer.
-			 */
-			assert(icb);
-			memcpy(data, icb->icb_buf, channel->io_blksize);
-		} else if (!icb) {
+		if (!icb) {
 			if (nocache)
 				continue;
 
-			/* Steal the LRU buffer */
-			icb = io_cache_pop_lru(ic);
-			icb->icb_blkno = blkno + i;
-			io_cache_insert(ic, icb);
+			/* Steal a buffer */
+			icb = io_cache_steal(channel);
+			if (!icb)
+				continue;
+			io_cache_insert(ic, icb, blkno + i);
 
 			/*
 			 * We did I/O into the data buffer, now update
 			 * the cache.
 			 */
 			memcpy(icb->icb_buf, data, channel->io_blksize);
+			continue;
 		}
+
 		/*
-		 * What about if ((i >= good_blocks) && icb)?  That means
-		 * we had the buffer in the cache, but we read it anyway
-		 * to get a single I/O.  Our cache guarantees that the
-		 * contents will match, so we just skip to marking the
-		 * buffer seen.
+		 * We had the buffer in the cache, but we read it anyway
+		 * to get a single I/O.  Either the cache matched the
+		 * disk or we copied the dirty block over the data, so
+		 * we just skip to marking the buffer seen.
 		 */
-
 		if (nocache)
 			io_cache_unsee(ic, icb);
 		else
 			io_cache_seen(ic, icb);
 	}
-
-out:
-	return ret;
 }
 
-static errcode_t io_cache_read_block(io_channel *channel, int64_t blkno,
-				     int count, char *data, bool nocache)
-
-{
-	int todo = one_meg_of_blocks(channel);
-	errcode_t ret = 0;
-
+/*
+ * This relies on the fact that our cache is always up to date.  If a
+ * block is in the cache, the same thing is on disk or the cache copy is
+ * dirty and newer.  Even if we re-read the disk block, we don't need to
+ * update the cache.  This allows us
+ * to look for optimal I/O sizes; it's better to call one read 1MB of
+ * half-cached blocks than to read every other block.
+ *
+ * If the caller specifies "nocache", we still want to give them anything
+ * we found in the cache, but we want cached blocks moved to ic_cold.
+ * That way they get stolen first.
+ */
+static errcode_t io_cache_read_blocks(io_channel *channel, int64_t blkno,
+				      int count, char *data, bool nocache)
+{
+	int good_blocks;
+	errcode_t ret = 0;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb;
+
+	/*
+	 * Here we check two things:
+	 *
+	 * 1) Are all the blocks cached?  If so, we can skip I/O.
+	 * 2) If they are not all cached, we want to start our read at the
+	 *    first uncached blkno.
+	 *
+	 * The cached blocks are copied to the data buffer as we go.
+	 */
+	for (good_blocks = 0; good_blocks < count; good_blocks++) {
+		icb = io_cache_lookup(ic, blkno + good_blocks);
+		if (!icb)
+			break;
+
+		memcpy(data, icb->icb_buf, channel->io_blksize);
+		data += channel->io_blksize;
+		if (nocache)
+			io_cache_unsee(ic, icb);
+		else
+			io_cache_seen(ic, icb);
+	}
+	ic->ic_stats.ics_hits += good_blocks;
+
+	if (good_blocks == count)
+		goto out;
+
+	/* Read any blocks not in the cache */
+	ic->ic_stats.ics_misses += count - good_blocks;
+	ret = unix_io_read_block(channel, blkno + good_blocks,
+				 count - good_blocks, data);
+	if (ret)
+		goto out;
+
+	/* Now we sync up the cache with the data buffer */
+	io_cache_fill_blocks(channel, blkno + good_blocks,
+			     count - good_blocks, data, nocache);
+
+out:
+	return ret;
+}
+
+/* The first readahead window, in blocks */
+#define IO_CACHE_RA_MIN		8
+
+/*
+ * Called after every cached read of count blocks at blkno.  If this read
+ * continues the last one, skips a little way forward from it, or is the
+ * same stride past it, the pattern counts.  Two matches in a row and we
+ * start reading ahead.  Anything else resets us.
+ *
+ * We only read ahead again when the caller has used half the window.
+ * Blocks already in the cache are skipped at the start of the window.
+ * Errors are ignored; the caller's own read will find them.
+ */
+static void io_cache_readahead(io_channel *channel, int64_t blkno,
+			       int count)
+{
+	struct io_cache *ic = channel->io_cache;
+	int64_t stride = blkno - ic->ic_ra_prev;
+	int64_t start, end, ahead;
+	int todo;
+
+	if (!ic->ic_ra_max || (count <= 0))
+		return;
+
+	if (((blkno >= ic->ic_ra_next) &&
+	     ((blkno - ic->ic_ra_next) <=
+	      ocfs2_max(ic->ic_ra_window, IO_CACHE_RA_MIN))) ||
+	    ((stride > 0) && (stride == ic->ic_ra_stride) &&
+	     (stride <= ic->ic_ra_max)))
+		ic->ic_ra_hits++;
+	else {
+		ic->ic_ra_hits = 0;
+		ic->ic_ra_window = 0;
+		ic->ic_ra_end = 0;
+	}
+	ic->ic_ra_prev = blkno;
+	ic->ic_ra_next = blkno + count;
+	ic->ic_ra_stride = stride;
+
+	if (ic->ic_ra_hits < 2)
+		return;
+
+	start = blkno + count;
+	if (ic->ic_ra_end > start)
+		start = ic->ic_ra_end;
+	ahead = start - (blkno + count);
+	if (ic->ic_ra_window && (ahead > (ic->ic_ra_window / 2)))
+		return;
+
+	if (!ic->ic_ra_window)
+		ic->ic_ra_window = ocfs2_max(IO_CACHE_RA_MIN, count);
+	else
+		ic->ic_ra_window <<= 1;
+	if (ic->ic_ra_window > ic->ic_ra_max)
+		ic->ic_ra_window = ic->ic_ra_max;
+
+	end = blkno + count + ic->ic_ra_window;
+	while ((start < end) && io_cache_lookup(ic, start))
+		start++;
+	if (start >= end) {
+		ic->ic_ra_end = end;
+		return;
+	}
+
+	todo = end - start;
+	if (unix_io_read_block(channel, start, todo, ic->ic_ra_buffer)) {
+		/* Probably the end of the device.  Stop guessing. */
+		ic->ic_ra_hits = 0;
+		ic->ic_ra_window = 0;
+		ic->ic_ra_end = 0;
+		return;
+	}
+
+	ic->ic_stats.ics_readahead += todo;
+	io_cache_fill_blocks(channel, start, todo, ic->ic_ra_buffer, false);
+	ic->ic_ra_end = end;
+}
+
+static errcode_t io_cache_read_block(io_channel *channel, int64_t blkno,
+				     int count, char *data, bool nocache)
+
+{
+	int todo = one_meg_of_blocks(channel);
+	errcode_t ret = 0;
+
 	/*
 	 * We do this in one meg hunks so that each hunk has an
 	 * opportunity to be in cache, but we get a good throughput.
@@ -383,6 +1058,9 @@ static errcode_t io_cache_read_block(io_channel *channel, int64_t blkno,
 		if (ret)
 			break;
 
+		if (!nocache)
+			io_cache_readahead(channel, blkno, todo);
+
 		blkno += todo;
 		count -= todo;
 		data += (channel->io_blksize * todo);
@@ -392,45 +1070,48 @@ static errcode_t io_cache_read_block(io_channel *channel, int64_t blkno,
 }
 
 /*
- * This relies on the fact that our cache is always up to date.  If a
- * block is in the cache, the same thing is on disk.  So here we'll write
- * a whole stream and update the cache as needed.
+ * Copy count blocks that were just written to disk into the cache.
+ *
+ * In the nocache case, we want to skip blocks that weren't in the
+ * cache, but we want to update blocks that where.  Even though
+ * the caller specified "don't cache this", it's already in the
+ * cache.  We don't want stale data.
+ *
+ * Any dirty copies in the range are older than what we just wrote.
+ * They're marked clean before we steal anything, so that a flush
+ * can't write them over the new data.
  */
-static errcode_t io_cache_write_blocks(io_channel *channel, int64_t blkno,
-				       int count, const char *data,
-				       bool nocache)
+static void io_cache_sync_blocks(io_channel *channel, int64_t blkno,
+				 int count, const char *data, bool nocache)
 {
-	int i, completed = 0;
-	errcode_t ret;
+	int i;
 	struct io_cache *ic = channel->io_cache;
 	struct io_cache_block *icb;
 
-	/* Get the write out of the way */
-	ret = unix_io_write_block_full(channel, blkno, count, data,
-				       &completed);
+	if (ic->ic_nr_dirty) {
+		for (i = 0; i < count; i++) {
+			icb = io_cache_lookup(ic, blkno + i);
+			if (icb)
+				io_cache_mark_clean(ic, icb);
+		}
+	}
 
-	/*
-	 * Now we sync up the cache with the data buffer.  We have
-	 * to sync up I/O that completed, even if the entire I/O did not.
-	 *
-	 * In the nocache case, we want to skip blocks that weren't in the
-	 * cache, but we want to update blocks that where.  Even though
-	 * the caller specified "don't cache this", it's already in the
-	 * cache.  We don't want stale data.
-	 */
-	for (i = 0; i < completed; i++, data += channel->io_blksize) {
+	for (i = 0; i < count; i++, data += channel->io_blksize) {
 		icb = io_cache_lookup(ic, blkno + i);
 		if (!icb) {
 			if (nocache)
 				continue;
 
 			/*
-			 * Steal the LRU buffer.  We can't error here, so
+			 * Steal a buffer.  We can't error here, so
 			 * we can safely insert it before we copy the data.
 			 */
-			icb = io_cache_pop_lru(ic);
-			icb->icb_blkno = blkno + i;
-			io_cache_insert(ic, icb);
+			icb = io_cache_steal(channel);
+			if (!icb)
+				continue;
+			io_cache_insert(ic, icb, blkno + i);
+			memcpy(icb->icb_buf, data, channel->io_blksize);
+			continue;
 		}
 
 		memcpy(icb->icb_buf, data, channel->io_blksize);
@@ -439,6 +1120,72 @@ static errcode_t io_cache_write_blocks(io_channel *channel, int64_t blkno,
 		else
 			io_cache_seen(ic, icb);
 	}
+}
+
+/*
+ * Write-back mode.  The blocks only go into the cache, marked dirty.
+ * If we can't get a cache buffer for a block, that block is written
+ * through.
+ */
+static errcode_t io_cache_buffer_blocks(io_channel *channel, int64_t blkno,
+					int count, const char *data)
+{
+	int i;
+	errcode_t ret;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb;
+
+	for (i = 0; i < count; i++, data += channel->io_blksize) {
+		icb = io_cache_lookup(ic, blkno + i);
+		if (!icb) {
+			icb = io_cache_steal(channel);
+			if (!icb) {
+				ret = unix_io_write_block(channel, blkno + i,
+							  1, data);
+				if (ret)
+					return ret;
+				continue;
+			}
+			io_cache_insert(ic, icb, blkno + i);
+		}
+
+		memcpy(icb->icb_buf, data, channel->io_blksize);
+		io_cache_mark_dirty(ic, icb);
+		io_cache_seen(ic, icb);
+	}
+
+	return 0;
+}
+
+/*
+ * This relies on the fact that our cache is always up to date.  If a
+ * block is in the cache, the same thing is on disk.  So here we'll write
+ * a whole stream and update the cache as needed.
+ *
+ * In write-back mode, small writes are held in the cache until
+ * io_flush().  Writes of a megabyte or more are already efficient, so
+ * they still go straight to disk.
+ */
+static errcode_t io_cache_write_blocks(io_channel *channel, int64_t blkno,
+				       int count, const char *data,
+				       bool nocache)
+{
+	int completed = 0;
+	errcode_t ret;
+
+	if (channel->io_cache->ic_writeback && !nocache &&
+	    (count > 0) && (count < one_meg_of_blocks(channel)))
+		return io_cache_buffer_blocks(channel, blkno, count, data);
+
+	/* Get the write out of the way */
+	ret = unix_io_write_block_full(channel, blkno, count, data,
+				       &completed);
+
+	/*
+	 * Now we sync up the cache with the data buffer.  We have
+	 * to sync up I/O that completed, even if the entire I/O did not.
+	 */
+	io_cache_sync_blocks(channel, blkno, completed, data, nocache);
 
 	return ret;
 }
@@ -464,7 +1211,11 @@ static void io_free_cache(struct io_cache *ic)
 			if (ic->ic_locked)
 				munlock(ic->ic_data_buffer,
 					ic->ic_data_buffer_len);
-			ocfs2_free(&ic->ic_data_buffer);
+			if (ic->ic_data_map_len)
+				munmap(ic->ic_data_buffer,
+				       ic->ic_data_map_len);
+			else
+				ocfs2_free(&ic->ic_data_buffer);
 		}
 		if (ic->ic_metadata_buffer) {
 			if (ic->ic_locked)
@@ -472,114 +1223,1066 @@ static void io_free_cache(struct io_cache *ic)
 					ic->ic_metadata_buffer_len);
 			ocfs2_free(&ic->ic_metadata_buffer);
 		}
+		if (ic->ic_ghost_buffer)
+			ocfs2_free(&ic->ic_ghost_buffer);
+		if (ic->ic_flush_list)
+			ocfs2_free(&ic->ic_flush_list);
+		if (ic->ic_ra_buffer)
+			ocfs2_free(&ic->ic_ra_buffer);
+		if (ic->ic_hash)
+			ocfs2_free(&ic->ic_hash);
+		if (ic->ic_ghost_hash)
+			ocfs2_free(&ic->ic_ghost_hash);
 		ocfs2_free(&ic);
 	}
 }
 
-void io_destroy_cache(io_channel *channel)
+void io_destroy_cache(io_channel *channel)
+{
+	if (channel->io_cache) {
+		/*
+		 * Last chance for dirty blocks.  Callers that care about
+		 * the error call io_flush() first.
+		 */
+		io_cache_flush(channel);
+		io_free_cache(channel->io_cache);
+		channel->io_cache = NULL;
+	}
+}
+
+/*
+ * A cache is kind of pointless if it is swappable, right?  Let's give
+ * applications the ability to pin the cache memory.  This is a separate
+ * call from io_init_cache() because non-privileged users can't do it, and
+ * they still want to create small caches.
+ */
+errcode_t io_mlock_cache(io_channel *channel)
+{
+	int rc;
+	struct io_cache *ic = channel->io_cache;
+	long pages_wanted, avpages;
+	struct timeval start, end;
+
+	if (!ic)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	if (ic->ic_locked)
+		return 0;
+
+	/*
+	 * We're going to lock our cache pages.  We don't want to
+	 * request more memory than the system has, though.  Huge
+	 * pages come out of their own pool, which mmap() already
+	 * checked.
+	 */
+	pages_wanted = channel->io_blksize * ic->ic_nr_blocks / getpagesize();
+	avpages = sysconf(_SC_AVPHYS_PAGES);
+	if (!ic->ic_hugetlb && (pages_wanted > avpages))
+		return OCFS2_ET_NO_MEMORY;
+
+	/* mlock() faults in every page, which is where startup goes */
+	gettimeofday(&start, NULL);
+	rc = mlock(ic->ic_data_buffer, ic->ic_data_buffer_len);
+	if (!rc) {
+		rc = mlock(ic->ic_metadata_buffer, ic->ic_metadata_buffer_len);
+		if (rc)
+			munlock(ic->ic_data_buffer, ic->ic_data_buffer_len);
+	}
+	gettimeofday(&end, NULL);
+
+	if (rc)
+		return OCFS2_ET_NO_MEMORY;
+
+	ic->ic_fault_usecs = ((end.tv_sec - start.tv_sec) * 1000000ULL) +
+		end.tv_usec - start.tv_usec;
+	ic->ic_locked = 1;
+	return 0;
+}
+
+#define IO_CACHE_HUGE_SIZE	(2 * ONE_MEGABYTE)
+
+/*
+ * Spread the pages of [buf, buf + len) over every online NUMA node.
+ * Returns 0 if the policy was set.  One node means there's nothing to
+ * do, and that isn't success.
+ */
+static int io_cache_interleave(void *buf, unsigned long len)
+{
+#if defined(__linux__) && defined(__NR_mbind)
+	unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+	unsigned long first, last, bits = 8 * sizeof(unsigned long);
+	int nodes = 0, rc = -1;
+	char line[256], *p;
+	FILE *f;
+
+	f = fopen("/sys/devices/system/node/online", "r");
+	if (!f)
+		return -1;
+	p = fgets(line, sizeof(line), f);
+	fclose(f);
+	if (!p)
+		return -1;
+
+	/* The format is a list of ranges, like "0-3,5" */
+	memset(mask, 0, sizeof(mask));
+	while (*p && (*p != '\n')) {
+		first = last = strtoul(p, &p, 10);
+		if (*p == '-')
+			last = strtoul(p + 1, &p, 10);
+		for (; (first <= last) && (first < (8 * sizeof(mask)));
+		     first++, nodes++)
+			mask[first / bits] |= 1UL << (first % bits);
+		if (*p != ',')
+			break;
+		p++;
+	}
+
+	if (nodes > 1)
+		rc = syscall(__NR_mbind, buf, len, MPOL_INTERLEAVE, mask,
+			     8 * sizeof(mask) + 1, 0);
+
+	return rc;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * Allocate ic_data_buffer.  Without flags this is plain
+ * ocfs2_malloc_blocks().  Otherwise we mmap() it so we can choose how
+ * it is backed.  IO_CACHE_HUGEPAGES tries hugetlbfs pages first, then
+ * asks for transparent huge pages on a 2MB aligned mapping.
+ * IO_CACHE_INTERLEAVE sets the NUMA policy before any page is touched.
+ * Both are hints; ic_flags records what we actually got.
+ */
+static errcode_t io_cache_alloc_data(io_channel *channel,
+				     struct io_cache *ic, int flags)
+{
+	unsigned long len = ic->ic_data_buffer_len;
+	unsigned long maplen, head;
+	char *buf = MAP_FAILED;
+
+	if (!(flags & (IO_CACHE_HUGEPAGES | IO_CACHE_INTERLEAVE)))
+		return ocfs2_malloc_blocks(channel, ic->ic_nr_blocks,
+					   &ic->ic_data_buffer);
+
+	maplen = (len + IO_CACHE_HUGE_SIZE - 1) & ~(IO_CACHE_HUGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+	if (flags & IO_CACHE_HUGEPAGES) {
+		buf = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (buf != MAP_FAILED) {
+			ic->ic_hugetlb = 1;
+			ic->ic_flags |= IO_CACHE_HUGEPAGES;
+		}
+	}
+#endif
+
+	if (buf == MAP_FAILED) {
+		/* Map an extra huge page so we can trim to alignment */
+		buf = mmap(NULL, maplen + IO_CACHE_HUGE_SIZE,
+			   PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			return OCFS2_ET_NO_MEMORY;
+
+		head = IO_CACHE_HUGE_SIZE -
+			((uintptr_t)buf & (IO_CACHE_HUGE_SIZE - 1));
+		if (head == IO_CACHE_HUGE_SIZE)
+			head = 0;
+		if (head)
+			munmap(buf, head);
+		munmap(buf + head + maplen, IO_CACHE_HUGE_SIZE - head);
+		buf += head;
+
+#ifdef MADV_HUGEPAGE
+		if ((flags & IO_CACHE_HUGEPAGES) &&
+		    !madvise(buf, maplen, MADV_HUGEPAGE))
+			ic->ic_flags |= IO_CACHE_HUGEPAGES;
+#endif
+	}
+
+	if ((flags & IO_CACHE_INTERLEAVE) &&
+	    !io_cache_interleave(buf, maplen))
+		ic->ic_flags |= IO_CACHE_INTERLEAVE;
+
+	ic->ic_data_buffer = buf;
+	ic->ic_data_map_len = maplen;
+	return 0;
+}
+
+errcode_t io_init_cache(io_channel *channel, size_t nr_blocks)
+{
+	return io_init_cache_flags(channel, nr_blocks, 0);
+}
+
+errcode_t io_init_cache_flags(io_channel *channel, size_t nr_blocks,
+			      int flags)
+{
+	int i;
+	struct io_cache *ic;
+	char *dbuf;
+	struct io_cache_block *icb_list;
+	size_t nr_ghosts = nr_blocks / 2;
+	errcode_t ret;
+
+	ret = ocfs2_malloc0(sizeof(struct io_cache), &ic);
+	if (ret)
+		goto out;
+
+	ic->ic_nr_blocks = nr_blocks;
+	ic->ic_a1in_target = nr_blocks / 4;
+	INIT_LIST_HEAD(&ic->ic_cold);
+	INIT_LIST_HEAD(&ic->ic_a1in);
+	INIT_LIST_HEAD(&ic->ic_am);
+	INIT_LIST_HEAD(&ic->ic_a1out);
+	INIT_LIST_HEAD(&ic->ic_dirty);
+
+	/* One bucket per block keeps the chains short */
+	ic->ic_hash_bits = 1;
+	while (((size_t)1 << ic->ic_hash_bits) < nr_blocks)
+		ic->ic_hash_bits++;
+
+	ret = ocfs2_malloc0(sizeof(struct io_cache_block *) <<
+			    ic->ic_hash_bits, &ic->ic_hash);
+	if (ret)
+		goto out;
+
+	ret = ocfs2_malloc0(sizeof(struct io_cache_ghost *) <<
+			    ic->ic_hash_bits, &ic->ic_ghost_hash);
+	if (ret)
+		goto out;
+
+	if (nr_ghosts) {
+		ret = ocfs2_malloc0(sizeof(struct io_cache_ghost) * nr_ghosts,
+				    &ic->ic_ghost_buffer);
+		if (ret)
+			goto out;
+	}
+	for (i = 0; i < nr_ghosts; i++) {
+		ic->ic_ghost_buffer[i].icg_blkno = UINT64_MAX;
+		list_add_tail(&ic->ic_ghost_buffer[i].icg_list,
+			      &ic->ic_a1out);
+	}
+
+	ic->ic_data_buffer_len = (unsigned long)nr_blocks * channel->io_blksize;
+	ret = io_cache_alloc_data(channel, ic, flags);
+	if (ret)
+		goto out;
+
+	ret = ocfs2_malloc0(sizeof(struct io_cache_block) * nr_blocks,
+			    &ic->ic_metadata_buffer);
+	if (ret)
+		goto out;
+	ic->ic_metadata_buffer_len =
+		(unsigned long)nr_blocks * sizeof(struct io_cache_block);
+
+	icb_list = ic->ic_metadata_buffer;
+	dbuf = ic->ic_data_buffer;
+	for (i = 0; i < nr_blocks; i++) {
+		icb_list[i].icb_blkno = UINT64_MAX;
+		icb_list[i].icb_buf = dbuf;
+		icb_list[i].icb_queue = IO_CACHE_COLD;
+		dbuf += channel->io_blksize;
+		list_add_tail(&icb_list[i].icb_list, &ic->ic_cold);
+	}
+
+	channel->io_cache = ic;
+
+	/* Readahead is an optimization; a cache without it still works */
+	io_set_readahead(channel, one_meg_of_blocks(channel));
+
+out:
+	if (ret)
+		io_free_cache(ic);
+
+	return ret;
+}
+
+errcode_t io_init_cache_size(io_channel *channel, size_t bytes)
+{
+	size_t blocks;
+
+	blocks = (bytes + (channel->io_blksize - 1)) / channel->io_blksize;
+
+	return io_init_cache(channel, blocks);
+}
+
+/*
+ * Readahead goes into ic_a1in, so a window bigger than that would push
+ * itself out before it was used.
+ */
+errcode_t io_set_readahead(io_channel *channel, int max_blocks)
+{
+	errcode_t ret;
+	struct io_cache *ic = channel->io_cache;
+
+	if (!ic || (max_blocks < 0))
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	if (max_blocks > ic->ic_a1in_target)
+		max_blocks = ic->ic_a1in_target;
+	if (max_blocks < IO_CACHE_RA_MIN)
+		max_blocks = 0;
+
+	if (ic->ic_ra_buffer)
+		ocfs2_free(&ic->ic_ra_buffer);
+	ic->ic_ra_max = 0;
+	ic->ic_ra_hits = 0;
+	ic->ic_ra_window = 0;
+	ic->ic_ra_end = 0;
+
+	if (!max_blocks)
+		return 0;
+
+	ret = ocfs2_malloc_blocks(channel, max_blocks, &ic->ic_ra_buffer);
+	if (ret)
+		return ret;
+
+	ic->ic_ra_max = max_blocks;
+	return 0;
+}
+
+/*
+ * Turn write-back caching on or off.  Turning it off flushes the cache
+ * first; if that fails, the cache stays in write-back mode.
+ */
+errcode_t io_set_writeback(io_channel *channel, bool writeback)
+{
+	errcode_t ret;
+	struct io_cache *ic = channel->io_cache;
+
+	if (!ic)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	if (!writeback) {
+		ret = io_cache_flush(channel);
+		if (ret)
+			return ret;
+		ic->ic_writeback = 0;
+		return 0;
+	}
+
+	if (!ic->ic_flush_list) {
+		ret = ocfs2_malloc(sizeof(struct io_cache_block *) *
+				   ic->ic_nr_blocks, &ic->ic_flush_list);
+		if (ret)
+			return ret;
+	}
+
+	ic->ic_writeback = 1;
+	return 0;
+}
+
+/*
+ * Write out everything the cache is holding back.  This is an ordering
+ * point: every write issued before io_flush() is on disk before any
+ * write issued after it.
+ */
+errcode_t io_flush(io_channel *channel)
+{
+	if (!channel->io_cache)
+		return 0;
+
+	return io_cache_flush(channel);
+}
+
+errcode_t io_get_cache_stats(io_channel *channel,
+			     struct io_cache_stats *stats)
+{
+	if (!channel->io_cache)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	*stats = channel->io_cache->ic_stats;
+	stats->ics_flags = channel->io_cache->ic_flags;
+	stats->ics_fault_usecs = channel->io_cache->ic_fault_usecs;
+	return 0;
+}
+
+
+/*
+ * I/O statistics.
+ */
+#define IO_STATS_ENV_TRACE_ENTRIES	(256 * 1024)
+
+errcode_t io_enable_stats(io_channel *channel, int trace_entries)
+{
+	errcode_t ret;
+	struct io_stats_ctx *isc;
+
+	if (trace_entries < 0)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	io_disable_stats(channel);
+
+	ret = ocfs2_malloc0(sizeof(struct io_stats_ctx), &isc);
+	if (ret)
+		return ret;
+
+	if (trace_entries) {
+		ret = ocfs2_malloc0(sizeof(struct io_trace_rec) *
+				    trace_entries, &isc->isc_trace);
+		if (ret) {
+			ocfs2_free(&isc);
+			return ret;
+		}
+		isc->isc_trace_size = trace_entries;
+	}
+
+	isc->isc_epoch = io_stats_now();
+	channel->io_stats = isc;
+	return 0;
+}
+
+void io_disable_stats(io_channel *channel)
+{
+	struct io_stats_ctx *isc = channel->io_stats;
+
+	if (!isc)
+		return;
+
+	if (isc->isc_trace)
+		ocfs2_free(&isc->isc_trace);
+	if (isc->isc_trace_file)
+		ocfs2_free(&isc->isc_trace_file);
+	ocfs2_free(&channel->io_stats);
+}
+
+errcode_t io_get_stats(io_channel *channel, struct io_stats *stats)
+{
+	if (!channel->io_stats)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	*stats = channel->io_stats->isc_stats;
+	return 0;
+}
+
+/*
+ * Copy up to nr of the most recent trace records into recs, oldest
+ * first.  Returns the number copied.
+ */
+int io_get_trace(io_channel *channel, struct io_trace_rec *recs, int nr)
+{
+	struct io_stats_ctx *isc = channel->io_stats;
+	uint64_t i, avail;
+
+	if (!isc || !isc->isc_trace_size || (nr <= 0))
+		return 0;
+
+	avail = isc->isc_trace_total;
+	if (avail > isc->isc_trace_size)
+		avail = isc->isc_trace_size;
+	if (avail > nr)
+		avail = nr;
+
+	for (i = 0; i < avail; i++)
+		recs[i] = isc->isc_trace[(isc->isc_trace_total - avail + i) %
+					 isc->isc_trace_size];
+
+	return avail;
+}
+
+static void io_stats_units(uint64_t ns, char *buf, size_t len)
+{
+	if (ns < 1000ULL)
+		snprintf(buf, len, "%"PRIu64"ns", ns);
+	else if (ns < 1000000ULL)
+		snprintf(buf, len, "%"PRIu64"us", ns / 1000);
+	else if (ns < 1000000000ULL)
+		snprintf(buf, len, "%"PRIu64"ms", ns / 1000000);
+	else
+		snprintf(buf, len, "%"PRIu64"s", ns / 1000000000);
+}
+
+/*
+ * Print the counters, then one histogram line for each op and request
+ * size we saw.  Latency bucket "<N" holds requests that took at least
+ * half of N.
+ */
+errcode_t io_print_stats(io_channel *channel, FILE *out)
+{
+	static const char *op_names[IO_STATS_NR_OPS] = { "read", "write" };
+	struct io_stats_ctx *isc = channel->io_stats;
+	struct io_op_stats *ios;
+	uint64_t lo, total;
+	char unit[16];
+	int op, s, l;
+
+	if (!isc)
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	fprintf(out, "I/O statistics for \"%s\":\n", channel->io_name);
+	fprintf(out, "%-6s %12s %16s %12s %8s\n", "op", "requests", "bytes",
+		"avg usecs", "errors");
+	for (op = 0; op < IO_STATS_NR_OPS; op++) {
+		ios = &isc->isc_stats.is_ops[op];
+		fprintf(out,
+			"%-6s %12"PRIu64" %16"PRIu64" %12"PRIu64" %8"PRIu64"\n",
+			op_names[op], ios->ios_requests, ios->ios_bytes,
+			ios->ios_requests ?
+			ios->ios_ns / ios->ios_requests / 1000 : 0,
+			ios->ios_errors);
+	}
+
+	for (op = 0; op < IO_STATS_NR_OPS; op++) {
+		ios = &isc->isc_stats.is_ops[op];
+		for (s = 0; s < IO_STATS_SIZE_BUCKETS; s++) {
+			for (l = 0, total = 0; l < IO_STATS_LAT_BUCKETS; l++)
+				total += ios->ios_hist[s][l];
+			if (!total)
+				continue;
+
+			lo = 1ULL << s;
+			if (s == (IO_STATS_SIZE_BUCKETS - 1))
+				fprintf(out, "%s %"PRIu64"+ blocks:",
+					op_names[op], lo);
+			else if (!s)
+				fprintf(out, "%s 1 block:", op_names[op]);
+			else
+				fprintf(out, "%s %"PRIu64"-%"PRIu64" blocks:",
+					op_names[op], lo, (lo << 1) - 1);
+
+			for (l = 0; l < IO_STATS_LAT_BUCKETS; l++) {
+				if (!ios->ios_hist[s][l])
+					continue;
+				io_stats_units(1ULL << (l + 1), unit,
+					       sizeof(unit));
+				fprintf(out, " %s%s:%"PRIu64,
+					(l == (IO_STATS_LAT_BUCKETS - 1)) ?
+					">=" : "<", unit, ios->ios_hist[s][l]);
+			}
+			fprintf(out, "\n");
+		}
+	}
+
+	return 0;
+}
+
+static void io_stats_write_trace(io_channel *channel)
+{
+	struct io_stats_ctx *isc = channel->io_stats;
+	struct io_trace_hdr hdr;
+	struct io_trace_rec *recs;
+	FILE *f;
+	int nr;
+
+	nr = isc->isc_trace_total < isc->isc_trace_size ?
+		isc->isc_trace_total : isc->isc_trace_size;
+	if (ocfs2_malloc(sizeof(struct io_trace_rec) * (nr ? nr : 1),
+			 &recs))
+		return;
+	nr = io_get_trace(channel, recs, nr);
+
+	f = fopen(isc->isc_trace_file, "a");
+	if (f) {
+		memcpy(hdr.ith_magic, IO_TRACE_MAGIC, sizeof(hdr.ith_magic));
+		hdr.ith_blksize = channel->io_blksize;
+		hdr.ith_nr_recs = nr;
+		fwrite(&hdr, sizeof(hdr), 1, f);
+		fwrite(recs, sizeof(struct io_trace_rec), nr, f);
+		fclose(f);
+	}
+
+	ocfs2_free(&recs);
+}
+
+/* A helper channel's requests count as its parent's */
+static void io_stats_merge(io_channel *parent, io_channel *child)
+{
+	struct io_op_stats *to, *from;
+	int op, s, l;
+
+	if (!parent->io_stats || !child->io_stats)
+		return;
+
+	for (op = 0; op < IO_STATS_NR_OPS; op++) {
+		to = &parent->io_stats->isc_stats.is_ops[op];
+		from = &child->io_stats->isc_stats.is_ops[op];
+		to->ios_requests += from->ios_requests;
+		to->ios_bytes += from->ios_bytes;
+		to->ios_ns += from->ios_ns;
+		to->ios_errors += from->ios_errors;
+		for (s = 0; s < IO_STATS_SIZE_BUCKETS; s++)
+			for (l = 0; l < IO_STATS_LAT_BUCKETS; l++)
+				to->ios_hist[s][l] += from->ios_hist[s][l];
+	}
+}
+
+/*
+ * Statistics are a debugging aid.  If we can't set them up from the
+ * environment, we carry on without them.
+ */
+static void io_stats_init_env(io_channel *channel)
+{
+	char *trace_file = getenv("OCFS2_IO_TRACE");
+	char *print = getenv("OCFS2_IO_STATS");
+
+	if (trace_file && !*trace_file)
+		trace_file = NULL;
+	if (print && !*print)
+		print = NULL;
+	if (!trace_file && !print)
+		return;
+
+	if (io_enable_stats(channel,
+			    trace_file ? IO_STATS_ENV_TRACE_ENTRIES : 0))
+		return;
+
+	channel->io_stats->isc_print = !!print;
+	if (trace_file &&
+	    ocfs2_malloc(strlen(trace_file) + 1,
+			 &channel->io_stats->isc_trace_file))
+		io_disable_stats(channel);
+	else if (trace_file)
+		strcpy(channel->io_stats->isc_trace_file, trace_file);
+}
+
+
+/*
+ * Asynchronous I/O.
+ *
+ * Scanners that know which blocks they want next can queue many reads
+ * at once and keep the device busy while they process earlier results.
+ * The kernel AIO interface is called directly via syscall(2) so that we
+ * don't pick up a library dependency.
+ */
+#ifdef __linux__
+static inline int sys_io_setup(unsigned nr_events, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr_events, ctxp);
+}
+
+static inline int sys_io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int sys_io_submit(aio_context_t ctx, long nr,
+				struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int sys_io_getevents(aio_context_t ctx, long min_nr,
+				   long nr, struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+#endif
+
+static void io_async_finish(io_channel *channel, struct io_async_req *req)
+{
+	struct io_async_ctx *iac = channel->io_async;
+
+	if (!req->ar_ret && channel->io_cache && !channel->io_map) {
+		if (req->ar_op == IO_ASYNC_READ)
+			io_cache_fill_blocks(channel, req->ar_blkno,
+					     req->ar_count, req->ar_buf,
+					     channel->io_nocache);
+		else
+			io_cache_sync_blocks(channel, req->ar_blkno,
+					     req->ar_count, req->ar_buf,
+					     channel->io_nocache);
+	}
+
+	list_add_tail(&req->ar_list, &iac->iac_done);
+	iac->iac_nr_done++;
+}
+
+/* Do the request the old fashioned way */
+static void io_async_sync_req(io_channel *channel, struct io_async_req *req)
+{
+	if (req->ar_op == IO_ASYNC_READ)
+		req->ar_ret = unix_io_read_block(channel, req->ar_blkno,
+						 req->ar_count, req->ar_buf);
+	else
+		req->ar_ret = unix_io_write_block(channel, req->ar_blkno,
+						  req->ar_count, req->ar_buf);
+	io_async_finish(channel, req);
+}
+
+#ifdef __linux__
+static void io_async_complete_event(io_channel *channel,
+				    struct io_event *ev)
+{
+	struct io_async_ctx *iac = channel->io_async;
+	struct io_async_req *req = (struct io_async_req *)(uintptr_t)ev->data;
+	struct iocb *iocb = (struct iocb *)(uintptr_t)ev->obj;
+	int64_t size = (int64_t)req->ar_count * channel->io_blksize;
+	int64_t done = ev->res;
+	int bdone, slot = iocb - iac->iac_iocbs;
+
+	iac->iac_free[iac->iac_nr_free++] = slot;
+	iac->iac_inflight--;
+
+	if (channel->io_stats)
+		io_stats_record(channel,
+				(req->ar_op == IO_ASYNC_READ) ?
+				IO_STATS_READ : IO_STATS_WRITE,
+				req->ar_blkno, size, iac->iac_submit_ns[slot],
+				(done < 0) ? OCFS2_ET_IO : 0);
+
+	if (done < 0) {
+		channel->io_error = -done;
+		req->ar_ret = OCFS2_ET_IO;
+		io_async_finish(channel, req);
+		return;
+	}
+
+	if (done == size) {
+		req->ar_ret = 0;
+		io_async_finish(channel, req);
+		return;
+	}
+
+	/*
+	 * A short transfer.  Finish the rest synchronously, which
+	 * gives us the same short read/write semantics as the
+	 * synchronous path.  The rest has to start on a block
+	 * boundary for O_DIRECT, so we redo any partial block.
+	 */
+	bdone = done / channel->io_blksize;
+	if (req->ar_op == IO_ASYNC_READ)
+		req->ar_ret = unix_io_read_block(channel,
+						 req->ar_blkno + bdone,
+						 req->ar_count - bdone,
+						 req->ar_buf +
+						 (bdone * channel->io_blksize));
+	else
+		req->ar_ret = unix_io_write_block(channel,
+						  req->ar_blkno + bdone,
+						  req->ar_count - bdone,
+						  req->ar_buf +
+						  (bdone * channel->io_blksize));
+	io_async_finish(channel, req);
+}
+#endif
+
+/*
+ * Hand as many pending requests to the kernel as we have iocbs for.
+ * If the kernel refuses a request outright, we do it synchronously so
+ * that the caller always gets a completion.  EAGAIN means the kernel
+ * is out of resources; that can wait for something in flight to
+ * complete, but if nothing is in flight, waiting won't help.
+ */
+errcode_t io_async_submit(io_channel *channel)
+{
+	struct io_async_ctx *iac = channel->io_async;
+#ifdef __linux__
+	struct io_async_req *req;
+	struct iocb *iocbp[IO_ASYNC_MAX_DEPTH];
+	struct iocb *iocb;
+	struct list_head *pos;
+	int i, nr, slot, rc;
+
+	if (!iac)
+		return 0;
+
+	while (iac->iac_nr_pending && iac->iac_nr_free) {
+		nr = 0;
+		list_for_each(pos, &iac->iac_pending) {
+			if (nr == iac->iac_nr_free)
+				break;
+			req = list_entry(pos, struct io_async_req, ar_list);
+			slot = iac->iac_free[iac->iac_nr_free - nr - 1];
+			iocb = &iac->iac_iocbs[slot];
+			memset(iocb, 0, sizeof(struct iocb));
+			iocb->aio_data = (uintptr_t)req;
+			iocb->aio_lio_opcode = (req->ar_op == IO_ASYNC_READ) ?
+				IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+			iocb->aio_fildes = channel->io_fd;
+			iocb->aio_buf = (uintptr_t)req->ar_buf;
+			iocb->aio_nbytes =
+				(uint64_t)req->ar_count * channel->io_blksize;
+			iocb->aio_offset =
+				(int64_t)req->ar_blkno * channel->io_blksize;
+			if (channel->io_stats)
+				iac->iac_submit_ns[slot] = io_stats_now();
+			iocbp[nr++] = iocb;
+		}
+
+		rc = sys_io_submit(iac->iac_ctx, nr, iocbp);
+		if ((rc < 0) && (errno == EAGAIN) && iac->iac_inflight)
+			break;
+
+		if (rc <= 0) {
+			/* Complete the first one by hand and try again */
+			req = list_entry(iac->iac_pending.next,
+					 struct io_async_req, ar_list);
+			list_del(&req->ar_list);
+			iac->iac_nr_pending--;
+			io_async_sync_req(channel, req);
+			continue;
+		}
+
+		for (i = 0; i < rc; i++) {
+			req = list_entry(iac->iac_pending.next,
+					 struct io_async_req, ar_list);
+			list_del(&req->ar_list);
+			iac->iac_nr_pending--;
+		}
+		iac->iac_nr_free -= rc;
+		iac->iac_inflight += rc;
+	}
+#endif
+
+	return 0;
+}
+
+static errcode_t io_async_queue(io_channel *channel,
+				struct io_async_req *req, int op)
+{
+	int i;
+	struct io_async_ctx *iac = channel->io_async;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb;
+
+	if (!iac || (req->ar_count <= 0))
+		return OCFS2_ET_INVALID_ARGUMENT;
+
+	req->ar_op = op;
+	req->ar_ret = 0;
+
+	/* A mapped channel is already as fast as it gets */
+	if (channel->io_map) {
+		io_async_sync_req(channel, req);
+		return 0;
+	}
+
+	/* Fully cached reads don't need to go anywhere */
+	if ((op == IO_ASYNC_READ) && ic) {
+		for (i = 0; i < req->ar_count; i++) {
+			if (!io_cache_lookup(ic, req->ar_blkno + i))
+				break;
+		}
+		if (i == req->ar_count) {
+			req->ar_ret = io_cache_read_blocks(channel,
+							   req->ar_blkno,
+							   req->ar_count,
+							   req->ar_buf,
+							   channel->io_nocache);
+			list_add_tail(&req->ar_list, &iac->iac_done);
+			iac->iac_nr_done++;
+			return 0;
+		}
+
+		/*
+		 * The kernel reads from disk, so dirty blocks in the
+		 * range have to get there first.
+		 */
+		for (i = 0; ic->ic_nr_dirty && (i < req->ar_count); i++) {
+			icb = io_cache_lookup(ic, req->ar_blkno + i);
+			if (icb && icb->icb_dirty) {
+				req->ar_ret = io_cache_flush(channel);
+				if (req->ar_ret) {
+					list_add_tail(&req->ar_list,
+						      &iac->iac_done);
+					iac->iac_nr_done++;
+					return 0;
+				}
+				break;
+			}
+		}
+	}
+
+	/* Write-back writes just go into the cache */
+	if ((op == IO_ASYNC_WRITE) && ic && ic->ic_writeback &&
+	    !channel->io_nocache) {
+		req->ar_ret = io_cache_write_blocks(channel, req->ar_blkno,
+						    req->ar_count,
+						    req->ar_buf, false);
+		list_add_tail(&req->ar_list, &iac->iac_done);
+		iac->iac_nr_done++;
+		return 0;
+	}
+
+	/*
+	 * Dirty copies of the blocks we're about to write are stale.
+	 * A flush must not write them after the kernel writes ours.
+	 */
+	if ((op == IO_ASYNC_WRITE) && ic && ic->ic_nr_dirty) {
+		for (i = 0; i < req->ar_count; i++) {
+			icb = io_cache_lookup(ic, req->ar_blkno + i);
+			if (icb)
+				io_cache_mark_clean(ic, icb);
+		}
+	}
+
+#ifdef __linux__
+	if (iac->iac_ctx) {
+		list_add_tail(&req->ar_list, &iac->iac_pending);
+		iac->iac_nr_pending++;
+		if (iac->iac_nr_pending >= iac->iac_nr_free)
+			return io_async_submit(channel);
+		return 0;
+	}
+#endif
+
+	io_async_sync_req(channel, req);
+	return 0;
+}
+
+/*
+ * Queue a read or write of req->ar_count blocks at req->ar_blkno
+ * to/from req->ar_buf.  The buffer must come from ocfs2_malloc_blocks()
+ * and must not be touched until io_async_wait() returns the request.
+ * The I/O result ends up in req->ar_ret.
+ */
+errcode_t io_read_blocks_async(io_channel *channel, struct io_async_req *req)
 {
-	if (channel->io_cache) {
-		io_free_cache(channel->io_cache);
-		channel->io_cache = NULL;
-	}
+	return io_async_queue(channel, req, IO_ASYNC_READ);
+}
+
+errcode_t io_write_blocks_async(io_channel *channel,
+				struct io_async_req *req)
+{
+	return io_async_queue(channel, req, IO_ASYNC_WRITE);
 }
 
 /*
- * A cache is kind of pointless if it is swappable, right?  Let's give
- * applications the ability to pin the cache memory.  This is a separate
- * call from io_init_cache() because non-privileged users can't do it, and
- * they still want to create small caches.
+ * Wait until at least min_nr requests have completed, and return up to
+ * max_nr of them in reqs.  *nr is set to the number returned.  Queued
+ * requests are submitted first, so callers don't need to call
+ * io_async_submit() themselves.
  */
-errcode_t io_mlock_cache(io_channel *channel)
+errcode_t io_async_wait(io_channel *channel, int min_nr, int max_nr,
+			struct io_async_req **reqs, int *nr)
 {
-	int rc;
-	struct io_cache *ic = channel->io_cache;
-	long pages_wanted, avpages;
+	struct io_async_ctx *iac = channel->io_async;
+	struct io_async_req *req;
+	errcode_t ret;
+#ifdef __linux__
+	int i, rc;
+#endif
 
-	if (!ic)
+	*nr = 0;
+	if (!iac)
 		return OCFS2_ET_INVALID_ARGUMENT;
 
-	if (ic->ic_locked)
-		return 0;
-
-	/*
-	 * We're going to lock our cache pages.  We don't want to
-	 * request more memory than the system has, though.
-	 */
-	pages_wanted = channel->io_blksize * ic->ic_nr_blocks / getpagesize();
-	avpages = sysconf(_SC_AVPHYS_PAGES);
-	if (pages_wanted > avpages)
-		return OCFS2_ET_NO_MEMORY;
+	if (min_nr > max_nr)
+		min_nr = max_nr;
 
-	rc = mlock(ic->ic_data_buffer, ic->ic_data_buffer_len);
-	if (!rc) {
-		rc = mlock(ic->ic_metadata_buffer, ic->ic_metadata_buffer_len);
-		if (rc)
-			munlock(ic->ic_data_buffer, ic->ic_data_buffer_len);
+	while (iac->iac_nr_done < min_nr) {
+		ret = io_async_submit(channel);
+		if (ret)
+			return ret;
+		if (!iac->iac_inflight)
+			break;
+#ifdef __linux__
+		rc = sys_io_getevents(iac->iac_ctx, 1, IO_ASYNC_MAX_DEPTH,
+				      iac->iac_events);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			channel->io_error = errno;
+			return OCFS2_ET_IO;
+		}
+		for (i = 0; i < rc; i++)
+			io_async_complete_event(channel, &iac->iac_events[i]);
+#endif
 	}
 
-	if (rc)
-		return OCFS2_ET_NO_MEMORY;
+	while ((*nr < max_nr) && !list_empty(&iac->iac_done)) {
+		req = list_entry(iac->iac_done.next, struct io_async_req,
+				 ar_list);
+		list_del(&req->ar_list);
+		iac->iac_nr_done--;
+		reqs[(*nr)++] = req;
+	}
 
-	ic->ic_locked = 1;
 	return 0;
 }
 
-errcode_t io_init_cache(io_channel *channel, size_t nr_blocks)
+/* How many requests are queued, in flight, or waiting to be reaped */
+int io_async_outstanding(io_channel *channel)
 {
-	int i;
-	struct io_cache *ic;
-	char *dbuf;
-	struct io_cache_block *icb_list;
-	errcode_t ret;
+	struct io_async_ctx *iac = channel->io_async;
 
-	ret = ocfs2_malloc0(sizeof(struct io_cache), &ic);
-	if (ret)
-		goto out;
+	if (!iac)
+		return 0;
 
-	ic->ic_nr_blocks = nr_blocks;
-	ic->ic_lookup = RB_ROOT;
-	INIT_LIST_HEAD(&ic->ic_lru);
+	return iac->iac_nr_pending + iac->iac_inflight + iac->iac_nr_done;
+}
 
-	ret = ocfs2_malloc_blocks(channel, nr_blocks, &ic->ic_data_buffer);
-	if (ret)
-		goto out;
-	ic->ic_data_buffer_len = (unsigned long)nr_blocks * channel->io_blksize;
+/*
+ * Queued requests are finished before the channel goes away, so a
+ * queued write is never lost.  Nobody is left to reap them, so the
+ * first error among the requests still on iac_done is returned.
+ */
+static errcode_t io_async_destroy(io_channel *channel)
+{
+	struct io_async_ctx *iac = channel->io_async;
+	struct io_async_req *req;
+	struct list_head *pos;
+	errcode_t ret = 0;
+#ifdef __linux__
+	int i, rc;
+#endif
 
-	ret = ocfs2_malloc0(sizeof(struct io_cache_block) * nr_blocks,
-			    &ic->ic_metadata_buffer);
-	if (ret)
-		goto out;
-	ic->ic_metadata_buffer_len =
-		(unsigned long)nr_blocks * sizeof(struct io_cache_block);
+	if (!iac)
+		return 0;
 
-	icb_list = ic->ic_metadata_buffer;
-	dbuf = ic->ic_data_buffer;
-	for (i = 0; i < nr_blocks; i++) {
-		icb_list[i].icb_blkno = UINT64_MAX;
-		icb_list[i].icb_buf = dbuf;
-		dbuf += channel->io_blksize;
-		list_add_tail(&icb_list[i].icb_list, &ic->ic_lru);
+#ifdef __linux__
+	/*
+	 * We can't free the iocbs while the kernel might still write
+	 * to the buffers.
+	 */
+	while (iac->iac_nr_pending || iac->iac_inflight) {
+		io_async_submit(channel);
+		if (!iac->iac_inflight)
+			continue;
+
+		rc = sys_io_getevents(iac->iac_ctx, 1, IO_ASYNC_MAX_DEPTH,
+				      iac->iac_events);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			channel->io_error = errno;
+			ret = OCFS2_ET_IO;
+			break;
+		}
+		for (i = 0; i < rc; i++)
+			io_async_complete_event(channel, &iac->iac_events[i]);
 	}
+	if (iac->iac_ctx)
+		sys_io_destroy(iac->iac_ctx);
+#endif
 
-	channel->io_cache = ic;
-
-out:
-	if (ret)
-		io_free_cache(ic);
+	list_for_each(pos, &iac->iac_done) {
+		req = list_entry(pos, struct io_async_req, ar_list);
+		if (!ret && req->ar_ret)
+			ret = req->ar_ret;
+	}
 
+	ocfs2_free(&channel->io_async);
 	return ret;
 }
 
-errcode_t io_init_cache_size(io_channel *channel, size_t bytes)
+static errcode_t io_async_init(io_channel *channel, bool kernel_aio)
 {
-	size_t blocks;
+	int i;
+	errcode_t ret;
+	struct io_async_ctx *iac;
 
-	blocks = (bytes + (channel->io_blksize - 1)) / channel->io_blksize;
+	ret = ocfs2_malloc0(sizeof(struct io_async_ctx), &iac);
+	if (ret)
+		return ret;
 
-	return io_init_cache(channel, blocks);
-}
+	INIT_LIST_HEAD(&iac->iac_pending);
+	INIT_LIST_HEAD(&iac->iac_done);
+	for (i = 0; i < IO_ASYNC_MAX_DEPTH; i++)
+		iac->iac_free[i] = IO_ASYNC_MAX_DEPTH - i - 1;
+	iac->iac_nr_free = IO_ASYNC_MAX_DEPTH;
+
+#ifdef __linux__
+	/* No kernel AIO means we fall back to synchronous I/O */
+	if (kernel_aio && sys_io_setup(IO_ASYNC_MAX_DEPTH, &iac->iac_ctx))
+		iac->iac_ctx = 0;
+#endif
 
+	channel->io_async = iac;
+	return 0;
+}
 
 static errcode_t io_validate_o_direct(io_channel *channel)
 {
@@ -604,7 +2307,34 @@ static errcode_t io_validate_o_direct(io_channel *channel)
 	return ret;
 }
 
-errcode_t io_open(const char *name, int flags, io_channel **channel)
+/*
+ * Map the whole device or file read-only.  Reads become memcpy()s out
+ * of the page cache, and io_get_block() can hand out pointers into the
+ * mapping.  If the mapping can't be made, the channel just uses
+ * pread64() as usual.
+ */
+static void io_map_device(io_channel *channel)
+{
+	off64_t len;
+	void *map;
+
+	len = lseek64(channel->io_fd, 0, SEEK_END);
+	if ((len <= 0) || ((uint64_t)len != (size_t)len))
+		return;
+
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, channel->io_fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	/* Metadata walks jump all over the place */
+	madvise(map, len, MADV_RANDOM);
+
+	channel->io_map = map;
+	channel->io_map_len = len;
+}
+
+static errcode_t unix_io_open(const char *name, int flags,
+			      io_channel *parent, io_channel **channel)
 {
 	errcode_t ret;
 	io_channel *chan = NULL;
@@ -627,6 +2357,11 @@ errcode_t io_open(const char *name, int flags, io_channel **channel)
 	chan->io_blksize = OCFS2_MIN_BLOCKSIZE;
 	chan->io_flags = (flags & OCFS2_FLAG_RW) ? O_RDWR : O_RDONLY;
 	chan->io_nocache = false;
+	/* A mapping goes through the page cache, so O_DIRECT is moot */
+	if (flags & OCFS2_FLAG_RW)
+		flags &= ~OCFS2_FLAG_MMAP;
+	if (flags & OCFS2_FLAG_MMAP)
+		flags |= OCFS2_FLAG_BUFFERED;
 	if (!(flags & OCFS2_FLAG_BUFFERED))
 		chan->io_flags |= O_DIRECT;
 	chan->io_error = 0;
@@ -647,6 +2382,19 @@ errcode_t io_open(const char *name, int flags, io_channel **channel)
 			goto out_close;  /* FIXME: bindraw here */
 	}
 
+	if (flags & OCFS2_FLAG_MMAP)
+		io_map_device(chan);
+
+	ret = io_async_init(chan, !!(flags & OCFS2_FLAG_ASYNC_IO));
+	if (ret)
+		goto out_unmap;
+
+	/* Only the tool's own channel looks at the environment */
+	if (!parent)
+		io_stats_init_env(chan);
+	else if (parent->io_stats && !io_enable_stats(chan, 0))
+		chan->io_parent = parent;
+
 	/* Workaround from e2fsprogs */
 #ifdef __linux__
 #undef RLIM_INFINITY
@@ -686,6 +2434,10 @@ errcode_t io_open(const char *name, int flags, io_channel **channel)
 	*channel = chan;
 	return 0;
 
+out_unmap:
+	if (chan->io_map)
+		munmap(chan->io_map, chan->io_map_len);
+
 out_close:
 	/* Ignore the return, leave the original error */
 	close(chan->io_fd);
@@ -700,13 +2452,49 @@ out_chan:
 	return ret;
 }
 
+errcode_t io_open(const char *name, int flags, io_channel **channel)
+{
+	return unix_io_open(name, flags, NULL, channel);
+}
+
+/*
+ * A second channel on the parent's device, for a thread that wants its
+ * own fd and cache.  It ignores OCFS2_IO_STATS and OCFS2_IO_TRACE.  If
+ * the parent is keeping statistics, the helper's are added to them when
+ * the helper is closed, so a tool prints one report.  Close the helper
+ * before the parent, and not while another thread is using the parent.
+ */
+errcode_t io_open_helper(io_channel *parent, int flags,
+			 io_channel **channel)
+{
+	return unix_io_open(parent->io_name, flags, parent, channel);
+}
+
 errcode_t io_close(io_channel *channel)
 {
-	errcode_t ret = 0;
+	errcode_t ret, async_ret;
 
+	async_ret = io_async_destroy(channel);
+	ret = io_flush(channel);
+	if (!ret)
+		ret = async_ret;
 	io_destroy_cache(channel);
 
-	if (close(channel->io_fd) < 0)
+	if (channel->io_parent)
+		io_stats_merge(channel->io_parent, channel);
+
+	if (channel->io_stats) {
+		if (channel->io_stats->isc_print)
+			io_print_stats(channel, stderr);
+		if (channel->io_stats->isc_trace_file)
+			io_stats_write_trace(channel);
+		io_disable_stats(channel);
+	}
+
+	if (channel->io_map)
+		munmap(channel->io_map, channel->io_map_len);
+
+	if ((close(channel->io_fd) < 0) && !ret)
 		ret = errno;
 
 	ocfs2_free(&channel->io_name);
@@ -759,7 +2547,7 @@ void io_set_nocache(io_channel *channel, bool nocache)
 errcode_t io_read_block(io_channel *channel, int64_t blkno, int count,
 			char *data)
 {
-	if (channel->io_cache)
+	if (channel->io_cache && !channel->io_map)
 		return io_cache_read_block(channel, blkno, count, data,
 					   channel->io_nocache);
 	else
@@ -769,13 +2557,169 @@ errcode_t io_read_block(io_channel *channel, int64_t blkno, int count,
 errcode_t io_read_block_nocache(io_channel *channel, int64_t blkno, int count,
 				char *data)
 {
-	if (channel->io_cache)
+	if (channel->io_cache && !channel->io_map)
 		return io_cache_read_block(channel, blkno, count, data,
 					   true);
 	else
 		return unix_io_read_block(channel, blkno, count, data);
 }
 
+static int io_vec_unit_cmp(const void *a, const void *b)
+{
+	const struct io_vec_unit *l = a;
+	const struct io_vec_unit *r = b;
+
+	if (l->ivu_blkno < r->ivu_blkno)
+		return -1;
+	if (l->ivu_blkno > r->ivu_blkno)
+		return 1;
+	return 0;
+}
+
+/* Reading a hole this small is cheaper than another I/O */
+#define IO_VEC_MAX_GAP		8
+
+/* Linux won't take more than 1024 iovecs in one preadv() */
+#define IO_VEC_MAX_IOVS		1024
+
+/*
+ * Read nr ranges of blocks, each into its own buffer.  Cached blocks at
+ * the front of a range come from the cache.  Everything else is sorted
+ * by block number, and ranges that are adjacent or close together go
+ * to disk as one preadv().  The small holes between them are read into
+ * a scratch buffer and thrown away.  The cache is filled just like
+ * io_read_block() does, minus the readahead; the caller already told
+ * us what it wants.
+ *
+ * Overlapping ranges are allowed, but they aren't merged.  If a read
+ * fails, the first error is returned and the buffers that didn't get
+ * read are undefined.
+ */
+errcode_t io_read_blocks_v(io_channel *channel, struct io_vec_unit *ivus,
+			   int nr)
+{
+	int i, j, k, n = 0, cached, iovcnt;
+	int64_t end, gap;
+	errcode_t ret = 0;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb;
+	struct io_vec_unit *todo = NULL, *ivu;
+	struct iovec *iov = NULL;
+	char *gap_buf = NULL, *data;
+
+	if (nr <= 0)
+		return nr ? OCFS2_ET_INVALID_ARGUMENT : 0;
+
+	for (i = 0; i < nr; i++) {
+		if ((ivus[i].ivu_blkno < 0) || (ivus[i].ivu_count <= 0))
+			return OCFS2_ET_INVALID_ARGUMENT;
+	}
+
+	if (channel->io_map) {
+		for (i = 0; !ret && (i < nr); i++)
+			ret = unix_io_read_block(channel, ivus[i].ivu_blkno,
+						 ivus[i].ivu_count,
+						 ivus[i].ivu_buf);
+		return ret;
+	}
+
+	ret = ocfs2_malloc(sizeof(struct io_vec_unit) * nr, &todo);
+	if (ret)
+		goto out;
+	ret = ocfs2_malloc(sizeof(struct iovec) * IO_VEC_MAX_IOVS, &iov);
+	if (ret)
+		goto out;
+	ret = ocfs2_malloc_blocks(channel, IO_VEC_MAX_GAP, &gap_buf);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < nr; i++) {
+		ivu = &ivus[i];
+		data = ivu->ivu_buf;
+		cached = 0;
+		for (; ic && (cached < ivu->ivu_count); cached++) {
+			icb = io_cache_lookup(ic, ivu->ivu_blkno + cached);
+			if (!icb)
+				break;
+
+			memcpy(data, icb->icb_buf, channel->io_blksize);
+			data += channel->io_blksize;
+			if (channel->io_nocache)
+				io_cache_unsee(ic, icb);
+			else
+				io_cache_seen(ic, icb);
+		}
+
+		if (ic) {
+			ic->ic_stats.ics_hits += cached;
+			ic->ic_stats.ics_misses += ivu->ivu_count - cached;
+		}
+		if (cached == ivu->ivu_count)
+			continue;
+
+		todo[n].ivu_blkno = ivu->ivu_blkno + cached;
+		todo[n].ivu_count = ivu->ivu_count - cached;
+		todo[n].ivu_buf = data;
+		n++;
+	}
+
+	qsort(todo, n, sizeof(struct io_vec_unit), io_vec_unit_cmp);
+
+	for (i = 0; i < n; i = j) {
+		iov[0].iov_base = todo[i].ivu_buf;
+		iov[0].iov_len = (size_t)todo[i].ivu_count *
+			channel->io_blksize;
+		iovcnt = 1;
+		end = todo[i].ivu_blkno + todo[i].ivu_count;
+
+		for (j = i + 1; j < n; j++) {
+			gap = todo[j].ivu_blkno - end;
+			if ((gap < 0) || (gap > IO_VEC_MAX_GAP) ||
+			    ((iovcnt + 2) > IO_VEC_MAX_IOVS))
+				break;
+
+			if (gap) {
+				iov[iovcnt].iov_base = gap_buf;
+				iov[iovcnt].iov_len = gap * channel->io_blksize;
+				iovcnt++;
+			}
+			iov[iovcnt].iov_base = todo[j].ivu_buf;
+			iov[iovcnt].iov_len = (size_t)todo[j].ivu_count *
+				channel->io_blksize;
+			iovcnt++;
+			end = todo[j].ivu_blkno + todo[j].ivu_count;
+		}
+
+		ret = unix_io_readv(channel, todo[i].ivu_blkno, iov, iovcnt);
+		if (ret)
+			break;
+
+		/*
+		 * Filling one range can flush and evict a dirty block
+		 * that a later range in this read needs.
+		 */
+		for (k = i; ic && (k < j); k++)
+			io_cache_overlay_dirty(channel, todo[k].ivu_blkno,
+					       todo[k].ivu_count,
+					       todo[k].ivu_buf);
+		for (k = i; ic && (k < j); k++)
+			io_cache_fill_blocks(channel, todo[k].ivu_blkno,
+					     todo[k].ivu_count,
+					     todo[k].ivu_buf,
+					     channel->io_nocache);
+	}
+
+out:
+	if (gap_buf)
+		ocfs2_free(&gap_buf);
+	if (iov)
+		ocfs2_free(&iov);
+	if (todo)
+		ocfs2_free(&todo);
+
+	return ret;
+}
+
 errcode_t io_write_block(io_channel *channel, int64_t blkno, int count,
 			 const char *data)
 {
@@ -796,6 +2740,103 @@ errcode_t io_write_block_nocache(io_channel *channel, int64_t blkno, int count,
 		return unix_io_write_block(channel, blkno, count, data);
 }
 
+/*
+ * Pin a block in the cache and return a pointer to it.  The buffer is
+ * read-only and stays valid until io_put_block().  If the channel has
+ * no cache, is in nocache mode, or every cache buffer is pinned, the
+ * block is read into private memory instead.  A mapped channel just
+ * returns a pointer into the mapping.  Callers can't tell the
+ * difference.
+ */
+errcode_t io_get_block(io_channel *channel, int64_t blkno,
+		       const char **buf)
+{
+	errcode_t ret;
+	struct io_cache *ic = channel->io_cache;
+	struct io_cache_block *icb = NULL;
+	char *blk;
+	uint64_t location = blkno * channel->io_blksize;
+
+	if (channel->io_map) {
+		if ((blkno >= 0) &&
+		    (location + channel->io_blksize <= channel->io_map_len)) {
+			*buf = channel->io_map + location;
+			return 0;
+		}
+		ic = NULL;	/* Short reads get the private buffer */
+	}
+
+	if (ic) {
+		icb = io_cache_lookup(ic, blkno);
+		if (icb) {
+			ic->ic_stats.ics_hits++;
+			if (channel->io_nocache)
+				io_cache_unsee(ic, icb);
+			else
+				io_cache_seen(ic, icb);
+			io_cache_pin(ic, icb);
+			*buf = icb->icb_buf;
+			if (!channel->io_nocache)
+				io_cache_readahead(channel, blkno, 1);
+			return 0;
+		}
+
+		ic->ic_stats.ics_misses++;
+		if (!channel->io_nocache)
+			icb = io_cache_steal(channel);
+	}
+
+	if (icb) {
+		ret = unix_io_read_block(channel, blkno, 1, icb->icb_buf);
+		if (ret) {
+			/* It's empty, so it goes where it will be reused */
+			icb->icb_queue = IO_CACHE_COLD;
+			list_add(&icb->icb_list, &ic->ic_cold);
+			return ret;
+		}
+
+		io_cache_insert(ic, icb, blkno);
+		io_cache_pin(ic, icb);
+		*buf = icb->icb_buf;
+		io_cache_readahead(channel, blkno, 1);
+		return 0;
+	}
+
+	ret = ocfs2_malloc_block(channel, &blk);
+	if (ret)
+		return ret;
+
+	ret = unix_io_read_block(channel, blkno, 1, blk);
+	if (ret) {
+		ocfs2_free(&blk);
+		return ret;
+	}
+
+	*buf = blk;
+	return 0;
+}
+
+void io_put_block(io_channel *channel, const char *buf)
+{
+	struct io_cache *ic = channel->io_cache;
+	unsigned long off;
+
+	if (channel->io_map && (buf >= channel->io_map) &&
+	    (buf < (channel->io_map + channel->io_map_len)))
+		return;
+
+	if (ic && (buf >= ic->ic_data_buffer) &&
+	    (buf < (ic->ic_data_buffer + ic->ic_data_buffer_len))) {
+		off = buf - ic->ic_data_buffer;
+		io_cache_unpin(ic,
+			       &ic->ic_metadata_buffer[off /
+						       channel->io_blksize]);
+		return;
+	}
+
+	ocfs2_free(&buf);
+}
+
 
 #ifdef DEBUG_EXE
 #include <stdio.h>
@@ -847,17 +2888,55 @@ static void dump_block(int64_t blkno, int blksize, char *buf)
 static void print_usage(void)
 {
 	fprintf(stderr,
-		"Usage: unix_io [-b <blkno>] [-c <count>] [-B <blksize>]\n"
+		"Usage: unix_io [-b <blkno>] [-c <count>] [-B <blksize>] [-a]\n"
 	       	"               <filename>\n");
 }
 
 extern int opterr, optind;
 extern char *optarg;
 
+/* Read each block with its own request, keeping them all in flight */
+static errcode_t read_async(io_channel *channel, int64_t blkno, int count,
+			    char *blks)
+{
+	errcode_t ret, err = 0;
+	int i, nr, todo = count;
+	struct io_async_req *reqs, *done[IO_ASYNC_MAX_DEPTH];
+
+	ret = ocfs2_malloc0(sizeof(struct io_async_req) * count, &reqs);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		reqs[i].ar_blkno = blkno + i;
+		reqs[i].ar_count = 1;
+		reqs[i].ar_buf = blks + (i * io_get_blksize(channel));
+		ret = io_read_blocks_async(channel, &reqs[i]);
+		if (ret)
+			goto out;
+	}
+
+	while (todo) {
+		ret = io_async_wait(channel, 1, IO_ASYNC_MAX_DEPTH, done, &nr);
+		if (ret)
+			goto out;
+		for (i = 0; i < nr; i++) {
+			if (done[i]->ar_ret && !err)
+				err = done[i]->ar_ret;
+		}
+		todo -= nr;
+	}
+	ret = err;
+
+out:
+	ocfs2_free(&reqs);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	errcode_t ret;
-	int c;
+	int c, async = 0;
 	int64_t blkno, count, blksize;
 	char *filename;
 	io_channel *channel;
@@ -870,8 +2949,12 @@ int main(int argc, char *argv[])
 
 	initialize_ocfs_error_table();
 
-	while((c = getopt(argc, argv, "b:c:B:")) != EOF) {
+	while((c = getopt(argc, argv, "b:c:B:a")) != EOF) {
 		switch (c) {
+			case 'a':
+				async = 1;
+				break;
+
 			case 'b':
 				blkno = read_number(optarg);
 				if (blkno < 0) {
@@ -942,7 +3025,9 @@ int main(int argc, char *argv[])
 
 	filename = argv[optind];
 
-	ret = io_open(filename, OCFS2_FLAG_RO, &channel);
+	ret = io_open(filename,
+		      OCFS2_FLAG_RO | (async ? OCFS2_FLAG_ASYNC_IO : 0),
+		      &channel);
 	if (ret) {
 		com_err(argv[0], ret,
 			"while opening file \"%s\"", filename);
@@ -956,7 +3041,10 @@ int main(int argc, char *argv[])
 		goto out_channel;
 	}
 
-	ret = io_read_block(channel, blkno, (int)count, blks);
+	if (async)
+		ret = read_async(channel, blkno, (int)count, blks);
+	else
+		ret = io_read_block(channel, blkno, (int)count, blks);
 	if (ret) {
 		com_err(argv[0], ret,
 			"while reading %"PRId64" blocks at block %"PRId64" (%s)",
@@ -39,16 +39,51 @@
 #include <ocfs2/bitops.h>
 #include <libgen.h>
 #include <sys/vfs.h>
+#include <pthread.h>
 
 #include "ocfs2/ocfs2.h"
 #include "ocfs2/image.h"
 
+/* Default number of threads walking inode groups */
+#define O2IMAGE_MAX_THREADS	8
+
+/* The copy reads and writes this much at a time */
+#define O2IMAGE_CHUNK_SIZE	(4 * 1024 * 1024)
+#define O2IMAGE_NR_CHUNKS	3
+
+/*
+ * Inode groups are where the work is.  Every inode in them is read,
+ * and every directory has its extents walked.  So traverse_chains()
+ * doesn't walk them itself; it queues them, and a pool of threads
+ * takes them off the queue, each reading through its own io_channel.
+ * Walking a group can turn up more inode allocators (the slot ones
+ * live in the global one), and their groups go on the same queue.
+ * We're done when the queue is empty and nobody is walking a group
+ * that could add to it.
+ */
+struct o2image_walk {
+	pthread_mutex_t	w_lock;
+	pthread_cond_t	w_cond;
+	uint64_t	*w_groups;
+	int		w_head;		/* next group to walk */
+	int		w_nr;
+	int		w_alloced;
+	int		w_busy;		/* threads walking a group */
+	errcode_t	w_ret;		/* the first error stops everyone */
+};
+
+static struct o2image_walk walk = {
+	.w_lock	= PTHREAD_MUTEX_INITIALIZER,
+	.w_cond	= PTHREAD_COND_INITIALIZER,
+};
+
 static errcode_t traverse_inode(ocfs2_filesys *ofs, uint64_t inode);
 char *program_name = NULL;
+static int nr_threads = 0;
 
 static void usage(void)
 {
-	fprintf(stderr, ("Usage: %s [-rI] device image_file\n"),
+	fprintf(stderr, ("Usage: %s [-rI] [-j threads] device image_file\n"),
 		program_name);
 	exit(1);
 }
@@ -79,6 +114,152 @@ static errcode_t traverse_group_desc(ocfs2_filesys *ofs,
 	return ret;
 }
 
+static errcode_t queue_inode_group(uint64_t blkno)
+{
+	errcode_t ret = 0;
+	int want;
+
+	pthread_mutex_lock(&walk.w_lock);
+	if (walk.w_nr == walk.w_alloced) {
+		want = walk.w_alloced ? walk.w_alloced * 2 : 256;
+		ret = ocfs2_realloc(sizeof(uint64_t) * want, &walk.w_groups);
+		if (!ret)
+			walk.w_alloced = want;
+	}
+	if (!ret) {
+		walk.w_groups[walk.w_nr++] = blkno;
+		pthread_cond_signal(&walk.w_cond);
+	}
+	pthread_mutex_unlock(&walk.w_lock);
+
+	return ret;
+}
+
+/*
+ * Walk queued inode groups until there are none left or someone has
+ * failed.  Returns the first error anyone hit.
+ */
+static errcode_t walk_inode_groups(ocfs2_filesys *ofs)
+{
+	struct ocfs2_group_desc *grp;
+	errcode_t ret;
+	uint64_t blkno;
+	char *buf = NULL;
+
+	ret = ocfs2_malloc_block(ofs->fs_io, &buf);
+	if (ret)
+		com_err(program_name, ret, "while allocating block buffer "
+			"to group descriptor");
+
+	pthread_mutex_lock(&walk.w_lock);
+	for (;;) {
+		if (ret && !walk.w_ret) {
+			walk.w_ret = ret;
+			pthread_cond_broadcast(&walk.w_cond);
+		}
+
+		while (!walk.w_ret && (walk.w_head == walk.w_nr) &&
+		       walk.w_busy)
+			pthread_cond_wait(&walk.w_cond, &walk.w_lock);
+		if (walk.w_ret || (walk.w_head == walk.w_nr))
+			break;
+
+		blkno = walk.w_groups[walk.w_head++];
+		if (walk.w_head == walk.w_nr)
+			walk.w_head = walk.w_nr = 0;
+		walk.w_busy++;
+		pthread_mutex_unlock(&walk.w_lock);
+
+		grp = (struct ocfs2_group_desc *)buf;
+		ret = ocfs2_read_group_desc(ofs, blkno, buf);
+		if (ret)
+			com_err(program_name, ret, "while reading inode group "
+				"%"PRIu64"", blkno);
+		else
+			ret = traverse_group_desc(ofs, grp,
+						  OCFS2_IMAGE_READ_INODE_YES);
+
+		pthread_mutex_lock(&walk.w_lock);
+		walk.w_busy--;
+		if (!walk.w_busy)
+			pthread_cond_broadcast(&walk.w_cond);
+	}
+	ret = walk.w_ret;
+	pthread_mutex_unlock(&walk.w_lock);
+
+	if (buf)
+		ocfs2_free(&buf);
+	return ret;
+}
+
+static void *walk_thread(void *arg)
+{
+	walk_inode_groups(arg);
+	return NULL;
+}
+
+/*
+ * Each thread gets a copy of the filesystem with its own read-only
+ * channel and cache.  The image state is shared; marking the bitmap is
+ * atomic.  If we can't start a thread, the ones we have do the work.
+ */
+static errcode_t walk_inode_groups_threaded(ocfs2_filesys *ofs)
+{
+	ocfs2_filesys *wfs = NULL;
+	pthread_t *threads = NULL;
+	errcode_t ret;
+	int i, started = 0;
+
+	if (nr_threads > 1) {
+		ret = ocfs2_malloc0(sizeof(ocfs2_filesys) * (nr_threads - 1),
+				    &wfs);
+		if (!ret)
+			ret = ocfs2_malloc0(sizeof(pthread_t) *
+					    (nr_threads - 1), &threads);
+		if (ret)
+			goto walk;
+	}
+
+	for (i = 0; i < nr_threads - 1; i++) {
+		wfs[i] = *ofs;
+		wfs[i].fs_io = NULL;
+		ret = io_open_helper(ofs->fs_io,
+				     OCFS2_FLAG_RO |
+				     (ofs->fs_flags & OCFS2_FLAG_BUFFERED),
+				     &wfs[i].fs_io);
+		if (!ret)
+			ret = io_set_blksize(wfs[i].fs_io, ofs->fs_blocksize);
+		if (!ret)
+			ret = io_init_cache_size(wfs[i].fs_io,
+						 8 * 1024 * 1024);
+		if (!ret && pthread_create(&threads[i], NULL, walk_thread,
+					   &wfs[i]))
+			ret = OCFS2_ET_NO_MEMORY;
+		if (ret) {
+			if (wfs[i].fs_io)
+				io_close(wfs[i].fs_io);
+			break;
+		}
+		started++;
+	}
+
+walk:
+	ret = walk_inode_groups(ofs);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+		io_close(wfs[i].fs_io);
+	}
+
+	if (threads)
+		ocfs2_free(&threads);
+	if (wfs)
+		ocfs2_free(&wfs);
+	if (walk.w_groups)
+		ocfs2_free(&walk.w_groups);
+	return ret;
+}
+
 static errcode_t mark_dealloc_bits(ocfs2_filesys *ofs,
 				   struct ocfs2_truncate_log *tl)
 {
@@ -154,11 +335,12 @@ static errcode_t traverse_chains(ocfs2_filesys *ofs,
 				goto out;
 
 			grp = (struct ocfs2_group_desc *)buf;
-			if (dump_type) {
+			if (dump_type == OCFS2_IMAGE_READ_INODE_YES)
+				ret = queue_inode_group(blkno);
+			else if (dump_type)
 				ret = traverse_group_desc(ofs, grp, dump_type);
-				if (ret)
-					goto out;
-			}
+			if (ret)
+				goto out;
 			blkno = grp->bg_next_group;
 		}
 	}
@@ -220,12 +402,11 @@ static errcode_t traverse_inode(ocfs2_filesys *ofs, uint64_t inode)
 			dump_type = OCFS2_IMAGE_READ_INODE_YES;
 
 	if (inode == ost->ost_glbl_inode_alloc) {
-		if (ost->ost_glbl_inode_traversed) {
+		/* It's in one of its own groups, so a walker will find it */
+		if (__sync_lock_test_and_set(&ost->ost_glbl_inode_traversed,
+					     1))
 			goto out;
-		} else {
-			dump_type = OCFS2_IMAGE_READ_INODE_YES;
-			ost->ost_glbl_inode_traversed = 1;
-		}
+		dump_type = OCFS2_IMAGE_READ_INODE_YES;
 	}
 
 	if ((di->i_flags & OCFS2_LOCAL_ALLOC_FL))
@@ -323,59 +504,317 @@ out:
 	return ret;
 }
 
-static errcode_t write_raw_image_file(ocfs2_filesys *ofs, int fd)
+/*
+ * The copy is a pipeline.  The main thread finds runs of marked
+ * blocks and reads a chunk of them with one vectored read, which the
+ * channel turns into a few large I/Os.  A writer thread puts full
+ * chunks out in order while the next ones are being read.
+ */
+struct o2image_chunk {
+	char			*ch_buf;
+	struct io_vec_unit	*ch_runs;
+	int			ch_nr_runs;
+	int			ch_blocks;	/* blocks used in ch_buf */
+};
+
+struct o2image_copy {
+	ocfs2_filesys		*cp_fs;
+	int			cp_fd;
+	int			cp_raw;
+	int			cp_chunk_blocks;
+	struct o2image_chunk	cp_chunks[O2IMAGE_NR_CHUNKS];
+	pthread_mutex_t		cp_lock;
+	pthread_cond_t		cp_cond;
+	int			cp_full;	/* chunks waiting to be written */
+	int			cp_done;	/* nothing more to read */
+	errcode_t		cp_ret;		/* the writer failed */
+	uint64_t		cp_next;	/* raw to stdout: next block due */
+	char			*cp_zero;	/* raw to stdout: for the holes */
+};
+
+/* The first block at or after start that is marked (or not) */
+static uint64_t find_next_mark(ocfs2_filesys *ofs, uint64_t start, int set)
+{
+	struct ocfs2_image_state *ost = ofs->ost;
+	uint64_t base;
+	int bits, off;
+	char *map;
+
+	while (start < ofs->fs_blocks) {
+		base = start - (start % OCFS2_IMAGE_BITS_IN_BLOCK);
+		bits = ocfs2_min(ofs->fs_blocks - base,
+				 (uint64_t)OCFS2_IMAGE_BITS_IN_BLOCK);
+		map = ost->ost_bmparr[base / OCFS2_IMAGE_BITS_IN_BLOCK].arr_map;
+
+		if (set)
+			off = ocfs2_find_next_bit_set(map, bits, start - base);
+		else
+			off = ocfs2_find_next_bit_clear(map, bits,
+							start - base);
+		if (off < bits)
+			return base + off;
+
+		start = base + bits;
+	}
+
+	return ofs->fs_blocks;
+}
+
+/*
+ * Fill a chunk with the runs of marked blocks from *next on, and move
+ * *next past them.  Returns the number of runs, zero at the end.
+ */
+static int fill_chunk(struct o2image_copy *cp, struct o2image_chunk *ch,
+		      uint64_t *next)
+{
+	ocfs2_filesys *ofs = cp->cp_fs;
+	struct io_vec_unit *run;
+	uint64_t start, end;
+
+	ch->ch_nr_runs = 0;
+	ch->ch_blocks = 0;
+	while (ch->ch_blocks < cp->cp_chunk_blocks) {
+		start = find_next_mark(ofs, *next, 1);
+		if (start >= ofs->fs_blocks)
+			break;
+		end = find_next_mark(ofs, start, 0);
+		end = ocfs2_min(end, start + cp->cp_chunk_blocks -
+				ch->ch_blocks);
+
+		run = &ch->ch_runs[ch->ch_nr_runs++];
+		run->ivu_blkno = start;
+		run->ivu_count = end - start;
+		run->ivu_buf = ch->ch_buf + ((uint64_t)ch->ch_blocks *
+					     ofs->fs_blocksize);
+		ch->ch_blocks += run->ivu_count;
+		*next = end;
+	}
+
+	return ch->ch_nr_runs;
+}
+
+/* A negative offset means write() at the current position */
+static errcode_t write_out(int fd, char *buf, uint64_t len, int64_t offset)
 {
-	struct ocfs2_super_block *super;
-	char *zero_buf = NULL;
-	char *blk_buf = NULL;
-	uint64_t blk = -1;
 	ssize_t count;
+
+	while (len) {
+		if (offset < 0)
+			count = write(fd, buf, len);
+		else
+			count = pwrite64(fd, buf, len, offset);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		if (!count)
+			return OCFS2_ET_SHORT_WRITE;
+
+		buf += count;
+		len -= count;
+		if (offset >= 0)
+			offset += count;
+	}
+
+	return 0;
+}
+
+/* stdout can't seek, so a raw image there has its holes written out */
+static errcode_t write_zeros(struct o2image_copy *cp, uint64_t end)
+{
+	ocfs2_filesys *ofs = cp->cp_fs;
+	uint64_t count;
 	errcode_t ret;
 
-	super = OCFS2_RAW_SB(ofs->fs_super);
-	ret = ocfs2_malloc_block(ofs->fs_io, &blk_buf);
+	while (cp->cp_next < end) {
+		count = ocfs2_min(end - cp->cp_next,
+				  (uint64_t)cp->cp_chunk_blocks);
+		ret = write_out(cp->cp_fd, cp->cp_zero,
+				count * ofs->fs_blocksize, -1);
+		if (ret) {
+			com_err(program_name, ret, "error writing "
+				"blk %"PRIu64"", cp->cp_next);
+			return ret;
+		}
+		cp->cp_next += count;
+	}
+
+	return 0;
+}
+
+static errcode_t write_chunk(struct o2image_copy *cp,
+			     struct o2image_chunk *ch)
+{
+	ocfs2_filesys *ofs = cp->cp_fs;
+	struct io_vec_unit *run;
+	errcode_t ret = 0;
+	int64_t offset;
+	int i;
+
+	/* The packed format is the blocks back to back */
+	if (!cp->cp_raw) {
+		ret = write_out(cp->cp_fd, ch->ch_buf,
+				(uint64_t)ch->ch_blocks * ofs->fs_blocksize,
+				-1);
+		if (ret)
+			com_err(program_name, ret, "error writing "
+				"blk %"PRIu64"", ch->ch_runs[0].ivu_blkno);
+		return ret;
+	}
+
+	for (i = 0; !ret && (i < ch->ch_nr_runs); i++) {
+		run = &ch->ch_runs[i];
+		offset = run->ivu_blkno * ofs->fs_blocksize;
+		if (cp->cp_fd == 1) {
+			ret = write_zeros(cp, run->ivu_blkno);
+			if (ret)
+				break;
+			offset = -1;
+			cp->cp_next = run->ivu_blkno + run->ivu_count;
+		}
+
+		ret = write_out(cp->cp_fd, run->ivu_buf,
+				(uint64_t)run->ivu_count * ofs->fs_blocksize,
+				offset);
+		if (ret)
+			com_err(program_name, ret, "error writing "
+				"blk %"PRIu64"", run->ivu_blkno);
+	}
+
+	return ret;
+}
+
+static void *copy_writer(void *arg)
+{
+	struct o2image_copy *cp = arg;
+	errcode_t ret;
+	int tail = 0;
+
+	pthread_mutex_lock(&cp->cp_lock);
+	for (;;) {
+		while (!cp->cp_full && !cp->cp_done)
+			pthread_cond_wait(&cp->cp_cond, &cp->cp_lock);
+		if (!cp->cp_full)
+			break;
+		pthread_mutex_unlock(&cp->cp_lock);
+
+		ret = write_chunk(cp, &cp->cp_chunks[tail]);
+		tail = (tail + 1) % O2IMAGE_NR_CHUNKS;
+
+		pthread_mutex_lock(&cp->cp_lock);
+		cp->cp_full--;
+		pthread_cond_signal(&cp->cp_cond);
+		if (ret) {
+			cp->cp_ret = ret;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&cp->cp_lock);
+
+	return NULL;
+}
+
+/*
+ * Copy every marked block to fd.  Packed, they follow one another;
+ * raw, they go at their own offset.  Installs read from the image
+ * file, which ocfs2_read_blocks_v() knows how to do.
+ */
+static errcode_t copy_blocks(ocfs2_filesys *ofs, int fd, int raw)
+{
+	struct o2image_copy cp;
+	struct o2image_chunk *ch;
+	pthread_t writer;
+	uint64_t next = 0;
+	errcode_t ret = 0;
+	int i, head = 0;
+
+	memset(&cp, 0, sizeof(cp));
+	cp.cp_fs = ofs;
+	cp.cp_fd = fd;
+	cp.cp_raw = raw;
+	cp.cp_chunk_blocks = O2IMAGE_CHUNK_SIZE / ofs->fs_blocksize;
+	pthread_mutex_init(&cp.cp_lock, NULL);
+	pthread_cond_init(&cp.cp_cond, NULL);
+
+	for (i = 0; !ret && (i < O2IMAGE_NR_CHUNKS); i++) {
+		ret = ocfs2_malloc_blocks(ofs->fs_io, cp.cp_chunk_blocks,
+					  &cp.cp_chunks[i].ch_buf);
+		if (!ret)
+			ret = ocfs2_malloc(sizeof(struct io_vec_unit) *
+					   cp.cp_chunk_blocks,
+					   &cp.cp_chunks[i].ch_runs);
+	}
+	if (!ret && raw && (fd == 1)) {
+		ret = ocfs2_malloc_blocks(ofs->fs_io, cp.cp_chunk_blocks,
+					  &cp.cp_zero);
+		if (!ret)
+			memset(cp.cp_zero, 0, O2IMAGE_CHUNK_SIZE);
+	}
 	if (ret) {
 		com_err(program_name, ret, "error while allocating buffer ");
 		goto out;
 	}
 
-	ret = ocfs2_malloc_block(ofs->fs_io, &zero_buf);
+	ret = pthread_create(&writer, NULL, copy_writer, &cp);
 	if (ret) {
-		com_err(program_name, ret, "error while allocating buffer ");
+		com_err(program_name, ret, "while starting the writer");
 		goto out;
 	}
-	memset(zero_buf, 0, ofs->fs_blocksize);
 
-	while (++blk < ofs->fs_blocks) {
-		if (ocfs2_image_test_bit(ofs, blk)) {
-			ret = ocfs2_read_blocks(ofs, blk, 1, blk_buf);
-			if (ret) {
-				com_err(program_name, ret, "error occurred "
-					"during read cluster %"PRIu64"", blk);
-				goto out;
-			}
+	/* Every block is read once; don't churn the cache with them */
+	io_set_nocache(ofs->fs_io, true);
 
-			if (fd == 1)
-				count = write(fd, blk_buf, ofs->fs_blocksize);
-			else
-				count = pwrite64(fd, blk_buf, ofs->fs_blocksize,
-					(__off64_t)(blk * ofs->fs_blocksize));
-		} else if (fd == 1) {
-			count = write(fd, zero_buf, ofs->fs_blocksize);
-		} else
-			continue;
-
-		if ((count == -1) || (count < ofs->fs_blocksize)) {
-			com_err(program_name, errno, "error writing "
-				"blk %"PRIu64"", blk);
-			goto out;
+	for (;;) {
+		pthread_mutex_lock(&cp.cp_lock);
+		while ((cp.cp_full == O2IMAGE_NR_CHUNKS) && !cp.cp_ret)
+			pthread_cond_wait(&cp.cp_cond, &cp.cp_lock);
+		pthread_mutex_unlock(&cp.cp_lock);
+		if (cp.cp_ret)
+			break;
+
+		ch = &cp.cp_chunks[head];
+		if (!fill_chunk(&cp, ch, &next))
+			break;
+
+		ret = ocfs2_read_blocks_v(ofs, ch->ch_runs, ch->ch_nr_runs);
+		if (ret) {
+			com_err(program_name, ret, "error occurred during "
+				"read of blocks %"PRIu64" to %"PRIu64"",
+				ch->ch_runs[0].ivu_blkno, next - 1);
+			break;
 		}
+
+		pthread_mutex_lock(&cp.cp_lock);
+		cp.cp_full++;
+		pthread_cond_signal(&cp.cp_cond);
+		pthread_mutex_unlock(&cp.cp_lock);
+		head = (head + 1) % O2IMAGE_NR_CHUNKS;
 	}
+
+	pthread_mutex_lock(&cp.cp_lock);
+	cp.cp_done = 1;
+	pthread_cond_signal(&cp.cp_cond);
+	pthread_mutex_unlock(&cp.cp_lock);
+	pthread_join(writer, NULL);
+	io_set_nocache(ofs->fs_io, false);
+
+	if (!ret)
+		ret = cp.cp_ret;
+	if (!ret && raw && (fd == 1))
+		ret = write_zeros(&cp, ofs->fs_blocks);
+
 out:
-	if (blk_buf)
-		ocfs2_free(&blk_buf);
-	if (zero_buf)
-		ocfs2_free(&zero_buf);
+	for (i = 0; i < O2IMAGE_NR_CHUNKS; i++) {
+		if (cp.cp_chunks[i].ch_buf)
+			ocfs2_free(&cp.cp_chunks[i].ch_buf);
+		if (cp.cp_chunks[i].ch_runs)
+			ocfs2_free(&cp.cp_chunks[i].ch_runs);
+	}
+	if (cp.cp_zero)
+		ocfs2_free(&cp.cp_zero);
+	pthread_mutex_destroy(&cp.cp_lock);
+	pthread_cond_destroy(&cp.cp_cond);
 	return ret;
 }
 
@@ -395,22 +834,17 @@ static errcode_t write_image_file(ocfs2_filesys *ofs, int fd)
 			ofs->fs_blocksize);
 		return ret;
 	}
+	memset(buf, 0, ofs->fs_blocksize);
 	hdr = (struct ocfs2_image_hdr *)buf;
 	hdr->hdr_magic = OCFS2_IMAGE_MAGIC;
 	memcpy(hdr->hdr_magic_desc, OCFS2_IMAGE_DESC,
 	       sizeof(OCFS2_IMAGE_DESC));
 
-	/* count metadata blocks that will be backedup */
-	blk = 0;
-	for (i = 0; i<ofs->fs_blocks; i++)
-		if (ocfs2_image_test_bit(ofs, i))
-			blk++;
-
 	hdr->hdr_timestamp 	= time(0);
 	hdr->hdr_version 	= OCFS2_IMAGE_VERSION;
 	hdr->hdr_fsblkcnt 	= ofs->fs_blocks;
 	hdr->hdr_fsblksz 	= ofs->fs_blocksize;
-	hdr->hdr_imgblkcnt	= blk;
+	hdr->hdr_imgblkcnt	= ost->ost_imgblkcnt;
 	hdr->hdr_bmpblksz	= ost->ost_bmpblksz;
 	hdr->hdr_superblkcnt 	=
 		ocfs2_get_backup_super_offsets(ofs, supers,
@@ -433,23 +867,10 @@ static errcode_t write_image_file(ocfs2_filesys *ofs, int fd)
 	}
 
 	/* copy metadata blocks to image files */
-	for (blk = 0; blk < ofs->fs_blocks; blk++) {
-		if (ocfs2_image_test_bit(ofs, blk)) {
-			ret = ocfs2_read_blocks(ofs, blk, 1, buf);
-			if (ret) {
-				com_err(program_name, ret, "error occurred "
-					"during read block %"PRIu64"", blk);
-				goto out;
-			}
+	ret = copy_blocks(ofs, fd, 0);
+	if (ret)
+		goto out;
 
-			bytes = write(fd, buf, ofs->fs_blocksize);
-			if ((bytes == -1) || (bytes < ofs->fs_blocksize)) {
-				com_err(program_name, errno, "error writing "
-					"blk %"PRIu64"", blk);
-				goto out;
-			}
-		}
-	}
 	/* write bitmap blocks at the end */
 	for(blk = 0; blk < ost->ost_bmpblks; blk++) {
 		bytes = write(fd, ost->ost_bmparr[blk].arr_map,
@@ -472,25 +893,21 @@ out:
 static errcode_t scan_raw_disk(ocfs2_filesys *ofs)
 {
 	struct ocfs2_image_state *ost = ofs->ost;
-	uint64_t bits_set = 0;
 	errcode_t ret;
-	int i, j;
 
 	/*
 	 * global inode alloc has list of all metadata inodes blocks.
-	 * traverse_inode recursively traverses each inode
+	 * traverse_inode queues its groups, and the walkers traverse
+	 * each inode in them recursively
 	 */
 	ret = traverse_inode(ofs, ofs->ost->ost_glbl_inode_alloc);
+	if (!ret)
+		ret = walk_inode_groups_threaded(ofs);
 	if (ret)
 		goto out;
 
 	/* update set_bit_cnt for future use */
-	for (i = 0; i < ost->ost_bmpblks; i++) {
-		ost->ost_bmparr[i].arr_set_bit_cnt = bits_set;
-		for (j = 0; j < (ost->ost_bmpblksz * 8); j++)
-			if (ocfs2_test_bit(j, ost->ost_bmparr[i].arr_map))
-				bits_set++;
-	}
+	ost->ost_imgblkcnt = ocfs2_image_count_bits(ofs);
 
 out:
 	return ret;
@@ -498,7 +915,6 @@ out:
 
 static int prompt_image_creation(ocfs2_filesys *ofs, int rawflg, char *filename)
 {
-	int i, n;
 	uint64_t free_spc;
 	struct statfs stat;
 	uint64_t img_size = 0;
@@ -508,15 +924,9 @@ static int prompt_image_creation(ocfs2_filesys *ofs, int rawflg, char *filename)
 	statfs(dirname(filepath), &stat);
 	free_spc = stat.f_bsize * stat.f_bavail;
 
-	n = ofs->ost->ost_bmpblks - 1;
 	if (!rawflg)
 		img_size = ofs->ost->ost_bmpblks * ofs->ost->ost_bmpblksz;
-	img_size += ofs->ost->ost_bmparr[n].arr_set_bit_cnt *
-		ofs->fs_blocksize;
-
-	for (i = 0; i < (ofs->ost->ost_bmpblksz * 8); i++)
-		if (ocfs2_test_bit(i, ofs->ost->ost_bmparr[n].arr_map))
-			img_size += ofs->fs_blocksize;
+	img_size += ofs->ost->ost_imgblkcnt * ofs->fs_blocksize;
 
 	fprintf(stdout, "Image file expected to be %luK, "
 		"Available free space %luK. Continue ? (y/N): ",
@@ -539,6 +949,8 @@ int main(int argc, char **argv)
 	int raw_flag      	= 0;
 	int install_flag  	= 0;
 	int fd            	= 0;
+	char *end;
+	long cpus;
 	int c;
 
 	if (argc && *argv)
@@ -547,8 +959,16 @@ int main(int argc, char **argv)
 	initialize_ocfs_error_table();
 
 	optind = 0;
-	while((c = getopt(argc, argv, "rI")) != EOF) {
+	while((c = getopt(argc, argv, "rIj:")) != EOF) {
 		switch (c) {
+		case 'j':
+			nr_threads = strtol(optarg, &end, 0);
+			if ((nr_threads < 1) || *end) {
+				fprintf(stderr, "Invalid thread count: %s\n",
+					optarg);
+				usage();
+			}
+			break;
 		case 'r':
 			raw_flag++;
 			break;
@@ -563,6 +983,12 @@ int main(int argc, char **argv)
 	if (optind != argc -2)
 		usage();
 
+	if (!nr_threads) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nr_threads = ocfs2_min(ocfs2_max(cpus, 1L),
+				       (long)O2IMAGE_MAX_THREADS);
+	}
+
 	/* We interchange src_file and image file if installing */
 	if (install_flag) {
 		dest_file    = argv[optind];
@@ -600,6 +1026,16 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	/*
+	 * We read metadata mostly in block order.  A modest cache lets
+	 * the io_channel readahead stream it.
+	 */
+	ret = io_init_cache_size(ofs->fs_io, 8 * 1024 * 1024);
+	if (ret)
+		com_err(program_name, ret,
+			"while initializing the I/O cache.  Continuing "
+			"without a cache (safe, but slower)");
+
 	/*
 	 * If src_file is opened with OCFS2_FLAG_IMAGE_FILE, then no need to
 	 * allocate and initialize ocfs2_image_state. ocfs2_open would have
@@ -645,7 +1081,7 @@ int main(int argc, char **argv)
 
 	/* Installs always are done in raw format */
 	if (raw_flag || install_flag)
-		ret = write_raw_image_file(ofs, fd);
+		ret = copy_blocks(ofs, fd, 1);
 	else
 		ret = write_image_file(ofs, fd);
 
@@ -608,7 +608,9 @@ out:
  * write that last from fs->fs_super.
  *
  * We store all of this in an rb-tree of block_to_ecc structures.  We can
- * look blocks back up if needed, and we have writeback functions attached.
+ * look blocks back up if needed.  Each block has a function that puts a
+ * copy of it in disk format, so that write_ecc_blocks() can compute the
+ * ECC of many blocks at once.
  *
  * For directory inodes, we pass e_buf into tunefs_prepare_dir_trailer(),
  * which does not copy off the inode.  Thus, when
@@ -624,7 +626,9 @@ struct block_to_ecc {
 	uint64_t e_blkno;
 	struct ocfs2_dinode *e_di;
 	char *e_buf;
-	errcode_t (*e_write)(ocfs2_filesys *fs, struct block_to_ecc *block);
+	/* Fills buf and points *bc at the block check inside it */
+	errcode_t (*e_to_disk)(ocfs2_filesys *fs, struct block_to_ecc *block,
+			       char *buf, struct ocfs2_block_check **bc);
 };
 
 /*
@@ -722,10 +726,17 @@ static errcode_t block_insert(struct add_ecc_context *ctxt,
 	return ret;
 }
 
-static errcode_t dinode_write_func(ocfs2_filesys *fs,
-				   struct block_to_ecc *block)
+static errcode_t dinode_to_disk_func(ocfs2_filesys *fs,
+				     struct block_to_ecc *block,
+				     char *buf, struct ocfs2_block_check **bc)
 {
-	return ocfs2_write_inode(fs, block->e_blkno, block->e_buf);
+	struct ocfs2_dinode *di = (struct ocfs2_dinode *)buf;
+
+	memcpy(buf, block->e_buf, fs->fs_blocksize);
+	ocfs2_swap_inode_from_cpu(fs, di);
+	*bc = &di->i_check;
+
+	return 0;
 }
 
 static errcode_t block_insert_dinode(ocfs2_filesys *fs,
@@ -746,7 +757,7 @@ static errcode_t block_insert_dinode(ocfs2_filesys *fs,
 	memcpy(block->e_buf, di, fs->fs_blocksize);
 	block->e_di = (struct ocfs2_dinode *)block->e_buf;
 	block->e_blkno = di->i_blkno;
-	block->e_write = dinode_write_func;
+	block->e_to_disk = dinode_to_disk_func;
 	block_insert(ctxt, block);
 
 out:
@@ -755,10 +766,17 @@ out:
 	return ret;
 }
 
-static errcode_t eb_write_func(ocfs2_filesys *fs,
-			       struct block_to_ecc *block)
+static errcode_t eb_to_disk_func(ocfs2_filesys *fs,
+				 struct block_to_ecc *block,
+				 char *buf, struct ocfs2_block_check **bc)
 {
-	return ocfs2_write_extent_block(fs, block->e_blkno, block->e_buf);
+	struct ocfs2_extent_block *eb = (struct ocfs2_extent_block *)buf;
+
+	memcpy(buf, block->e_buf, fs->fs_blocksize);
+	ocfs2_swap_extent_block_from_cpu(fs, eb);
+	*bc = &eb->h_check;
+
+	return 0;
 }
 
 static errcode_t block_insert_eb(ocfs2_filesys *fs,
@@ -779,7 +797,7 @@ static errcode_t block_insert_eb(ocfs2_filesys *fs,
 
 	memcpy(block->e_buf, eb, fs->fs_blocksize);
 	block->e_blkno = eb->h_blkno;
-	block->e_write = eb_write_func;
+	block->e_to_disk = eb_to_disk_func;
 	block_insert(ctxt, block);
 
 out:
@@ -788,10 +806,17 @@ out:
 	return ret;
 }
 
-static errcode_t gd_write_func(ocfs2_filesys *fs,
-			       struct block_to_ecc *block)
+static errcode_t gd_to_disk_func(ocfs2_filesys *fs,
+				 struct block_to_ecc *block,
+				 char *buf, struct ocfs2_block_check **bc)
 {
-	return ocfs2_write_group_desc(fs, block->e_blkno, block->e_buf);
+	struct ocfs2_group_desc *gd = (struct ocfs2_group_desc *)buf;
+
+	memcpy(buf, block->e_buf, fs->fs_blocksize);
+	ocfs2_swap_group_desc(gd);
+	*bc = &gd->bg_check;
+
+	return 0;
 }
 
 static errcode_t block_insert_gd(ocfs2_filesys *fs,
@@ -812,7 +837,7 @@ static errcode_t block_insert_gd(ocfs2_filesys *fs,
 
 	memcpy(block->e_buf, gd, fs->fs_blocksize);
 	block->e_blkno = gd->bg_blkno;
-	block->e_write = gd_write_func;
+	block->e_to_disk = gd_to_disk_func;
 	block_insert(ctxt, block);
 
 out:
@@ -821,11 +846,30 @@ out:
 	return ret;
 }
 
-static errcode_t dirblock_write_func(ocfs2_filesys *fs,
-				     struct block_to_ecc *block)
+/* Matches ocfs2_write_dir_block() */
+static errcode_t dirblock_to_disk_func(ocfs2_filesys *fs,
+				       struct block_to_ecc *block,
+				       char *buf, struct ocfs2_block_check **bc)
 {
-	return ocfs2_write_dir_block(fs, block->e_di, block->e_blkno,
-				     block->e_buf);
+	errcode_t ret;
+	int end = fs->fs_blocksize;
+	struct ocfs2_dir_block_trailer *trailer;
+
+	memcpy(buf, block->e_buf, fs->fs_blocksize);
+
+	if (ocfs2_dir_has_trailer(fs, block->e_di))
+		end = ocfs2_dir_trailer_blk_off(fs);
+
+	ret = ocfs2_swap_dir_entries_from_cpu(buf, end);
+	if (ret)
+		return ret;
+
+	trailer = ocfs2_dir_trailer_from_block(fs, buf);
+	if (ocfs2_dir_has_trailer(fs, block->e_di))
+		ocfs2_swap_dir_trailer(trailer);
+	*bc = &trailer->db_check;
+
+	return 0;
 }
 
 static errcode_t block_insert_dirblock(ocfs2_filesys *fs,
@@ -847,7 +891,7 @@ static errcode_t block_insert_dirblock(ocfs2_filesys *fs,
 	memcpy(block->e_buf, buf, fs->fs_blocksize);
 	block->e_di = di;
 	block->e_blkno = blkno;
-	block->e_write = dirblock_write_func;
+	block->e_to_disk = dirblock_to_disk_func;
 	block_insert(ctxt, block);
 
 out:
@@ -1264,19 +1308,75 @@ static errcode_t install_trailers(ocfs2_filesys *fs,
 	return ret;
 }
 
+/* How many blocks write_ecc_blocks() prepares at a time */
+#define ECC_BATCH_BLOCKS	256
+
+/*
+ * Computes the ECC for a prepared batch and writes it out.  Adjacent
+ * blocks sit next to each other in the batch buffer, so each run of
+ * them goes out in one I/O.
+ */
+static errcode_t write_ecc_batch(ocfs2_filesys *fs, uint64_t *blknos,
+				 void **data, struct ocfs2_block_check **bc,
+				 int nr)
+{
+	errcode_t ret = 0;
+	int i, run;
+
+	ocfs2_compute_meta_ecc_many(fs, data, bc, nr);
+
+	for (i = 0; i < nr; i += run) {
+		for (run = 1; (i + run) < nr; run++) {
+			if (blknos[i + run] != (blknos[i] + run))
+				break;
+		}
+
+		ret = io_write_block(fs->fs_io, blknos[i], run, data[i]);
+		if (ret)
+			break;
+
+		fs->fs_flags |= OCFS2_FLAG_CHANGED;
+	}
+
+	return ret;
+}
+
 static errcode_t write_ecc_blocks(ocfs2_filesys *fs,
 				  struct add_ecc_context *ctxt)
 {
-	errcode_t ret = 0;
+	errcode_t ret, err;
+	int nr = 0;
+	char *buf = NULL;
+	uint64_t *blknos = NULL;
+	void **data = NULL;
+	struct ocfs2_block_check **bc = NULL;
 	struct rb_node *n;
 	struct block_to_ecc *block;
 	struct tools_progress *prog;
 
+	if (!(fs->fs_flags & OCFS2_FLAG_RW))
+		return OCFS2_ET_RO_FILESYS;
+
+	ret = ocfs2_malloc_blocks(fs->fs_io, ECC_BATCH_BLOCKS, &buf);
+	if (!ret)
+		ret = ocfs2_malloc(sizeof(uint64_t) * ECC_BATCH_BLOCKS,
+				   &blknos);
+	if (!ret)
+		ret = ocfs2_malloc(sizeof(void *) * ECC_BATCH_BLOCKS, &data);
+	if (!ret)
+		ret = ocfs2_malloc(sizeof(struct ocfs2_block_check *) *
+				   ECC_BATCH_BLOCKS, &bc);
+	if (ret)
+		goto out_free;
+
 	prog = tools_progress_start("Writing blocks", "ECC",
 				    ctxt->ae_blockcount);
-	if (!prog)
-		return TUNEFS_ET_NO_MEMORY;
+	if (!prog) {
+		ret = TUNEFS_ET_NO_MEMORY;
+		goto out_free;
+	}
 
+	ocfs2_block_check_start_threads();
 	n = rb_first(&ctxt->ae_blocks);
 	while (n) {
 		block = rb_entry(n, struct block_to_ecc, e_node);
@@ -1284,14 +1384,47 @@ static errcode_t write_ecc_blocks(ocfs2_filesys *fs,
 			 block->e_blkno);
 
 		tools_progress_step(prog, 1);
-		ret = block->e_write(fs, block);
+		if ((block->e_blkno < OCFS2_SUPER_BLOCK_BLKNO) ||
+		    (block->e_blkno > fs->fs_blocks)) {
+			ret = OCFS2_ET_BAD_BLKNO;
+			break;
+		}
+
+		data[nr] = buf + (nr * fs->fs_blocksize);
+		ret = block->e_to_disk(fs, block, data[nr], &bc[nr]);
 		if (ret)
 			break;
+		blknos[nr++] = block->e_blkno;
+
+		if (nr == ECC_BATCH_BLOCKS) {
+			ret = write_ecc_batch(fs, blknos, data, bc, nr);
+			nr = 0;
+			if (ret)
+				break;
+		}
 
 		n = rb_next(n);
 	}
+
+	/* Whatever was prepared before an error still goes out */
+	if (nr) {
+		err = write_ecc_batch(fs, blknos, data, bc, nr);
+		if (!ret)
+			ret = err;
+	}
+	ocfs2_block_check_stop_threads();
 	tools_progress_stop(prog);
 
+out_free:
+	if (bc)
+		ocfs2_free(&bc);
+	if (data)
+		ocfs2_free(&data);
+	if (blknos)
+		ocfs2_free(&blknos);
+	if (buf)
+		ocfs2_free(&buf);
+
 	return ret;
 }
 
@@ -1437,7 +1570,7 @@ out:
 DEFINE_TUNEFS_FEATURE_INCOMPAT(metaecc,
 			       OCFS2_FEATURE_INCOMPAT_META_ECC,
 			       TUNEFS_FLAG_RW | TUNEFS_FLAG_ALLOCATION |
-			       TUNEFS_FLAG_LARGECACHE,
+			       TUNEFS_FLAG_LARGECACHE | TUNEFS_FLAG_WRITEBACK,
 			       enable_metaecc,
 			       disable_metaecc);
 
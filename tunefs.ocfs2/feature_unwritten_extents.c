@@ -127,6 +127,8 @@ static errcode_t unwritten_iterate(ocfs2_filesys *fs,
 			tunefs_unblock_signals();
 			if (ret)
 				break;
+			/* The leaves changed under ci; don't trust its map */
+			ocfs2_extent_map_drop(ci);
 			tools_progress_step(prog, 1);
 		}
 
@@ -1360,6 +1360,15 @@ static void tunefs_init_cache(ocfs2_filesys *fs)
 
 		blocks_wanted >>= 1;
 	}
+
+	/*
+	 * Operations that rewrite a lot of metadata can let the cache
+	 * gather their writes.  Superblock writes and tunefs_close()
+	 * flush it, so nothing is held past the cluster lock.
+	 */
+	if ((tp->tp_open_flags & TUNEFS_FLAG_WRITEBACK) &&
+	    !io_set_writeback(fs->fs_io, true))
+		verbosef(VL_LIB, "I/O cache is in write-back mode\n");
 }
 
 static void tunefs_drop_cache(ocfs2_filesys *fs)
@@ -1559,6 +1568,9 @@ errcode_t tunefs_close(ocfs2_filesys *fs)
 		verbosef(VL_LIB, "Closing device \"%s\"\n", fs->fs_devname);
 		tunefs_close_online_descriptor(fs);
 		err = tunefs_close_bitmap_check(fs);
+		tmp = ocfs2_flush(fs);
+		if (!err)
+			err = tmp;
 		tmp = tunefs_unlock_filesystem(fs);
 		if (!err)
 			err = tmp;
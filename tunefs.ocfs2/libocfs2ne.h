@@ -75,6 +75,8 @@
 					   cluster stack */
 #define TUNEFS_FLAG_LARGECACHE	0x20	/* Operation needs a large I/O
 					   cache */
+#define TUNEFS_FLAG_WRITEBACK	0x40	/* Operation can hold writes in
+					   the I/O cache until close */
 
 
 /* What to do with a feature */
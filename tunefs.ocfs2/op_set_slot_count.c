@@ -1105,7 +1105,8 @@ static int set_slot_count_run(struct tunefs_operation *op,
 DEFINE_TUNEFS_OP(set_slot_count,
 		 "Usage: op_set_slot_count [opts] <device> "
 		 "<number_of_slots>\n",
-		 TUNEFS_FLAG_RW | TUNEFS_FLAG_ALLOCATION,
+		 TUNEFS_FLAG_RW | TUNEFS_FLAG_ALLOCATION |
+		 TUNEFS_FLAG_WRITEBACK,
 		 set_slot_count_parse_option,
 		 set_slot_count_run);
 